@@ -0,0 +1,355 @@
+//=====================================================
+// compbench.c
+// Compiler workload benchmark
+//
+// Compiles a fixed corpus of modules with the bundled single-pass
+// compiler (compile.OBJ) n times, typing the file names at its
+// prompt from memory. Each run reports the wall time, the M-codes
+// executed, M-codes per second, the peak heap size and the stack
+// high-water mark. The object and reference files written by each
+// run must be byte-identical to those in the reference directory, or
+// to those of the first run if there is none.
+//
+// The runs happen in workdir, a copy of the disk directory whose
+// outputs are overwritten. The clock of the machine is fixed, so
+// that the module keys in the outputs do not depend on the time.
+//
+//   compbench [-e engine] [-j calls] [-n runs] [-r refdir] workdir
+//             [module.MOD ...]
+//
+// The output has one tab-separated line per run and a total line.
+//
+// Lilith M-Code Emulator
+//
+// Guido Hoss, 12.03.2022
+//
+// Published by Guido Hoss under GNU Public License V3.
+//=====================================================
+
+#include <config.h>
+#include <ctype.h>
+#include <time.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include "le_mach.h"
+#include "le_io.h"
+#include "le_heap.h"
+#include "le_loader.h"
+#include "le_mcode.h"
+#include "le_jit.h"
+
+#define CORPUS_MAX		32
+#define FIXED_TIME		1647043200		// 12.03.2022 00:00 UTC
+#define STACK_PAINT		0xa55a			// Fills unused memory before a run
+#define USAGE	"usage: compbench [-e engine] [-j calls] [-n runs] " \
+	"[-r refdir] workdir [module.MOD ...]"
+
+bool le_verbose = false;
+
+// Default corpus
+char *corpus_def[] = {
+	"M2SGL.MOD", "M2SPL.MOD", "FileNames.MOD", "RealInOut.MOD",
+	"M2SS.MOD", "InOut.MOD"
+};
+
+// Corpus and outputs of the first run
+char **corpus = corpus_def;
+int corpus_n = sizeof(corpus_def) / sizeof(corpus_def[0]);
+char *module[CORPUS_MAX];
+const char *out_ext[] = { "OBJ", "RFC" };
+char *first[CORPUS_MAX][2];
+size_t first_sz[CORPUS_MAX][2];
+
+char *ref_dir = NULL;
+
+
+// out_name()
+// Returns the name of the output with extension ext of module mod,
+// in directory dir unless it is NULL (to be freed by caller)
+//
+char *out_name(const char *dir, const char *mod, const char *ext)
+{
+	char *fn;
+
+	if (((dir != NULL) && (asprintf(&fn, "%s/%s.%s", dir, mod, ext) < 0))
+		|| ((dir == NULL) && (asprintf(&fn, "%s.%s", mod, ext) < 0)))
+		le_error(1, errno, "Can't allocate file name");
+	return fn;
+}
+
+
+// read_file()
+// Returns the contents of file fn, and its size in sz
+//
+char *read_file(const char *fn, size_t *sz)
+{
+	FILE *f;
+	char *buf;
+
+	if ((f = fopen(fn, "rb")) == NULL)
+		le_error(1, errno, "Can't open '%s'", fn);
+	fseek(f, 0, SEEK_END);
+	*sz = ftell(f);
+	rewind(f);
+	if ((buf = malloc(*sz + 1)) == NULL)
+		le_error(1, errno, "Can't read '%s'", fn);
+	if (fread(buf, 1, *sz, f) != *sz)
+		le_error(1, errno, "Can't read '%s'", fn);
+	fclose(f);
+	return buf;
+}
+
+
+// module_name()
+// Returns the name of the module in source file fn, which names the
+// outputs of the compiler (M2SPL.MOD holds module compile)
+//
+char *module_name(const char *fn)
+{
+	size_t sz;
+	char *src = read_file(fn, &sz);
+	char *name = NULL;
+	int depth = 0;
+
+	src[sz] = '\0';
+	for (char *p = src; (*p != '\0') && (name == NULL); p ++)
+	{
+		// Skip nested comments
+		if ((p[0] == '(') && (p[1] == '*'))
+		{
+			depth ++;
+			p ++;
+		}
+		else if ((depth > 0) && (p[0] == '*') && (p[1] == ')'))
+		{
+			depth --;
+			p ++;
+		}
+		else if ((depth == 0) && (strncmp(p, "MODULE", 6) == 0)
+			&& ((p == src) || ! isalnum(p[-1])) && isspace(p[6]))
+		{
+			p += 6;
+			while (isspace(*p))
+				p ++;
+			int l = 0;
+			while (isalnum(p[l]))
+				l ++;
+			name = strndup(p, l);
+		}
+	}
+	if ((name == NULL) || (*name == '\0'))
+		le_error(1, 0, "%s: no module found", fn);
+	free(src);
+	return name;
+}
+
+
+// check_outputs()
+// Compares the outputs of run r with the reference files, or with
+// the outputs of the first run. Returns the number of differences.
+//
+int check_outputs(int r)
+{
+	int diff = 0;
+
+	for (int i = 0; i < corpus_n; i ++)
+	{
+		for (int e = 0; e < 2; e ++)
+		{
+			char *fn = out_name(NULL, module[i], out_ext[e]);
+			size_t sz, ref_sz;
+			char *buf;
+
+			struct stat st;
+			if ((stat(fn, &st) != 0) || (st.st_mtime == 0))
+			{
+				le_error(0, 0, "Run %d: %s not written", r + 1, fn);
+				diff ++;
+				free(fn);
+				continue;
+			}
+			buf = read_file(fn, &sz);
+
+			char *ref = first[i][e];
+			ref_sz = first_sz[i][e];
+			if (ref_dir != NULL)
+			{
+				char *ref_fn = out_name(ref_dir, module[i], out_ext[e]);
+				ref = read_file(ref_fn, &ref_sz);
+				free(ref_fn);
+			}
+
+			if (ref == NULL)
+			{
+				// First run without reference directory
+				first[i][e] = buf;
+				first_sz[i][e] = sz;
+				buf = NULL;
+			}
+			else if ((sz != ref_sz) || (memcmp(buf, ref, sz) != 0))
+			{
+				le_error(0, 0, "Run %d: %s differs from %s", r + 1, fn,
+					(ref_dir != NULL) ? "reference" : "first run");
+				diff ++;
+			}
+
+			if (ref_dir != NULL)
+				free(ref);
+			free(buf);
+			free(fn);
+		}
+	}
+	return diff;
+}
+
+
+// run()
+// Compiles the corpus once on a new machine. Returns the M-codes
+// executed, the wall time in s in t, the peak heap size and the
+// stack high-water mark in words in heap and stack.
+//
+uint32_t run(char *input, double *t, uint16_t *heap, uint16_t *stack)
+{
+	struct timespec t0, t1;
+	char *out;
+	size_t sz;
+
+	// Date the outputs of the previous run back to the epoch, which
+	// shows whether this run writes them. They can't be removed, as
+	// the compiler may load its own passes from the corpus.
+	for (int i = 0; i < corpus_n; i ++)
+	{
+		for (int e = 0; e < 2; e ++)
+		{
+			char *fn = out_name(NULL, module[i], out_ext[e]);
+			utime(fn, &(struct utimbuf) { 0, 0 });
+			free(fn);
+		}
+	}
+
+	mach_init();
+	mach_ctx.fixed_time = FIXED_TIME;
+	if (((mach_ctx.term_in = fmemopen(input, strlen(input), "r")) == NULL)
+		|| ((mach_ctx.term_out = open_memstream(&out, &sz)) == NULL))
+		le_error(1, errno, "Can't open terminal streams");
+
+	uint8_t top = le_load_initfile("compile", "SYS");
+	if (top == 0)
+		le_error(1, 0, "Can't load compile.OBJ");
+
+	// Paint the memory above the loaded modules, so that the highest
+	// word written below the heap marks the peak of the stack
+	uint16_t base = data_top;
+	for (uint32_t i = base; i < MACH_DSHMEM_SZ; i ++)
+		dsh_mem[i] = STACK_PAINT;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	uint32_t n = le_execute(top);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	*t = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+
+	*heap = MACH_DSHMEM_SZ - 1 - hp_low;
+	uint16_t i = hp_low;
+	while ((i > base) && (dsh_mem[i - 1] == STACK_PAINT))
+		i --;
+	*stack = i - base;
+
+	fclose(mach_ctx.term_in);
+	fclose(mach_ctx.term_out);
+	mach_ctx.term_in = mach_ctx.term_out = NULL;
+	mach_free();
+	free(out);
+	return n;
+}
+
+
+// main()
+//
+int main(int argc, char *argv[])
+{
+	int runs = 3;
+	int c;
+
+	le_include_path(".");
+	while ((c = getopt(argc, argv, "e:j:n:r:")) != -1)
+	{
+		switch (c)
+		{
+			case 'e' :
+				if (! le_set_engine(optarg))
+					le_error(1, 0, "Unknown execution engine '%s'", optarg);
+				break;
+			case 'j' :
+				jit_threshold = atoi(optarg);
+				break;
+			case 'n' :
+				runs = atoi(optarg);
+				break;
+			case 'r' :
+				ref_dir = realpath(optarg, NULL);
+				if (ref_dir == NULL)
+					le_error(1, errno, "Invalid reference directory '%s'", optarg);
+				break;
+			default :
+				le_error(1, 0, USAGE);
+		}
+	}
+	if ((optind >= argc) || (runs < 1) || (jit_threshold < 1)
+		|| (argc - optind - 1 > CORPUS_MAX))
+		le_error(1, 0, USAGE);
+	if (chdir(argv[optind]) != 0)
+		le_error(1, errno, "Can't change to '%s'", argv[optind]);
+	if (argc - optind > 1)
+	{
+		corpus = &argv[optind + 1];
+		corpus_n = argc - optind - 1;
+	}
+
+	for (int i = 0; i < corpus_n; i ++)
+		module[i] = module_name(corpus[i]);
+
+	// Dates of the fixed clock as in the reference files
+	setenv("TZ", "UTC", 1);
+	tzset();
+
+	// File names typed at the prompt of the compiler, ESC ends it
+	char *input;
+	size_t input_sz;
+	FILE *f = open_memstream(&input, &input_sz);
+	for (int i = 0; i < corpus_n; i ++)
+		fprintf(f, "%s\r", corpus[i]);
+	fputc('\033', f);
+	fclose(f);
+
+	printf("# %d modules, %d runs\n", corpus_n, runs);
+	printf("# run\tseconds\tmcodes\tmcodes/s\theap\tstack\n");
+
+	double t_sum = 0;
+	uint64_t n_sum = 0;
+	uint16_t heap_max = 0, stack_max = 0;
+	int diff = 0;
+	for (int r = 0; r < runs; r ++)
+	{
+		double t;
+		uint16_t heap, stack;
+		uint32_t n = run(input, &t, &heap, &stack);
+
+		printf("%d\t%.3f\t%u\t%.0f\t%u\t%u\n", r + 1, t, n, n / t, heap, stack);
+		fflush(stdout);
+		diff += check_outputs(r);
+
+		t_sum += t;
+		n_sum += n;
+		if (heap > heap_max)
+			heap_max = heap;
+		if (stack > stack_max)
+			stack_max = stack;
+	}
+	printf("total\t%.3f\t%lu\t%.0f\t%u\t%u\n", t_sum, (unsigned long) n_sum,
+		n_sum / t_sum, heap_max, stack_max);
+	if (diff > 0)
+		le_error(1, 0, "%d outputs differ", diff);
+
+	free(input);
+	return 0;
+}
@@ -0,0 +1,163 @@
+//=====================================================
+// ctxstress.c
+// Stress test of concurrent machine contexts
+//
+// Runs an object file such as Hello.OBJ once on the main
+// thread as reference, then repeatedly in N threads at the same
+// time. Each thread has its own machine context and writes its
+// terminal output to a memory stream. Every run must produce the
+// output and M-code count of the reference run.
+//
+//   ctxstress [-e engine] [-j calls] [-i path] [-n threads] [-r runs]
+//             object_file
+//
+// Lilith M-Code Emulator
+//
+// Guido Hoss, 12.03.2022
+//
+// Published by Guido Hoss under GNU Public License V3.
+//=====================================================
+
+#include <config.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <time.h>
+#include "le_mach.h"
+#include "le_io.h"
+#include "le_loader.h"
+#include "le_mcode.h"
+#include "le_jit.h"
+
+#define THREADS_MAX		256
+#define USAGE	"usage: ctxstress [-e engine] [-j calls] [-i path] " \
+	"[-n threads] [-r runs] object_file"
+
+bool le_verbose = false;
+
+// Object file and reference run
+char *obj_name;
+char *ref_out;
+size_t ref_sz;
+uint32_t ref_count;
+
+// Runs per thread and failed runs
+int runs = 20;
+int failed = 0;
+pthread_mutex_t failed_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+// run()
+// Runs the object file on a new machine of the calling thread.
+// Returns the M-codes executed and the terminal output in out/sz.
+//
+uint32_t run(char **out, size_t *sz)
+{
+	mach_init();
+	if ((mach_ctx.term_out = open_memstream(out, sz)) == NULL)
+		le_error(1, errno, "Can't open output stream");
+
+	uint32_t n = 0;
+	uint8_t top = le_load_initfile(obj_name, "SYS");
+	if (top > 0)
+		n = le_execute(top);
+
+	fclose(mach_ctx.term_out);
+	mach_free();
+	return n;
+}
+
+
+// stress()
+// Thread function: repeats the run and compares it to the reference
+//
+void *stress(void *arg)
+{
+	for (int i = 0; i < runs; i ++)
+	{
+		char *out;
+		size_t sz;
+		uint32_t n = run(&out, &sz);
+
+		if ((n != ref_count) || (sz != ref_sz) || (memcmp(out, ref_out, sz) != 0))
+		{
+			pthread_mutex_lock(&failed_lock);
+			failed ++;
+			pthread_mutex_unlock(&failed_lock);
+		}
+		free(out);
+	}
+	return NULL;
+}
+
+
+// main()
+//
+int main(int argc, char *argv[])
+{
+	int threads = 8;
+	int c;
+
+	le_include_path(".");
+	while ((c = getopt(argc, argv, "e:j:i:n:r:")) != -1)
+	{
+		switch (c)
+		{
+			case 'e' :
+				if (! le_set_engine(optarg))
+					le_error(1, 0, "Unknown execution engine '%s'", optarg);
+				break;
+			case 'j' :
+				jit_threshold = atoi(optarg);
+				break;
+			case 'i' :
+				le_include_path(optarg);
+				break;
+			case 'n' :
+				threads = atoi(optarg);
+				break;
+			case 'r' :
+				runs = atoi(optarg);
+				break;
+			default :
+				le_error(1, 0, USAGE);
+		}
+	}
+	if ((optind >= argc) || (threads < 1) || (threads > THREADS_MAX)
+		|| (runs < 1) || (jit_threshold < 1))
+		le_error(1, 0, USAGE);
+
+	// Load from the directory of the object file like mule
+	char *fn1 = strdup(argv[optind]);
+	char *fn2 = strdup(argv[optind]);
+	if (chdir(dirname(fn1)) != 0)
+		le_error(1, errno, "Can't change to '%s'", fn1);
+	obj_name = basename(fn2);
+
+	ref_count = run(&ref_out, &ref_sz);
+	if (ref_count == 0)
+		le_error(1, 0, "%s: reference run failed", obj_name);
+
+	// Start all threads at once
+	pthread_t tid[THREADS_MAX];
+	struct timespec t0, t1;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (int i = 0; i < threads; i ++)
+	{
+		if (pthread_create(&tid[i], NULL, stress, NULL) != 0)
+			le_error(1, errno, "Can't create thread");
+	}
+	for (int i = 0; i < threads; i ++)
+		pthread_join(tid[i], NULL);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	double t = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+	printf("%s: %d threads x %d runs of %u M-codes and %lu bytes output "
+		"in %.3f s: %d failed\n",
+		obj_name, threads, runs, ref_count, (unsigned long) ref_sz, t, failed);
+
+	free(ref_out);
+	free(fn1);
+	free(fn2);
+	return (failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,216 @@
+//=====================================================
+// esbench.c
+// Expression stack microbenchmark
+//
+// Runs small M-code loops in the threaded engine, which accesses
+// the expression stack through es_push()/es_pop(), in the tos
+// engine, which caches the stack pointer and top of stack in
+// registers, and in the regir engine, which keeps intermediate
+// values in the virtual registers of its register IR. Reports the time per instruction, or when built with
+// LE_ES_STATS (esbench_stats), the reads and writes of exs_mem and
+// gs_SP per instruction. Built with LE_ES_WORDS (esbench_words), the
+// engines move double words word by word, for comparison of the
+// LONGINT and REAL kernels.
+//
+// Lilith M-Code Emulator
+//
+// Guido Hoss, 12.03.2022
+//
+// Published by Guido Hoss under GNU Public License V3.
+//=====================================================
+
+#include <config.h>
+#include <time.h>
+#include "le_mach.h"
+#include "le_io.h"
+#include "le_stack.h"
+#include "le_mcode.h"
+#include "le_verify.h"
+#include "le_regir.h"
+
+#define ITER		50000	// Loop iterations per run
+#define RUNS		40		// Runs per kernel and engine
+#define LOOP_LEN	7		// Instructions of loop control
+
+bool le_verbose = false;
+
+// Loop bodies; locals are at L+5..L+11, globals at G+2..G+7
+typedef struct {
+	const char *name;
+	uint8_t n;				// Number of instructions
+	uint8_t len;			// Number of bytes
+	uint8_t code[24];
+} kernel_t;
+
+const kernel_t kernels[] = {
+	// LI2 LI3 IADD SLW5
+	{ "const", 4, 4, { 002, 003, 0330, 065 } },
+
+	// LLW5 LLW6 IADD SLW7
+	{ "local", 4, 4, { 045, 046, 0330, 067 } },
+
+	// LLW5 LLW6 LSS SLW7
+	{ "compare", 4, 4, { 045, 046, 0312, 067 } },
+
+	// LLW5 LGW2 IADD SLW6 LLW6 SGW3 LLW7 LGW3 UADD SLW5
+	{ "frames", 10, 10, { 045, 0102, 0330, 066, 046, 0123, 047, 0103, 0270, 065 } },
+
+	// LLW5 LI3 IADD LLW6 LI1 USUB AND SLW7
+	{ "expr", 8, 8, { 045, 003, 0330, 046, 001, 0271, 0322, 067 } },
+
+	// LID 1 2 LID 3 4 DADD SLD 5
+	{ "double", 4, 13, { 023, 0, 1, 0, 2, 023, 0, 3, 0, 4, 0210, 061, 5 } },
+
+	// LLD 6 LLD 8 DADD SLD 10
+	{ "long", 4, 7, { 041, 6, 041, 8, 0210, 061, 10 } },
+
+	// LID 0 3 LID 0 5 DMUL SLD 6
+	{ "lmul", 4, 13, { 023, 0, 0, 0, 3, 023, 0, 0, 0, 5, 0212, 061, 6 } },
+
+	// LID 3.0 LID 5.0 FADD SLD 6
+	{ "fadd", 4, 13, { 023, 0x40, 0x40, 0, 0, 023, 0x40, 0xa0, 0, 0, 0230, 061, 6 } },
+
+	// LID 3.0 LID 5.0 FMUL SLD 6
+	{ "fmul", 4, 13, { 023, 0x40, 0x40, 0, 0, 023, 0x40, 0xa0, 0, 0, 0232, 061, 6 } },
+};
+
+const struct {
+	const char *name;
+	enum le_engine_t engine;
+} engines[] = {
+	{ "threaded", ENGINE_THREADED },
+	{ "tos", ENGINE_TOS },
+	{ "regir", ENGINE_REGIR },
+};
+
+
+// make_module()
+// Builds a module whose body runs kernel k in a loop of ITER
+// iterations and returns its index
+//
+uint8_t make_module(const kernel_t *k)
+{
+	uint8_t *code = malloc(64);
+	uint8_t *p = code;
+	mod_id_t id;
+
+	// PC 0 ends the engine, so the body starts at 1
+	*p ++ = 0;
+
+	// ENTR 8; LIW ITER; SLW4
+	*p ++ = 0353; *p ++ = 8;
+	*p ++ = 022; *p ++ = ITER >> 8; *p ++ = ITER & 0xff;
+	*p ++ = 064;
+
+	// Loop: kernel; LLW4 LI1 USUB SLW4 LLW4 JPC exit; JPB loop
+	uint8_t *loop = p;
+	memcpy(p, k->code, k->len);
+	p += k->len;
+	*p ++ = 044; *p ++ = 001; *p ++ = 0271; *p ++ = 064; *p ++ = 044;
+	*p ++ = 030; *p ++ = 0; *p ++ = 4;
+	*p ++ = 035; *p = p - loop;
+	p ++;
+
+	// Exit: RTN
+	*p ++ = 0354;
+
+	memset(&id, 0, sizeof(id));
+	strcpy(id.name, "Bench");
+	mod_entry_t *mod = init_mod_entry(&id);
+	mod->id.loaded = true;
+	mod->code_sz = p - code;
+	mod->code = code;
+	mod->proc_n = 1;
+	mod->proc = calloc(1, MACH_WORD_SZ);
+	mod->proc[0] = 1;
+	mod->data_ofs = data_top;
+	mod->data_sz = 8;
+	data_top += mod->data_sz;
+	vf_verify_module(mod);
+	ri_translate_module(mod);
+	return mod->id.idx;
+}
+
+
+// run()
+// Runs the benchmark module once and returns the M-codes executed
+//
+uint32_t run(uint8_t m)
+{
+	gs_PC = gs_L = gs_CS = 0;
+	gs_S = data_top;
+	stk_mark(CALL_EXT, 0);
+	return le_run(m, m, module_tab[m].proc[0]);
+}
+
+
+// main()
+// Runs all kernels in all engines
+//
+int main(int argc, char *argv[])
+{
+	mach_init();
+
+#ifdef LE_ES_STATS
+	printf("Expression stack memory accesses per instruction\n\n");
+	printf("%-8s  %-9s %8s %8s\n", "kernel", "engine", "reads", "writes");
+#else
+#ifdef LE_ES_WORDS
+	printf("Double words moved word by word\n");
+#endif
+	printf("Time per instruction (fastest of %d runs of %d iterations)\n\n", RUNS, ITER);
+	printf("%-8s  %-9s %8s\n", "kernel", "engine", "ns/instr");
+#endif
+
+	for (int k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k ++)
+	{
+		// The module replaces the one of the previous kernel
+		if (mach_num_modules() > 1)
+			data_top -= mach_unload_top();
+		uint8_t m = make_module(&kernels[k]);
+		uint64_t expect = (kernels[k].n + LOOP_LEN) * ITER + 3;
+
+		for (int e = 0; e < sizeof(engines) / sizeof(engines[0]); e ++)
+		{
+			le_engine = engines[e].engine;
+			uint64_t n = 0;
+
+#ifdef LE_ES_STATS
+			es_stat_rd = es_stat_wr = 0;
+			n = run(m);
+			if (n != expect)
+				le_error(1, 0, "%s: %lu instructions executed",
+					kernels[k].name, (unsigned long) n);
+			printf("%-8s  %-9s %8.2f %8.2f\n",
+				kernels[k].name, engines[e].name,
+				(double) es_stat_rd / n, (double) es_stat_wr / n
+			);
+#else
+			double t = 0;
+
+			// The fastest run is the least disturbed by the host
+			run(m);
+			for (int r = 0; r < RUNS; r ++)
+			{
+				struct timespec t0, t1;
+
+				clock_gettime(CLOCK_MONOTONIC, &t0);
+				n = run(m);
+				clock_gettime(CLOCK_MONOTONIC, &t1);
+				if (n != expect)
+					le_error(1, 0, "%s: %lu instructions executed",
+						kernels[k].name, (unsigned long) n);
+
+				double tr = (t1.tv_sec - t0.tv_sec) * 1e9
+					+ (t1.tv_nsec - t0.tv_nsec);
+				if ((r == 0) || (tr < t))
+					t = tr;
+			}
+			printf("%-8s  %-9s %8.2f\n",
+				kernels[k].name, engines[e].name, t / n
+			);
+#endif
+		}
+	}
+	return 0;
+}
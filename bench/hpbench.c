@@ -0,0 +1,131 @@
+//=====================================================
+// hpbench.c
+// Heap allocator microbenchmark
+//
+// Fills the heap of a new machine with a number of live blocks of
+// random sizes, frees every other one to fragment it, and then times
+// pairs of hp_free() and hp_alloc() of random blocks, so that the
+// number of live blocks stays the same. The cost per pair should not
+// grow with the number of live blocks. Finally times hp_free_all() of
+// the live blocks, below the blocks of another module that stay, as
+// at the end of a program started by a command interpreter. Prints
+// one tab-separated line per number of live blocks.
+//
+//   hpbench [-r pairs]
+//
+// Lilith M-Code Emulator
+//
+// Guido Hoss, 12.03.2022
+//
+// Published by Guido Hoss under GNU Public License V3.
+//=====================================================
+
+#include <config.h>
+#include <time.h>
+#include "le_mach.h"
+#include "le_io.h"
+#include "le_heap.h"
+
+#define PAIRS		1000000		// Timed free/alloc pairs per line
+#define SZ_MAX		8			// Largest block in words
+#define MOD			2			// Owner of the blocks
+#define MOD_BASE	1			// Owner of the blocks that stay
+#define BASE_N		1024		// Number of blocks that stay
+#define USAGE		"usage: hpbench [-r pairs]"
+
+bool le_verbose = false;
+
+// Numbers of live blocks
+const int lives[] = { 16, 64, 256, 1024, 2048, 4096, 6144 };
+
+// Pseudo-random numbers, the same sequence for every line
+uint32_t seed;
+
+
+// rnd()
+// Returns a pseudo-random number below n
+//
+uint32_t rnd(uint32_t n)
+{
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 16) % n;
+}
+
+
+// main()
+//
+int main(int argc, char *argv[])
+{
+	int pairs = PAIRS;
+	int c;
+
+	while ((c = getopt(argc, argv, "r:")) != -1)
+	{
+		switch (c)
+		{
+			case 'r' :
+				pairs = atoi(optarg);
+				break;
+			default :
+				le_error(1, 0, USAGE);
+		}
+	}
+	if ((optind < argc) || (pairs < 1))
+		le_error(1, 0, USAGE);
+
+	printf("# ns per hp_free() and hp_alloc() of %d to %d words, %d pairs\n",
+		1, SZ_MAX, pairs);
+	printf("# us per hp_free_all() of the live blocks, %d others stay\n",
+		BASE_N);
+	printf("# live\tns\theap\tfree_all\n");
+
+	for (int k = 0; k < sizeof(lives) / sizeof(lives[0]); k ++)
+	{
+		int n = lives[k];
+		uint16_t *ptr = malloc(2 * n * sizeof(uint16_t));
+		struct timespec t0, t1;
+
+		mach_init();
+		gs_S = 0;
+		seed = 1;
+
+		// Blocks of another module, at the top of the heap
+		for (int i = 0; i < BASE_N; i ++)
+			hp_alloc(MOD_BASE, 1 + rnd(SZ_MAX), MOD_BASE, 0);
+
+		// Allocate twice as many blocks and free every other one
+		for (int i = 0; i < 2 * n; i ++)
+			ptr[i] = hp_alloc(MOD, 1 + rnd(SZ_MAX), MOD, 0);
+		for (int i = 0; i < n; i ++)
+		{
+			hp_free(ptr[2 * i + 1]);
+			ptr[i] = ptr[2 * i];
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		for (int i = 0; i < pairs; i ++)
+		{
+			uint32_t j = rnd(n);
+			hp_free(ptr[j]);
+			ptr[j] = hp_alloc(MOD, 1 + rnd(SZ_MAX), MOD, 0);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+
+		double t = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+		uint16_t heap = MACH_DSHMEM_SZ - 1 - gs_H;
+
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		hp_free_all(MOD, UINT16_MAX);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		double t_all = (t1.tv_sec - t0.tv_sec) * 1e6
+			+ (t1.tv_nsec - t0.tv_nsec) * 1e-3;
+		printf("%d\t%.1f\t%u\t%.1f\n", n, t / pairs, heap, t_all);
+
+		hp_free_all(MOD_BASE, UINT16_MAX);
+		if (gs_H != MACH_DSHMEM_SZ - 1)
+			le_error(1, 0, "%d live blocks: heap not empty after release", n);
+		mach_free();
+		free(ptr);
+	}
+	return 0;
+}
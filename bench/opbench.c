@@ -0,0 +1,354 @@
+//=====================================================
+// opbench.c
+// Opcode family microbenchmark
+//
+// Runs one hand-assembled M-code kernel per opcode family in a loop
+// through le_execute() and reports the time per M-code, using the
+// count returned by le_execute(), for every engine of the build. The
+// kernels run in module OpBench, which imports OpLib for external
+// loads, stores and calls. Every engine must execute as many M-codes
+// as the switch engine.
+//
+// The output has one tab-separated line per family and engine, so
+// that the results of two builds can be compared:
+//
+//   opbench [-e engine] [-r runs] [-c file]
+//
+// -c reads the output of an earlier run from file and adds its time
+// and the ratio of both times to each line.
+//
+// Lilith M-Code Emulator
+//
+// Guido Hoss, 12.03.2022
+//
+// Published by Guido Hoss under GNU Public License V3.
+//=====================================================
+
+#include <config.h>
+#include <time.h>
+#include "le_mach.h"
+#include "le_io.h"
+#include "le_mcode.h"
+#include "le_verify.h"
+#include "le_predec.h"
+#include "le_regir.h"
+
+#define ITER		20000	// Loop iterations per run
+#define RUNS		20		// Timed runs per family and engine
+#define RESULTS_MAX	256		// Lines read from the file of -c
+#define USAGE	"usage: opbench [-e engine] [-r runs] [-c file]"
+
+bool le_verbose = false;
+
+// Loop bodies of the families. Locals are at L+5..L+11, globals of
+// OpBench at G+2..G+63 and of OpLib at G+2..G+15. The module number
+// of OpLib is stored at the code offsets in ext (0 = unused). CLL1
+// calls local procedure 1 of OpBench, CLX OpLib.1:
+//
+//   OpBench.1: ENTR 1 LI1 SLW4 RTN
+//   OpLib.1:   LGW2 LI1 IADD SGW2 RTN
+//
+typedef struct {
+	const char *name;
+	uint8_t len;			// Number of bytes
+	uint8_t code[40];
+	uint8_t ext[6];			// Offsets of module numbers of OpLib
+} family_t;
+
+const family_t families[] = {
+	// LI5 LIB 200 IADD LIW x1234 UADD SLW5 LID 1 2 SLD 6
+	{ "imm", 16, { 005, 020, 200, 0330, 022, 0x12, 0x34, 0270, 065,
+		023, 0, 1, 0, 2, 061, 6 } },
+
+	// LLW5 LLW6 IADD SLW7 LLW 9 SLW 10 LLD 6 SLD 8
+	{ "local", 12, { 045, 046, 0330, 067, 040, 9, 060, 10, 041, 6, 061, 8 } },
+
+	// LGW2 LGW3 IADD SGW4 LGW 9 SGW 10 LGD 12 SGD 14
+	{ "global", 12, { 0102, 0103, 0330, 0124, 0100, 9, 0120, 10,
+		0101, 12, 0121, 14 } },
+
+	// LEW 2 LEW 3 IADD SEW 4 LEW 5 SEW 6 LED 8 SLD 10 (OpLib; SED
+	// halts the machine)
+	{ "external", 21, { 042, 0, 2, 042, 0, 3, 0330, 062, 0, 4,
+		042, 0, 5, 062, 0, 6, 043, 0, 8, 061, 10 },
+		{ 1, 4, 8, 11, 14, 17 } },
+
+	// LLA 5 LI1 LXW SLW9 LLA 5 LI2 LLW9 SXW
+	{ "xword", 10, { 024, 5, 001, 0206, 071, 024, 5, 002, 051, 0226 } },
+
+	// LLA 5 LI3 LXB SLW9 LLA 5 LI2 LLW9 SXB
+	{ "xbyte", 10, { 024, 5, 003, 0205, 071, 024, 5, 002, 051, 0225 } },
+
+	// LI0 JPC +3 NOP LI1 JPC +3 NOP JP +2
+	{ "jump", 13, { 000, 030, 0, 3, 0336, 001, 030, 0, 3, 0336, 031, 0, 2 } },
+
+	// FOR L+5 := 1 TO 8 DO L+6 := L+6 + 1 END
+	{ "for", 16, { 024, 5, 001, 010, 0300, 0, 0, 10,
+		046, 001, 0330, 066, 0301, 1, 0xff, 0xfa } },
+
+	// CASE L+5 MOD 4 OF 0..3: L+6 := label END; L+5 := L+5 + 1
+	{ "case", 37, { 045, 003, 0322, 0302, 0, 15,
+		000, 066, 0303, 001, 066, 0303, 002, 066, 0303, 003, 066, 0303, 0303,
+		0, 0, 0, 3, 0xff, 0xfb, 0xff, 0xed, 0xff, 0xee, 0xff, 0xef, 0xff, 0xf0,
+		045, 001, 0330, 065 } },
+
+	// CLL1 CLX OpLib.1
+	{ "call", 4, { 0361, 0355, 0, 1 }, { 2 } },
+
+	// LLW5 LI3 IMUL LI7 IDIV LI5 IADD LI3 IMOD SLW5 LLW6 LLW7 ISUB SLW6
+	{ "int16", 14, { 045, 003, 0332, 007, 0333, 005, 0330, 003, 0334, 065,
+		046, 047, 0331, 066 } },
+
+	// LLD 6 LID 0 3 DADD LID 0 1 DSUB SLD 6 LLD 6 LID 0 7 DMUL LID 0 7
+	// DDIV SLD 8
+	{ "int32", 32, { 041, 6, 023, 0, 0, 0, 3, 0210, 023, 0, 0, 0, 1, 0211,
+		061, 6, 041, 6, 023, 0, 0, 0, 7, 0212, 023, 0, 0, 0, 7, 0213,
+		061, 8 } },
+
+	// LID 3.0 LID 5.0 FMUL LID 2.0 FDIV LID 1.0 FSUB SLD 10
+	{ "float", 25, { 023, 0x40, 0x40, 0, 0, 023, 0x40, 0xa0, 0, 0, 0232,
+		023, 0x40, 0, 0, 0, 0233, 023, 0x3f, 0x80, 0, 0, 0231, 061, 10 } },
+
+	// LGA 16 LGA 40 LIB 24 MOV
+	{ "block", 7, { 025, 16, 025, 40, 020, 24, 0340 } },
+};
+
+const char *engines[] = {
+	"switch", "threaded", "tos", "super", "regir", "jit"
+};
+
+// Results of an earlier run (-c)
+struct {
+	char family[16];
+	char engine[16];
+	double ns;
+} results[RESULTS_MAX];
+int results_n = 0;
+
+
+// make_module()
+// Registers a module with the given name, code frame of sz bytes
+// (copied), n procedures at the entries proc and data_sz words of
+// data. Returns its entry.
+//
+mod_entry_t *make_module(const char *name, const uint8_t *code,
+	uint16_t sz, uint16_t n, const uint16_t *proc, uint16_t data_sz)
+{
+	mod_id_t id;
+
+	memset(&id, 0, sizeof(id));
+	strcpy(id.name, name);
+	mod_entry_t *mod = init_mod_entry(&id);
+	mod->id.loaded = true;
+	mod->code_sz = sz;
+	if (((mod->code = malloc(sz)) == NULL)
+		|| ((mod->proc = malloc(n * MACH_WORD_SZ)) == NULL))
+		le_error(1, errno, "Can't allocate module %s", name);
+	memcpy(mod->code, code, sz);
+	memcpy(mod->proc, proc, n * MACH_WORD_SZ);
+	mod->proc_n = n;
+	mod->data_ofs = data_top;
+	mod->data_sz = data_sz;
+	data_top += data_sz;
+	return mod;
+}
+
+
+// load()
+// Builds the modules running family f and prepares them for the
+// selected engine like the loader. Returns the index of OpBench.
+//
+uint8_t load(const family_t *f)
+{
+	uint8_t code[256];
+	uint8_t *p = code;
+	uint8_t m = mach_num_modules();
+
+	// PC 0 ends the engine, so the body starts at 1
+	*p ++ = 0;
+
+	// ENTR 8; LIW ITER; SLW4
+	*p ++ = 0353; *p ++ = 8;
+	*p ++ = 022; *p ++ = ITER >> 8; *p ++ = ITER & 0xff;
+	*p ++ = 064;
+
+	// Loop: family; LLW4 LI1 USUB SLW4 LLW4 JPC exit; JPB loop
+	uint8_t *loop = p;
+	memcpy(p, f->code, f->len);
+	for (int i = 0; (i < sizeof(f->ext)) && (f->ext[i] > 0); i ++)
+		p[f->ext[i]] = m + 1;
+	p += f->len;
+	*p ++ = 044; *p ++ = 001; *p ++ = 0271; *p ++ = 064; *p ++ = 044;
+	*p ++ = 030; *p ++ = 0; *p ++ = 4;
+	*p ++ = 035; *p = p - loop;
+	p ++;
+
+	// Exit: RTN
+	*p ++ = 0354;
+
+	// Procedure 1: ENTR 1 LI1 SLW4 RTN
+	uint16_t proc[2] = { 1, p - code };
+	*p ++ = 0353; *p ++ = 1; *p ++ = 001; *p ++ = 064; *p ++ = 0354;
+	make_module("OpBench", code, p - code, 2, proc, 64);
+
+	// OpLib: RTN; LGW2 LI1 IADD SGW2 RTN
+	const uint8_t lib[] = { 0, 0354, 0102, 001, 0330, 0122, 0354 };
+	const uint16_t lib_proc[2] = { 1, 2 };
+	make_module("OpLib", lib, sizeof(lib), 2, lib_proc, 16);
+
+	for (uint8_t i = m; i <= m + 1; i ++)
+	{
+		mod_entry_t *mod = &(module_tab[i]);
+
+		vf_verify_module(mod);
+		if ((le_engine == ENGINE_SUPER) || (le_engine == ENGINE_JIT))
+			pd_decode_module(mod);
+		else if (le_engine == ENGINE_REGIR)
+			ri_translate_module(mod);
+	}
+	for (uint8_t i = m; i <= m + 1; i ++)
+	{
+		if (module_tab[i].pcode != NULL)
+			pd_link_module(&(module_tab[i]));
+	}
+	return m;
+}
+
+
+// run()
+// Runs family f once in the selected engine and returns the M-codes
+// executed; the time taken in ns is returned in t
+//
+uint32_t run(const family_t *f, double *t)
+{
+	struct timespec t0, t1;
+	uint8_t m = load(f);
+
+	// le_execute() unloads both modules
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	uint32_t n = le_execute(m);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	*t = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+	return n;
+}
+
+
+// read_results()
+// Reads the output of an earlier run from file fn
+//
+void read_results(const char *fn)
+{
+	FILE *f;
+	char line[128];
+
+	if ((f = fopen(fn, "r")) == NULL)
+		le_error(1, errno, "Can't open '%s'", fn);
+	while ((results_n < RESULTS_MAX) && (fgets(line, sizeof(line), f) != NULL))
+	{
+		unsigned long n;
+
+		if ((line[0] != '#') && (sscanf(line, "%15s %15s %lu %lf",
+			results[results_n].family, results[results_n].engine,
+			&n, &(results[results_n].ns)) == 4))
+			results_n ++;
+	}
+	fclose(f);
+}
+
+
+// find_result()
+// Returns the earlier time of family and engine, or 0 if not found
+//
+double find_result(const char *family, const char *engine)
+{
+	for (int i = 0; i < results_n; i ++)
+	{
+		if ((strcmp(results[i].family, family) == 0)
+			&& (strcmp(results[i].engine, engine) == 0))
+			return results[i].ns;
+	}
+	return 0;
+}
+
+
+// main()
+// Runs all families in the selected or all engines
+//
+int main(int argc, char *argv[])
+{
+	char *engine = NULL;
+	char *cmp = NULL;
+	int runs = RUNS;
+	int c;
+
+	while ((c = getopt(argc, argv, "e:r:c:")) != -1)
+	{
+		switch (c)
+		{
+			case 'e' :
+				if (! le_set_engine(optarg))
+					le_error(1, 0, "Unknown execution engine '%s'", optarg);
+				engine = optarg;
+				break;
+			case 'r' :
+				runs = atoi(optarg);
+				break;
+			case 'c' :
+				cmp = optarg;
+				break;
+			default :
+				le_error(1, 0, USAGE);
+		}
+	}
+	if ((optind < argc) || (runs < 1))
+		le_error(1, 0, USAGE);
+	if (cmp != NULL)
+		read_results(cmp);
+
+	mach_init();
+	printf("# ns per M-code, fastest of %d runs of %d iterations\n", runs, ITER);
+	printf("# family\tengine\tmcodes\tns%s\n", (cmp != NULL) ? "\told\tratio" : "");
+
+	for (int k = 0; k < sizeof(families) / sizeof(families[0]); k ++)
+	{
+		const family_t *f = &families[k];
+		double t;
+
+		// The switch engine is the reference for the count
+		le_engine = ENGINE_SWITCH;
+		uint32_t expect = run(f, &t);
+
+		for (int e = 0; e < sizeof(engines) / sizeof(engines[0]); e ++)
+		{
+			if (((engine != NULL) && (strcmp(engine, engines[e]) != 0))
+				|| ! le_set_engine((char *) engines[e]))
+				continue;
+
+			// The fastest run is the least disturbed by the host
+			double best = 0;
+			run(f, &t);
+			for (int r = 0; r < runs; r ++)
+			{
+				uint32_t n = run(f, &t);
+				if (n != expect)
+					le_error(1, 0, "%s: %u M-codes executed by %s engine, "
+						"%u by switch engine", f->name, n, engines[e], expect);
+				if ((r == 0) || (t < best))
+					best = t;
+			}
+
+			printf("%s\t%s\t%u\t%.3f", f->name, engines[e], expect, best / expect);
+			if (cmp != NULL)
+			{
+				double old = find_result(f->name, engines[e]);
+				if (old > 0)
+					printf("\t%.3f\t%.3f", old, (best / expect) / old);
+				else
+					printf("\t-\t-");
+			}
+			printf("\n");
+		}
+	}
+	return 0;
+}
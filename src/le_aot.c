@@ -0,0 +1,280 @@
+//=====================================================
+// le_aot.c
+// Native module libraries translated by mule2c
+//
+// mule2c translates each procedure of a module into a C function.
+// The functions work on the machine state like the interpreter and
+// run until the RTN of their procedure. When a library matching
+// name and key of a loaded module is found, the first opcode of
+// each procedure is replaced by AOT_OPC, so that every engine calls
+// the translated function when it enters the procedure.
+//
+// Calls from translated code go through aot_call(): translated
+// procedures are called directly, all others are interpreted by a
+// nested run of the engine, which ends when the procedure returns
+// to PC 0 stored in its stack mark.
+//
+// Loop heads in translated code are safepoints, which call
+// aot_poll() when work is pending. As the translated code cannot
+// continue in the instrumented engine, the monitor is entered there.
+//
+// Libraries are shared by the machines of all threads. They access
+// the machine context of the calling thread at the offsets of the
+// build of mule2c, which records a signature of these offsets in
+// the library. Libraries are only used if it matches the emulator.
+//
+// Lilith M-Code Emulator
+//
+// Guido Hoss, 12.03.2022
+//
+// Published by Guido Hoss under GNU Public License V3.
+//=====================================================
+
+#include <config.h>
+#include <dlfcn.h>
+#include "le_mach.h"
+#include "le_io.h"
+#include "le_stack.h"
+#include "le_trace.h"
+#include "le_mcode.h"
+#include "le_helper.h"
+#include "le_aot.h"
+
+bool aot_enabled = true;		// Use module libraries if found
+
+
+// aot_members()
+// Stores the members of the machine context which translated code
+// uses into m (AOT_MEMBERS entries), in order of offsets
+//
+void aot_members(aot_member_t *m)
+{
+#define pending			(mach_ctx.pending)
+#define AOT_CTX(t, v)	{ #v, t, (uint8_t *) &(v) - (uint8_t *) &mach_ctx, sizeof(v) }
+	const aot_member_t t[AOT_MEMBERS] = {
+		AOT_CTX("uint16_t *", dsh_mem),
+		AOT_CTX("uint16_t", gs_PC),
+		AOT_CTX("uint16_t", gs_IR),
+		AOT_CTX("uint16_t", gs_G),
+		AOT_CTX("uint16_t", gs_L),
+		AOT_CTX("uint16_t", gs_S),
+		AOT_CTX("uint16_t *", exs_mem),
+		AOT_CTX("uint8_t", gs_SP),
+		AOT_CTX("uint32_t", oh_count),
+		AOT_CTX("volatile int", pending),
+	};
+#undef AOT_CTX
+#undef pending
+	memcpy(m, t, sizeof(t));
+}
+
+
+// aot_signature()
+// Returns a hash (FNV-1a) of the offsets and sizes of the machine
+// context members used by translated code in this build
+//
+uint32_t aot_signature()
+{
+	aot_member_t m[AOT_MEMBERS];
+	uint32_t h = 2166136261u;
+
+	aot_members(m);
+	for (int i = 0; i < AOT_MEMBERS; i ++)
+	{
+		uint32_t v[2] = { m[i].ofs, m[i].sz };
+		const uint8_t *b = (const uint8_t *) v;
+		for (int k = 0; k < sizeof(v); k ++)
+			h = (h ^ b[k]) * 16777619u;
+	}
+	return h;
+}
+
+
+// aot_load()
+// Binds the module library in file fn to module mod if its name
+// and key match. Returns false if the library cannot be used.
+//
+bool aot_load(mod_entry_t *mod, const char *fn)
+{
+	void *dl = dlopen(fn, RTLD_NOW | RTLD_LOCAL);
+	if (dl == NULL)
+	{
+		le_verbose_msg("failed (%s)\n", dlerror());
+		return false;
+	}
+
+	const aot_lib_t *lib = dlsym(dl, "aot_lib");
+	if ((lib == NULL) || (lib->abi != AOT_ABI))
+	{
+		le_verbose_msg("failed (incompatible library)\n");
+		dlclose(dl);
+		return false;
+	}
+	if (lib->sig != aot_signature())
+	{
+		le_verbose_msg("failed (machine context layout differs)\n");
+		dlclose(dl);
+		return false;
+	}
+	if ((strcmp(lib->name, mod->id.name) != 0)
+		|| (memcmp(lib->key, mod->id.key.w, sizeof(lib->key)) != 0)
+		|| (lib->proc_n != mod->proc_n))
+	{
+		le_verbose_msg("failed (key mismatch)\n");
+		dlclose(dl);
+		return false;
+	}
+
+	// Resolve imported modules by name
+	uint8_t imp_mod[lib->import_n + 1];
+	uint16_t imp_ofs[lib->import_n + 1];
+	for (uint16_t i = 1; i <= lib->import_n; i ++)
+	{
+		uint8_t k = 0;
+		while ((k < mach_num_modules())
+			&& (strcmp(module_tab[k].id.name, lib->import[i]) != 0))
+			k ++;
+		if (k == mach_num_modules())
+		{
+			le_verbose_msg("failed (import %s missing)\n", lib->import[i]);
+			dlclose(dl);
+			return false;
+		}
+		imp_mod[i] = k;
+		imp_ofs[i] = module_tab[k].data_ofs;
+	}
+	lib->bind(imp_mod, imp_ofs);
+
+	// Redirect procedure entries to the translated functions and
+	// index them by entry offset for aot_proc()
+	mod->aot_ix = calloc((mod->code_sz > 0) ? mod->code_sz : 1, sizeof(uint16_t));
+	if (mod->aot_ix == NULL)
+		le_error(1, errno, "Cannot allocate procedure index for %s", mod->id.name);
+	for (uint16_t i = 0; i < mod->proc_n; i ++)
+	{
+		uint16_t e = mod->proc[i];
+		if ((e != 0) && (e < mod->code_sz) && (lib->proc[i] != NULL)
+			&& (mod->aot_ix[e] == 0))
+		{
+			mod->code[e] = AOT_OPC;
+			mod->aot_ix[e] = i + 1;
+		}
+	}
+
+	mod->aot = lib;
+	mod->aot_dl = dl;
+	le_verbose_msg("ok\n");
+	return true;
+}
+
+
+// aot_unload()
+// Releases the module library of module mod
+//
+void aot_unload(mod_entry_t *mod)
+{
+	if (mod->aot_dl != NULL)
+		dlclose(mod->aot_dl);
+	mod->aot_dl = NULL;
+	mod->aot = NULL;
+	free(mod->aot_ix);
+	mod->aot_ix = NULL;
+}
+
+
+// aot_proc()
+// Returns the translated procedure with entry point pc in module
+// mod or NULL
+//
+void (*aot_proc(mod_entry_t *mod, uint16_t pc))()
+{
+	if ((mod->aot_ix != NULL) && (pc < mod->code_sz))
+	{
+		uint16_t i = mod->aot_ix[pc];
+		if (i > 0)
+			return mod->aot->proc[i - 1];
+	}
+	return NULL;
+}
+
+
+// aot_enter()
+// Executes the translated procedure with entry point pc of module
+// mod, called by an engine with exec_mod as the running program.
+// Adds the executed M-codes to count (the engine has already counted
+// the entry instruction) and returns the module to continue in
+// (PC is in gs_PC).
+//
+uint8_t aot_enter(uint8_t exec_mod, mod_entry_t *mod, uint16_t pc, uint32_t *count)
+{
+	void (*f)() = aot_proc(mod, pc);
+	if (f == NULL)
+	{
+		gs_PC = pc + 1;
+		le_trap(mod, TRAP_INV_OPC);
+	}
+
+	uint8_t saved_exec_mod = oh_exec_mod;
+	uint32_t n = oh_count;
+
+	oh_exec_mod = exec_mod;
+	oh_set_module(mod->id.idx);
+	f();
+
+	// count may be the helper counter itself
+	uint32_t d = oh_count - n - 1;
+	oh_count = n;
+	*count += d;
+	oh_exec_mod = saved_exec_mod;
+	return oh_modn;
+}
+
+
+// aot_call()
+// Executes the call instruction in IR (operands at PC) for
+// translated code and runs the called procedure until it returns
+//
+void aot_call()
+{
+	uint8_t caller = oh_modn;
+
+	oh_tab[gs_IR]();
+
+	void (*f)() = aot_proc(oh_modp, gs_PC);
+	if (f != NULL)
+	{
+		f();
+	}
+	else
+	{
+		// Interpret procedure; its return to PC 0 ends the engine
+		uint32_t n = oh_count;
+		dsh_mem[gs_CS + 2] = 0;
+		n += le_run(oh_exec_mod, oh_modn, gs_PC);
+		oh_count = n;
+	}
+	oh_set_module(caller);
+}
+
+
+// aot_bad()
+// Traps on code which cannot be translated (jumps outside the code
+// frame or to computed addresses not found by the translator)
+//
+void aot_bad(uint16_t pc)
+{
+	gs_PC = pc + 1;
+	le_trap(oh_modp, TRAP_CODE_OVF);
+}
+
+
+// aot_poll()
+// Does the work pending at the safepoint of translated code before
+// the instruction at pc
+//
+void aot_poll(uint16_t pc)
+{
+	gs_PC = pc;
+	if (le_safepoint(oh_modp, 0))
+		le_monitor(oh_modp);
+}
@@ -0,0 +1,65 @@
+//=====================================================
+// le_aot.h
+// Native module libraries translated by mule2c
+//
+// Lilith M-Code Emulator
+//
+// Guido Hoss, 12.03.2022
+//
+// Published by Guido Hoss under GNU Public License V3.
+//=====================================================
+
+#ifndef _LE_AOT_H
+#define _LE_AOT_H   1
+
+#include "le_mach.h"
+
+// Version of the interface between module libraries and the emulator
+#define AOT_ABI		7
+
+// Opcode replacing the entry points of translated procedures
+// (unused by the Lilith)
+#define AOT_OPC		0214
+
+// Member of the machine context used by translated code
+typedef struct {
+	const char *name;					// Member name
+	const char *type;					// C type
+	long ofs;							// Offset in mach_ctx
+	long sz;							// Size in bytes
+} aot_member_t;
+
+// Number of machine context members used by translated code
+#define AOT_MEMBERS	10
+
+// Module library (symbol "aot_lib" in the shared object)
+typedef struct aot_lib_t {
+	uint32_t abi;						// AOT_ABI
+	uint32_t sig;						// aot_signature() of mule2c
+	const char *name;					// Module name
+	uint16_t key[3];					// Module key
+	uint16_t proc_n;					// Number of procedures
+	void (*const *proc)();				// Procedure functions
+	uint16_t import_n;					// Number of imported modules
+	const char *const *import;			// Import names (index 1..import_n)
+
+	// Passes the module indexes and data frame offsets of the imports.
+	// The library keeps them per thread, as each machine context has
+	// its own module table.
+	void (*bind)(const uint8_t *mod, const uint16_t *ofs);
+} aot_lib_t;
+
+extern bool aot_enabled;
+
+// Function declarations
+//
+void aot_members(aot_member_t *m);
+uint32_t aot_signature();
+bool aot_load(mod_entry_t *mod, const char *fn);
+void aot_unload(mod_entry_t *mod);
+uint8_t aot_enter(uint8_t exec_mod, mod_entry_t *mod, uint16_t pc, uint32_t *count);
+void aot_call();
+void aot_bad(uint16_t pc);
+void aot_poll(uint16_t pc);
+
+#endif
@@ -0,0 +1,227 @@
+//=====================================================
+// le_block.c
+// Block operations on main memory
+//
+// The kernels work on whole vectors of words where a block lies
+// inside main memory, and word by word where it wraps around the
+// end of the 16-bit address space. On x86-64, the vector loops are
+// compiled for AVX2 and for SSE2 and the faster variant is selected
+// when the program starts; other hosts get the generic code of the
+// vector extensions. Copies go through memmove(), which the C
+// library implements with the best instructions of the host.
+//
+// Lilith M-Code Emulator
+//
+// Guido Hoss, 12.03.2022
+//
+// Published by Guido Hoss under GNU Public License V3.
+//=====================================================
+
+#include <config.h>
+#include "le_mach.h"
+#include "le_block.h"
+
+// Vector of words processed by one step of the vector loops
+#define BK_VEC_WORDS	16
+typedef uint16_t bk_vec_t __attribute__((vector_size(BK_VEC_WORDS * 2)));
+typedef uint64_t bk_vec64_t __attribute__((vector_size(BK_VEC_WORDS * 2)));
+
+#if defined(__x86_64__)
+#define BK_SIMD	__attribute__((target_clones("avx2", "default")))
+#else
+#define BK_SIMD
+#endif
+
+// True if n words at adr lie inside main memory without wrapping
+#define bk_inside(adr, n)	((uint32_t) (adr) + (n) <= MACH_DSHMEM_SZ)
+
+
+// bk_char()
+// Returns character i of the string at adr; the even character is
+// in the high byte of a word
+//
+static inline uint8_t bk_char(uint16_t adr, uint32_t i)
+{
+	uint16_t w = dsh_mem[(uint16_t) (adr + (i >> 1))];
+	return (i & 1) ? (w & 0xff) : (w >> 8);
+}
+
+
+// bk_setchar()
+// Stores character ch as character i of the string at adr
+//
+static inline void bk_setchar(uint16_t adr, uint32_t i, uint8_t ch)
+{
+	uint16_t *p = &(dsh_mem[(uint16_t) (adr + (i >> 1))]);
+	*p = (i & 1) ? ((*p & 0xff00) | ch) : ((*p & 0x00ff) | (ch << 8));
+}
+
+
+// bk_move()
+// Copies n words from src to dst in ascending order, as the Lilith
+// does: if dst lies inside the source block, the first dst-src words
+// are repeated over the destination
+//
+void bk_move(uint16_t dst, uint16_t src, uint16_t n)
+{
+	uint16_t d = dst - src;
+
+	if ((n == 0) || (d == 0))
+		return;
+
+	if (! bk_inside(dst, n) || ! bk_inside(src, n))
+	{
+		for (uint16_t i = 0; i < n; i ++)
+			dsh_mem[(uint16_t) (dst + i)] = dsh_mem[(uint16_t) (src + i)];
+	}
+	else if (d >= n)
+	{
+		// Destination below or behind the source block
+		memmove(&(dsh_mem[dst]), &(dsh_mem[src]), n * MACH_WORD_SZ);
+	}
+	else
+	{
+		// Double the repeated pattern until it covers the destination
+		uint16_t *p = &(dsh_mem[src]);
+		uint32_t len = d;
+		uint32_t end = (uint32_t) d + n;
+
+		while (len < end)
+		{
+			uint32_t k = (end - len < len) ? end - len : len;
+			memcpy(p + len, p, k * MACH_WORD_SZ);
+			len += k;
+		}
+	}
+}
+
+
+// bk_fill()
+// Stores word w into n words at dst
+//
+BK_SIMD
+void bk_fill(uint16_t dst, uint16_t w, uint16_t n)
+{
+	uint32_t i = 0;
+
+	if (bk_inside(dst, n))
+	{
+		bk_vec_t v = (bk_vec_t) { } + w;
+		uint16_t *p = &(dsh_mem[dst]);
+
+		for (; i + BK_VEC_WORDS <= n; i += BK_VEC_WORDS)
+			memcpy(p + i, &v, sizeof(v));
+	}
+	for (; i < n; i ++)
+		dsh_mem[(uint16_t) (dst + i)] = w;
+}
+
+
+// bk_compare()
+// Returns the number of equal words at the start of the blocks of
+// n words at a and b
+//
+BK_SIMD
+uint16_t bk_compare(uint16_t a, uint16_t b, uint16_t n)
+{
+	uint32_t i = 0;
+
+	if (bk_inside(a, n) && bk_inside(b, n))
+	{
+		const uint16_t *p = &(dsh_mem[a]);
+		const uint16_t *q = &(dsh_mem[b]);
+
+		for (; i + BK_VEC_WORDS <= n; i += BK_VEC_WORDS)
+		{
+			bk_vec_t x, y;
+
+			memcpy(&x, p + i, sizeof(x));
+			memcpy(&y, q + i, sizeof(y));
+			bk_vec64_t z = (bk_vec64_t) (x ^ y);
+			if ((z[0] | z[1] | z[2] | z[3]) != 0)
+				break;
+		}
+	}
+	while ((i < n)
+		&& (dsh_mem[(uint16_t) (a + i)] == dsh_mem[(uint16_t) (b + i)]))
+		i ++;
+	return i;
+}
+
+
+// bk_strlen()
+// Returns the number of characters of the string at adr before the
+// first 0C, but at most max
+//
+uint16_t bk_strlen(uint16_t adr, uint16_t max)
+{
+	for (uint32_t i = 0; i < max; i += 2)
+	{
+		uint16_t w = dsh_mem[(uint16_t) (adr + (i >> 1))];
+
+		if ((w & 0xff00) == 0)
+			return i;
+		if (((w & 0xff) == 0) && (i + 1 < max))
+			return i + 1;
+	}
+	return max;
+}
+
+
+// bk_strcmp()
+// Compares n characters from character ai of the string at a with
+// those from character bi of the string at b. Returns the difference
+// of the first unequal characters, or 0.
+//
+int16_t bk_strcmp(uint16_t a, uint16_t ai, uint16_t b, uint16_t bi, uint16_t n)
+{
+	uint32_t k = 0;
+
+	// With both strings at the same byte position in their words,
+	// whole words are compared until the first difference
+	if (((ai ^ bi) & 1) == 0)
+	{
+		if ((ai & 1) && (n > 0) && (bk_char(a, ai) == bk_char(b, bi)))
+			k = 1;
+		if ((k > 0) || ! (ai & 1))
+		{
+			uint16_t wa = a + ((ai + k) >> 1);
+			uint16_t wb = b + ((bi + k) >> 1);
+			k += bk_compare(wa, wb, (n - k) >> 1) * 2;
+		}
+	}
+
+	for (; k < n; k ++)
+	{
+		int16_t d = bk_char(a, ai + k) - bk_char(b, bi + k);
+		if (d != 0)
+			return d;
+	}
+	return 0;
+}
+
+
+// bk_strcpy()
+// Copies n characters from character si of the string at src to
+// character di of the string at dst, in ascending order
+//
+void bk_strcpy(uint16_t dst, uint16_t di, uint16_t src, uint16_t si, uint16_t n)
+{
+	uint32_t k = 0;
+
+	if (((di ^ si) & 1) == 0)
+	{
+		// Leading odd character, whole words, trailing character
+		if ((di & 1) && (n > 0))
+		{
+			bk_setchar(dst, di, bk_char(src, si));
+			k = 1;
+		}
+		uint16_t w = (n - k) >> 1;
+		bk_move(dst + ((di + k) >> 1), src + ((si + k) >> 1), w);
+		k += w * 2;
+	}
+
+	for (; k < n; k ++)
+		bk_setchar(dst, di + k, bk_char(src, si + k));
+}
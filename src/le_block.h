@@ -0,0 +1,26 @@
+//=====================================================
+// le_block.h
+// Block operations on main memory
+//
+// Lilith M-Code Emulator
+//
+// Guido Hoss, 12.03.2022
+//
+// Published by Guido Hoss under GNU Public License V3.
+//=====================================================
+
+#ifndef _LE_BLOCK_H
+#define _LE_BLOCK_H   1
+
+#include "le_mach.h"
+
+// Function declarations
+//
+void bk_move(uint16_t dst, uint16_t src, uint16_t n);
+void bk_fill(uint16_t dst, uint16_t w, uint16_t n);
+uint16_t bk_compare(uint16_t a, uint16_t b, uint16_t n);
+uint16_t bk_strlen(uint16_t adr, uint16_t max);
+int16_t bk_strcmp(uint16_t a, uint16_t ai, uint16_t b, uint16_t bi, uint16_t n);
+void bk_strcpy(uint16_t dst, uint16_t di, uint16_t src, uint16_t si, uint16_t n);
+
+#endif
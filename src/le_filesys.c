@@ -28,10 +28,10 @@ struct fs_index_t {
 
 typedef struct fs_index_t *fs_index_ptr;
 
-// Pointer to head of list
-fs_index_ptr fd_list = NULL;
-uint16_t last_m2file = 0;		// Last referenced M2 file descriptor
-fs_index_ptr last_fd = NULL;	// Last associated file list entry
+// Pointer to head of list (machine context)
+#define fd_list		(mach_ctx.fd_list)
+#define last_m2file	(mach_ctx.last_m2file)	// Last referenced M2 file descriptor
+#define last_fd		(mach_ctx.last_fd)		// Last associated file list entry
 
 
 // fs_swapcpy()
@@ -256,6 +256,18 @@ void fs_close_all(uint16_t owner)
 }
 
 
+// fs_release()
+// Closes all open files
+//
+void fs_release()
+{
+	while (fd_list != NULL)
+		fs_close_int(fd_list);
+
+	fs_cache_last(NULL);
+}
+
+
 // fs_rename()
 // Renames the open file f to a new name
 // If the name is empty, f is converted to a temporary file.
@@ -1,7 +1,23 @@
 //=====================================================
 // le_heap.c
 // Dynamic heap allocation functions
-// 
+//
+// The heap grows down from the top of main memory towards the
+// stack; gs_H is the address of its lowest block. Free blocks are
+// kept in segregated lists by size class: one class per size below
+// HP_EXACT words and one per power of two above. Allocated blocks are
+// kept in one list per owning module, so that the blocks of a module
+// or of a program level are released in time proportional to their
+// number, whatever the size of the heap. The metadata of the blocks
+// is held in a side table indexed by address, so that freeing a block
+// and coalescing it with its free neighbours takes constant time.
+// Main memory itself only holds the data of the program.
+//
+// Every allocation is counted for its owning program and for its
+// site, the return address of the call of Storage.ALLOCATE. The
+// report of the statistics is shown on heap overflow, on SIGUSR1 and
+// at exit if requested by -H, which also writes it to a file.
+//
 // Lilith M-Code Emulator
 //
 // Guido Hoss, 12.03.2022
@@ -14,189 +30,688 @@
 #include "le_heap.h"
 
 
-// Heap header structure
-struct hp_header_t {
-	struct hp_header_t *next;	// Pointer to next header
-	uint16_t adr;				// Address of block in dsh_mem
-	uint16_t sz;				// Size of block
-	uint8_t owner;				// Module index of owner
+// Size classes: sizes 1..HP_EXACT-1 have their own class, larger
+// sizes share one class per power of two
+#define HP_EXACT		32
+#define HP_CLASSES		(HP_EXACT + 11)
+
+// Blocks of a size class scanned for a fit before moving on to a
+// larger class, where every block fits
+#define HP_SCAN			8
+
+// End of the heap, above its highest block
+#define HP_END			(MACH_DSHMEM_SZ - 1)
+
+// Statistics: modules by name, allocation sites (power of 2) and
+// sites in each list of the report
+#define HP_USERS		256
+#define HP_SITES		4096
+#define HP_REPORT_MAX	10
+
+// Bytes of w words in the report
+#define HP_BYTES(w)		((unsigned int) ((w) * MACH_WORD_SZ))
+
+// Block metadata, indexed by address, in one pool of 8-byte entries
+// per machine. Only the entries at the start of a block are valid
+// (sz > 0). The links are those of the free list of the size class
+// for free blocks (owner = 0), and those of the list of the owner for
+// allocated blocks. The entry of the last word of a free block of
+// more than one word is not a start; its prev field holds the start
+// of the block (foot).
+typedef struct {
+	uint16_t sz;				// Size of block starting here
+	uint16_t next;				// Next block of list (0 = none)
+	uint16_t prev;				// Previous block of list, or foot
+	uint8_t owner;				// Module index of owner (0 = free)
+} hp_block_t;
+
+// Heap usage of a module, by name. Entry 0 collects the modules
+// which don't fit.
+typedef struct {
+	mod_name_t name;			// Module name
+	uint32_t count;				// Allocations
+	uint64_t words;				// Words allocated
+	uint32_t live;				// Words allocated and not freed
+	uint32_t peak;				// Peak of live words
+} hp_usage_t;
+
+// Allocation site of a program: return address of a call of
+// Storage.ALLOCATE. Entry 0 collects the sites which don't fit.
+typedef struct {
+	uint16_t owner;				// Usage entry of owning program
+	uint16_t caller;			// Usage entry of calling module
+	uint16_t pc;				// Return address in calling module
+	uint32_t count;				// Allocations (0 = unused entry)
+	uint64_t words;				// Words allocated
+	uint32_t live_n;			// Blocks allocated and not freed
+	uint32_t live;				// Words allocated and not freed
+} hp_site_t;
+
+// Heap of a machine
+struct hp_heap_t {
+	hp_block_t blk[MACH_DSHMEM_SZ];		// Side table of blocks
+	uint16_t head[HP_CLASSES];			// Free lists by size class
+	uint64_t nonempty;					// Bit set of non-empty lists
+	uint16_t own[MOD_TAB_MAX + 1];		// Allocated blocks by owner
+	uint64_t mark[MACH_DSHMEM_SZ / 64];	// Blocks released by hp_free_all()
+
+	// Statistics
+	uint16_t site[MACH_DSHMEM_SZ];		// Site of allocated block
+	hp_site_t sites[HP_SITES];			// Sites, hashed
+	uint16_t sites_n;					// Used entries of sites
+	hp_usage_t use[HP_USERS];			// Usage by module name
+	uint16_t use_n;						// Used entries of use
+	uint16_t user[MOD_TAB_MAX + 1];		// Usage entry of loaded module
+	uint32_t live;						// Words allocated and not freed
+	uint32_t live_n;					// Blocks allocated and not freed
+	uint32_t peak;						// Peak of live words
+	uint16_t min_gap;					// Smallest gap to stack
 };
 
-typedef struct hp_header_t *hp_header_ptr;
+// Report file (-H) or NULL
+FILE *hp_file = NULL;
+
+// Heap of the machine (machine context)
+#define heap		(mach_ctx.heap)
+#define blk			(heap->blk)
+
+
+// hp_class()
+// Returns the size class of a block of sz words
+//
+static inline uint8_t hp_class(uint16_t sz)
+{
+	return (sz < HP_EXACT) ? sz : HP_EXACT - 5 + (31 - __builtin_clz(sz));
+}
+
+
+// hp_insert()
+// Inserts the free block at adr into the list of its size class
+//
+void hp_insert(uint16_t adr)
+{
+	uint16_t sz = blk[adr].sz;
+	uint8_t c = hp_class(sz);
+	uint16_t h = heap->head[c];
+
+	blk[adr].owner = 0;
+	blk[adr].next = h;
+	blk[adr + sz - 1].prev = adr;
+	blk[adr].prev = 0;
+	if (h != 0)
+		blk[h].prev = adr;
+	heap->head[c] = adr;
+	heap->nonempty |= (uint64_t) 1 << c;
+}
+
+
+// hp_remove()
+// Removes the free block at adr from the list of its size class
+//
+void hp_remove(uint16_t adr)
+{
+	uint8_t c = hp_class(blk[adr].sz);
+	uint16_t next = blk[adr].next;
+	uint16_t prev = blk[adr].prev;
+
+	if (prev != 0)
+		blk[prev].next = next;
+	else if ((heap->head[c] = next) == 0)
+		heap->nonempty &= ~((uint64_t) 1 << c);
+	if (next != 0)
+		blk[next].prev = prev;
+}
+
+
+// hp_own()
+// Links the block at adr into the list of allocated blocks of module
+// mod
+//
+void hp_own(uint16_t adr, uint8_t mod)
+{
+	uint16_t h = heap->own[mod];
+
+	blk[adr].owner = mod;
+	blk[adr].next = h;
+	blk[adr].prev = 0;
+	if (h != 0)
+		blk[h].prev = adr;
+	heap->own[mod] = adr;
+}
+
+
+// hp_disown()
+// Unlinks the allocated block at adr from the list of its owner
+//
+void hp_disown(uint16_t adr)
+{
+	uint16_t next = blk[adr].next;
+	uint16_t prev = blk[adr].prev;
+
+	if (prev != 0)
+		blk[prev].next = next;
+	else
+		heap->own[blk[adr].owner] = next;
+	if (next != 0)
+		blk[next].prev = prev;
+}
+
+
+// hp_user()
+// Returns the usage entry of loaded module mod
+//
+static inline uint16_t hp_user(uint8_t mod)
+{
+	uint16_t u = heap->user[mod];
+	mod_name_t name;
+
+	if (u != 0)
+		return u;
+
+	if (module_tab[mod].id.name[0] != '\0')
+		strcpy(name, module_tab[mod].id.name);
+	else
+		snprintf(name, sizeof(name), "#%u", mod);
+	for (u = 1; (u < heap->use_n) && (strcmp(heap->use[u].name, name) != 0); u ++)
+		;
+	if (u == HP_USERS)
+		return 0;
+	if (u == heap->use_n)
+	{
+		strcpy(heap->use[u].name, name);
+		heap->use_n ++;
+	}
+	return heap->user[mod] = u;
+}
+
+
+// hp_site()
+// Returns the entry of the allocation site at pc in the module with
+// usage entry caller, called by the program with usage entry owner
+//
+static inline uint16_t hp_site(uint16_t owner, uint16_t caller, uint16_t pc)
+{
+	uint32_t key = ((uint32_t) owner << 24) ^ ((uint32_t) caller << 16) ^ pc;
+	uint16_t i = ((key * 0x9e3779b1) >> 16) & (HP_SITES - 1);
+	hp_site_t *s;
+
+	while (true)
+	{
+		if (i == 0)
+			i = 1;
+		s = &(heap->sites[i]);
+		if ((s->count == 0) || ((s->owner == owner) && (s->caller == caller)
+			&& (s->pc == pc)))
+			break;
+		i = (i + 1) & (HP_SITES - 1);
+	}
+
+	if (s->count == 0)
+	{
+		// New site, unless the table is full
+		if (heap->sites_n * 4 >= HP_SITES * 3)
+			return 0;
+		s->owner = owner;
+		s->caller = caller;
+		s->pc = pc;
+		heap->sites_n ++;
+	}
+	return i;
+}
+
+
+// hp_tag()
+// Counts the allocation of the block at adr by program mod, called
+// at pc in module caller
+//
+static inline void hp_tag(uint16_t adr, uint8_t mod, uint8_t caller, uint16_t pc)
+{
+	uint16_t sz = blk[adr].sz;
+	uint16_t owner = hp_user(mod);
+	uint16_t i = hp_site(owner, hp_user(caller), pc);
+	hp_site_t *s = &(heap->sites[i]);
+	hp_usage_t *u = &(heap->use[owner]);
+
+	heap->site[adr] = i;
+	s->count ++;
+	s->words += sz;
+	s->live_n ++;
+	s->live += sz;
+
+	u->count ++;
+	u->words += sz;
+	u->live += sz;
+	if (u->live > u->peak)
+		u->peak = u->live;
+
+	heap->live += sz;
+	heap->live_n ++;
+	if (heap->live > heap->peak)
+		heap->peak = heap->live;
+}
+
 
+// hp_untag()
+// Counts the release of the allocated block at adr
+//
+static inline void hp_untag(uint16_t adr)
+{
+	uint16_t sz = blk[adr].sz;
+	hp_site_t *s = &(heap->sites[heap->site[adr]]);
 
-// Heap memory
-uint16_t gs_H;
-hp_header_ptr heap_top;
+	s->live_n --;
+	s->live -= sz;
+	heap->use[hp_user(blk[adr].owner)].live -= sz;
+	heap->live -= sz;
+	heap->live_n --;
+}
 
 
-// hp_hdr_alloc()
-// Allocate a header block
+// hp_fit()
+// Returns the address of a free block of at least sz words, or 0
+// if there is none
 //
-hp_header_ptr hp_hdr_alloc()
+uint16_t hp_fit(uint16_t sz)
 {
-	return malloc(sizeof(struct hp_header_t));
+	uint8_t c = hp_class(sz);
+
+	// Blocks of an exact class fit, the others may be too small
+	uint16_t adr = heap->head[c];
+	for (int i = 0; (i < HP_SCAN) && (adr != 0); i ++)
+	{
+		if (blk[adr].sz >= sz)
+			return adr;
+		adr = blk[adr].next;
+	}
+
+	// First block of the next larger non-empty class
+	uint64_t m = (c + 1 < HP_CLASSES) ? heap->nonempty >> (c + 1) : 0;
+	if (m == 0)
+		return 0;
+	return heap->head[c + 1 + __builtin_ctzll(m)];
 }
 
 
-// le_heap_alloc()
+// hp_alloc()
 // Allocate sz words on heap and return a pointer
 // to the memory address (heap index). Block is
-// registered to module index "mod".
+// registered to module index "mod". The allocation
+// is counted for the site at pc in module "caller".
 //
-uint16_t hp_alloc(uint8_t mod, uint16_t sz)
+uint16_t hp_alloc(uint8_t mod, uint16_t sz, uint8_t caller, uint16_t pc)
 {
-	hp_header_ptr cur = heap_top;
-	hp_header_ptr prev = NULL;
+	uint16_t adr;
 
 	// Allocate non-zero size
 	if (sz == 0)
 		sz = 1;
 
-	// Scan block list for suitable gaps
-	while (cur != NULL)
+	// Gap between stack and heap
+	int gap = gs_H - gs_S;
+	if (gap < heap->min_gap)
+		heap->min_gap = (gap > 0) ? gap : 0;
+
+	if ((adr = hp_fit(sz)) != 0)
 	{
-		if ((cur->owner == 0) && (cur->sz >= sz))
+		// Take the upper part of the free block and keep the rest
+		uint16_t rest = blk[adr].sz - sz;
+
+		hp_remove(adr);
+		if (rest > 0)
 		{
-			// Suitable gap found
-			if (cur->sz > sz)
-			{
-				// Split block
-				hp_header_ptr p = hp_hdr_alloc();
-				p->next = cur->next;
-				cur->next = p;
-				p->sz = cur->sz - sz;
-				p->adr = cur->adr;
-				cur->adr += p->sz;
-				cur->sz = sz;
-				p->owner = 0;
-			}
-			cur->owner = mod;
-			break;
+			blk[adr].sz = rest;
+			hp_insert(adr);
+			adr += rest;
+			blk[adr].sz = sz;
 		}
-		prev = cur;
-		cur = cur->next;
 	}
+	else if (gs_H - gs_S > sz)
+	{
+		// No suitable gap found, so extend heap
+		gs_H -= sz;
+		if (gs_H < hp_low)
+			hp_low = gs_H;
+		adr = gs_H;
+		blk[adr].sz = sz;
+	}
+	else
+	{
+		// Heap overflow error, after the report unless it is shown
+		// at exit
+		if (hp_file == NULL)
+			hp_show();
+		le_error(1, 0, "Heap overflow");
+	}
+
+	hp_own(adr, mod);
+	hp_tag(adr, mod, caller, pc);
+	return adr;
+}
 
-	// At end of block list?
-	if (cur == NULL)
+
+// hp_merge()
+// Frees the block of sz words at adr, which is in no list, and
+// merges it with its free neighbours. The heap shrinks if the block
+// is its lowest one.
+//
+void hp_merge(uint16_t adr, uint16_t sz)
+{
+	uint16_t up = adr + sz;
+
+	// Merge with upper neighbour
+	if ((up < HP_END) && (blk[up].owner == 0))
 	{
-		// No matching gap found, so extend heap
-		if (gs_H - gs_S > sz)
+		hp_remove(up);
+		sz += blk[up].sz;
+		blk[up].sz = 0;
+	}
+
+	// Merge with lower neighbour, which starts at the word below or
+	// is found through its foot
+	if (adr > gs_H)
+	{
+		uint16_t e = adr - 1;
+		uint16_t low = (blk[e].sz != 0) ? e : blk[e].prev;
+		if ((low >= gs_H) && (low <= e) && (blk[low].sz == adr - low)
+			&& (blk[low].owner == 0))
+		{
+			hp_remove(low);
+			blk[adr].sz = 0;
+			sz += adr - low;
+			adr = low;
+		}
+	}
+	blk[adr].sz = sz;
+
+	if (adr == gs_H)
+	{
+		// Lowest block, return it to the stack
+		blk[adr].sz = 0;
+		gs_H += sz;
+		return;
+	}
+	hp_insert(adr);
+}
+
+
+// hp_release_block()
+// Releases the allocated block at adr
+//
+void hp_release_block(uint16_t adr)
+{
+	hp_untag(adr);
+	hp_disown(adr);
+	hp_merge(adr, blk[adr].sz);
+}
+
+
+// hp_free()
+// Frees specified pointer
+//
+void hp_free(uint16_t ptr)
+{
+	if ((ptr < gs_H) || (ptr >= HP_END) || (blk[ptr].sz == 0)
+		|| (blk[ptr].owner == 0))
+		le_error(1, 0, "Heap pointer *%04X invalid", ptr);
+	hp_release_block(ptr);
+}
+
+
+// hp_free_all()
+// Frees all blocks belonging to the specified module
+// at or below pointer address "limit". The blocks of the module are
+// unlinked and marked first, and then released in one pass in address
+// order, so that each run of adjacent released and free blocks is
+// merged into a single free block, or returned to the stack if it is
+// the lowest one.
+//
+void hp_free_all(uint8_t mod, uint16_t limit)
+{
+	uint64_t *mark = heap->mark;
+	uint16_t lo = HP_END;
+	uint16_t hi = 0;
+	uint16_t adr = heap->own[mod];
+
+	while (adr != 0)
+	{
+		uint16_t next = blk[adr].next;
+		if (adr <= limit)
 		{
-			// Still room left, create new block header
-			cur = hp_hdr_alloc();
-			prev->next = cur;
-			cur->next = NULL;
-			gs_H -= sz;
-			cur->adr = gs_H;
-			cur->sz = sz;
-			cur->owner = mod;
+			hp_untag(adr);
+			hp_disown(adr);
+			mark[adr >> 6] |= (uint64_t) 1 << (adr & 63);
+			if (adr < lo)
+				lo = adr;
+			if (adr > hi)
+				hi = adr;
 		}
-		else
+		adr = next;
+	}
+
+	for (uint32_t w = lo >> 6; w <= hi >> 6; w ++)
+	{
+		while (mark[w] != 0)
 		{
-			// Heap overflow error
-			le_error(1, 0, "Heap overflow");
+			adr = (w << 6) + __builtin_ctzll(mark[w]);
+			mark[w] &= mark[w] - 1;
+
+			// Extend the run over the released and free blocks above
+			uint32_t end = adr + blk[adr].sz;
+			while (end < HP_END)
+			{
+				uint64_t bit = (uint64_t) 1 << (end & 63);
+				uint16_t sz = blk[end].sz;
+
+				if (mark[end >> 6] & bit)
+					mark[end >> 6] &= ~bit;
+				else if (blk[end].owner == 0)
+					hp_remove(end);
+				else
+					break;
+				blk[end].sz = 0;
+				end += sz;
+			}
+			hp_merge(adr, end - adr);
 		}
 	}
-	return cur->adr;
 }
 
 
-// hp_free_int()
-// Deallocate the heap memory previously allocated
-// to "ptr" if by_ptr=true, or allocated to "mod"
-// if by_ptr=false. Only check pointers below/equal to "limit".
+// hp_unload()
+// Frees all blocks of module mod, which is unloaded
 //
-void hp_free_int(uint8_t mod, uint16_t ptr, uint16_t limit, bool by_ptr)
+void hp_unload(uint8_t mod)
 {
-	hp_header_ptr cur = heap_top;
-	hp_header_ptr prev = NULL;
+	hp_free_all(mod, UINT16_MAX);
+
+	// The index may be taken by another module next
+	heap->user[mod] = 0;
+}
+
 
-	void consolidate(hp_header_ptr p, hp_header_ptr q)
+// hp_free_stats()
+// Returns the number of free blocks below the heap limit, their
+// words and the words of the largest one
+//
+void hp_free_stats(uint32_t *n, uint32_t *words, uint16_t *largest)
+{
+	*n = *words = *largest = 0;
+	for (uint8_t c = 0; c < HP_CLASSES; c ++)
 	{
-		p->sz += q->sz;
-		p->adr = q->adr;
-		p->next = q->next;
-		free(q);
+		for (uint16_t adr = heap->head[c]; adr != 0; adr = blk[adr].next)
+		{
+			(*n) ++;
+			*words += blk[adr].sz;
+			if (blk[adr].sz > *largest)
+				*largest = blk[adr].sz;
+		}
 	}
+}
+
 
-	bool is_match(hp_header_ptr p)
+// hp_sorted_sites()
+// Returns the used site entries sorted by words allocated, or by
+// allocations if by_count is TRUE (to be freed by caller), and
+// their number in n
+//
+uint16_t *hp_sorted_sites(bool by_count, uint16_t *n)
+{
+	int cmp_words(const void *a, const void *b)
 	{
-		return (p != heap_top) &&
-			(((by_ptr && (p->adr == ptr)) ||
-			((! by_ptr) && (p->owner == mod))));
+		const hp_site_t *x = &(heap->sites[*(const uint16_t *) a]);
+		const hp_site_t *y = &(heap->sites[*(const uint16_t *) b]);
+		return (x->words < y->words) ? 1 : (x->words > y->words) ? -1 : 0;
 	}
 
-	bool is_free(hp_header_ptr p)
+	int cmp_count(const void *a, const void *b)
 	{
-		return (p != heap_top) && ((p->owner == 0) || 
-			((! by_ptr) && ((p->owner == mod))));
+		const hp_site_t *x = &(heap->sites[*(const uint16_t *) a]);
+		const hp_site_t *y = &(heap->sites[*(const uint16_t *) b]);
+		return (x->count < y->count) ? 1 : (x->count > y->count) ? -1 : 0;
 	}
 
-	// Scan block list for address
-	while (cur != NULL)
+	uint16_t *ix = malloc(HP_SITES * sizeof(uint16_t));
+	if (ix == NULL)
+		le_error(1, errno, "Can't allocate heap report");
+
+	*n = 0;
+	for (uint16_t i = 0; i < HP_SITES; i ++)
 	{
-		if ((cur->adr <= limit) && (cur->owner != 0) && is_match(cur))
-		{
-			// Valid pointer, proceed to release
-			cur->owner = 0;
+		if (heap->sites[i].count > 0)
+			ix[(*n) ++] = i;
+	}
+	qsort(ix, *n, sizeof(uint16_t), by_count ? cmp_count : cmp_words);
+	return ix;
+}
 
-			// Consolidate with previous block
-			if ((prev != NULL) && (prev->adr <= limit) && is_free(prev))
-			{
-				consolidate(prev, cur);
-				cur = prev;
-			}
-			
-			// Consolidate with next block
-			if ((cur->next != NULL) && is_free(cur->next))
-				consolidate(cur, cur->next);
 
-			if (cur->next == NULL)
-			{
-				// Last block above heap_top
-				hp_header_ptr p = heap_top;
-				while (p->next != cur)
-					p = p->next;
-				gs_H = p->adr;
-				p->next = NULL;
-				free(cur);
-				return;
-			}
+// hp_show()
+// Shows the report of the heap statistics
+//
+void hp_show()
+{
+	uint32_t free_n, free_words;
+	uint16_t largest;
+
+	if (heap == NULL)
+		return;
+	hp_free_stats(&free_n, &free_words, &largest);
 
-			// Return after one deallocation if pointer mode
-			if (by_ptr)
-				return;
-			else
-				continue;
+	le_error(0, 0, "\nHeap: %u bytes live in %u blocks, peak %u bytes",
+		HP_BYTES(heap->live), heap->live_n, HP_BYTES(heap->peak));
+	le_error(0, 0, "Heap: size %u bytes, peak %u bytes",
+		HP_BYTES(HP_END - gs_H), HP_BYTES(HP_END - hp_low));
+	le_error(0, 0, "Heap: gap to stack %d bytes, smallest %u bytes",
+		(gs_H - gs_S) * (int) MACH_WORD_SZ, HP_BYTES(heap->min_gap));
+	le_error(0, 0, "Heap: %u free blocks of %u bytes, largest %u bytes, "
+		"fragmentation %.2f", free_n, HP_BYTES(free_words),
+		HP_BYTES(largest),
+		(free_words > 0) ? 1.0 - (double) largest / free_words : 0.0);
+
+	le_error(0, 0, "%-16s %10s %12s %10s %10s", "Program", "allocs",
+		"bytes", "live", "peak");
+	for (uint16_t i = 0; i < heap->use_n; i ++)
+	{
+		hp_usage_t *u = &(heap->use[i]);
+		if (u->count > 0)
+			le_error(0, 0, "%-16s %10u %12lu %10u %10u", u->name, u->count,
+				(unsigned long) (u->words * MACH_WORD_SZ),
+				HP_BYTES(u->live), HP_BYTES(u->peak));
+	}
+
+	for (int k = 0; k < 2; k ++)
+	{
+		uint16_t n;
+		uint16_t *ix = hp_sorted_sites(k == 1, &n);
+
+		le_error(0, 0, "Top sites by %-11s %-16s %10s %12s %10s",
+			(k == 1) ? "count" : "bytes", "program", "allocs", "bytes", "live");
+		for (uint16_t i = 0; (i < n) && (i < HP_REPORT_MAX); i ++)
+		{
+			hp_site_t *s = &(heap->sites[ix[i]]);
+			char site[MOD_NAME_MAX + 9];
+
+			snprintf(site, sizeof(site), "%s:%07o", heap->use[s->caller].name,
+				s->pc);
+			le_error(0, 0, "%-24s %-16s %10u %12lu %10u",
+				site, heap->use[s->owner].name,
+				s->count, (unsigned long) (s->words * MACH_WORD_SZ),
+				HP_BYTES(s->live));
 		}
-		prev = cur;
-		cur = cur->next;
+		free(ix);
 	}
+}
 
-	// At end of block list?
-	if ((cur == NULL) && by_ptr)
-		le_error(1, 0, "Heap pointer *%04X invalid", ptr);
+
+// hp_write()
+// Writes the report of the heap statistics to f as tab-separated
+// lines, with all sites by bytes allocated
+//
+void hp_write(FILE *f)
+{
+	uint32_t free_n, free_words;
+	uint16_t largest, n;
+	uint16_t *ix = hp_sorted_sites(false, &n);
+
+	hp_free_stats(&free_n, &free_words, &largest);
+
+	fprintf(f,
+		"# mule heap report, sizes in bytes\n"
+		"# heap\tlive\tlive_blocks\tpeak\tsize\tpeak_size\tgap\tmin_gap"
+		"\tfree_blocks\tfree\tlargest_free\tfragmentation\n"
+		"# program\tname\tallocs\tbytes\tlive\tpeak\n"
+		"# site\tmodule\tpc\tprogram\tallocs\tbytes\tlive_blocks\tlive\n");
+	fprintf(f, "heap\t%u\t%u\t%u\t%u\t%u\t%d\t%u\t%u\t%u\t%u\t%.4f\n",
+		HP_BYTES(heap->live), heap->live_n, HP_BYTES(heap->peak),
+		HP_BYTES(HP_END - gs_H), HP_BYTES(HP_END - hp_low),
+		(gs_H - gs_S) * (int) MACH_WORD_SZ, HP_BYTES(heap->min_gap),
+		free_n, HP_BYTES(free_words), HP_BYTES(largest),
+		(free_words > 0) ? 1.0 - (double) largest / free_words : 0.0);
+
+	for (uint16_t i = 0; i < heap->use_n; i ++)
+	{
+		hp_usage_t *u = &(heap->use[i]);
+		if (u->count > 0)
+			fprintf(f, "program\t%s\t%u\t%lu\t%u\t%u\n", u->name, u->count,
+				(unsigned long) (u->words * MACH_WORD_SZ),
+				HP_BYTES(u->live), HP_BYTES(u->peak));
+	}
+	for (uint16_t i = 0; i < n; i ++)
+	{
+		hp_site_t *s = &(heap->sites[ix[i]]);
+		fprintf(f, "site\t%s\t%07o\t%s\t%u\t%lu\t%u\t%u\n",
+			heap->use[s->caller].name, s->pc, heap->use[s->owner].name,
+			s->count, (unsigned long) (s->words * MACH_WORD_SZ), s->live_n,
+			HP_BYTES(s->live));
+	}
+	free(ix);
 }
 
 
-// hp_free()
-// Frees specified pointer
+// hp_exit()
+// Shows the heap report and writes it to the report file at exit
 //
-void hp_free(uint16_t ptr)
+void hp_exit()
 {
-	hp_free_int(0, ptr, UINT16_MAX, true);
+	if (heap != NULL)
+	{
+		hp_show();
+		hp_write(hp_file);
+	}
+	fclose(hp_file);
+	hp_file = NULL;
 }
 
 
-// hp_free_all()
-// Frees all blocks belonging to the specified module
-// above and including pointer address "limit"
+// hp_open_report()
+// Opens the heap report file, which is written when the emulator
+// exits
 //
-void hp_free_all(uint8_t mod, uint16_t limit)
+void hp_open_report(char *fname)
 {
-	hp_free_int(mod, 0, limit, false);
+	if ((hp_file = fopen(fname, "w")) == NULL)
+		le_error(1, errno, "Can't create heap report '%s'", fname);
+	atexit(hp_exit);
 }
 
 
@@ -206,10 +721,26 @@ void hp_free_all(uint8_t mod, uint16_t limit)
 void hp_init()
 {
 	// Initialize top of heap
-	gs_H = MACH_DSHMEM_SZ - 1;
-	heap_top = hp_hdr_alloc();
-	heap_top->adr = gs_H;
-	heap_top->next = NULL;
-	heap_top->sz = 0;
-	heap_top->owner = 0;
+	gs_H = hp_low = HP_END;
+	if ((heap = calloc(1, sizeof(struct hp_heap_t))) == NULL)
+		le_error(1, errno, "Can't allocate heap tables");
+
+	// Usage entry 0 and site 0 collect what doesn't fit
+	strcpy(heap->use[0].name, "(other)");
+	heap->use_n = 1;
+	heap->min_gap = UINT16_MAX;
+
+	// Fault in the marks of hp_free_all() now rather than on the
+	// first release
+	memset(heap->mark, 0, sizeof(heap->mark));
+}
+
+
+// hp_release()
+// Free the tables of the heap
+//
+void hp_release()
+{
+	free(heap);
+	heap = NULL;
 }
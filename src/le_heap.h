@@ -14,16 +14,21 @@
 
 #include "le_mach.h"
 
-// External variables defined in le_heap.c
+// Heap state (machine context)
 //
-extern uint16_t gs_H;		// Heap limit address
+#define gs_H		(mach_ctx.gs_H)			// Heap limit address
+#define hp_low		(mach_ctx.hp_low)		// Lowest heap limit (peak heap size)
 
 
 // Function declarations
 //
-uint16_t hp_alloc(uint8_t mod, uint16_t sz);
+uint16_t hp_alloc(uint8_t mod, uint16_t sz, uint8_t caller, uint16_t pc);
 void hp_free(uint16_t ptr);
 void hp_init();
+void hp_release();
 void hp_free_all(uint8_t mod, uint16_t limit);
+void hp_unload(uint8_t mod);
+void hp_show();
+void hp_open_report(char *fname);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,82 @@
+//=====================================================
+// le_helper.c
+// Opcode helper functions for native code
+//
+// Each handler of le_mcode_ops.h is compiled into a function, so
+// that native code (JIT-compiled or translated modules) can execute
+// any instruction it does not implement itself. The helpers keep
+// their interpreter state in the oh_ variables.
+//
+// Lilith M-Code Emulator
+//
+// Guido Hoss, 12.03.2022
+//
+// Published by Guido Hoss under GNU Public License V3.
+//=====================================================
+
+#include <config.h>
+#include "le_mach.h"
+#include "le_io.h"
+#include "le_stack.h"
+#include "le_heap.h"
+#include "le_trace.h"
+#include "le_syscall.h"
+#include "le_block.h"
+#include "le_filesys.h"
+#include "le_loader.h"
+#include "le_mcode.h"
+#include "le_aot.h"
+#include "le_verify.h"
+#include "le_jit.h"
+#include "le_helper.h"
+
+// Names used by le_mcode_ops.h
+#define modp		oh_modp
+#define code_p		oh_code_p
+#define modn		oh_modn
+#define exec_mod	oh_exec_mod
+#define counter		oh_count
+
+// Translated code changes L and G itself, so the helpers address
+// the frames through the registers
+#define local_p		(&(dsh_mem[gs_L]))
+#define global_p	(&(dsh_mem[gs_G]))
+#undef set_local_ptr
+#undef set_global_ptr
+#define set_local_ptr()		((void) 0)
+#define set_global_ptr()	((void) 0)
+
+// Native code polls at its loop heads instead
+#define SAFEPOINT	{ }
+
+// Native code dispatches on the PC itself
+#define RESUME		{ }
+
+// The M-codes of native code are charged when it returns to the
+// engine
+#define le_charge(c)	((void) 0)
+
+
+// Opcode helpers
+// Each handler becomes a function oh_op_<opcode>
+//
+void oh_op_none()
+{
+#define OP(n)		} void oh_op_##n() {
+#define OPR(n, m)	} void oh_op_##n() {
+#define OP_DEFAULT	} void oh_op_invalid() {
+#define NEXT		return
+
+#include "le_mcode_ops.h"
+
+#undef OP
+#undef OPR
+#undef OP_DEFAULT
+#undef NEXT
+}
+
+#define T(n)		[n] = oh_op_##n
+#define TR(n, m)	[n ... m] = oh_op_##n
+#define T_INVALID	oh_op_invalid
+
+void (*const oh_tab[256])() = { OP_TABLE };
@@ -0,0 +1,36 @@
+//=====================================================
+// le_helper.h
+// Opcode helper functions for native code
+//
+// Lilith M-Code Emulator
+//
+// Guido Hoss, 12.03.2022
+//
+// Published by Guido Hoss under GNU Public License V3.
+//=====================================================
+
+#ifndef _LE_HELPER_H
+#define _LE_HELPER_H   1
+
+#include "le_mach.h"
+
+// Interpreter state used by the helpers (machine context)
+#define oh_modp		(mach_ctx.oh_modp)		// Current module
+#define oh_code_p	(mach_ctx.oh_code_p)	// Code frame of current module
+#define oh_modn		(mach_ctx.oh_modn)		// Index of current module
+#define oh_exec_mod	(mach_ctx.oh_exec_mod)	// Module of running program
+#define oh_count	(mach_ctx.oh_count)		// M-codes executed by SVC programs
+
+// Helper for each opcode. Executes the instruction with opcode IR
+// whose operands start at PC.
+extern void (*const oh_tab[256])();
+
+// Set current module of the helpers
+#define oh_set_module(n) do { \
+		oh_modn = (n); \
+		oh_modp = &(module_tab[oh_modn]); \
+		oh_code_p = oh_modp->code; \
+		gs_G = oh_modp->data_ofs; \
+	} while (0)
+
+#endif
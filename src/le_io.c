@@ -11,17 +11,33 @@
 
 #include "le_mach.h"
 #include "le_io.h"
+#include "le_lockstep.h"
 
 // Structures for terminal input and output
 //
 WINDOW *app_win;
-char kbd_buf;
+#define kbd_buf		(mach_ctx.kbd_buf)
 enum {
 	LE_COL_NORMAL,
 	LE_COL_ERROR,
 	LE_COL_VERBOSE
 };
 
+// le_kbd_poll()
+// Returns the next character typed on the keyboard or a value
+// <= 0 if there is none
+//
+char le_kbd_poll()
+{
+	if (mach_ctx.term_in != NULL)
+	{
+		int c = getc(mach_ctx.term_in);
+		return (c == EOF) ? 0 : c;
+	}
+	return getch();
+}
+
+
 // le_ioread()
 // Read word from hardware channel
 //
@@ -38,7 +54,7 @@ uint16_t le_ioread(uint16_t chan)
 
 		case 1 : {
 			// Keyboard status register
-			kbd_buf = getch();
+			kbd_buf = LS_IO(le_kbd_poll());
 			return (kbd_buf > 0) ? 1 : 0;
 			break;
 		}
@@ -70,6 +86,21 @@ void le_iowrite(uint16_t chan, uint16_t w)
 //
 void le_putchar(char c)
 {
+	// In a lockstep run only the reference machine prints
+	if (mach_ctx.ls != NULL)
+	{
+		ls_output(c);
+		if (mach_ctx.ls->replay)
+			return;
+	}
+
+	// Machines with their own terminal stream bypass ncurses
+	if (mach_ctx.term_out != NULL)
+	{
+		putc((c == 0177) ? '\010' : c, mach_ctx.term_out);
+		return;
+	}
+
 	switch (c)
 	{
 		case 0177 :
@@ -124,6 +155,18 @@ void le_error(bool ex_code, int errnum, char *msg, ...)
 	va_list arg_p;
 	va_start(arg_p, msg);
 
+	// Print to stderr if the terminal is not initialized
+	if (app_win == NULL)
+	{
+		vfprintf(stderr, msg, arg_p);
+		if (errnum != 0)
+			fprintf(stderr, " (%s)", strerror(errno));
+		fprintf(stderr, "\n");
+		if (ex_code != 0)
+			exit(ex_code);
+		return;
+	}
+
 	// Print message and variable arguments
 	wattron(app_win, COLOR_PAIR(LE_COL_ERROR));
 	vw_printw(app_win, msg, arg_p);
@@ -152,6 +195,11 @@ void le_verbose_msg(char *msg, ...)
 		va_start(arg_p, msg);
 
 		// Print message and variable arguments
+		if (app_win == NULL)
+		{
+			vfprintf(stderr, msg, arg_p);
+			return;
+		}
 		wattron(app_win, COLOR_PAIR(LE_COL_VERBOSE));
 		vw_printw(app_win, msg, arg_p);
 		wattroff(app_win, COLOR_PAIR(LE_COL_VERBOSE));
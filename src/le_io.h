@@ -16,6 +16,7 @@
 
 // Function declarations
 //
+char le_kbd_poll();
 uint16_t le_ioread(uint16_t chan);
 void le_iowrite(uint16_t chan, uint16_t w);
 void le_putchar(char ch);
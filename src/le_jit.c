@@ -0,0 +1,1317 @@
+//=====================================================
+// le_jit.c
+// Template-based x86-64 JIT compiler
+//
+// Procedures are compiled after jit_threshold calls. The native
+// code keeps using the machine state in main memory and the
+// expression stack, so control can pass between compiled and
+// interpreted code at any instruction boundary:
+//
+// - Frequent simple instructions (constants, local/global access,
+//   stack addressed and indexed loads and stores, integer arithmetic
+//   and comparisons, jumps) are emitted inline.
+// - CHKZ and ENTR are emitted inline too, but call their helper to
+//   raise the trap when the check fails.
+// - All other instructions call their opcode helper (le_helper.c).
+// - Calls and returns execute through their helper. They continue
+//   in native code if their target has been compiled and no work is
+//   pending. Otherwise they leave the native code, and the
+//   pre-decoded engine continues at the new PC.
+// - SVC, TRAP, coroutine transfers, I/O and all instructions which
+//   cannot be compiled safely exit to the interpreter.
+//
+// Loops are traced separately: after JIT_LOOP_THRESHOLD executions
+// of a backward jump (JPB, JPBC, FOR2), one iteration is recorded
+// through the helpers, following CLL calls, and compiled into a
+// linear loop with guards for the recorded jump directions.
+//
+// Native code is entered only while the monitor is inactive and no
+// work is pending. Loop heads are safepoints which leave the native
+// code when work is pending, so that the interpreter does it.
+// Compiled code is listed in /tmp/perf-<pid>.map as Module.procN
+// or Module.loopPC for perf, with the PC of the loop in octal as in
+// the monitor and trap messages.
+//
+// Lilith M-Code Emulator
+//
+// Guido Hoss, 12.03.2022
+//
+// Published by Guido Hoss under GNU Public License V3.
+//=====================================================
+
+#include <config.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include "le_mach.h"
+#include "le_stack.h"
+#include "le_io.h"
+#include "le_trace.h"
+#include "le_mcode.h"
+#include "le_predec.h"
+#include "le_helper.h"
+#include "le_jit.h"
+
+uint32_t jit_threshold = JIT_THRESHOLD;
+
+#ifdef LE_JIT
+
+// Instruction classes for code generation
+enum jit_kind_t {
+	JK_HELPER,		// Call helper, continue with next instruction
+	JK_LIT,			// Push constant
+	JK_LLA,			// Push local address
+	JK_LLW,			// Load local word
+	JK_SLW,			// Store local word
+	JK_LDA,			// Load word at absolute address
+	JK_STA,			// Store word at absolute address
+	JK_BIN,			// Integer add/subtract, logical operations
+	JK_LSW,			// Load stack addressed word
+	JK_SSW,			// Store stack addressed word
+	JK_LXW,			// Load indexed word
+	JK_LXB,			// Load indexed byte
+	JK_COPT,		// Copy top of stack
+	JK_CHKZ,		// Index check (helper traps)
+	JK_ENTR,		// Enter procedure (helper traps)
+	JK_CMP,			// Integer comparisons
+	JK_JPC,			// Conditional jump
+	JK_JP,			// Jump
+	JK_BRANCH,		// Call helper, continue at one of two targets
+	JK_CALL,		// Call helper and leave; return point is an entry
+	JK_LEAVE,		// Call helper and leave
+	JK_EXIT			// Leave; instruction runs in the interpreter
+};
+
+// Discovery flags for code frame offsets
+#define F_CODE		1		// Instruction is compiled
+#define F_LABEL		2		// Jump target or entry point
+#define F_ENTRY		4		// Entry point from the interpreter
+#define F_LOOP		8		// Target of a backward jump (safepoint)
+#define F_RETURN	16		// Return point of a call
+
+// Native code buffer of the machine (machine context). Native code
+// addresses the state of the machine that compiled it.
+#define jit_buf		(mach_ctx.jit_buf)
+#define jit_used	(mach_ctx.jit_used)
+
+// M-codes executed by native code (addressed through r15)
+#define jit_count	(mach_ctx.jit_count)
+
+// Perf map shared by all machines
+FILE *jit_map = NULL;
+pthread_mutex_t jit_map_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+// jit_kind()
+// Returns the code generation class of the instruction at pc
+//
+enum jit_kind_t jit_kind(mod_entry_t *mod, uint16_t pc)
+{
+	uint8_t op = mod->code[pc];
+	const void *h = (mod->jit[pc].handler != NULL)
+		? mod->jit[pc].handler : mod->pcode[pc].handler;
+
+	// Instructions at the end of the code frame and instructions whose
+	// operands the pre-decoder did not resolve run in the interpreter
+	bool decoded = (h != pd_generic[op]);
+	if (pc + le_opcode_len(op) >= mod->code_sz)
+		return JK_EXIT;
+
+	switch (op)
+	{
+		case 000 ... 020 :
+		case 022 :
+		case 025 :
+		case 027 :
+		case 0325 :
+			return decoded ? JK_LIT : JK_EXIT;
+
+		case 024 :
+			return decoded ? JK_LLA : JK_EXIT;
+
+		case 040 :
+		case 044 ... 057 :
+			return decoded ? JK_LLW : JK_EXIT;
+
+		case 060 :
+		case 064 ... 077 :
+			return decoded ? JK_SLW : JK_EXIT;
+
+		case 042 :
+		case 0100 :
+		case 0102 ... 0117 :
+			return decoded ? JK_LDA : JK_EXIT;
+
+		case 062 :
+		case 0120 :
+		case 0122 ... 0137 :
+			return decoded ? JK_STA : JK_EXIT;
+
+		case 030 :
+		case 032 :
+		case 034 :
+			return decoded ? JK_JPC : JK_EXIT;
+
+		case 031 :
+		case 033 :
+		case 035 :
+			return decoded ? JK_JP : JK_EXIT;
+
+		case 036 :
+		case 037 :
+		case 0300 :
+		case 0301 :
+			return decoded ? JK_BRANCH : JK_EXIT;
+
+		case 0270 :
+		case 0271 :
+		case 0320 ... 0322 :
+		case 0330 :
+		case 0331 :
+			return JK_BIN;
+
+		case 0140 ... 0157 :
+			return JK_LSW;
+
+		case 0160 ... 0177 :
+			return JK_SSW;
+
+		case 0206 :
+			return JK_LXW;
+
+		case 0205 :
+			return JK_LXB;
+
+		case 0265 :
+			return JK_COPT;
+
+		case 0306 :
+			return JK_CHKZ;
+
+		case 0353 :
+			return JK_ENTR;
+
+		case 0252 ... 0255 :
+		case 0310 ... 0315 :
+			return JK_CMP;
+
+		case 0355 ... 0377 :
+			return JK_CALL;
+
+		case 0302 :
+		case 0303 :
+		case 0354 :
+			return JK_LEAVE;
+
+		case 021 :
+		case 0214 :
+		case 0215 :
+		case 0240 ... 0244 :
+		case 0246 ... 0251 :
+		case 0256 :
+		case 0257 :
+		case 0304 :
+		case 0342 ... 0345 :
+			return JK_EXIT;
+
+		default :
+			return JK_HELPER;
+	}
+}
+
+
+// jit_target()
+// Returns the resolved jump target of the instruction at pc
+//
+uint16_t jit_target(mod_entry_t *mod, uint16_t pc)
+{
+	return mod->pcode[pc].target - mod->pcode;
+}
+
+
+// jit_init_module()
+// Prepares a pre-decoded module for the JIT: procedure entry points
+// count their calls until the procedure is compiled, and backward
+// jumps count their executions until the loop is traced
+//
+void jit_init_module(mod_entry_t *mod)
+{
+	free(mod->jit);
+	mod->jit = calloc((mod->code_sz > 0) ? mod->code_sz : 1, sizeof(jit_pc_t));
+	if (mod->jit == NULL)
+		le_error(1, errno, "Can't allocate JIT state for %s", mod->id.name);
+
+	for (uint16_t i = 0; i < mod->proc_n; i ++)
+	{
+		uint16_t e = mod->proc[i];
+		if ((e == 0) || (e >= mod->code_sz) || (mod->jit[e].handler != NULL))
+			continue;
+
+		mod->jit[e].handler = mod->pcode[e].handler;
+		mod->pcode[e].handler = pd_handler[PD_JIT_COUNT];
+	}
+
+	for (uint32_t pc = 0; pc < mod->code_sz; pc ++)
+	{
+		pd_instr_t *ip = &(mod->pcode[pc]);
+		if ((ip->handler != pd_handler[PD_JPB]) && (ip->handler != pd_handler[PD_JPBC])
+			&& ((ip->handler != pd_handler[PD_FOR2]) || (ip->target - mod->pcode > pc)))
+			continue;
+
+		mod->jit[pc].handler = ip->handler;
+		ip->handler = pd_handler[PD_JIT_LOOP];
+	}
+}
+
+
+// Code generation
+// The emitters append to jit_p. Instructions executed since the
+// last update of jit_count are counted in jit_pending.
+//
+#define jit_p		(mach_ctx.jit_p)
+#define jit_exit	(mach_ctx.jit_exit)
+#define jit_pending	(mach_ctx.jit_pending)
+
+#define EMIT(...) do { \
+		const uint8_t _b[] = { __VA_ARGS__ }; \
+		memcpy(jit_p, _b, sizeof(_b)); \
+		jit_p += sizeof(_b); \
+	} while (0)
+
+void jit_imm16(uint16_t x) { memcpy(jit_p, &x, 2); jit_p += 2; }
+void jit_imm32(uint32_t x) { memcpy(jit_p, &x, 4); jit_p += 4; }
+void jit_imm64(const void *x) { memcpy(jit_p, &x, 8); jit_p += 8; }
+
+
+// jit_room()
+// Returns true if the code buffer has room for one more instruction
+// template or entry stub
+//
+bool jit_room()
+{
+	return (jit_p + 192 < jit_buf + JIT_CODE_SZ);
+}
+
+
+// jit_begin()
+// Starts a new block of native code with its common exit, which
+// restores the callee-saved registers and returns to jit_run().
+// Returns false if the code buffer is full.
+//
+bool jit_begin()
+{
+	if (jit_buf == NULL)
+	{
+		jit_buf = mmap(NULL, JIT_CODE_SZ, PROT_READ | PROT_WRITE | PROT_EXEC,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (jit_buf == MAP_FAILED)
+			le_error(1, errno, "Can't allocate JIT code buffer");
+	}
+
+	jit_p = jit_exit = jit_buf + jit_used;
+	jit_pending = 0;
+	if (! jit_room())
+		return false;
+
+	EMIT(0x41, 0x5f, 0x41, 0x5e, 0x41, 0x5d, 0x41, 0x5c, 0x5b, 0xc3);
+	return true;
+}
+
+
+// jit_end()
+// Commits the current block and lists it in the perf map
+//
+void jit_end(mod_entry_t *mod, const char *fmt, int n)
+{
+	uint8_t *start = jit_buf + jit_used;
+	jit_used = jit_p - jit_buf;
+
+	pthread_mutex_lock(&jit_map_lock);
+	if (jit_map == NULL)
+	{
+		char fn[32];
+		snprintf(fn, sizeof(fn), "/tmp/perf-%d.map", getpid());
+		jit_map = fopen(fn, "w+");
+	}
+	if (jit_map != NULL)
+	{
+		fprintf(jit_map, "%lx %lx %s.",
+			(unsigned long) start, (unsigned long) (jit_p - start), mod->id.name);
+		fprintf(jit_map, fmt, n);
+		fputc('\n', jit_map);
+		fflush(jit_map);
+	}
+	pthread_mutex_unlock(&jit_map_lock);
+}
+
+
+// jit_entry()
+// Emits an entry stub which saves the callee-saved registers, loads
+// the base registers and jumps to target. Returns the stub address.
+// Registers in native code: rbx = expression stack, r12 = main
+// memory, r13 = &SP, r14 = &L, r15 = &jit_count
+//
+const void *jit_entry(const uint8_t *target)
+{
+	const void *stub = jit_p;
+
+	EMIT(0x53, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57);
+	EMIT(0x48, 0xbb);
+	jit_imm64(exs_mem);
+	EMIT(0x49, 0xbc);
+	jit_imm64(dsh_mem);
+	EMIT(0x49, 0xbd);
+	jit_imm64(&gs_SP);
+	EMIT(0x49, 0xbe);
+	jit_imm64(&gs_L);
+	EMIT(0x49, 0xbf);
+	jit_imm64(&jit_count);
+	EMIT(0xe9);
+	jit_imm32(target - (jit_p + 4));
+	return stub;
+}
+
+
+// jit_jmp_exit()
+// Emits a jump to the common exit
+//
+void jit_jmp_exit()
+{
+	EMIT(0xe9);
+	jit_imm32(jit_exit - (jit_p + 4));
+}
+
+
+// jit_flush()
+// Adds the pending instructions to jit_count
+//
+void jit_flush()
+{
+	if (jit_pending > 0)
+	{
+		EMIT(0x41, 0x81, 0x07);					// add dword [r15], n
+		jit_imm32(jit_pending);
+		jit_pending = 0;
+	}
+}
+
+
+// jit_set_reg()
+// Emits mov word [reg], x
+//
+void jit_set_reg(uint16_t *reg, uint16_t x)
+{
+	EMIT(0x48, 0xb8);
+	jit_imm64(reg);
+	EMIT(0x66, 0xc7, 0x00);
+	jit_imm16(x);
+}
+
+
+// jit_check_pc()
+// Emits a comparison of PC with x, followed by the opcode of a
+// conditional jump (rel32 to be appended by the caller)
+//
+void jit_check_pc(uint16_t x, uint8_t jcc)
+{
+	EMIT(0x48, 0xb8);							// mov rax, &gs_PC
+	jit_imm64(&gs_PC);
+	EMIT(0x0f, 0xb7, 0x00);						// movzx eax, word [rax]
+	EMIT(0x3d);									// cmp eax, x
+	jit_imm32(x);
+	EMIT(0x0f, jcc);
+}
+
+
+// jit_poll()
+// Emits a safepoint which leaves the native code at pc if work is
+// pending
+//
+void jit_poll(uint16_t pc)
+{
+	EMIT(0x48, 0xb8);							// mov rax, &pending
+	jit_imm64((const void *) &(mach_ctx.pending));
+	EMIT(0x83, 0x38, 0x00);						// cmp dword [rax], 0
+	EMIT(0x74, 0x14);							// je +20
+	jit_set_reg(&gs_PC, pc);					// (15 bytes)
+	jit_jmp_exit();								// (5 bytes)
+}
+
+
+// jit_chain()
+// Emits a jump to the compiled code at PC of the current module after
+// a call or return, whose helper has run: field is the offset of the
+// native address (body or ret) in jit_pc_t. Leaves the native code
+// if work is pending or PC has not been compiled.
+//
+void jit_chain(uint8_t field)
+{
+	EMIT(0x48, 0xb8);							// mov rax, &pending
+	jit_imm64((const void *) &(mach_ctx.pending));
+	EMIT(0x83, 0x38, 0x00);						// cmp dword [rax], 0
+	EMIT(0x0f, 0x85);							// jne exit
+	jit_imm32(jit_exit - (jit_p + 4));
+	EMIT(0x48, 0xba);							// mov rdx, &oh_modp
+	jit_imm64(&oh_modp);
+	EMIT(0x48, 0x8b, 0x12);						// mov rdx, [rdx]
+	EMIT(0x48, 0x8b, 0x92);						// mov rdx, [rdx+jit]
+	jit_imm32(offsetof(mod_entry_t, jit));
+	EMIT(0x48, 0x85, 0xd2);						// test rdx, rdx
+	EMIT(0x0f, 0x84);							// jz exit
+	jit_imm32(jit_exit - (jit_p + 4));
+	EMIT(0x48, 0xb8);							// mov rax, &gs_PC
+	jit_imm64(&gs_PC);
+	EMIT(0x0f, 0xb7, 0x00);						// movzx eax, word [rax]
+	EMIT(0x6b, 0xc0, sizeof(jit_pc_t));			// imul eax, eax, size
+	EMIT(0x48, 0x8b, 0x44, 0x02, field);		// mov rax, [rdx+rax+field]
+	EMIT(0x48, 0x85, 0xc0);						// test rax, rax
+	EMIT(0x0f, 0x84);							// jz exit
+	jit_imm32(jit_exit - (jit_p + 4));
+	EMIT(0xff, 0xe0);							// jmp rax
+}
+
+
+// jit_call_helper()
+// Emits a call of the helper of the instruction at pc
+//
+void jit_call_helper(mod_entry_t *mod, uint16_t pc)
+{
+	uint8_t op = mod->code[pc];
+
+	jit_set_reg(&gs_PC, pc + 1);
+	jit_set_reg(&gs_IR, op);
+	EMIT(0x48, 0xb8);
+	jit_imm64(oh_tab[op]);
+	EMIT(0xff, 0xd0);
+}
+
+
+// Expression stack access through cx
+//
+void jit_push_cx()
+{
+	EMIT(0x41, 0x0f, 0xb6, 0x45, 0x00);			// movzx eax, byte [r13]
+	EMIT(0x66, 0x89, 0x0c, 0x43);				// mov [rbx+rax*2], cx
+	EMIT(0x41, 0xfe, 0x45, 0x00);				// inc byte [r13]
+}
+
+void jit_pop_cx()
+{
+	EMIT(0x41, 0xfe, 0x4d, 0x00);				// dec byte [r13]
+	EMIT(0x41, 0x0f, 0xb6, 0x45, 0x00);			// movzx eax, byte [r13]
+	EMIT(0x0f, 0xb7, 0x0c, 0x43);				// movzx ecx, word [rbx+rax*2]
+}
+
+
+// jit_local_adr()
+// Emits rdx = (uint16_t) (L + x)
+//
+void jit_local_adr(uint16_t x)
+{
+	EMIT(0x41, 0x0f, 0xb7, 0x16);				// movzx edx, word [r14]
+	EMIT(0x66, 0x81, 0xc2);						// add dx, x
+	jit_imm16(x);
+	EMIT(0x0f, 0xb7, 0xd2);						// movzx edx, dx
+}
+
+
+// jit_compare()
+// Pops the operands j and i of a comparison and compares i with j
+//
+void jit_compare()
+{
+	jit_pop_cx();
+	EMIT(0x89, 0xce);							// mov esi, ecx
+	jit_pop_cx();
+	EMIT(0x66, 0x39, 0xf1);						// cmp cx, si
+}
+
+
+// jit_cond()
+// Returns the x86 condition code of the comparison opcode op
+//
+uint8_t jit_cond(uint8_t op)
+{
+	switch (op)
+	{
+		case 0310 : return 0x4;		// EQL: e
+		case 0311 : return 0x5;		// NEQ: ne
+		case 0312 : return 0xc;		// LSS: l
+		case 0313 : return 0xe;		// LEQ: le
+		case 0314 : return 0xf;		// GTR: g
+		case 0315 : return 0xd;		// GEQ: ge
+		case 0252 : return 0x2;		// ULSS: b
+		case 0253 : return 0x6;		// ULEQ: be
+		case 0254 : return 0x7;		// UGTR: a
+		default : return 0x3;		// UGEQ: ae
+	}
+}
+
+
+// jit_slow()
+// Emits a jump over a call of the helper of the instruction at pc,
+// which the preceding fast path enters through a conditional jump
+// to its end
+//
+void jit_slow(mod_entry_t *mod, uint16_t pc)
+{
+	EMIT(0xeb, 0x00);							// jmp done
+	uint8_t *jmp = jit_p;
+	jit_call_helper(mod, pc);
+	jmp[-1] = jit_p - jmp;
+}
+
+
+// jit_straight()
+// Emits the instruction at pc if it is of a kind without control
+// transfer (JK_HELPER ... JK_CMP) and counts it
+//
+void jit_straight(mod_entry_t *mod, uint16_t pc, enum jit_kind_t kind)
+{
+	pd_instr_t *ip = &(mod->pcode[pc]);
+	uint8_t op = mod->code[pc];
+
+	jit_pending ++;
+	switch (kind)
+	{
+		case JK_LIT :
+			EMIT(0x41, 0x0f, 0xb6, 0x45, 0x00);	// movzx eax, byte [r13]
+			EMIT(0x66, 0xc7, 0x04, 0x43);		// mov word [rbx+rax*2], a
+			jit_imm16(ip->a);
+			EMIT(0x41, 0xfe, 0x45, 0x00);		// inc byte [r13]
+			break;
+
+		case JK_LLA :
+			EMIT(0x41, 0x0f, 0xb7, 0x0e);		// movzx ecx, word [r14]
+			EMIT(0x81, 0xc1);					// add ecx, a
+			jit_imm32(ip->a);
+			jit_push_cx();
+			break;
+
+		case JK_LLW :
+			jit_local_adr(ip->a);
+			EMIT(0x41, 0x0f, 0xb7, 0x0c, 0x54);	// movzx ecx, [r12+rdx*2]
+			jit_push_cx();
+			break;
+
+		case JK_SLW :
+			jit_pop_cx();
+			jit_local_adr(ip->a);
+			EMIT(0x66, 0x41, 0x89, 0x0c, 0x54);	// mov [r12+rdx*2], cx
+			break;
+
+		case JK_LDA :
+			EMIT(0x41, 0x0f, 0xb7, 0x8c, 0x24);	// movzx ecx, [r12+a*2]
+			jit_imm32(ip->a * 2);
+			jit_push_cx();
+			break;
+
+		case JK_STA :
+			jit_pop_cx();
+			EMIT(0x66, 0x41, 0x89, 0x8c, 0x24);	// mov [r12+a*2], cx
+			jit_imm32(ip->a * 2);
+			break;
+
+		case JK_BIN : {
+			uint8_t alu;
+			switch (op)
+			{
+				case 0270 :
+				case 0330 : alu = 0x01; break;		// add
+				case 0271 :
+				case 0331 : alu = 0x29; break;		// sub
+				case 0320 : alu = 0x09; break;		// or
+				case 0321 : alu = 0x31; break;		// xor
+				default : alu = 0x21; break;		// and
+			}
+			jit_pop_cx();
+			EMIT(0x89, 0xce);					// mov esi, ecx
+			jit_pop_cx();
+			EMIT(0x66, alu, 0xf1);				// op cx, si
+			jit_push_cx();
+			break;
+		}
+
+		case JK_LSW :
+			jit_pop_cx();
+			EMIT(0x83, 0xc1, op & 0xf);			// add ecx, n
+			EMIT(0x41, 0x0f, 0xb7, 0x0c, 0x4c);	// movzx ecx, [r12+rcx*2]
+			jit_push_cx();
+			break;
+
+		case JK_SSW :
+			jit_pop_cx();
+			EMIT(0x89, 0xce);					// mov esi, ecx
+			jit_pop_cx();
+			EMIT(0x83, 0xc1, op & 0xf);			// add ecx, n
+			EMIT(0x66, 0x41, 0x89, 0x34, 0x4c);	// mov [r12+rcx*2], si
+			break;
+
+		case JK_LXW :
+			jit_pop_cx();
+			EMIT(0x89, 0xce);					// mov esi, ecx
+			jit_pop_cx();
+			EMIT(0x01, 0xf1);					// add ecx, esi
+			EMIT(0x41, 0x0f, 0xb7, 0x0c, 0x4c);	// movzx ecx, [r12+rcx*2]
+			jit_push_cx();
+			break;
+
+		case JK_LXB :
+			jit_pop_cx();
+			EMIT(0x89, 0xce);					// mov esi, ecx
+			jit_pop_cx();
+			EMIT(0x89, 0xf2);					// mov edx, esi
+			EMIT(0xd1, 0xea);					// shr edx, 1
+			EMIT(0x01, 0xd1);					// add ecx, edx
+			EMIT(0x41, 0x0f, 0xb7, 0x0c, 0x4c);	// movzx ecx, [r12+rcx*2]
+			EMIT(0x40, 0xf6, 0xc6, 0x01);		// test sil, 1
+			EMIT(0x74, 0x05);					// jz high
+			EMIT(0x0f, 0xb6, 0xc9);				// movzx ecx, cl
+			EMIT(0xeb, 0x03);					// jmp push
+			EMIT(0xc1, 0xe9, 0x08);				// high: shr ecx, 8
+			jit_push_cx();
+			break;
+
+		case JK_COPT :
+			EMIT(0x41, 0x0f, 0xb6, 0x45, 0x00);	// movzx eax, byte [r13]
+			EMIT(0x0f, 0xb7, 0x4c, 0x43, 0xfe);	// movzx ecx, [rbx+rax*2-2]
+			jit_push_cx();
+			break;
+
+		case JK_CHKZ : {
+			// Pop the bound if 0 <= i <= bound, else trap in the helper
+			EMIT(0x41, 0x0f, 0xb6, 0x45, 0x00);	// movzx eax, byte [r13]
+			EMIT(0x0f, 0xb7, 0x4c, 0x43, 0xfe);	// movzx ecx, [rbx+rax*2-2]
+			EMIT(0x0f, 0xb7, 0x54, 0x43, 0xfc);	// movzx edx, [rbx+rax*2-4]
+			EMIT(0x66, 0x85, 0xd2);				// test dx, dx
+			EMIT(0x78, 0x0b);					// js trap
+			EMIT(0x66, 0x39, 0xca);				// cmp dx, cx
+			EMIT(0x7f, 0x06);					// jg trap
+			EMIT(0x41, 0xfe, 0x4d, 0x00);		// dec byte [r13]
+			jit_slow(mod, pc);
+			break;
+		}
+
+		case JK_ENTR :
+			// Add n to S unless the stack overflows, else trap in the
+			// helper
+			EMIT(0x48, 0xb8);					// mov rax, &gs_S
+			jit_imm64(&gs_S);
+			EMIT(0x0f, 0xb7, 0x08);				// movzx ecx, word [rax]
+			EMIT(0x81, 0xf9);					// cmp ecx, size - n
+			jit_imm32(MACH_DSHMEM_SZ - mod->code[pc + 1]);
+			EMIT(0x73, 0x07);					// jae trap
+			EMIT(0x66, 0x81, 0x00);				// add word [rax], n
+			jit_imm16(mod->code[pc + 1]);
+			jit_slow(mod, pc);
+			break;
+
+		case JK_CMP :
+			jit_compare();
+			EMIT(0x0f, 0x90 | jit_cond(op), 0xc2);	// setcc dl
+			EMIT(0x0f, 0xb6, 0xca);					// movzx ecx, dl
+			jit_push_cx();
+			break;
+
+		default :
+			jit_call_helper(mod, pc);
+			break;
+	}
+}
+
+
+// jit_compile()
+// Compiles the procedure at entry point pc of module mod and
+// installs its native entry points. Returns false if the procedure
+// could not be compiled.
+//
+bool jit_compile(mod_entry_t *mod, uint16_t entry)
+{
+	uint32_t sz = mod->code_sz;
+	uint32_t n = 0;				// Number of instructions
+	uint8_t *flag;				// Discovery flags
+	uint16_t *work;				// Discovery work list
+	uint32_t work_n = 0;
+	uint32_t *lab;				// Native offsets of instructions
+	struct {
+		uint32_t pos;			// Offset of rel32 field
+		uint16_t pc;			// Target instruction
+	} *fix;
+	uint32_t fix_n = 0;
+	bool ok = false;
+
+	flag = calloc(sz, 1);
+	work = malloc(sz * sizeof(uint16_t));
+	lab = malloc(sz * sizeof(uint32_t));
+	fix = malloc((sz * 2 + 1) * sizeof(*fix));
+	if ((flag == NULL) || (work == NULL) || (lab == NULL) || (fix == NULL))
+		le_error(1, errno, "Can't allocate JIT tables");
+
+	// Add instruction at pc to the procedure
+	void add(uint16_t pc, uint8_t f)
+	{
+		if (! (flag[pc] & F_CODE))
+		{
+			flag[pc] |= F_CODE;
+			work[work_n ++] = pc;
+			n ++;
+		}
+		flag[pc] |= f;
+	}
+
+	// Flag for the target of the jump at pc
+	uint8_t back(uint16_t pc)
+	{
+		return (jit_target(mod, pc) <= pc) ? F_LOOP : 0;
+	}
+
+	// Part 1: Find all instructions reachable from the entry point
+	// without following calls and returns
+	add(entry, F_LABEL | F_ENTRY);
+	while ((work_n > 0) && (n <= JIT_PROC_MAX))
+	{
+		uint16_t pc = work[-- work_n];
+		uint16_t next = pc + le_opcode_len(mod->code[pc]);
+
+		switch (jit_kind(mod, pc))
+		{
+			case JK_JP :
+				add(jit_target(mod, pc), F_LABEL | back(pc));
+				break;
+
+			case JK_JPC :
+				add(jit_target(mod, pc), F_LABEL | back(pc));
+				add(next, 0);
+				break;
+
+			case JK_BRANCH :
+				add(jit_target(mod, pc), F_LABEL | back(pc));
+				add(next, F_LABEL);
+				break;
+
+			case JK_CALL :
+				// Callee returns here
+				if (next < sz)
+					add(next, F_LABEL | F_ENTRY | F_RETURN);
+				break;
+
+			case JK_EXIT :
+				// Interpreter continues here after the instruction
+				if (next < sz)
+					add(next, F_LABEL | F_ENTRY);
+				break;
+
+			case JK_LEAVE :
+				break;
+
+			default :
+				add(next, 0);
+				break;
+		}
+	}
+	if ((n > JIT_PROC_MAX) || ! jit_begin())
+		goto done;
+
+	// Part 2: Generate code
+	uint8_t *start = jit_exit;
+	int32_t fall = -1;			// Fall-through target of last instruction
+	int32_t skip = -1;			// Instruction fused with its predecessor
+
+	// rel32 to instruction at pc, patched after code generation
+	void rel(uint16_t pc)
+	{
+		fix[fix_n].pos = jit_p - start;
+		fix[fix_n ++].pc = pc;
+		jit_imm32(0);
+	}
+
+	for (uint32_t pc = 0; pc < sz; pc ++)
+	{
+		if (! (flag[pc] & F_CODE) || (pc == skip))
+			continue;
+
+		if (! jit_room())
+			goto done;
+
+		// Continue at fall-through target if not adjacent
+		if ((fall >= 0) && (fall != pc))
+		{
+			jit_flush();
+			EMIT(0xe9);
+			rel(fall);
+		}
+		fall = -1;
+
+		if (flag[pc] & F_LABEL)
+			jit_flush();
+		lab[pc] = jit_p - start;
+		if (flag[pc] & F_LOOP)
+			jit_poll(pc);
+
+		uint8_t op = mod->code[pc];
+		uint16_t next = pc + le_opcode_len(op);
+		enum jit_kind_t kind = jit_kind(mod, pc);
+
+		switch (kind)
+		{
+			case JK_CMP :
+				if ((flag[next] & (F_CODE | F_LABEL)) == F_CODE
+					&& (jit_kind(mod, next) == JK_JPC))
+				{
+					// Fuse with following conditional jump
+					// (count first, the addition changes the flags)
+					jit_pending += 2;
+					jit_flush();
+					jit_compare();
+					EMIT(0x0f, 0x80 | (jit_cond(op) ^ 1));	// jncc target
+					rel(jit_target(mod, next));
+					skip = next;
+					fall = next + le_opcode_len(mod->code[next]);
+					break;
+				}
+				// Fall through
+
+			case JK_HELPER :
+			case JK_LIT :
+			case JK_LLA :
+			case JK_LLW :
+			case JK_SLW :
+			case JK_LDA :
+			case JK_STA :
+			case JK_BIN :
+			case JK_LSW :
+			case JK_SSW :
+			case JK_LXW :
+			case JK_LXB :
+			case JK_COPT :
+			case JK_CHKZ :
+			case JK_ENTR :
+				jit_straight(mod, pc, kind);
+				fall = next;
+				break;
+
+			case JK_JPC :
+				jit_pending ++;
+				jit_flush();
+				jit_pop_cx();
+				EMIT(0x66, 0x85, 0xc9);			// test cx, cx
+				EMIT(0x0f, 0x84);				// jz target
+				rel(jit_target(mod, pc));
+				fall = next;
+				break;
+
+			case JK_JP :
+				jit_pending ++;
+				jit_flush();
+				EMIT(0xe9);						// jmp target
+				rel(jit_target(mod, pc));
+				break;
+
+			case JK_BRANCH :
+				jit_pending ++;
+				jit_flush();
+				jit_call_helper(mod, pc);
+				jit_check_pc(jit_target(mod, pc), 0x84);	// je target
+				rel(jit_target(mod, pc));
+				fall = next;
+				break;
+
+			case JK_CALL :
+				jit_pending ++;
+				jit_flush();
+				jit_call_helper(mod, pc);
+				jit_chain(offsetof(jit_pc_t, body));
+				break;
+
+			case JK_LEAVE :
+				jit_pending ++;
+				jit_flush();
+				jit_call_helper(mod, pc);
+				if (op == 0354)
+					jit_chain(offsetof(jit_pc_t, ret));
+				else
+					jit_jmp_exit();
+				break;
+
+			case JK_EXIT :
+				jit_flush();
+				jit_set_reg(&gs_PC, pc);
+				jit_jmp_exit();
+				break;
+		}
+	}
+	if (fall >= 0)
+	{
+		jit_flush();
+		EMIT(0xe9);
+		rel(fall);
+	}
+
+	// Resolve jumps
+	for (uint32_t i = 0; i < fix_n; i ++)
+	{
+		int32_t r = lab[fix[i].pc] - (fix[i].pos + 4);
+		memcpy(start + fix[i].pos, &r, 4);
+	}
+
+	// Part 3: Generate entry stubs and install entry points
+	for (uint32_t pc = 0; pc < sz; pc ++)
+	{
+		if (! (flag[pc] & F_ENTRY) || (jit_kind(mod, pc) == JK_EXIT)
+			|| (mod->jit[pc].native != NULL))
+			continue;
+
+		if (! jit_room())
+			goto done;
+
+		jit_pc_t *j = &(mod->jit[pc]);
+		if (j->handler == NULL)
+			j->handler = mod->pcode[pc].handler;
+		j->native = jit_entry(start + lab[pc]);
+		mod->pcode[pc].handler = pd_handler[PD_JIT];
+
+		// Targets of calls and returns in native code
+		if (pc == entry)
+			j->body = start + lab[pc];
+		else if (flag[pc] & F_RETURN)
+			j->ret = start + lab[pc];
+	}
+
+	// Register procedure for perf
+	uint16_t i = 0;
+	while ((i < mod->proc_n) && (mod->proc[i] != entry))
+		i ++;
+	jit_end(mod, "proc%d", i);
+	ok = true;
+
+done:
+	free(flag);
+	free(work);
+	free(lab);
+	free(fix);
+	return ok;
+}
+
+
+// Trace recorded by jit_trace() (per thread)
+__thread struct {
+	uint16_t pc;			// Instruction
+	uint16_t next;			// Observed successor
+} jit_tr[JIT_TRACE_MAX];
+
+
+// jit_compile_trace()
+// Compiles the n instructions in jit_tr, which form a loop through
+// the backward jump at jit_tr[0]. Conditional jumps and branches are
+// compiled for the recorded direction with a guard which leaves the
+// native code when the other direction is taken. Calls and returns
+// within the trace are executed by their helpers without leaving.
+// Returns the native entry point or NULL.
+//
+const void *jit_compile_trace(mod_entry_t *mod, uint16_t n)
+{
+	struct {
+		uint8_t *pos;			// Address of rel32 field
+		uint16_t pc;			// PC to continue at in the interpreter
+	} side[JIT_TRACE_MAX];
+	uint16_t side_n = 0;
+
+	if (! jit_begin())
+		return NULL;
+	uint8_t *loop = jit_p;
+	jit_poll(jit_tr[0].pc);
+
+	// Conditional jump to a side exit continuing at pc
+	void guard(uint8_t jcc, uint16_t pc)
+	{
+		EMIT(0x0f, jcc);
+		side[side_n].pos = jit_p;
+		side[side_n ++].pc = pc;
+		jit_imm32(0);
+	}
+
+	for (uint16_t i = 0; i < n; i ++)
+	{
+		if (! jit_room())
+			return NULL;
+
+		uint16_t pc = jit_tr[i].pc;
+		uint8_t op = mod->code[pc];
+		uint16_t next = pc + le_opcode_len(op);
+		enum jit_kind_t kind = jit_kind(mod, pc);
+
+		switch (kind)
+		{
+			case JK_CMP :
+				if ((i + 1 < n) && (jit_kind(mod, jit_tr[i + 1].pc) == JK_JPC))
+				{
+					// Fuse with following conditional jump; the jump
+					// is taken if the condition is false
+					uint16_t jpc = jit_tr[++ i].pc;
+					uint16_t tgt = jit_target(mod, jpc);
+					jit_pending += 2;
+					jit_flush();
+					jit_compare();
+					if (jit_tr[i].next == tgt)
+						guard(0x80 | jit_cond(op), jpc + le_opcode_len(mod->code[jpc]));
+					else
+						guard(0x80 | (jit_cond(op) ^ 1), tgt);
+					break;
+				}
+				// Fall through
+
+			case JK_HELPER :
+			case JK_LIT :
+			case JK_LLA :
+			case JK_LLW :
+			case JK_SLW :
+			case JK_LDA :
+			case JK_STA :
+			case JK_BIN :
+			case JK_LSW :
+			case JK_SSW :
+			case JK_LXW :
+			case JK_LXB :
+			case JK_COPT :
+			case JK_CHKZ :
+			case JK_ENTR :
+				jit_straight(mod, pc, kind);
+				break;
+
+			case JK_JPC :
+				jit_pending ++;
+				jit_flush();
+				jit_pop_cx();
+				EMIT(0x66, 0x85, 0xc9);			// test cx, cx
+				if (jit_tr[i].next == next)
+					guard(0x84, jit_target(mod, pc));	// jz exit
+				else
+					guard(0x85, next);					// jnz exit
+				break;
+
+			case JK_JP :
+				jit_pending ++;
+				break;
+
+			case JK_BRANCH :
+				// The helper leaves the correct PC for the side exit
+				jit_pending ++;
+				jit_flush();
+				jit_call_helper(mod, pc);
+				jit_check_pc(jit_tr[i].next, 0x85);		// jne exit
+				jit_imm32(jit_exit - (jit_p + 4));
+				break;
+
+			default :
+				// CLL and RTN of procedures called within the trace
+				jit_pending ++;
+				jit_call_helper(mod, pc);
+				break;
+		}
+	}
+
+	// Close the loop
+	jit_flush();
+	EMIT(0xe9);
+	jit_imm32(loop - (jit_p + 4));
+
+	// Side exits (instructions are already counted)
+	for (uint16_t i = 0; i < side_n; i ++)
+	{
+		if (! jit_room())
+			return NULL;
+
+		int32_t r = jit_p - (side[i].pos + 4);
+		memcpy(side[i].pos, &r, 4);
+		jit_set_reg(&gs_PC, side[i].pc);
+		jit_jmp_exit();
+	}
+
+	const void *stub = jit_entry(loop);
+	jit_end(mod, "loop%07o", jit_tr[0].pc);
+	return stub;
+}
+
+
+// jit_trace()
+// Records a trace of the loop closed by the hot backward jump at
+// anchor in module mod by executing one iteration through the
+// opcode helpers. The trace follows CLL calls and their returns and
+// ends when it arrives at the anchor again. Recording stops at
+// instructions which cannot be traced; the interpreter continues
+// there. A complete trace is compiled and installed at the anchor.
+// Stores the number of executed M-codes in count and returns the
+// module number to continue in (PC is in gs_PC).
+//
+uint8_t jit_trace(mod_entry_t *mod, uint16_t anchor, uint32_t *count)
+{
+	jit_pc_t *j = &(mod->jit[anchor]);
+	uint16_t pc = anchor;
+	uint16_t n = 0;
+	int depth = 0;				// Procedures called within the trace
+	bool closed = false;
+
+	oh_set_module(mod->id.idx);
+	while (n < JIT_TRACE_MAX)
+	{
+		uint8_t op = mod->code[pc];
+		enum jit_kind_t kind = jit_kind(mod, pc);
+
+		if ((kind == JK_EXIT)
+			|| ((kind == JK_CALL) && (op < 0360))
+			|| ((kind == JK_LEAVE) && ((op != 0354) || (depth == 0))))
+			break;
+
+		gs_PC = pc + 1;
+		gs_IR = op;
+		oh_tab[op]();
+		depth += (kind == JK_CALL) ? 1 : (kind == JK_LEAVE) ? -1 : 0;
+
+		jit_tr[n].pc = pc;
+		jit_tr[n ++].next = pc = gs_PC;
+		if ((pc == anchor) && (depth == 0))
+		{
+			closed = true;
+			break;
+		}
+		if ((pc == 0) || (pc >= mod->code_sz))
+			break;
+	}
+	*count = n;
+	gs_PC = pc;
+
+	const void *native = closed ? jit_compile_trace(mod, n) : NULL;
+	if (native != NULL)
+	{
+		j->native = native;
+		mod->pcode[anchor].handler = pd_handler[PD_JIT];
+	}
+	else if (++ j->fails < JIT_TRACE_TRIES)
+	{
+		// Try again later
+		j->calls = 0;
+	}
+	else
+	{
+		// Give up and stop counting
+		mod->pcode[anchor].handler = j->handler;
+	}
+	return oh_modn;
+}
+
+
+// jit_run()
+// Executes native code of module mod at entry point native.
+// Stores the number of executed M-codes in count and returns the
+// module number to continue in (PC is in gs_PC).
+//
+uint8_t jit_run(mod_entry_t *mod, const void *native, uint32_t *count)
+{
+	oh_set_module(mod->id.idx);
+	jit_count = 0;
+	((void (*)()) native)();
+	*count = jit_count;
+	return oh_modn;
+}
+
+
+// jit_drop_map()
+// Removes the perf map entries of the native code from addresses
+// lo to hi, which is about to be reused
+//
+void jit_drop_map(const uint8_t *lo, const uint8_t *hi)
+{
+	pthread_mutex_lock(&jit_map_lock);
+	if (jit_map != NULL)
+	{
+		char *buf = NULL;
+		size_t buf_sz = 0;
+		FILE *f = open_memstream(&buf, &buf_sz);
+		char ln[256];
+		rewind(jit_map);
+		while ((f != NULL) && (fgets(ln, sizeof(ln), jit_map) != NULL))
+		{
+			const uint8_t *a = (const uint8_t *) strtoul(ln, NULL, 16);
+			if ((a < lo) || (a >= hi))
+				fputs(ln, f);
+		}
+		if (f != NULL)
+		{
+			fclose(f);
+			rewind(jit_map);
+			fwrite(buf, 1, buf_sz, jit_map);
+			fflush(jit_map);
+			if (ftruncate(fileno(jit_map), buf_sz) != 0)
+				le_verbose_msg("Can't truncate perf map\n");
+		}
+		fseek(jit_map, 0, SEEK_END);
+		free(buf);
+	}
+	pthread_mutex_unlock(&jit_map_lock);
+}
+
+
+// jit_forget()
+// Discards the native code of module mod if some of it lies above
+// mark, and counts calls and backward jumps again from zero
+//
+void jit_forget(mod_entry_t *mod, const uint8_t *mark)
+{
+	uint32_t pc;
+	for (pc = 0; pc < mod->code_sz; pc ++)
+	{
+		const jit_pc_t *j = &(mod->jit[pc]);
+		if (((const uint8_t *) j->native >= mark)
+			|| ((const uint8_t *) j->body >= mark)
+			|| ((const uint8_t *) j->ret >= mark))
+			break;
+	}
+	if (pc == mod->code_sz)
+		return;
+
+	for (pc = 0; pc < mod->code_sz; pc ++)
+	{
+		if (mod->jit[pc].handler != NULL)
+			mod->pcode[pc].handler = mod->jit[pc].handler;
+	}
+	jit_init_module(mod);
+}
+
+#endif
+
+
+// jit_reset()
+// Returns the native code compiled since the code buffer was used
+// up to mark to the buffer. Called after a program level has
+// unloaded its modules; the remaining modules compile again what
+// they had compiled meanwhile.
+//
+void jit_reset(uint32_t mark)
+{
+#ifdef LE_JIT
+	if ((jit_buf == NULL) || (jit_used <= mark))
+		return;
+
+	for (uint8_t i = 1; i < mach_num_modules(); i ++)
+	{
+		mod_entry_t *mod = &(module_tab[i]);
+		if (mod->jit != NULL)
+			jit_forget(mod, jit_buf + mark);
+	}
+	jit_drop_map(jit_buf + mark, jit_buf + JIT_CODE_SZ);
+	jit_used = mark;
+#endif
+}
+
+
+// jit_release()
+// Frees the native code buffer of the machine
+//
+void jit_release()
+{
+#ifdef LE_JIT
+	if (jit_buf != NULL)
+		munmap(jit_buf, JIT_CODE_SZ);
+	jit_buf = NULL;
+	jit_used = 0;
+#endif
+}
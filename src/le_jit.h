@@ -0,0 +1,50 @@
+//=====================================================
+// le_jit.h
+// Template-based x86-64 JIT compiler
+//
+// Lilith M-Code Emulator
+//
+// Guido Hoss, 12.03.2022
+//
+// Published by Guido Hoss under GNU Public License V3.
+//=====================================================
+
+#ifndef _LE_JIT_H
+#define _LE_JIT_H   1
+
+#include "le_mach.h"
+
+// The JIT needs the threaded engines and an x86-64 host
+#if defined(LE_THREADED) && defined(__x86_64__)
+#define LE_JIT	1
+#endif
+
+#define JIT_THRESHOLD	10			// Default calls before compilation
+#define JIT_CODE_SZ		(32 << 20)	// Size of native code buffer
+#define JIT_PROC_MAX	16384		// Max. instructions per procedure
+#define JIT_LOOP_THRESHOLD	50		// Backward jumps before tracing
+#define JIT_TRACE_MAX	1024		// Max. instructions per trace
+#define JIT_TRACE_TRIES	4			// Attempts to record a trace
+
+// JIT state of a code frame byte offset
+typedef struct jit_pc_t {
+	const void *native;		// Native entry point or NULL
+	const void *handler;	// Original pre-decoded handler
+	const void *body;		// Compiled procedure entry or NULL
+	const void *ret;		// Compiled return point of a call or NULL
+	uint32_t calls;			// Calls of entry point or backward jumps
+	uint32_t fails;			// Failed attempts to record a trace
+} jit_pc_t;
+
+extern uint32_t jit_threshold;
+
+// Function declarations
+//
+void jit_init_module(mod_entry_t *mod);
+bool jit_compile(mod_entry_t *mod, uint16_t entry);
+uint8_t jit_trace(mod_entry_t *mod, uint16_t anchor, uint32_t *count);
+uint8_t jit_run(mod_entry_t *mod, const void *native, uint32_t *count);
+void jit_reset(uint32_t mark);
+void jit_release();
+
+#endif
@@ -13,6 +13,14 @@
 #include "le_io.h"
 #include "le_trace.h"
 #include "le_loader.h"
+#include "le_mcode.h"
+#include "le_predec.h"
+#include "le_profile.h"
+#include "le_aot.h"
+#include "le_verify.h"
+#include "le_block.h"
+#include "le_regir.h"
+#include "le_lockstep.h"
 
 
 // Array of include paths
@@ -109,11 +117,13 @@ void le_expect(FILE *f, uint16_t w)
 
 // le_parse_objfile()
 // Decode the specified object file f
+// Returns the module table entry of the module defined in the file
 //
-void le_parse_objfile(FILE *f)
+mod_entry_t *le_parse_objfile(FILE *f)
 {
     uint16_t w, n, a;
     mod_entry_t *mod = NULL;	// Pointer to current mod in module table
+    mod_entry_t *first = NULL;	// Module defined in the file
     bool proc_section = true;
     bool eof = false;
 
@@ -145,6 +155,8 @@ void le_parse_objfile(FILE *f)
             le_read_modid(f, &modid);
             mod = init_mod_entry(&modid);
             mod->id.loaded = true;
+            if (first == NULL)
+                first = mod;
 
             // Skip bytes following module name/key in later versions
             if (n == 0x11)
@@ -154,6 +166,11 @@ void le_parse_objfile(FILE *f)
             mod->data_sz = le_rword(f);			// words
 			mod->data_ofs = data_top;
 			data_top += mod->data_sz;
+
+			// Clear the data frame, which may still hold the stack
+			// of the program calling this one
+			bk_fill(mod->data_ofs, 0, mod->data_sz);
+
             mod->code_sz = le_rword(f) << 1;	// bytes
             if (((mod->code = calloc(mod->code_sz, 1)) == NULL))
                 le_memerr();
@@ -285,6 +302,32 @@ void le_parse_objfile(FILE *f)
             break;
         }
     };
+    return first;
+}
+
+
+// le_load_native()
+// Binds a module library translated by mule2c to module mod if
+// one with matching key is found in the include paths
+//
+void le_load_native(mod_entry_t *mod)
+{
+	for (uint16_t i = 0; i < num_paths; i ++)
+	{
+		char *fpath;
+
+		asprintf(&fpath, "%s/%s.so", patharray[i].path, mod->id.name);
+		if (access(fpath, R_OK) == 0)
+		{
+			le_verbose_msg("Native library '%s'... ", fpath);
+			bool ok = aot_load(mod, fpath);
+			free(fpath);
+			if (ok)
+				return;
+		}
+		else
+			free(fpath);
+	}
 }
 
 
@@ -295,10 +338,10 @@ void le_fix_extcalls(uint8_t top)
 {
     uint8_t max = mach_num_modules();
 
-    while (top < max)
+    for (uint8_t m = top; m < max; m ++)
     {
 		uint16_t n;
-        mod_entry_t *mod = &(module_tab[top]);
+        mod_entry_t *mod = &(module_tab[m]);
 
         if (! mod->id.loaded)
             le_error(1, 0, "Module %s missing after load", mod->id.name);
@@ -310,7 +353,7 @@ void le_fix_extcalls(uint8_t top)
 		{
 			// Allocate memory for procedure table
 			// Missing procedures will have an (invalid) entry point 0
-			// which will be detected at runtime
+			// which the verifier rejects as target of static calls
 			uint16_t *ptab = calloc(n, MACH_WORD_SZ);
 			mod->proc = ptab;	
 
@@ -341,12 +384,14 @@ void le_fix_extcalls(uint8_t top)
 						case 062 :	// SEW
 						case 0355 :	// CLX
 							// Change first opbyte to absolute index of module
+							// (module #0 is the module itself)
 							if (b1 > mod->import_n)
 								le_error(1, 0, 
 									"%s: %07o opc %03o illegal module #%03o", 
 									mod->id.name, loc - 1, opc, b1
 								);
-							mod->code[loc] = mod->import[b1 - 1].idx;
+							mod->code[loc] = (b1 == 0)
+								? mod->id.idx : mod->import[b1 - 1].idx;
 							break;
 						
 						default :
@@ -373,9 +418,37 @@ void le_fix_extcalls(uint8_t top)
 		// Free module import table
 		if (mod->import != NULL)
 			free(mod->import);
-			
-        top ++;
+	}
+
+	// The procedure tables of all called modules are final now
+    for (uint8_t m = top; m < max; m ++)
+    {
+        mod_entry_t *mod = &(module_tab[m]);
+
+		// Part 2: Verify code frame before any engine runs it
+		vf_verify_module(mod);
+
+		// Part 3: Use native module library if available (the
+		// translated code bypasses tracing, profiling, the
+		// instruction budget and lockstep runs)
+		if (aot_enabled && ! le_trace && ! le_profile && (le_max_mcodes == 0)
+			&& (ls_interval == 0))
+			le_load_native(mod);
+
+		// Part 4: Pre-decode or translate code frame with final
+		// module indexes
+		if ((le_engine == ENGINE_SUPER) || (le_engine == ENGINE_JIT))
+			pd_decode_module(mod);
+		else if (le_engine == ENGINE_REGIR)
+			ri_translate_module(mod);
     }
+
+	// Part 5: Link calls to the pre-decoded entry points
+	for (uint8_t m = top; m < max; m ++)
+	{
+		if (module_tab[m].pcode != NULL)
+			pd_link_module(&(module_tab[m]));
+	}
 }
 
 
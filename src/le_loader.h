@@ -14,6 +14,7 @@
 
 // Function declarations
 //
+mod_entry_t *le_parse_objfile(FILE *f);
 uint8_t le_load_initfile(char *fn, char *alt_prefix);
 void le_include_path(char *path);
 void le_dump_paths();
@@ -0,0 +1,353 @@
+//=====================================================
+// le_lockstep.c
+// Lockstep differential execution
+//
+// Runs the object file on two machines in lockstep: the reference
+// machine in the instrumented switch engine on the calling thread,
+// and a second machine in the selected engine on its own thread.
+// The threads take turns, so that only one machine runs at a time.
+//
+// The engine decides where the machines are compared: at the first
+// safepoint after every ls_interval M-codes, it hands over to the
+// reference, which steps to the same instruction count and compares
+// the registers, the expression stack, main memory and the terminal
+// output of both machines. The first difference stops the run.
+//
+// Host I/O (file system, keyboard, clock) is only done by the
+// reference, which records the results of the calls in a queue.
+// The other machine gets the recorded results instead, handing over
+// to the reference whenever the queue is empty. Its terminal output
+// is only hashed.
+//
+// Lilith M-Code Emulator
+//
+// Guido Hoss, 12.03.2022
+//
+// Published by Guido Hoss under GNU Public License V3.
+//=====================================================
+
+#include <config.h>
+#include <pthread.h>
+#include "le_mach.h"
+#include "le_io.h"
+#include "le_heap.h"
+#include "le_trace.h"
+#include "le_loader.h"
+#include "le_mcode.h"
+#include "le_lockstep.h"
+
+
+// What the engine machine waits for
+enum ls_post_t {
+	LS_START,		// Not started yet
+	LS_CHECK,		// Comparison at instruction count ls_target
+	LS_IO,			// Next recorded I/O result
+	LS_DONE			// Nothing, the program has ended
+};
+
+uint32_t ls_interval = 0;		// M-codes between comparisons
+
+ls_side_t ls_ref;				// Reference machine
+ls_side_t ls_eng;				// Machine running the selected engine
+
+// Turns of the threads
+pthread_mutex_t ls_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t ls_cond = PTHREAD_COND_INITIALIZER;
+bool ls_ref_turn = true;		// TRUE while the reference runs
+
+// Request of the engine machine
+enum ls_post_t ls_post = LS_START;
+uint64_t ls_target = 0;			// Instruction count of comparison
+uint64_t ls_next = 0;			// Count of next comparison
+uint64_t ls_checks = 0;			// Comparisons done
+uint32_t ls_eng_count;			// M-codes run by the engine machine
+
+// Queue of recorded I/O results
+uint32_t *ls_queue = NULL;
+uint32_t ls_head = 0;
+uint32_t ls_tail = 0;
+uint32_t ls_max = 0;
+
+// Object file of the run
+char *ls_fn;
+
+
+// ls_es_depth()
+// Returns the words of the expression stack saved on side s; a
+// broken engine may have pushed more words than fit
+//
+#define ls_es_depth(s)	(((s)->sp < MACH_EXSMEM_SZ) ? (s)->sp : MACH_EXSMEM_SZ)
+
+
+// ls_hand_over()
+// Gives the turn to the reference (ref = TRUE) or the engine
+// machine and waits until it comes back unless wait is FALSE
+//
+void ls_hand_over(bool ref, bool wait)
+{
+	pthread_mutex_lock(&ls_lock);
+	ls_ref_turn = ref;
+	pthread_cond_broadcast(&ls_cond);
+	while (wait && (ls_ref_turn == ref))
+		pthread_cond_wait(&ls_cond, &ls_lock);
+	pthread_mutex_unlock(&ls_lock);
+}
+
+
+// ls_record()
+// Appends the I/O result v of the reference machine to the queue
+// and hands over if the engine machine waits for it. Returns v.
+//
+uint32_t ls_record(uint32_t v)
+{
+	if (ls_head == ls_tail)
+		ls_head = ls_tail = 0;
+	if (ls_tail == ls_max)
+	{
+		ls_max = (ls_max == 0) ? 256 : 2 * ls_max;
+		if ((ls_queue = realloc(ls_queue, ls_max * sizeof(uint32_t))) == NULL)
+			le_error(1, errno, "Can't allocate lockstep I/O queue");
+	}
+	ls_queue[ls_tail ++] = v;
+
+	if (ls_post == LS_IO)
+		ls_hand_over(false, true);
+	return v;
+}
+
+
+// ls_replay()
+// Returns the next I/O result recorded by the reference machine,
+// which runs until it has recorded one if the queue is empty
+//
+uint32_t ls_replay()
+{
+	if (ls_head == ls_tail)
+	{
+		ls_post = LS_IO;
+		ls_hand_over(true, true);
+	}
+	return ls_queue[ls_head ++];
+}
+
+
+// ls_output()
+// Hashes a character written to the terminal by the machine
+//
+void ls_output(char c)
+{
+	ls_side_t *s = mach_ctx.ls;
+
+	s->out_hash = (s->out_hash ^ (uint8_t) c) * 16777619;
+	s->out_n ++;
+}
+
+
+// ls_save()
+// Saves the state of the machine run by the calling thread, which
+// runs module modp, to its side
+//
+void ls_save(mod_entry_t *modp)
+{
+	ls_side_t *s = mach_ctx.ls;
+
+	s->modp = modp;
+	s->pc = gs_PC;
+	s->s = gs_S;
+	s->l = gs_L;
+	s->g = gs_G;
+	s->cs = gs_CS;
+	s->h = gs_H;
+	s->sp = gs_SP;
+	memcpy(s->es, exs_mem, ls_es_depth(s) * MACH_WORD_SZ);
+}
+
+
+// ls_show()
+// Shows the saved state of side s under the label name
+//
+void ls_show(char *name, ls_side_t *s)
+{
+	char es[8 * MACH_EXSMEM_SZ + 1];
+
+	es[0] = '\0';
+	for (uint8_t i = 0; i < ls_es_depth(s); i ++)
+		sprintf(es + strlen(es), " %04X", s->es[i]);
+
+	le_error(0, 0, "%-9s %s PC=%07o S=x%04X L=x%04X G=x%04X CS=x%04X "
+		"H=x%04X ES=[%s ] out=%u/%08X",
+		name, s->modp->id.name, s->pc, s->s, s->l, s->g, s->cs, s->h,
+		es, s->out_n, s->out_hash);
+}
+
+
+// ls_fail()
+// Stops the lockstep run with reason after n M-codes, showing the
+// state of both machines and the next instruction of the reference.
+// Called by the reference while the engine machine waits.
+//
+void ls_fail(char *reason, uint64_t n)
+{
+	le_error(0, 0, "\nLockstep: %s after %lu M-codes (%lu comparisons)",
+		reason, (unsigned long) n, (unsigned long) ls_checks);
+	ls_show("reference", &ls_ref);
+	ls_show("engine", &ls_eng);
+
+	// Show the first words of memory which differ
+	uint16_t *m1 = ls_ref.mem;
+	uint16_t *m2 = ls_eng.mem;
+	int k = 0;
+	for (uint32_t i = 0; (i < MACH_DSHMEM_SZ) && (k < LS_MEM_DIFF_MAX); i ++)
+	{
+		if (m1[i] != m2[i])
+		{
+			le_error(0, 0, "mem[x%04X]: reference x%04X, engine x%04X",
+				i, m1[i], m2[i]);
+			k ++;
+		}
+	}
+
+	if (gs_PC < ls_ref.modp->code_sz)
+		le_decode(ls_ref.modp, gs_PC);
+	le_error(1, 0, "Lockstep run stopped");
+}
+
+
+// ls_compare()
+// Compares the saved states of the machines after n M-codes
+//
+void ls_compare(uint64_t n)
+{
+	ls_side_t *r = &ls_ref;
+	ls_side_t *e = &ls_eng;
+
+	ls_checks ++;
+	if ((r->pc != e->pc) || (r->s != e->s) || (r->l != e->l) || (r->g != e->g)
+		|| (r->cs != e->cs) || (r->h != e->h) || (r->sp != e->sp))
+		ls_fail("registers differ", n);
+	if (memcmp(r->es, e->es, ls_es_depth(r) * MACH_WORD_SZ) != 0)
+		ls_fail("expression stacks differ", n);
+	if (memcmp(r->mem, e->mem, MACH_DSHMEM_SZ * MACH_WORD_SZ) != 0)
+		ls_fail("memory differs", n);
+	if ((r->out_n != e->out_n) || (r->out_hash != e->out_hash))
+		ls_fail("terminal output differs", n);
+}
+
+
+// ls_check()
+// Called at the safepoints of the engine machine with the M-codes
+// charged: hands over to the reference for a comparison every
+// ls_interval M-codes
+//
+void ls_check(mod_entry_t *modp)
+{
+	if (! mach_ctx.ls->replay || (mach_ctx.mcodes < ls_next))
+		return;
+
+	ls_next = mach_ctx.mcodes + ls_interval;
+	ls_save(modp);
+	ls_target = mach_ctx.mcodes;
+	ls_post = LS_CHECK;
+	ls_hand_over(true, true);
+}
+
+
+// ls_step()
+// Called by the reference machine before each instruction of module
+// modp, with counter M-codes run by the innermost engine: compares
+// the machines when the count of the requested comparison is reached
+//
+void ls_step(mod_entry_t *modp, uint32_t counter)
+{
+	uint64_t n = mach_ctx.mcodes + counter - mach_ctx.run->charged;
+
+	if ((ls_post == LS_CHECK) && (n > ls_target))
+	{
+		ls_save(modp);
+		ls_fail("reference passed the comparison", n);
+	}
+	while ((n == ls_target) && ((ls_post == LS_START) || (ls_post == LS_CHECK)))
+	{
+		ls_save(modp);
+		if (ls_post == LS_CHECK)
+			ls_compare(n);
+		ls_hand_over(false, true);
+	}
+}
+
+
+// ls_run_engine()
+// Thread function of the engine machine
+//
+void *ls_run_engine(void *arg)
+{
+	// Signals go to the reference
+	sigset_t set;
+	sigfillset(&set);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+	pthread_mutex_lock(&ls_lock);
+	while (ls_ref_turn)
+		pthread_cond_wait(&ls_cond, &ls_lock);
+	pthread_mutex_unlock(&ls_lock);
+
+	mach_init();
+	ls_eng.mem = dsh_mem;
+	ls_eng.replay = true;
+	mach_ctx.ls = &ls_eng;
+
+	ls_eng_count = 0;
+	uint8_t top = le_load_initfile(ls_fn, "SYS");
+	if (top > 0)
+		ls_eng_count = le_execute(top);
+
+	// Keep the context until the reference has checked the end
+	ls_post = LS_DONE;
+	ls_hand_over(true, true);
+	mach_ctx.ls = NULL;
+	return NULL;
+}
+
+
+// ls_execute()
+// Executes the loaded module top of the object file fn on the
+// reference machine in lockstep with a machine running the selected
+// engine, which loads fn itself. Returns the number of M-codes
+// executed.
+//
+uint32_t ls_execute(uint8_t top, char *fn)
+{
+	pthread_t tid;
+
+	ls_fn = fn;
+	ls_next = ls_interval;
+	ls_ref.mem = dsh_mem;
+	mach_ctx.ls = &ls_ref;
+	if (pthread_create(&tid, NULL, ls_run_engine, NULL) != 0)
+		le_error(1, errno, "Can't create lockstep thread");
+
+	uint32_t n = le_execute(top);
+
+	// The engine machine must have ended with the same count,
+	// output and I/O
+	if (ls_post != LS_DONE)
+		le_error(1, 0, "Lockstep: reference ended after %u M-codes, engine %s",
+			n, (ls_post == LS_IO) ? "waits for I/O" : "continues");
+	if (ls_eng_count != n)
+		le_error(1, 0, "Lockstep: engine ended after %u M-codes, "
+			"reference after %u", ls_eng_count, n);
+	if (ls_head != ls_tail)
+		le_error(1, 0, "Lockstep: engine skipped I/O of reference");
+	if ((ls_ref.out_n != ls_eng.out_n) || (ls_ref.out_hash != ls_eng.out_hash))
+		le_error(1, 0, "Lockstep: terminal output differs at end of program");
+
+	ls_hand_over(false, false);
+	pthread_join(tid, NULL);
+	mach_ctx.ls = NULL;
+	free(ls_queue);
+	ls_queue = NULL;
+
+	le_verbose_msg("Lockstep: %u M-codes, %lu comparisons, no differences\n",
+		n, (unsigned long) ls_checks);
+	return n;
+}
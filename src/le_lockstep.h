@@ -0,0 +1,60 @@
+//=====================================================
+// le_lockstep.h
+// Lockstep differential execution
+//
+// Lilith M-Code Emulator
+//
+// Guido Hoss, 12.03.2022
+//
+// Published by Guido Hoss under GNU Public License V3.
+//=====================================================
+
+#ifndef _LE_LOCKSTEP_H
+#define _LE_LOCKSTEP_H   1
+
+#include "le_mach.h"
+#include "le_stack.h"
+
+// Differences shown per memory comparison
+#define LS_MEM_DIFF_MAX		8
+
+// Machine of a lockstep run, with its state at the last comparison
+typedef struct ls_side_t {
+	bool replay;				// Replays the I/O results of the reference
+	uint32_t out_n;				// Characters written to the terminal
+	uint32_t out_hash;			// FNV-1a hash of the terminal output
+	uint16_t *mem;				// Main memory
+	mod_entry_t *modp;			// Running module
+	uint16_t pc, s, l, g, cs, h;	// Registers
+	uint8_t sp;					// Expression stack pointer
+	uint16_t es[MACH_EXSMEM_SZ];	// Expression stack
+} ls_side_t;
+
+// M-codes between comparisons (0 = no lockstep run)
+extern uint32_t ls_interval;
+
+// ls_reference()
+// Returns TRUE if the calling thread runs the reference machine of
+// a lockstep run, which uses the instrumented switch engine
+//
+#define ls_reference()	((mach_ctx.ls != NULL) && ! mach_ctx.ls->replay)
+
+// LS_IO()
+// Evaluates expr, the result of a host I/O call. In a lockstep run
+// the reference machine records the result and the other machine
+// gets the recorded result instead of doing the call itself.
+//
+#define LS_IO(expr) \
+	((mach_ctx.ls == NULL) ? (uint32_t) (expr) \
+		: mach_ctx.ls->replay ? ls_replay() : ls_record(expr))
+
+// Function declarations
+//
+uint32_t ls_record(uint32_t v);
+uint32_t ls_replay();
+void ls_output(char c);
+void ls_check(mod_entry_t *modp);
+void ls_step(mod_entry_t *modp, uint32_t counter);
+uint32_t ls_execute(uint8_t top, char *fn);
+
+#endif
@@ -0,0 +1,822 @@
+//=====================================================
+// le_m2c.c
+// mule2c: ahead-of-time translator from M-Code to C
+//
+// Translates the procedures of M-Code object files into C source
+// files, which are compiled into module libraries:
+//
+//   mule2c -o lib Module.OBJ
+//   cc -O2 -shared -fPIC -o lib/Module.so lib/Module.c
+//
+// mule binds a library to a loaded module of the same name and key
+// (see le_aot.c). Each procedure becomes a C function working on
+// the machine state of the emulator. Simple instructions are
+// translated inline, all others call the opcode helpers of
+// le_helper.c. Procedures which cannot be translated statically
+// (jumps outside the code frame, malformed CASE tables) are left
+// to the interpreter.
+//
+// Lilith M-Code Emulator
+//
+// Guido Hoss, 12.03.2022
+//
+// Published by Guido Hoss under GNU Public License V3.
+//=====================================================
+
+#include <config.h>
+#include <libgen.h>
+#include "le_mach.h"
+#include "le_io.h"
+#include "le_stack.h"
+#include "le_helper.h"
+#include "le_trace.h"
+#include "le_loader.h"
+#include "le_aot.h"
+
+#define PKG_M2C "mule2c"
+
+// Flags per code frame offset
+#define MC_SEEN		1		// Instruction reached in current procedure
+#define MC_LABEL	2		// Instruction needs a label
+#define MC_DISPATCH	4		// Target of a computed jump (ENTC, EXC)
+#define MC_LOOP		8		// Target of a backward jump (safepoint)
+
+bool le_verbose = false;
+
+// Translation state of the current module
+mod_entry_t *mc_mod;		// Module being translated
+FILE *mc_out;				// Output C file
+bool *mc_fix;				// Operand byte holds an import number
+uint16_t *mc_entry;			// Procedure entry points
+bool *mc_ok;				// Procedure can be translated
+uint8_t *mc_flags;			// Flags per code frame offset
+uint16_t *mc_work;			// Worklist of code frame offsets
+uint32_t mc_work_n;			// Entries in worklist
+
+// Interface of the emulator used by the generated code
+const char *mc_prologue =
+	"#include <stddef.h>\n"
+	"#include <stdint.h>\n"
+	"\n"
+	"extern void (*const oh_tab[256])();\n"
+	"extern void aot_call();\n"
+	"extern void aot_bad(uint16_t pc);\n"
+	"extern void aot_poll(uint16_t pc);\n"
+	"\n"
+	"typedef struct aot_lib_t {\n"
+	"\tuint32_t abi;\n"
+	"\tuint32_t sig;\n"
+	"\tconst char *name;\n"
+	"\tuint16_t key[3];\n"
+	"\tuint16_t proc_n;\n"
+	"\tvoid (*const *proc)();\n"
+	"\tuint16_t import_n;\n"
+	"\tconst char *const *import;\n"
+	"\tvoid (*bind)(const uint8_t *mod, const uint16_t *ofs);\n"
+	"} aot_lib_t;\n"
+	"\n";
+
+const char *mc_macros =
+	"#define MEM\t\tdsh_mem\n"
+	"#define G\t\tgs_G\n"
+	"#define PUSH(x)\t(exs_mem[gs_SP ++] = (x))\n"
+	"#define POP()\t(exs_mem[-- gs_SP])\n"
+	"#define TOP\t\t(exs_mem[gs_SP - 1])\n"
+	"\n"
+	"// Execute instruction by its helper / call procedure\n"
+	"#define OP(pc, op)\t{ gs_PC = (pc) + 1; gs_IR = (op); oh_tab[op](); }\n"
+	"#define CALL(pc, op)\t{ gs_PC = (pc) + 1; gs_IR = (op); aot_call(); }\n"
+	"\n"
+	"// Safepoint at a loop head\n"
+	"#define POLL(pc)\tif (pending) aot_poll(pc);\n"
+	"\n";
+
+
+// mc_context()
+// Writes the declaration of the machine context of the calling
+// thread to f. Only the members used by the generated code are
+// declared, at their offsets in this build, with padding between.
+//
+void mc_context(FILE *f)
+{
+	aot_member_t m[AOT_MEMBERS];
+	long ofs = 0;
+
+	aot_members(m);
+	fprintf(f, "extern __thread struct mach_ctx_t {\n");
+	for (int i = 0; i < AOT_MEMBERS; i ++)
+	{
+		if (m[i].ofs < ofs)
+			le_error(1, 0, "Machine context member '%s' out of order", m[i].name);
+		if (m[i].ofs > ofs)
+			fprintf(f, "\tuint8_t pad%d[%ld];\n", i, m[i].ofs - ofs);
+		fprintf(f, "\t%s%s%s;\n", m[i].type,
+			(m[i].type[strlen(m[i].type) - 1] == '*') ? "" : " ", m[i].name);
+		ofs = m[i].ofs + m[i].sz;
+	}
+	fprintf(f, "} mach_ctx __attribute__((tls_model(\"initial-exec\")));\n\n");
+
+	for (int i = 0; i < AOT_MEMBERS; i ++)
+		fprintf(f, "#define %s\t(mach_ctx.%s)\n", m[i].name, m[i].name);
+	fprintf(f, "\n");
+}
+
+
+// mc_word()
+// Returns the word at offset pc of the code frame
+//
+uint16_t mc_word(uint32_t pc)
+{
+	return (mc_mod->code[pc] << 8) | mc_mod->code[pc + 1];
+}
+
+
+// mc_jump()
+// Returns the target of the jump instruction at pc or UINT32_MAX
+// if the instruction is no jump
+//
+uint32_t mc_jump(uint16_t pc)
+{
+	uint8_t *c = mc_mod->code;
+
+	switch (c[pc])
+	{
+		case 030 :	// JPC
+		case 031 :	// JP
+			return (uint16_t) (pc + 1 + mc_word(pc + 1));
+
+		case 032 :	// JPFC
+		case 033 :	// JPF
+		case 036 :	// ORJP
+		case 037 :	// ANDJP
+			return (uint16_t) (pc + 1 + c[pc + 1]);
+
+		case 034 :	// JPBC
+		case 035 :	// JPB
+			return (uint16_t) (pc + 1 - c[pc + 1]);
+
+		case 0300 :	// FOR1
+		case 0301 :	// FOR2
+			return (uint16_t) (pc + 2 + (int16_t) mc_word(pc + 2));
+
+		default :
+			return UINT32_MAX;
+	}
+}
+
+
+// mc_ends_flow()
+// Returns true if the instruction with opcode op never continues
+// with the following instruction
+//
+bool mc_ends_flow(uint8_t op)
+{
+	switch (op)
+	{
+		case 031 :	// JP
+		case 033 :	// JPF
+		case 035 :	// JPB
+		case 0302 :	// ENTC
+		case 0303 :	// EXC
+		case 0354 :	// RTN
+			return true;
+
+		default :
+			return false;
+	}
+}
+
+
+// mc_add()
+// Marks code frame offset pc with flags and adds it to the worklist
+// if not reached before. Returns false if pc is no valid target.
+//
+bool mc_add(uint32_t pc, uint8_t flags)
+{
+	if ((pc == 0) || (pc >= mc_mod->code_sz))
+		return false;
+
+	mc_flags[pc] |= flags;
+	if (! (mc_flags[pc] & MC_SEEN))
+	{
+		mc_flags[pc] |= MC_SEEN;
+		mc_work[mc_work_n ++] = pc;
+	}
+	return true;
+}
+
+
+// mc_scan()
+// Finds the instructions of the procedure with entry point entry.
+// Returns false if the procedure cannot be translated.
+//
+bool mc_scan(uint16_t entry)
+{
+	uint32_t sz = mc_mod->code_sz;
+
+	memset(mc_flags, 0, sz);
+	mc_work_n = 0;
+	if (! mc_add(entry, MC_LABEL))
+		return false;
+
+	while (mc_work_n > 0)
+	{
+		uint16_t pc = mc_work[-- mc_work_n];
+		uint8_t op = mc_mod->code[pc];
+		uint8_t len = le_opcode_len(op);
+
+		if (pc + len > sz)
+			return false;
+
+		uint32_t t = mc_jump(pc);
+		if ((t != UINT32_MAX) && (! mc_add(t, MC_LABEL | ((t <= pc) ? MC_LOOP : 0))))
+			return false;
+
+		if (op == 0302)
+		{
+			// ENTC: all cases of the table and the exit address
+			// are targets of computed jumps
+			uint32_t tab = (uint16_t) (pc + 1 + mc_word(pc + 1));
+			if (tab + 4 > sz)
+				return false;
+			uint16_t low = mc_word(tab);
+			uint16_t hi = mc_word(tab + 2);
+			uint32_t ex = tab + 8 + 2 * (uint32_t) (hi - low);
+			if ((hi < low) || (ex > sz))
+				return false;
+
+			for (uint32_t e = tab + 4; e < ex; e += 2)
+			{
+				if (! mc_add((uint16_t) (e + mc_word(e)), MC_LABEL | MC_DISPATCH))
+					return false;
+			}
+			if (! mc_add(ex, MC_LABEL | MC_DISPATCH))
+				return false;
+		}
+
+		if ((! mc_ends_flow(op)) && (! mc_add(pc + len, 0)))
+			return false;
+	}
+	return true;
+}
+
+
+// mc_next()
+// Returns the next reached instruction after pc or UINT32_MAX
+//
+uint32_t mc_next(uint32_t pc)
+{
+	while (++ pc < mc_mod->code_sz)
+	{
+		if (mc_flags[pc] & MC_SEEN)
+			return pc;
+	}
+	return UINT32_MAX;
+}
+
+
+// mc_ends_block()
+// Returns true if the instruction at pc is the last one of a basic
+// block, which counts its instructions on entry
+//
+bool mc_ends_block(uint16_t pc)
+{
+	uint8_t op = mc_mod->code[pc];
+	uint32_t n = mc_next(pc);
+
+	return (mc_jump(pc) != UINT32_MAX) || mc_ends_flow(op)
+		|| (n != pc + le_opcode_len(op))
+		|| (mc_flags[n] & MC_LABEL);
+}
+
+
+// mc_import()
+// Returns true if the operand byte at pc holds an import number
+//
+bool mc_import(uint16_t pc)
+{
+	return mc_fix[pc] && (mc_mod->code[pc] > 0)
+		&& (mc_mod->code[pc] <= mc_mod->import_n);
+}
+
+
+// mc_instr()
+// Writes the translation of the instruction at pc
+//
+void mc_instr(uint16_t pc)
+{
+	FILE *f = mc_out;
+	uint8_t *c = mc_mod->code;
+	uint8_t op = c[pc];
+	uint8_t len = le_opcode_len(op);
+	uint8_t b1 = (len > 1) ? c[pc + 1] : 0;
+	uint8_t b2 = (len > 2) ? c[pc + 2] : 0;
+	uint16_t w = (b1 << 8) | b2;
+	char m[LE_MNEM_LEN + 1];
+
+	fprintf(f, "\t// %o %s\n", pc, le_mnemonic(op, m));
+	switch (op)
+	{
+		case 000 ... 017 :	// LI0 - LI15
+			fprintf(f, "\tPUSH(%d);\n", op & 0xf);
+			break;
+
+		case 020 :	// LIB
+			fprintf(f, "\tPUSH(%d);\n", b1);
+			break;
+
+		case 022 :	// LIW (procedure constants hold a module number)
+			if (mc_import(pc + 1))
+				fprintf(f, "\tPUSH((M[%d] << 8) | %d);\n", b1, b2);
+			else
+				fprintf(f, "\tPUSH(%d);\n", w);
+			break;
+
+		case 023 :	// LID
+			fprintf(f, "\tPUSH(%d);\n\tPUSH(%d);\n", w, mc_word(pc + 3));
+			break;
+
+		case 024 :	// LLA
+			fprintf(f, "\tPUSH(gs_L + %d);\n", b1);
+			break;
+
+		case 025 :	// LGA
+			fprintf(f, "\tPUSH(G + %d);\n", b1);
+			break;
+
+		case 026 :	// LSA
+			fprintf(f, "\tTOP += %d;\n", b1);
+			break;
+
+		case 027 :	// LEA
+			if (! mc_import(pc + 1))
+				goto helper;
+			fprintf(f, "\tPUSH(E[%d] + %d);\n", b1, b2);
+			break;
+
+		case 030 :	// JPC
+		case 032 :	// JPFC
+		case 034 :	// JPBC
+			fprintf(f, "\tif (POP() == 0) goto L%o;\n", mc_jump(pc));
+			break;
+
+		case 031 :	// JP
+		case 033 :	// JPF
+		case 035 :	// JPB
+			fprintf(f, "\tgoto L%o;\n", mc_jump(pc));
+			break;
+
+		case 036 :	// ORJP
+			fprintf(f, "\tif (POP() != 0) { PUSH(1); goto L%o; }\n", mc_jump(pc));
+			break;
+
+		case 037 :	// ANDJP
+			fprintf(f, "\tif (POP() == 0) { PUSH(0); goto L%o; }\n", mc_jump(pc));
+			break;
+
+		case 040 :	// LLW
+		case 044 ... 057 :	// LLW4 - LLW15
+			fprintf(f, "\tPUSH(MEM[gs_L + %d]);\n", (op == 040) ? b1 : op & 0xf);
+			break;
+
+		case 041 :	// LLD
+			fprintf(f, "\t{ uint16_t i = gs_L + %d; PUSH(MEM[i]); PUSH(MEM[i + 1]); }\n", b1);
+			break;
+
+		case 042 :	// LEW
+			if (! mc_import(pc + 1))
+				goto helper;
+			fprintf(f, "\tPUSH(MEM[(uint16_t) (E[%d] + %d)]);\n", b1, b2);
+			break;
+
+		case 043 :	// LED
+			if (! mc_import(pc + 1))
+				goto helper;
+			fprintf(f, "\t{ uint16_t i = E[%d] + %d; PUSH(MEM[i]); PUSH(MEM[i + 1]); }\n", b1, b2);
+			break;
+
+		case 060 :	// SLW
+		case 064 ... 077 :	// SLW4 - SLW15
+			fprintf(f, "\tMEM[gs_L + %d] = POP();\n", (op == 060) ? b1 : op & 0xf);
+			break;
+
+		case 061 :	// SLD
+			fprintf(f, "\t{ uint16_t i = gs_L + %d; MEM[i + 1] = POP(); MEM[i] = POP(); }\n", b1);
+			break;
+
+		case 062 :	// SEW
+			if (! mc_import(pc + 1))
+				goto helper;
+			fprintf(f, "\tMEM[(uint16_t) (E[%d] + %d)] = POP();\n", b1, b2);
+			break;
+
+		case 063 :	// SED
+			if (! mc_import(pc + 1))
+				goto helper;
+			fprintf(f, "\t{ uint16_t i = E[%d] + %d; MEM[i + 1] = POP(); MEM[i] = POP(); }\n", b1, b2);
+			break;
+
+		case 0100 :	// LGW
+		case 0102 ... 0117 :	// LGW2 - LGW15
+			fprintf(f, "\tPUSH(MEM[(uint16_t) (G + %d)]);\n", (op == 0100) ? b1 : op & 0xf);
+			break;
+
+		case 0120 :	// SGW
+		case 0122 ... 0137 :	// SGW2 - SGW15
+			fprintf(f, "\tMEM[(uint16_t) (G + %d)] = POP();\n", (op == 0120) ? b1 : op & 0xf);
+			break;
+
+		case 0121 :	// SGD
+			fprintf(f, "\t{ uint16_t i = G + %d; MEM[i + 1] = POP(); MEM[i] = POP(); }\n", b1);
+			break;
+
+		case 0140 ... 0157 :	// LSW0 - LSW15
+		case 0200 :	// LSW
+			fprintf(f, "\t{ uint16_t i = POP() + %d; PUSH(MEM[i]); }\n", (op == 0200) ? b1 : op & 0xf);
+			break;
+
+		case 0201 :	// LSD
+		case 0202 :	// LSD0
+			fprintf(f, "\t{ uint16_t i = POP() + %d; PUSH(MEM[i]); PUSH(MEM[i + 1]); }\n", b1);
+			break;
+
+		case 0160 ... 0177 :	// SSW0 - SSW15
+		case 0220 :	// SSW
+			fprintf(f, "\t{ uint16_t k = POP(); uint16_t i = POP() + %d; MEM[i] = k; }\n",
+				(op == 0220) ? b1 : op & 0xf);
+			break;
+
+		case 0204 :	// LSTA
+			fprintf(f, "\tPUSH(MEM[(uint16_t) (G + 2)] + %d);\n", b1);
+			break;
+
+		case 0252 :	// ULSS
+		case 0253 :	// ULEQ
+		case 0254 :	// UGTR
+		case 0255 :	// UGEQ
+		case 0310 :	// EQL
+		case 0311 :	// NEQ
+		case 0312 :	// LSS
+		case 0313 :	// LEQ
+		case 0314 :	// GTR
+		case 0315 :	// GEQ
+		{
+			static const char *cmp[] = { "<", "<=", ">", ">=" };
+			const char *t = ((op >= 0312) && (op <= 0315)) ? "int16_t" : "uint16_t";
+			const char *o = (op == 0310) ? "==" : (op == 0311) ? "!=" : cmp[(op - 2) & 3];
+			fprintf(f, "\t{ %s j = POP(); %s i = POP(); PUSH((i %s j) ? 1 : 0); }\n", t, t, o);
+			break;
+		}
+
+		case 0270 :	// UADD
+		case 0330 :	// IADD
+		case 0271 :	// USUB
+		case 0331 :	// ISUB
+		case 0320 :	// OR
+		case 0321 :	// XOR
+		case 0322 :	// AND
+		{
+			const char *o = ((op == 0270) || (op == 0330)) ? "+"
+				: ((op == 0271) || (op == 0331)) ? "-"
+				: (op == 0320) ? "|" : (op == 0321) ? "^" : "&";
+			fprintf(f, "\t{ uint16_t j = POP(); uint16_t i = POP(); PUSH(i %s j); }\n", o);
+			break;
+		}
+
+		case 0300 :	// FOR1
+			fprintf(f,
+				"\t{\n"
+				"\t\tint16_t hi = POP();\n"
+				"\t\tint16_t low = POP();\n"
+				"\t\tuint16_t adr = POP();\n"
+				"\t\tif (!(%s))\n"
+				"\t\t\tgoto L%o;\n"
+				"\t\tMEM[adr] = low;\n"
+				"\t\tMEM[gs_S] = adr;\n"
+				"\t\tMEM[gs_S + 1] = hi;\n"
+				"\t\tgs_S += 2;\n"
+				"\t}\n",
+				(b1 == 0) ? "low <= hi" : "low >= hi", mc_jump(pc)
+			);
+			break;
+
+		case 0301 :	// FOR2
+			fprintf(f,
+				"\t{\n"
+				"\t\tint16_t hi = MEM[gs_S - 1];\n"
+				"\t\tuint16_t adr = MEM[gs_S - 2];\n"
+				"\t\tint16_t i = MEM[adr] + %d;\n"
+				"\t\tif (%s)\n"
+				"\t\t\tgs_S -= 2;\n"
+				"\t\telse\n"
+				"\t\t{\n"
+				"\t\t\tMEM[adr] = i;\n"
+				"\t\t\tgoto L%o;\n"
+				"\t\t}\n"
+				"\t}\n",
+				(int8_t) b1,
+				((int8_t) b1 > 0) ? "i > hi" : ((int8_t) b1 < 0) ? "i < hi" : "i != hi",
+				mc_jump(pc)
+			);
+			break;
+
+		case 0302 :	// ENTC
+		case 0303 :	// EXC
+			fprintf(f, "\tOP(%d, %d)\n\tgoto dispatch;\n", pc, op);
+			break;
+
+		case 0325 :	// LIN
+			fprintf(f, "\tPUSH(0xffff);\n");
+			break;
+
+		case 0354 :	// RTN
+			fprintf(f, "\tOP(%d, %d)\n\treturn;\n", pc, op);
+			break;
+
+		case 0355 :	// CLX (calls to System.0 are ignored)
+			if ((b1 != 0) || (b2 != 0))
+				fprintf(f, "\tCALL(%d, %d)\n", pc, op);
+			break;
+
+		case 0356 :	// CLI
+		case 0360 :	// CLL
+		case 0361 ... 0377 :	// CLL1 - CLL15
+		{
+			uint8_t i = (op >= 0361) ? op & 0xf : b1;
+			if ((i < mc_mod->proc_n) && mc_ok[i])
+				fprintf(f, "\tOP(%d, %d)\n\tp%d();\n", pc, op, i);
+			else
+				fprintf(f, "\tCALL(%d, %d)\n", pc, op);
+			break;
+		}
+
+		case 0357 :	// CLF
+			fprintf(f, "\tCALL(%d, %d)\n", pc, op);
+			break;
+
+		default :
+		helper:
+			fprintf(f, "\tOP(%d, %d)\n", pc, op);
+			break;
+	}
+}
+
+
+// mc_proc()
+// Writes the function of procedure i
+//
+void mc_proc(uint16_t i)
+{
+	FILE *f = mc_out;
+	uint32_t sz = mc_mod->code_sz;
+	uint32_t n = 0;
+	bool dispatch = false;
+
+	mc_scan(mc_entry[i]);
+
+	// Continuations not following their instruction need a label
+	for (uint32_t pc = mc_next(0); pc < sz; pc = mc_next(pc))
+	{
+		uint8_t op = mc_mod->code[pc];
+		uint32_t next = pc + le_opcode_len(op);
+		if ((! mc_ends_flow(op)) && (mc_next(pc) != next))
+			mc_flags[next] |= MC_LABEL;
+		if (mc_flags[pc] & MC_DISPATCH)
+			dispatch = true;
+	}
+
+	fprintf(f, "// Procedure %d\nstatic void p%d(void)\n{\n", i, i);
+	if (mc_next(0) != mc_entry[i])
+		fprintf(f, "\tgoto L%o;\n", mc_entry[i]);
+
+	for (uint32_t pc = mc_next(0); pc < sz; pc = mc_next(pc))
+	{
+		if (mc_flags[pc] & MC_LABEL)
+			fprintf(f, "L%o:\n", pc);
+		if (mc_flags[pc] & MC_LOOP)
+			fprintf(f, "\tPOLL(%d)\n", pc);
+
+		// Count the instructions of each basic block on entry
+		if (n == 0)
+		{
+			uint32_t k = pc;
+			for (n = 1; ! mc_ends_block(k); n ++)
+				k = mc_next(k);
+			fprintf(f, "\toh_count += %d;\n", n);
+		}
+		mc_instr(pc);
+		n --;
+
+		uint8_t op = mc_mod->code[pc];
+		uint32_t next = pc + le_opcode_len(op);
+		if ((! mc_ends_flow(op)) && (mc_next(pc) != next))
+			fprintf(f, "\tgoto L%o;\n", next);
+	}
+
+	// Computed jumps of CASE statements
+	if (dispatch)
+	{
+		fprintf(f, "dispatch:\n\tswitch (gs_PC)\n\t{\n");
+		for (uint32_t pc = mc_next(0); pc < sz; pc = mc_next(pc))
+		{
+			if (mc_flags[pc] & MC_DISPATCH)
+				fprintf(f, "\t\tcase %d : goto L%o;\n", pc, pc);
+		}
+		fprintf(f, "\t\tdefault : aot_bad(gs_PC); return;\n\t}\n");
+	}
+	fprintf(f, "}\n\n");
+}
+
+
+// mc_module()
+// Writes the C source file of module mod to directory dir
+//
+void mc_module(mod_entry_t *mod, char *dir)
+{
+	uint32_t sz = mod->code_sz;
+	uint16_t pn = mod->proc_n;
+	char *fn;
+
+	mc_mod = mod;
+	mc_fix = calloc(sz + 1, sizeof(bool));
+	mc_entry = calloc(pn + 1, sizeof(uint16_t));
+	mc_ok = calloc(pn + 1, sizeof(bool));
+	mc_flags = calloc(sz + 1, sizeof(uint8_t));
+	mc_work = calloc(sz + 1, sizeof(uint16_t));
+	if ((mc_fix == NULL) || (mc_entry == NULL) || (mc_ok == NULL)
+		|| (mc_flags == NULL) || (mc_work == NULL))
+		le_error(1, errno, "Cannot allocate translator tables");
+
+	// Collect entry points and locations of import numbers
+	for (proctmp_t *pt = mod->proc_tmp; pt != NULL; pt = pt->next)
+	{
+		mc_entry[pt->idx] = pt->entry;
+		for (uint16_t i = 0; i < pt->fixup_n; i ++)
+		{
+			if (pt->fixup[i] < sz)
+				mc_fix[pt->fixup[i]] = true;
+		}
+	}
+
+	uint16_t ok = 0;
+	for (uint16_t i = 0; i < pn; i ++)
+	{
+		mc_ok[i] = (mc_entry[i] != 0) && mc_scan(mc_entry[i]);
+		if (mc_ok[i])
+			ok ++;
+		else
+			le_verbose_msg("  procedure %d not translated\n", i);
+	}
+
+	asprintf(&fn, "%s/%s.c", dir, mod->id.name);
+	if ((mc_out = fopen(fn, "w")) == NULL)
+		le_error(1, errno, "Cannot create '%s'", fn);
+
+	FILE *f = mc_out;
+	fprintf(f, "// %s.c\n// Translated from M-Code by " PKG_M2C " - do not edit\n//\n\n",
+		mod->id.name);
+	fputs(mc_prologue, f);
+	mc_context(f);
+	fputs(mc_macros, f);
+
+	uint16_t in = mod->import_n;
+	fprintf(f, "static __thread uint8_t M[%d];\nstatic __thread uint16_t E[%d];\n\n",
+		in + 1, in + 1);
+
+	for (uint16_t i = 0; i < pn; i ++)
+	{
+		if (mc_ok[i])
+			fprintf(f, "static void p%d(void);\n", i);
+	}
+	fprintf(f, "\n");
+
+	for (uint16_t i = 0; i < pn; i ++)
+	{
+		if (mc_ok[i])
+			mc_proc(i);
+	}
+
+	// Library descriptor
+	fprintf(f, "static void (*const proc[%d])() = {\n", pn + 1);
+	for (uint16_t i = 0; i < pn; i ++)
+	{
+		if (mc_ok[i])
+			fprintf(f, "\tp%d,\n", i);
+		else
+			fprintf(f, "\tNULL,\n");
+	}
+	fprintf(f, "};\n\nstatic const char *const import[%d] = {\n\tNULL,\n", in + 1);
+	for (uint16_t i = 0; i < in; i ++)
+		fprintf(f, "\t\"%s\",\n", mod->import[i].name);
+	fprintf(f,
+		"};\n\n"
+		"static void bind(const uint8_t *mod, const uint16_t *ofs)\n"
+		"{\n"
+		"\tfor (int i = 1; i <= %d; i ++)\n"
+		"\t{\n"
+		"\t\tM[i] = mod[i];\n"
+		"\t\tE[i] = ofs[i];\n"
+		"\t}\n"
+		"}\n\n"
+		"const aot_lib_t aot_lib = {\n"
+		"\t%d, 0x%08x, \"%s\", { %d, %d, %d }, %d, proc, %d, import, bind\n"
+		"};\n",
+		in, AOT_ABI, aot_signature(), mod->id.name,
+		mod->id.key.w[0], mod->id.key.w[1], mod->id.key.w[2],
+		pn, in
+	);
+	fclose(f);
+
+	le_verbose_msg("%s: %d of %d procedures translated\n", fn, ok, pn);
+	free(fn);
+	free(mc_fix);
+	free(mc_entry);
+	free(mc_ok);
+	free(mc_flags);
+	free(mc_work);
+}
+
+
+// mc_usage()
+// Show program usage information
+//
+void mc_usage()
+{
+	printf(
+		"USAGE: " PKG_M2C " [-hv] [-o dir] object_file...\n\n"
+		"Translates M-Code object files into C module libraries for mule.\n\n"
+		"-o\tWrite C files to directory dir (default: current directory)\n"
+		"-v\tVerbose mode\n"
+		"-h\tShow this help information\n\n"
+		"Compile each module with\n"
+		"\tcc -O2 -shared -fPIC -o Module.so Module.c\n"
+		"and place the library in the search path of mule.\n\n"
+	);
+}
+
+
+// main()
+// Main program entry point
+//
+int main(int argc, char *argv[])
+{
+	char *dir = ".";
+	int c;
+
+	opterr = 0;
+	while ((c = getopt(argc, argv, "hvo:")) != -1)
+	{
+		switch (c)
+		{
+		case 'h' :
+			mc_usage();
+			exit(0);
+
+		case 'v' :
+			le_verbose = true;
+			break;
+
+		case 'o' :
+			dir = optarg;
+			break;
+
+		default :
+			error(1, 0,
+				"Unrecognized option (run \"" PKG_M2C " -h\" for help)."
+			);
+			break;
+		}
+	}
+	if (optind >= argc)
+		error(1, 0, "No object file specified (run \"" PKG_M2C " -h\" for help).");
+
+	mach_init();
+	for (int i = optind; i < argc; i ++)
+	{
+		FILE *f = fopen(argv[i], "r");
+		if (f == NULL)
+			le_error(1, errno, "Cannot open '%s'", argv[i]);
+
+		le_verbose_msg("Translating %s\n", argv[i]);
+		data_top = 0;
+		mod_entry_t *mod = le_parse_objfile(f);
+		fclose(f);
+		if (mod == NULL)
+			le_error(1, 0, "%s: no module found", argv[i]);
+		mc_module(mod, dir);
+
+		// Forget all modules before the next file
+		for (proctmp_t *pt = mod->proc_tmp; pt != NULL; )
+		{
+			proctmp_t *q = pt;
+			pt = pt->next;
+			free(q->fixup);
+			free(q);
+		}
+		mod->proc_tmp = NULL;
+		free(mod->import);
+		while (mach_num_modules() > 1)
+			mach_unload_top();
+	}
+	return 0;
+}
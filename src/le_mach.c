@@ -9,31 +9,21 @@
 // Published by Guido Hoss under GNU Public License V3.
 //=====================================================
 
+#include <config.h>
+#include <sys/mman.h>
 #include "le_mach.h"
 #include "le_stack.h"
 #include "le_io.h"
 #include "le_heap.h"
+#include "le_aot.h"
+#include "le_filesys.h"
+#include "le_jit.h"
+#include "le_predec.h"
 
 
-// Memory structures defined in le_mach.h
+// Machine context of the calling thread (le_mach.h)
 //
-uint16_t *dsh_mem;
-uint16_t data_top;
-
-uint16_t gs_PC;
-uint16_t gs_IR;
-uint16_t gs_G;
-uint16_t gs_L;
-uint16_t gs_S;
-uint16_t gs_CS;
-uint16_t gs_P;
-uint16_t gs_M;
-bool gs_REQ;
-uint16_t gs_ReqNo;
-
-// Module table (entry 0 reserved for SYSTEM module)
-mod_entry_t *module_tab;    // Pointer to module entries
-uint8_t module_num = 1;	    // Number of modules in table
+__thread mach_ctx_t mach_ctx;
 
 
 // mach_num_modules()
@@ -109,6 +99,17 @@ mod_entry_t *init_mod_entry(mod_id_t *mod)
         p->import = NULL;
         p->import_n = 0;
         p->code = NULL;
+        p->pcode = NULL;
+        p->rcode = NULL;
+        p->rcode_ix = NULL;
+        p->jit = NULL;
+        p->aot = NULL;
+        p->aot_dl = NULL;
+        p->aot_ix = NULL;
+        p->flags = NULL;
+        p->resume = NULL;
+        p->case_ix = NULL;
+        p->case_tab = NULL;
         p->data_ofs = UINT16_MAX;
         p->proc_tmp = NULL;
         p->proc_n = 0;
@@ -131,19 +132,57 @@ void init_module_tab()
     mod_key_t *k = &(module_tab->id.key);
     k->w[0] = k->w[1] = k->w[2] = 0x0000;
     module_tab->id.loaded = true;
+    module_tab->code = NULL;
+    module_tab->code_sz = 0;
 
     // First user module (boot program) gets assigned entry 1
 	module_num = 1;
 }
 
 
+// mach_map_mem()
+// Allocates zeroed main memory which is mapped twice in a row, so
+// that a host pointer to a frame near the top of memory reaches the
+// words at its bottom with offsets past the top, just as 16-bit
+// addresses wrap around. Returns NULL on failure.
+//
+uint16_t *mach_map_mem()
+{
+	size_t sz = MACH_DSHMEM_SZ * MACH_WORD_SZ;
+	uint8_t *p = MAP_FAILED;
+	int fd;
+
+#ifdef HAVE_MEMFD_CREATE
+	fd = memfd_create("mule", MFD_CLOEXEC);
+#else
+	char fn[] = "/tmp/muleXXXXXX";
+	if ((fd = mkstemp(fn)) >= 0)
+		unlink(fn);
+#endif
+	if (fd < 0)
+		return NULL;
+
+	if (ftruncate(fd, sz) == 0)
+		p = mmap(NULL, 2 * sz, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if ((p != MAP_FAILED)
+		&& ((mmap(p, sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+		|| (mmap(p + sz, sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)))
+	{
+		munmap(p, 2 * sz);
+		p = MAP_FAILED;
+	}
+	close(fd);
+	return (p == MAP_FAILED) ? NULL : (uint16_t *) p;
+}
+
+
 // mach_init()
 // Initialize memory structures
 //
 void mach_init()
 {
     // Allocate data/stack/heap memory and zero it
-    if ((dsh_mem = calloc(MACH_DSHMEM_SZ, MACH_WORD_SZ)) == NULL)
+    if ((dsh_mem = mach_map_mem()) == NULL)
 	{
         le_error(1, errno, "Can't allocate DSH memory");
 	}
@@ -173,8 +212,49 @@ uint16_t mach_unload_top()
 	// Free code frame and procedure table
 	free(p->code);
 	free(p->proc);
+	if (p->pcode != NULL)
+		pd_unlink_module(p);
+	free(p->pcode);
+	p->pcode = NULL;
+	free(p->rcode);
+	p->rcode = NULL;
+	free(p->rcode_ix);
+	p->rcode_ix = NULL;
+	free(p->jit);
+	p->jit = NULL;
+	free(p->flags);
+	p->flags = NULL;
+	free(p->resume);
+	p->resume = NULL;
+	free(p->case_ix);
+	p->case_ix = NULL;
+	free(p->case_tab);
+	p->case_tab = NULL;
+	aot_unload(p);
 
 	// Decrement number of modules
 	module_num --;
 	return p->data_sz;
-}
\ No newline at end of file
+}
+
+
+// mach_free()
+// Releases all resources of the machine of the calling thread.
+// mach_init() starts a new machine afterwards.
+//
+void mach_free()
+{
+	// Close files and unload modules
+	fs_release();
+	while (module_num > 1)
+		mach_unload_top();
+	free(module_tab);
+
+	// Release heap, memory and native code
+	hp_release();
+	es_release();
+	munmap(dsh_mem, 2 * MACH_DSHMEM_SZ * MACH_WORD_SZ);
+	jit_release();
+
+	memset(&mach_ctx, 0, sizeof(mach_ctx));
+}
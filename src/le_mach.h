@@ -19,6 +19,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <signal.h>
 #include <unistd.h>
 #include <string.h>
 
@@ -32,10 +33,6 @@ extern WINDOW *app_win;
 // Machine word = 16 bits
 #define MACH_WORD_SZ    sizeof(uint16_t)
 
-// Main memory for data, stack and heap
-extern uint16_t *dsh_mem;	// Points to base of main memory
-extern uint16_t data_top;	// Offset of 1st word after data areas
-
 // Module table
 //
 #define MOD_NAME_MAX    16			// Maximum length of module names
@@ -78,23 +75,117 @@ typedef struct {
     uint16_t proc_n;            // Number of entries in procedure table
     mod_id_t *import;	    	// Pointer to table of imported modules
     uint8_t import_n;           // Number of entries in import table
+    struct pd_instr_t *pcode;	// Pre-decoded code frame or NULL
+    struct ri_instr_t *rcode;	// Register IR of code frame or NULL
+    uint32_t *rcode_ix;			// IR index per code frame offset or NULL
+    struct jit_pc_t *jit;		// JIT state per code frame offset or NULL
+    const struct aot_lib_t *aot;	// Translated module library or NULL
+    void *aot_dl;				// Handle of module library or NULL
+    uint16_t *aot_ix;			// Procedure number + 1 per entry offset or NULL
+    uint8_t *flags;				// Verifier flags of code frame bytes or NULL
+    uint8_t *resume;			// Bitmap of verified resume points or NULL
+    uint16_t *case_ix;			// Case table index per ENTC offset or NULL
+    uint16_t *case_tab;			// Resolved case tables of ENTC or NULL
+    uint8_t es_depth;			// Max. expression stack depth of code
 } mod_entry_t;
 
-extern mod_entry_t *module_tab;		// Pointer to module table
+
+// Machine context
+// Holds the complete state of one M-Code machine. Each thread has
+// its own context, so independent machines can run concurrently on
+// separate threads. The state variables of the emulator modules are
+// aliases of its members. Translated module libraries address the
+// members by offset and record a signature of the offsets, which
+// aot_load() checks (see aot_members()).
+//
+typedef struct mach_ctx_t {
+	// Main memory and module table (le_mach.c)
+	uint16_t *dsh_mem;
+	uint16_t data_top;
+	mod_entry_t *module_tab;
+	uint8_t module_num;
+
+	// Registers (le_mach.c)
+	uint16_t gs_PC, gs_IR, gs_G, gs_L, gs_S, gs_CS, gs_P, gs_M;
+	bool gs_REQ;
+	uint16_t gs_ReqNo;
+
+	// Expression stack (le_stack.c)
+	uint16_t *exs_mem;
+	uint8_t gs_SP;
+
+	// Heap (le_heap.c)
+	uint16_t gs_H;
+	uint16_t hp_low;
+	struct hp_heap_t *heap;
+
+	// Open files (le_filesys.c)
+	struct fs_index_t *fd_list;
+	uint16_t last_m2file;
+	struct fs_index_t *last_fd;
+
+	// Opcode helpers (le_helper.c)
+	mod_entry_t *oh_modp;
+	uint8_t *oh_code_p;
+	uint8_t oh_modn;
+	uint8_t oh_exec_mod;
+	uint32_t oh_count;
+
+	// Native code buffer and code generator (le_jit.c)
+	uint8_t *jit_buf;
+	uint32_t jit_used;
+	uint32_t jit_count;
+	uint8_t *jit_p;
+	uint8_t *jit_exit;
+	uint32_t jit_pending;
+
+	// Terminal streams, or NULL for the ncurses window (le_io.c)
+	FILE *term_in;
+	FILE *term_out;
+	char kbd_buf;
+
+	// Time read by the clock SVC, or 0 for the host clock (le_syscall.c)
+	time_t fixed_time;
+
+	// Safepoints (le_mcode.c). pending is set, also by signal
+	// handlers, when work waits for the next safepoint.
+	volatile sig_atomic_t pending;
+	volatile sig_atomic_t attach;		// Monitor requested by signal
+	volatile sig_atomic_t report;		// Heap report requested by signal
+	volatile sig_atomic_t expired;		// Time budget expired
+	uint64_t mcodes;					// M-codes charged to the budget
+	struct le_run_t *run;				// Innermost run of an engine
+
+	// Lockstep run (le_lockstep.c)
+	struct ls_side_t *ls;				// Side of lockstep run or NULL
+} mach_ctx_t;
+
+// Context of the machine run by the calling thread. libmule.a is
+// only linked into executables, so the local-exec model applies and
+// member accesses cost the same as accesses of plain globals.
+extern __thread mach_ctx_t mach_ctx __attribute__((tls_model("local-exec")));
+
+// Main memory
+#define dsh_mem		(mach_ctx.dsh_mem)		// Points to base of main memory
+#define data_top	(mach_ctx.data_top)		// Offset of 1st word after data areas
+
+// Module table
+#define module_tab	(mach_ctx.module_tab)	// Pointer to module table
+#define module_num	(mach_ctx.module_num)	// Number of modules in table
 
 
 // Global State Variables
 //
-extern uint16_t gs_PC;		// Program counter
-extern uint16_t gs_IR;		// Instruction register
-extern uint16_t gs_G;		// Data frame base address
-extern uint16_t gs_L;		// Local segment address
-extern uint16_t gs_S;		// Stack pointer
-extern uint16_t gs_CS;		// Call stack pointer
-extern uint16_t gs_P;  		// Process base address
-extern uint16_t gs_M;		// process interrupt mask (bitset)
-extern bool gs_REQ;			// Interrupt request
-extern uint16_t gs_ReqNo;	// Request number, 8..15
+#define gs_PC		(mach_ctx.gs_PC)		// Program counter
+#define gs_IR		(mach_ctx.gs_IR)		// Instruction register
+#define gs_G		(mach_ctx.gs_G)			// Data frame base address
+#define gs_L		(mach_ctx.gs_L)			// Local segment address
+#define gs_S		(mach_ctx.gs_S)			// Stack pointer
+#define gs_CS		(mach_ctx.gs_CS)		// Call stack pointer
+#define gs_P		(mach_ctx.gs_P)			// Process base address
+#define gs_M		(mach_ctx.gs_M)			// process interrupt mask (bitset)
+#define gs_REQ		(mach_ctx.gs_REQ)		// Interrupt request (set pending too)
+#define gs_ReqNo	(mach_ctx.gs_ReqNo)		// Request number, 8..15
 
 
 // Function declarations
@@ -104,6 +195,7 @@ uint8_t mach_num_modules();
 mod_entry_t *find_mod_entry(mod_id_t *mod_id);
 mod_entry_t *init_mod_entry(mod_id_t *mod_id);
 uint16_t mach_unload_top();
+void mach_free();
 
 
 // Tracing and debugging
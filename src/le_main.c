@@ -10,11 +10,17 @@
 //=====================================================
 
 #include <libgen.h>
+#include <time.h>
 #include "le_mach.h"
 #include "le_io.h"
+#include "le_heap.h"
 #include "le_loader.h"
 #include "le_mcode.h"
 #include "le_usage.h"
+#include "le_profile.h"
+#include "le_jit.h"
+#include "le_aot.h"
+#include "le_lockstep.h"
 
 
 // Global variables
@@ -64,7 +70,7 @@ int main(int argc, char *argv[])
 
 	// Parse command line options
 	opterr = 0;
-	while ((c = getopt (argc, argv, "Vtvhi:")) != -1)
+	while ((c = getopt (argc, argv, "VNtvhi:e:P:j:l:T:D:H:")) != -1)
 	{
 		switch (c)
 		{
@@ -88,6 +94,55 @@ int main(int argc, char *argv[])
 			le_include_path(optarg);
 			break;
 
+		case 'e' :
+			// Select execution engine
+			if (! le_set_engine(optarg))
+				error(1, 0, "Unknown execution engine '%s'", optarg);
+			break;
+
+		case 'j' :
+			// Calls before a procedure is compiled by the JIT
+			if (atoi(optarg) < 1)
+				error(1, 0, "Invalid JIT threshold '%s'", optarg);
+			jit_threshold = atoi(optarg);
+			break;
+
+		case 'l' :
+			// Instruction budget
+			if (strtoull(optarg, NULL, 10) < 1)
+				error(1, 0, "Invalid instruction budget '%s'", optarg);
+			le_max_mcodes = strtoull(optarg, NULL, 10);
+			break;
+
+		case 'T' :
+			// Time budget
+			if (atoi(optarg) < 1)
+				error(1, 0, "Invalid time budget '%s'", optarg);
+			le_max_time = atoi(optarg);
+			break;
+
+		case 'D' :
+			// Lockstep run with the reference engine
+			if (atoi(optarg) < 1)
+				error(1, 0, "Invalid lockstep interval '%s'", optarg);
+			ls_interval = atoi(optarg);
+			break;
+
+		case 'N' :
+			// Don't use native module libraries
+			aot_enabled = false;
+			break;
+
+		case 'P' :
+			// Record sequence profile
+			pf_open(optarg);
+			break;
+
+		case 'H' :
+			// Heap report at exit
+			hp_open_report(optarg);
+			break;
+
 		case 't' :
 			// Trace mode enabled (implies verbose mode)
 			le_trace = le_verbose = true;
@@ -104,6 +159,14 @@ int main(int argc, char *argv[])
         }
     }
 
+	// The profiler is driven by the switch engine
+	if (le_profile)
+		le_engine = ENGINE_SWITCH;
+
+	// The reference machine of a lockstep run uses the monitor hooks
+	if ((ls_interval > 0) && (le_trace || le_profile))
+		error(1, 0, "Lockstep runs can't be traced or profiled");
+
 	// Start interpreter loop with the specified object file
 	if (optind < argc)
 	{
@@ -137,9 +200,22 @@ int main(int argc, char *argv[])
 			if (top > 0)
 			{
 				// Execute module
+				struct timespec t0, t1;
+
 				le_verbose_msg("Starting execution.\n");
-				le_execute(top);
-				le_verbose_msg("Execution terminated normally.\n");
+				le_init_signals();
+				clock_gettime(CLOCK_MONOTONIC, &t0);
+				uint32_t n = (ls_interval > 0) ? ls_execute(top, basn)
+					: le_execute(top);
+				clock_gettime(CLOCK_MONOTONIC, &t1);
+
+				double t = (t1.tv_sec - t0.tv_sec)
+					+ (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+				le_verbose_msg(
+					"Execution terminated normally.\n"
+					"%u M-codes in %.3f s (%.0f M-codes/s)\n",
+					n, t, (t > 0) ? n / t : 0.0
+				);
 			}
 		}
 		free(fn1);
@@ -1,7 +1,7 @@
 //=====================================================
 // le_mcode.c
 // M-Code Interpreter
-// 
+//
 // Lilith M-Code Emulator
 //
 // Guido Hoss, 12.03.2022
@@ -9,6 +9,7 @@
 // Published by Guido Hoss under GNU Public License V3.
 //=====================================================
 
+#include <config.h>
 #include <string.h>
 #include "le_mach.h"
 #include "le_stack.h"
@@ -19,8 +20,63 @@
 #include "le_filesys.h"
 #include "le_loader.h"
 #include "le_mcode.h"
+#include "le_predec.h"
+#include "le_profile.h"
+#include "le_super.h"
+#include "le_jit.h"
+#include "le_aot.h"
+#include "le_verify.h"
+#include "le_block.h"
+#include "le_regir.h"
+#include "le_lockstep.h"
+
+
+// Selected dispatch engine
+#ifdef LE_THREADED
+enum le_engine_t le_engine = ENGINE_THREADED;
+#else
+enum le_engine_t le_engine = ENGINE_SWITCH;
+#endif
+
+
+// FETCH
+// Fetches the next opcode into IR. The loader has verified that the
+// code stays inside the code frame, so the PC needs no check.
+//
+#define FETCH { \
+		gs_IR = le_next(); \
+		counter ++; \
+	}
+
+// RESUME
+// Checks a PC loaded from memory (RTN, EXC, return from translated
+// code): PC 0 ends the engine, any other PC must be a resume point
+// of the verified code frame
+//
+#define RESUME { \
+		if (gs_PC == 0) \
+			goto done; \
+		if (! vf_resume(modp, gs_PC)) \
+			le_trap(modp, TRAP_CODE_OVF); \
+	}
+
+// SAFEPOINT
+// Polls for pending work. Only backward jumps, calls and SVC are
+// safepoints, so straight-line code runs without any checks. If the
+// work needs the instrumented engine, it continues the run.
+//
+#define SAFEPOINT { \
+		if (mach_ctx.pending && le_safepoint(modp, counter)) \
+		{ \
+			counter += le_run(exec_mod, modn, gs_PC); \
+			goto done; \
+		} \
+	}
 
-#define _HALT	{ gs_PC --; le_error(1, 0, "Halted in %s:%07o at opcode %03o", modp->id.name, gs_PC, gs_IR); }
+
+// Budgets of a run (0 = unlimited)
+uint64_t le_max_mcodes = 0;		// M-codes executed
+uint32_t le_max_time = 0;		// Seconds of execution
 
 
 // le_transfer()
@@ -37,46 +93,1286 @@ void le_transfer(bool chg, uint16_t to, uint16_t from)
 }
 
 
-// le_interpret()
-// Main interpreter loop
-// Executes specified module and procedure
+// le_attach()
+// Handler of SIGINT: enters the monitor at the next safepoint of the
+// machine
 //
-uint32_t le_execute(uint8_t exec_mod)
+void le_attach(int sig)
+{
+	mach_ctx.attach = 1;
+	mach_ctx.pending = 1;
+}
+
+
+// le_report()
+// Handler of SIGUSR1: shows the heap report at the next safepoint of
+// the machine
+//
+void le_report(int sig)
+{
+	mach_ctx.report = 1;
+	mach_ctx.pending = 1;
+}
+
+
+// le_expire()
+// Handler of SIGALRM: stops the machine at the next safepoint
+//
+void le_expire(int sig)
+{
+	mach_ctx.expired = 1;
+	mach_ctx.pending = 1;
+}
+
+
+// le_init_signals()
+// Installs the signal handlers which request work at safepoints and
+// starts the time budget
+//
+void le_init_signals()
+{
+	struct sigaction sa;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_flags = SA_RESTART;
+	sa.sa_handler = le_attach;
+	sigaction(SIGINT, &sa, NULL);
+	sa.sa_handler = le_report;
+	sigaction(SIGUSR1, &sa, NULL);
+
+	if (le_max_time > 0)
+	{
+		sa.sa_handler = le_expire;
+		sigaction(SIGALRM, &sa, NULL);
+		alarm(le_max_time);
+	}
+}
+
+
+// le_charge()
+// Charges the M-codes of the innermost run, which has executed
+// counter M-codes, to the machine. Called at safepoints and before
+// nested runs, so that the count of the machine is exact there.
+//
+void le_charge(uint32_t counter)
+{
+	le_run_t *run = mach_ctx.run;
+
+	mach_ctx.mcodes += counter - run->charged;
+	run->charged = counter;
+}
+
+
+// le_safepoint()
+// Does the work pending at a safepoint of an engine running module
+// modp, which has executed counter M-codes. The flag is kept raised
+// while every safepoint has work (instrumented engine, instruction
+// budget, lockstep run). Returns TRUE if the run must continue in the
+// instrumented engine.
+//
+bool le_safepoint(mod_entry_t *modp, uint32_t counter)
+{
+	char msg[64];
+
+	// Clear the flag first, so that a signal arriving from now on
+	// raises it again
+	mach_ctx.pending = 0;
+
+	// Monitor requested by signal
+	if (mach_ctx.attach)
+	{
+		mach_ctx.attach = 0;
+		le_trace = le_verbose = true;
+		le_verbose_msg("\nMonitor attached\n");
+	}
+
+	// Heap report requested by signal
+	if (mach_ctx.report)
+	{
+		mach_ctx.report = 0;
+		hp_show();
+	}
+
+	// Interrupt request
+	if (gs_REQ)
+	{
+		le_error(1, 0, "Halted in %s:%07o at interrupt request %d",
+			modp->id.name, gs_PC, gs_ReqNo);
+		le_transfer(true, 2 * gs_ReqNo, 2 * gs_ReqNo + 1);
+	}
+
+	// Budgets
+	if (mach_ctx.expired)
+	{
+		snprintf(msg, sizeof(msg), "Time budget of %u s exceeded", le_max_time);
+		le_abort(modp, msg);
+	}
+	if (mach_ctx.run != NULL)
+		le_charge(counter);
+	if ((le_max_mcodes > 0) && (mach_ctx.mcodes > le_max_mcodes))
+	{
+		snprintf(msg, sizeof(msg), "Budget of %lu M-codes exceeded",
+			(unsigned long) le_max_mcodes);
+		le_abort(modp, msg);
+	}
+
+	// Lockstep comparison
+	if (mach_ctx.ls != NULL)
+		ls_check(modp);
+
+	bool debug = le_trace || breakpoint || le_profile;
+	if (debug || (mach_ctx.run != NULL))
+		mach_ctx.pending = 1;
+	return debug;
+}
+
+
+// Switch-based dispatch engine, built twice from le_mcode_run.h:
+// le_run_switch() without any per-instruction hooks, and the
+// instrumented le_run_debug() for tracing, breakpoints and profiling
+//
+#define RUN_FN		le_run_switch
+#define RUN_DEBUG	0
+#include "le_mcode_run.h"
+#undef RUN_FN
+#undef RUN_DEBUG
+
+#define RUN_FN		le_run_debug
+#define RUN_DEBUG	1
+#include "le_mcode_run.h"
+#undef RUN_FN
+#undef RUN_DEBUG
+
+
+#ifdef LE_THREADED
+
+// Handler table entries of the threaded engines
+#define T(n)		[n] = &&op_##n
+#define TR(n, m)	[n ... m] = &&op_##n
+#define T_INVALID	&&op_invalid
+
+
+// le_run_threaded()
+// Direct-threaded dispatch engine: every handler ends in its own
+// copy of the dispatch sequence, jumping through a table of label
+// addresses (GCC labels-as-values extension)
+//
+uint32_t le_run_threaded(uint8_t exec_mod, uint8_t mod, uint16_t pc)
+{
+	mod_entry_t *modp;		// Pointer to current module
+	uint8_t *code_p;		// Pointer to module code frame
+	uint16_t *local_p;		// Pointer to local frame at L
+	uint16_t *global_p;		// Pointer to global frame at G
+	uint32_t counter = 0;	// M-code counter
+	uint8_t modn;
+
+	// Handler table indexed by opcode
+	static const void *const op_tab[256] = { OP_TABLE };
+
+	// Setup registers and start at PC of module
+	set_module_ptr(mod);
+	gs_PC = pc;
+
+#define DISPATCH { \
+		FETCH \
+		goto *op_tab[gs_IR]; \
+	}
+
+#define OP(n)		op_##n : ;
+#define OPR(n, m)	op_##n : ;
+#define OP_DEFAULT	op_invalid : ;
+#define NEXT		DISPATCH
+
+	// Dispatch first instruction; the handlers do the rest
+	DISPATCH
+
+#include "le_mcode_ops.h"
+
+#undef OP
+#undef OPR
+#undef OP_DEFAULT
+#undef NEXT
+#undef DISPATCH
+
+done:
+	return counter;
+}
+
+// le_run_tos()
+// Direct-threaded engine which keeps the expression stack pointer
+// and the top of stack in local variables, so that the compiler can
+// hold them in registers. The other entries stay in exs_mem. The
+// cache is written back around calls which access the expression
+// stack in memory (supervisor calls, traps, es_save() and
+// es_restore(), translated modules, safepoints with pending work).
+//
+uint32_t le_run_tos(uint8_t exec_mod, uint8_t mod, uint16_t pc)
+{
+	mod_entry_t *modp;		// Pointer to current module
+	uint8_t *code_p;		// Pointer to module code frame
+	uint16_t *local_p;		// Pointer to local frame at L
+	uint16_t *global_p;		// Pointer to global frame at G
+	uint32_t counter = 0;	// M-code counter
+	uint8_t modn;
+	uint8_t *const sp_p = &gs_SP;
+	uint8_t sp = gs_SP;				// Cached stack pointer
+	uint16_t tos = exs_mem[sp - 1];	// Cached top of stack
+
+	// Handler table indexed by opcode
+	static const void *const op_tab[256] = { OP_TABLE };
+
+	// Setup registers and start at PC of module
+	set_module_ptr(mod);
+	gs_PC = pc;
+	ES_STAT(2, 0);
+
+#define ES_FLUSH	{ ES_STAT(0, 2); exs_mem[sp - 1] = tos; *sp_p = sp; }
+#define ES_RELOAD	{ ES_STAT(2, 0); sp = *sp_p; tos = exs_mem[sp - 1]; }
+
+#pragma push_macro("gs_SP")
+#undef gs_SP
+#define gs_SP		sp
+#define es_push(x)	do { \
+		uint16_t _x = (x); \
+		ES_STAT(0, 1); \
+		exs_mem[sp - 1] = tos; \
+		sp ++; \
+		tos = _x; \
+	} while (0)
+#define es_pop()	({ \
+		uint16_t _x = tos; \
+		ES_STAT(1, 0); \
+		sp --; \
+		tos = exs_mem[sp - 1]; \
+		_x; \
+	})
+#ifdef LE_ES_WORDS
+#define es_dpush(d)	do { \
+		floatword_t _d = (d); \
+		es_push(_d.w[1]); \
+		es_push(_d.w[0]); \
+	} while (0)
+#define es_dpop()	({ \
+		floatword_t _d; \
+		_d.w[0] = es_pop(); \
+		_d.w[1] = es_pop(); \
+		_d; \
+	})
+#define es_dload(p)	do { \
+		const uint16_t *_p = (p); \
+		es_push(_p[0]); \
+		es_push(_p[1]); \
+	} while (0)
+#define es_dstore(p)	do { \
+		uint16_t *_p = (p); \
+		_p[1] = es_pop(); \
+		_p[0] = es_pop(); \
+	} while (0)
+#else
+	// Double words: the high word goes to memory along with the
+	// previous top of stack, the low word becomes the new top
+#define es_dpush(d)	do { \
+		floatword_t _d = (d); \
+		uint16_t _w[2] = { tos, _d.w[1] }; \
+		ES_STAT(0, 1); \
+		memcpy(&exs_mem[sp - 1], _w, 4); \
+		sp += 2; \
+		tos = _d.w[0]; \
+	} while (0)
+#define es_dpop()	({ \
+		floatword_t _d; \
+		uint16_t _w[2]; \
+		ES_STAT(1, 0); \
+		memcpy(_w, &exs_mem[sp - 3], 4); \
+		_d.w[0] = tos; \
+		_d.w[1] = _w[1]; \
+		sp -= 2; \
+		tos = _w[0]; \
+		_d; \
+	})
+#define es_dload(p)	do { \
+		const uint16_t *_p = (p); \
+		uint16_t _w[2] = { tos, _p[0] }; \
+		ES_STAT(0, 1); \
+		memcpy(&exs_mem[sp - 1], _w, 4); \
+		sp += 2; \
+		tos = _p[1]; \
+	} while (0)
+#define es_dstore(p)	do { \
+		uint16_t *_p = (p); \
+		uint16_t _w[2]; \
+		ES_STAT(1, 0); \
+		memcpy(_w, &exs_mem[sp - 3], 4); \
+		_p[0] = _w[1]; \
+		_p[1] = tos; \
+		sp -= 2; \
+		tos = _w[0]; \
+	} while (0)
+#endif
+
+	// Functions using the expression stack in memory
+#define es_save()	do { ES_FLUSH (es_save)(); ES_RELOAD } while (0)
+#define es_restore()	do { ES_FLUSH (es_restore)(); ES_RELOAD } while (0)
+#define le_trap(m, n)	do { ES_FLUSH (le_trap)(m, n); } while (0)
+#define le_supervisor_call(m, n) \
+	do { ES_FLUSH (le_supervisor_call)(m, n); ES_RELOAD } while (0)
+#define le_system_call(n) \
+	do { ES_FLUSH (le_system_call)(n); ES_RELOAD } while (0)
+
+	// The SVC handler restores the stack pointer after le_execute()
+#define le_execute(m)	({ \
+		uint8_t _sp = sp; \
+		ES_FLUSH \
+		uint32_t _n = (le_execute)(m); \
+		sp = _sp; \
+		tos = exs_mem[sp - 1]; \
+		_n; \
+	})
+#define aot_enter(e, m, p, c) \
+	({ ES_FLUSH uint8_t _m = (aot_enter)(e, m, p, c); ES_RELOAD _m; })
+#define le_run(e, m, p) \
+	({ ES_FLUSH uint32_t _n = (le_run)(e, m, p); ES_RELOAD _n; })
+#define le_safepoint(m, c) \
+	({ ES_FLUSH (le_safepoint)(m, c); })
+
+#define DISPATCH { \
+		FETCH \
+		goto *op_tab[gs_IR]; \
+	}
+
+#define OP(n)		op_##n : ;
+#define OPR(n, m)	op_##n : ;
+#define OP_DEFAULT	op_invalid : ;
+#define NEXT		DISPATCH
+
+	// Dispatch first instruction; the handlers do the rest
+	DISPATCH
+
+#include "le_mcode_ops.h"
+
+#undef OP
+#undef OPR
+#undef OP_DEFAULT
+#undef NEXT
+#undef DISPATCH
+
+done:
+	ES_FLUSH
+	return counter;
+
+#pragma pop_macro("gs_SP")
+#undef es_push
+#undef es_pop
+#undef es_dpush
+#undef es_dpop
+#undef es_dload
+#undef es_dstore
+#undef es_save
+#undef es_restore
+#undef le_trap
+#undef le_supervisor_call
+#undef le_system_call
+#undef le_execute
+#undef aot_enter
+#undef le_run
+#undef le_safepoint
+#undef ES_FLUSH
+#undef ES_RELOAD
+}
+
+
+// le_run_super()
+// Engine "super", also the interpreter of the jit engine: runs the
+// pre-decoded code frames built by pd_decode_module() with the fused
+// handlers of le_super_ops.h. Instructions with a pd_handler_t entry
+// take their operands from the decoded instruction, all others run
+// through the generic handlers in le_mcode_ops.h. Called with
+// exec_mod = 0, it only exports its handler addresses to the
+// pre-decoder.
+//
+__attribute__((noinline, noclone))
+uint32_t le_run_super(uint8_t exec_mod, uint8_t mod, uint16_t pc)
 {
 	mod_entry_t *modp;		// Pointer to current module
 	uint8_t *code_p;		// Pointer to module code frame
+	uint16_t *local_p;		// Pointer to local frame at L
+	uint16_t *global_p;		// Pointer to global frame at G
+	pd_instr_t *ip;			// Current pre-decoded instruction
 	uint32_t counter = 0;	// M-code counter
 	uint8_t modn;
 
-	// le_next()
-	// Fetch next instruction
-	//
-	uint8_t le_next()
+	// Generic handlers indexed by opcode
+	static const void *const op_tab[256] = { OP_TABLE };
+
+	// Handlers taking decoded operands
+	static const void *const pd_tab[PD_NUM_HANDLERS] = {
+		[PD_LIT] = &&pd_lit,		[PD_LIT2] = &&pd_lit2,
+		[PD_LLA] = &&pd_lla,		[PD_LSA] = &&pd_lsa,
+		[PD_LSTA] = &&pd_lsta,		[PD_JP] = &&pd_jp,
+		[PD_JPC] = &&pd_jpc,		[PD_JPB] = &&pd_jpb,
+		[PD_JPBC] = &&pd_jpbc,		[PD_ORJP] = &&pd_orjp,
+		[PD_ANDJP] = &&pd_andjp,	[PD_LLW] = &&pd_llw,
+		[PD_LLD] = &&pd_lld,		[PD_LDA] = &&pd_lda,
+		[PD_LDA2] = &&pd_lda2,		[PD_SLW] = &&pd_slw,
+		[PD_SLD] = &&pd_sld,		[PD_STA] = &&pd_sta,
+		[PD_STA2] = &&pd_sta2,		[PD_LSW] = &&pd_lsw,
+		[PD_LSD] = &&pd_lsd,		[PD_SSW] = &&pd_ssw,
+		[PD_FOR1] = &&pd_for1,		[PD_FOR2] = &&pd_for2,
+		[PD_ENTR] = &&pd_entr,		[PD_CLX] = &&pd_clx,
+		[PD_CLL] = &&pd_cll,		[PD_CLF] = &&pd_clf,
+		[PD_JIT] = &&pd_jit,
+		[PD_JIT_COUNT] = &&pd_jit_count,	[PD_JIT_LOOP] = &&pd_jit_loop
+	};
+
+	// Superinstruction handlers
+	static const void *const su_tab[SU_NUM] = { SU_LABELS };
+
+	if (exec_mod == 0)
+	{
+		pd_handler = pd_tab;
+		pd_generic = op_tab;
+		pd_super = su_tab;
+		return 0;
+	}
+
+// PD_DISPATCH
+// Jump to the handler of instruction ip. PC and IR are kept up to
+// date for traps and the generic handlers.
+//
+#define PD_DISPATCH { \
+		gs_PC = ip->pc + 1; \
+		gs_IR = ip->op; \
+		counter ++; \
+		goto *ip->handler; \
+	}
+
+// PD_GOTO
+// Continue at a computed PC of the current module
+//
+#define PD_GOTO(pc) { \
+		uint16_t _pc = (pc); \
+		if (_pc == 0) \
+			goto done; \
+		if (_pc >= modp->code_sz) \
+		{ \
+			gs_PC = _pc; \
+			le_trap(modp, TRAP_CODE_OVF); \
+		} \
+		ip = modp->pcode + _pc; \
+	}
+
+// PD_SAFEPOINT
+// Polls for pending work before instruction ip
+//
+#define PD_SAFEPOINT { \
+		if (mach_ctx.pending) \
+		{ \
+			gs_PC = ip->pc; \
+			if (le_safepoint(modp, counter)) \
+			{ \
+				counter += le_run(exec_mod, modn, ip->pc); \
+				goto done; \
+			} \
+		} \
+	}
+
+// Continue with the next sequential instruction
+#define PD_NEXT { \
+		ip += ip->len; \
+		PD_DISPATCH \
+	}
+
+	// Setup registers and start at PC of module
+	set_module_ptr(mod);
+	PD_GOTO(pc)
+	PD_DISPATCH
+
+pd_lit:
+	es_push(ip->a);
+	PD_NEXT
+
+pd_lit2:
+	es_push(ip->a);
+	es_push(ip->b);
+	PD_NEXT
+
+pd_lla:
+	es_push(gs_L + ip->a);
+	PD_NEXT
+
+pd_lsa:
+	es_push(es_pop() + ip->a);
+	PD_NEXT
+
+pd_lsta:
+	es_push(dsh_mem[ip->a] + ip->b);
+	PD_NEXT
+
+pd_jp:
+	ip = ip->target;
+	PD_DISPATCH
+
+pd_jpc:
+	ip = (es_pop() == 0) ? ip->target : ip + ip->len;
+	PD_DISPATCH
+
+pd_jpb:
+	ip = ip->target;
+	PD_SAFEPOINT
+	PD_DISPATCH
+
+pd_jpbc:
+	if (es_pop() != 0)
+	{
+		ip += ip->len;
+		PD_DISPATCH
+	}
+	ip = ip->target;
+	PD_SAFEPOINT
+	PD_DISPATCH
+
+pd_orjp:
+	if (es_pop() == 0)
+	{
+		ip += ip->len;
+	}
+	else
+	{
+		es_push(1);
+		ip = ip->target;
+	}
+	PD_DISPATCH
+
+pd_andjp:
+	if (es_pop() == 0)
+	{
+		es_push(0);
+		ip = ip->target;
+	}
+	else
+	{
+		ip += ip->len;
+	}
+	PD_DISPATCH
+
+pd_llw:
+	es_push(local_p[ip->a]);
+	PD_NEXT
+
+pd_lld:
+	es_dload(&local_p[ip->a]);
+	PD_NEXT
+
+pd_lda:
+	es_push(dsh_mem[ip->a]);
+	PD_NEXT
+
+pd_lda2:
+	es_dload(&dsh_mem[ip->a]);
+	PD_NEXT
+
+pd_slw:
+	local_p[ip->a] = es_pop();
+	PD_NEXT
+
+pd_sld:
+	es_dstore(&local_p[ip->a]);
+	PD_NEXT
+
+pd_sta:
+	dsh_mem[ip->a] = es_pop();
+	PD_NEXT
+
+pd_sta2:
+	es_dstore(&dsh_mem[ip->a]);
+	PD_NEXT
+
+pd_lsw: {
+	uint16_t i = es_pop() + ip->a;
+	es_push(dsh_mem[i]);
+	PD_NEXT
+}
+
+pd_lsd: {
+	uint16_t i = es_pop() + ip->a;
+	es_dload(&dsh_mem[i]);
+	PD_NEXT
+}
+
+pd_ssw: {
+	uint16_t k = es_pop();
+	uint16_t i = es_pop() + ip->a;
+	dsh_mem[i] = k;
+	PD_NEXT
+}
+
+pd_for1: {
+	int16_t hi = es_pop();
+	int16_t low = es_pop();
+	uint16_t adr = es_pop();
+	if (((ip->a == 0) && (low <= hi))
+		|| ((ip->a != 0) && (low >= hi)))
+	{
+		dsh_mem[adr] = low;
+		dsh_mem[gs_S] = adr;
+		dsh_mem[gs_S + 1] = hi;
+		gs_S += 2;
+		ip += ip->len;
+	}
+	else
+	{
+		ip = ip->target;
+	}
+	PD_DISPATCH
+}
+
+pd_for2: {
+	int16_t hi = dsh_mem[gs_S - 1];
+	uint16_t adr = dsh_mem[gs_S - 2];
+	int8_t step = ip->a;
+	int16_t i = dsh_mem[adr] + step;
+	if (((step >= 0) && (i > hi)) || ((step <= 0) && (i < hi)))
+	{
+		gs_S -= 2;
+		ip += ip->len;
+	}
+	else
+	{
+		dsh_mem[adr] = i;
+		ip = ip->target;
+		PD_SAFEPOINT
+	}
+	PD_DISPATCH
+}
+
+pd_entr:
+	if (gs_S < MACH_DSHMEM_SZ - ip->a)
+		gs_S += ip->a;
+	else
+		le_trap(modp, TRAP_STACK_OVF);
+	PD_NEXT
+
+pd_clx:
+	gs_PC = ip->pc + ip->len;
+	stk_mark(CALL_EXT, modn);
+	set_module_ptr(ip->a);
+	ip = ip->target;
+	PD_SAFEPOINT
+	PD_DISPATCH
+
+pd_cll:
+	gs_PC = ip->pc + ip->len;
+	stk_mark(CALL_LOCAL, 0);
+	set_local_ptr();
+	ip = ip->target;
+	PD_SAFEPOINT
+	PD_DISPATCH
+
+pd_clf: {
+	// Look up the procedure unless it was called here last time
+	uint16_t i = dsh_mem[gs_S - 1];
+	gs_PC = ip->pc + ip->len;
+	if (i != ip->b)
+	{
+		uint8_t call_mod = i >> 8;
+		uint8_t call_proc = i & 0xff;
+		mod_entry_t *callee = &(module_tab[call_mod]);
+
+		if ((call_mod >= module_num) || (call_proc >= callee->proc_n)
+			|| (callee->proc[call_proc] == 0))
+			le_trap(modp, TRAP_CODE_OVF);
+		ip->b = i;
+		ip->target = callee->pcode + callee->proc[call_proc];
+	}
+	stk_mark(CALL_FORMAL, modn);
+	set_module_ptr(ip->b >> 8);
+	ip = ip->target;
+	PD_SAFEPOINT
+	PD_DISPATCH
+}
+
+	// Compiled procedures and loops (IR and counter already include
+	// the first instruction, which is executed again in native code
+	// or while recording a trace)
+pd_jit_count: {
+#ifdef LE_JIT
+	jit_pc_t *j = &(modp->jit[ip->pc]);
+	if ((++ j->calls == jit_threshold) && jit_compile(modp, ip->pc)
+		&& (j->native != NULL))
+		goto pd_jit;
+	goto *j->handler;
+#else
+	goto *pd_generic[ip->op];
+#endif
+}
+
+pd_jit_loop: {
+#ifdef LE_JIT
+	jit_pc_t *j = &(modp->jit[ip->pc]);
+	if (++ j->calls == JIT_LOOP_THRESHOLD)
+	{
+		uint32_t n;
+		set_module_ptr(jit_trace(modp, ip->pc, &n));
+		counter += n - 1;
+		PD_GOTO(gs_PC)
+		PD_DISPATCH
+	}
+	goto *j->handler;
+#else
+	goto *pd_generic[ip->op];
+#endif
+}
+
+pd_jit: {
+#ifdef LE_JIT
+	// Pending work is done at the safepoints of the interpreter
+	jit_pc_t *j = &(modp->jit[ip->pc]);
+	if (mach_ctx.pending)
+		goto *j->handler;
+	uint32_t n;
+	set_module_ptr(jit_run(modp, j->native, &n));
+	counter += n - 1;
+	PD_GOTO(gs_PC)
+	PD_DISPATCH
+#else
+	goto *pd_generic[ip->op];
+#endif
+}
+
+	// Superinstructions (traps report the PC of instruction p)
+#define SU(n)			su_##n : ;
+#define SU_TRAP(p, n)	{ gs_PC = (p)->pc + 1; le_trap(modp, n); }
+
+#include "le_super_ops.h"
+
+#undef SU
+#undef SU_TRAP
+
+	// Generic handlers continue at PC as left by the instruction
+#define OP(n)		op_##n : ;
+#define OPR(n, m)	op_##n : ;
+#define OP_DEFAULT	op_invalid : ;
+#define NEXT		{ ip = modp->pcode + gs_PC; PD_DISPATCH }
+
+#include "le_mcode_ops.h"
+
+#undef OP
+#undef OPR
+#undef OP_DEFAULT
+#undef NEXT
+#undef PD_NEXT
+#undef PD_SAFEPOINT
+#undef PD_GOTO
+#undef PD_DISPATCH
+
+done:
+	return counter;
+}
+
+
+// le_run_regir()
+// Threaded engine running on the register IR built by
+// ri_translate_module(). Operands are addressed through the base
+// pointer of their mode: the virtual registers, the local frame,
+// main memory or the table of constants. M-codes without a register
+// form run through the generic handlers in le_mcode_ops.h and
+// continue at the IR of the PC they leave. Called with exec_mod = 0,
+// it only exports its handler addresses to the translator.
+//
+__attribute__((noinline, noclone))
+uint32_t le_run_regir(uint8_t exec_mod, uint8_t mod, uint16_t pc)
+{
+	mod_entry_t *modp;		// Pointer to current module
+	uint8_t *code_p;		// Pointer to module code frame
+	uint16_t *global_p;		// Pointer to global frame at G
+	ri_instr_t *ip;			// Current IR instruction
+	uint32_t counter = 0;	// M-code counter
+	uint8_t modn;
+	uint16_t reg[MACH_EXSMEM_SZ];	// Virtual registers
+
+	// Base pointers of the operand modes
+	uint16_t *ri_base[RI_NUM_MODES] = {
+		[RI_REG] = reg, [RI_LOC] = NULL, [RI_MEM] = dsh_mem, [RI_IMM] = ri_imm
+	};
+
+	// Generic handlers indexed by opcode
+	static const void *const op_tab[256] = { OP_TABLE };
+
+	// Handlers of IR instructions
+	static const void *const ri_tab[RI_NUM_HANDLERS] = {
+		[RI_PUSH] = &&ri_push,		[RI_POP] = &&ri_pop,
+		[RI_MOV] = &&ri_mov,		[RI_LLA] = &&ri_lla,
+		[RI_ADD] = &&ri_add,		[RI_SUB] = &&ri_sub,
+		[RI_MUL] = &&ri_mul,		[RI_DIV] = &&ri_div,
+		[RI_MOD] = &&ri_mod,		[RI_IDIV] = &&ri_idiv,
+		[RI_IMOD] = &&ri_imod,		[RI_AND] = &&ri_and,
+		[RI_OR] = &&ri_or,
+		[RI_XOR] = &&ri_xor,		[RI_SHL] = &&ri_shl,
+		[RI_SHR] = &&ri_shr,		[RI_IN] = &&ri_in,
+		[RI_EQL] = &&ri_eql,		[RI_NEQ] = &&ri_neq,
+		[RI_LSS] = &&ri_lss,		[RI_LEQ] = &&ri_leq,
+		[RI_GTR] = &&ri_gtr,		[RI_GEQ] = &&ri_geq,
+		[RI_ULSS] = &&ri_ulss,		[RI_ULEQ] = &&ri_uleq,
+		[RI_UGTR] = &&ri_ugtr,		[RI_UGEQ] = &&ri_ugeq,
+		[RI_NEG] = &&ri_neg,		[RI_COM] = &&ri_com,
+		[RI_NOT] = &&ri_not,		[RI_ABS] = &&ri_abs,
+		[RI_LDX] = &&ri_ldx,		[RI_LDB] = &&ri_ldb,
+		[RI_STX] = &&ri_stx,		[RI_STB] = &&ri_stb,
+		[RI_CHK] = &&ri_chk,		[RI_ENTR] = &&ri_entr,
+		[RI_JP] = &&ri_jp,			[RI_JPB] = &&ri_jpb,
+		[RI_JZ] = &&ri_jz,			[RI_JZB] = &&ri_jzb,
+		[RI_JEQ] = &&ri_jeq,		[RI_JNE] = &&ri_jne,
+		[RI_JLT] = &&ri_jlt,		[RI_JLE] = &&ri_jle,
+		[RI_JGT] = &&ri_jgt,		[RI_JGE] = &&ri_jge,
+		[RI_JULT] = &&ri_jult,		[RI_JULE] = &&ri_jule,
+		[RI_JUGT] = &&ri_jugt,		[RI_JUGE] = &&ri_juge
+	};
+
+	if (exec_mod == 0)
 	{
-		return (uint8_t) code_p[gs_PC ++];
+		ri_handler = ri_tab;
+		ri_generic = op_tab;
+		return 0;
+	}
+
+	// The local frame is the base of mode RI_LOC
+#define local_p		(ri_base[RI_LOC])
+
+	// Operands of instruction ip
+#define RI_A		(ri_base[ip->am][ip->a])
+#define RI_B		(ri_base[ip->bm][ip->b])
+#define RI_D		(ri_base[ip->dm][ip->d])
+
+// RI_DISPATCH
+// Jump to the handler of instruction ip. PC and IR are kept up to
+// date for traps and the generic handlers.
+//
+#define RI_DISPATCH { \
+		gs_PC = ip->pc + 1; \
+		gs_IR = ip->op; \
+		counter += ip->n; \
+		goto *ip->handler; \
+	}
+
+// RI_GOTO
+// Continue at a computed PC of the current module, which must have
+// an entry in the index of the IR
+//
+#define RI_GOTO(pc) { \
+		uint16_t _pc = (pc); \
+		if (_pc == 0) \
+			goto done; \
+		if ((_pc >= modp->code_sz) || (modp->rcode_ix[_pc] == 0)) \
+		{ \
+			gs_PC = _pc; \
+			le_trap(modp, TRAP_CODE_OVF); \
+		} \
+		ip = modp->rcode + modp->rcode_ix[_pc]; \
+	}
+
+// RI_SAFEPOINT
+// Polls for pending work before the M-code at pc. This is the jump
+// target, not the PC of the instruction there, which may have
+// folded the loads at the target into its operands.
+//
+#define RI_SAFEPOINT(pc) { \
+		if (mach_ctx.pending) \
+		{ \
+			gs_PC = (pc); \
+			if (le_safepoint(modp, counter)) \
+			{ \
+				counter += le_run(exec_mod, modn, gs_PC); \
+				goto done; \
+			} \
+		} \
+	}
+
+// Continue with the next instruction
+#define RI_NEXT { \
+		ip ++; \
+		RI_DISPATCH \
 	}
 
-	// le_next2()
-	// Fetch next two instructions
-	//
-	uint16_t le_next2()
+// RI_JUMP_IF
+// Jump to the target of instruction ip if cond holds
+//
+#define RI_JUMP_IF(cond) { \
+		ip = (cond) ? ip->target : ip + 1; \
+		RI_DISPATCH \
+	}
+
+	// Setup registers; a run starting where the expression stack is
+	// not in memory (when the monitor hands it back) stays in the
+	// switch engine
+	set_module_ptr(mod);
+	if ((modp->rcode == NULL) || (pc >= modp->code_sz)
+		|| (modp->rcode_ix[pc] == 0))
+		return le_run_switch(exec_mod, mod, pc);
+	RI_GOTO(pc)
+	RI_DISPATCH
+
+ri_push:
+	es_push(RI_A);
+	RI_NEXT
+
+ri_pop:
+	RI_D = es_pop();
+	RI_NEXT
+
+ri_mov:
+	RI_D = RI_A;
+	RI_NEXT
+
+ri_lla:
+	RI_D = gs_L + RI_A;
+	RI_NEXT
+
+ri_add:
+	RI_D = RI_A + RI_B;
+	RI_NEXT
+
+ri_sub:
+	RI_D = RI_A - RI_B;
+	RI_NEXT
+
+ri_mul:
+	RI_D = (uint32_t) RI_A * RI_B;
+	RI_NEXT
+
+ri_div:
+	RI_D = RI_A / RI_B;
+	RI_NEXT
+
+ri_mod:
+	RI_D = RI_A % RI_B;
+	RI_NEXT
+
+ri_idiv:
+	RI_D = (int16_t) RI_A / (int16_t) RI_B;
+	RI_NEXT
+
+ri_imod:
+	RI_D = (int16_t) RI_A % (int16_t) RI_B;
+	RI_NEXT
+
+ri_and:
+	RI_D = RI_A & RI_B;
+	RI_NEXT
+
+ri_or:
+	RI_D = RI_A | RI_B;
+	RI_NEXT
+
+ri_xor:
+	RI_D = RI_A ^ RI_B;
+	RI_NEXT
+
+ri_shl:
+	RI_D = RI_A << (RI_B & 0xf);
+	RI_NEXT
+
+ri_shr:
+	RI_D = RI_A >> (RI_B & 0xf);
+	RI_NEXT
+
+ri_in: {
+	uint16_t i = RI_A;
+	RI_D = (0x8000 >> i) & RI_B;
+	RI_NEXT
+}
+
+ri_eql:
+	RI_D = (RI_A == RI_B) ? 1 : 0;
+	RI_NEXT
+
+ri_neq:
+	RI_D = (RI_A != RI_B) ? 1 : 0;
+	RI_NEXT
+
+ri_lss:
+	RI_D = ((int16_t) RI_A < (int16_t) RI_B) ? 1 : 0;
+	RI_NEXT
+
+ri_leq:
+	RI_D = ((int16_t) RI_A <= (int16_t) RI_B) ? 1 : 0;
+	RI_NEXT
+
+ri_gtr:
+	RI_D = ((int16_t) RI_A > (int16_t) RI_B) ? 1 : 0;
+	RI_NEXT
+
+ri_geq:
+	RI_D = ((int16_t) RI_A >= (int16_t) RI_B) ? 1 : 0;
+	RI_NEXT
+
+ri_ulss:
+	RI_D = (RI_A < RI_B) ? 1 : 0;
+	RI_NEXT
+
+ri_uleq:
+	RI_D = (RI_A <= RI_B) ? 1 : 0;
+	RI_NEXT
+
+ri_ugtr:
+	RI_D = (RI_A > RI_B) ? 1 : 0;
+	RI_NEXT
+
+ri_ugeq:
+	RI_D = (RI_A >= RI_B) ? 1 : 0;
+	RI_NEXT
+
+ri_neg:
+	RI_D = - (int16_t) RI_A;
+	RI_NEXT
+
+ri_com:
+	RI_D = ~RI_A;
+	RI_NEXT
+
+ri_not:
+	RI_D = (RI_A & 1) ? 0 : 1;
+	RI_NEXT
+
+ri_abs: {
+	int16_t i = RI_A;
+	RI_D = (i < 0) ? (-i) : i;
+	RI_NEXT
+}
+
+ri_ldx:
+	RI_D = dsh_mem[(uint16_t) (RI_A + RI_B)];
+	RI_NEXT
+
+ri_ldb: {
+	uint16_t i = RI_B;
+	uint16_t k = dsh_mem[(uint16_t) (RI_A + (i >> 1))];
+	RI_D = (i & 1) ? (uint8_t) k : (k >> 8);
+	RI_NEXT
+}
+
+ri_stx:
+	dsh_mem[(uint16_t) (RI_A + RI_B)] = RI_D;
+	RI_NEXT
+
+ri_stb: {
+	uint16_t k = RI_D;
+	uint16_t i = RI_B;
+	uint16_t *p = &(dsh_mem[(uint16_t) (RI_A + (i >> 1))]);
+	*p = (i & 1) ? ((*p & 0xff00) | k) : ((*p & 0x00ff) | (k << 8));
+	RI_NEXT
+}
+
+ri_chk: {
+	int16_t i = RI_A;
+	if ((i < (int16_t) RI_B) || (i > (int16_t) RI_D))
+		le_trap(modp, TRAP_INDEX);
+	RI_NEXT
+}
+
+ri_entr:
+	if (gs_S < MACH_DSHMEM_SZ - RI_A)
+		gs_S += RI_A;
+	else
+		le_trap(modp, TRAP_STACK_OVF);
+	RI_NEXT
+
+ri_jp:
+	ip = ip->target;
+	RI_DISPATCH
+
+ri_jpb:
+	RI_SAFEPOINT(ip->d)
+	ip = ip->target;
+	RI_DISPATCH
+
+ri_jz:
+	RI_JUMP_IF(RI_A == 0)
+
+ri_jzb:
+	if (RI_A != 0)
+		RI_NEXT
+	RI_SAFEPOINT(ip->d)
+	ip = ip->target;
+	RI_DISPATCH
+
+ri_jeq:
+	RI_JUMP_IF(RI_A == RI_B)
+
+ri_jne:
+	RI_JUMP_IF(RI_A != RI_B)
+
+ri_jlt:
+	RI_JUMP_IF((int16_t) RI_A < (int16_t) RI_B)
+
+ri_jle:
+	RI_JUMP_IF((int16_t) RI_A <= (int16_t) RI_B)
+
+ri_jgt:
+	RI_JUMP_IF((int16_t) RI_A > (int16_t) RI_B)
+
+ri_jge:
+	RI_JUMP_IF((int16_t) RI_A >= (int16_t) RI_B)
+
+ri_jult:
+	RI_JUMP_IF(RI_A < RI_B)
+
+ri_jule:
+	RI_JUMP_IF(RI_A <= RI_B)
+
+ri_jugt:
+	RI_JUMP_IF(RI_A > RI_B)
+
+ri_juge:
+	RI_JUMP_IF(RI_A >= RI_B)
+
+	// Generic handlers continue at PC as left by the instruction
+#define OP(n)		op_##n : ;
+#define OPR(n, m)	op_##n : ;
+#define OP_DEFAULT	op_invalid : ;
+#define NEXT		{ RI_GOTO(gs_PC) RI_DISPATCH }
+
+#include "le_mcode_ops.h"
+
+#undef OP
+#undef OPR
+#undef OP_DEFAULT
+#undef NEXT
+#undef RI_JUMP_IF
+#undef RI_NEXT
+#undef RI_SAFEPOINT
+#undef RI_GOTO
+#undef RI_DISPATCH
+#undef RI_A
+#undef RI_B
+#undef RI_D
+#undef local_p
+
+done:
+	return counter;
+}
+
+#endif
+
+
+// le_set_engine()
+// Selects the dispatch engine by name
+// Returns FALSE if the name is unknown or the engine not available
+//
+bool le_set_engine(char *name)
+{
+	if (strcmp(name, "switch") == 0)
+	{
+		le_engine = ENGINE_SWITCH;
+		return true;
+	}
+#ifdef LE_THREADED
+	if (strcmp(name, "threaded") == 0)
+	{
+		le_engine = ENGINE_THREADED;
+		return true;
+	}
+	if (strcmp(name, "tos") == 0)
+	{
+		le_engine = ENGINE_TOS;
+		return true;
+	}
+	if (strcmp(name, "super") == 0)
+	{
+		le_engine = ENGINE_SUPER;
+		return true;
+	}
+	if (strcmp(name, "regir") == 0)
+	{
+		le_engine = ENGINE_REGIR;
+		return true;
+	}
+#endif
+#ifdef LE_JIT
+	if (strcmp(name, "jit") == 0)
 	{
-		uint16_t w = le_next();
-		w = (w << 8) | le_next();
-		return w;
+		le_engine = ENGINE_JIT;
+		return true;
 	}
+#endif
+	return false;
+}
+
+
+// le_run_engine()
+// Runs the selected engine from PC pc of module mod until PC 0 is
+// reached. exec_mod is the module of the running program. While
+// tracing, breakpoints or profiling are enabled, every run uses the
+// instrumented engine, so the other engines need no hooks.
+// Returns the number of M-codes executed
+//
+uint32_t le_run_engine(uint8_t exec_mod, uint8_t mod, uint16_t pc)
+{
+	// Missing module body
+	if (pc == 0)
+		return 0;
+
+	// Tracing, breakpoints, profiling and the reference machine of a
+	// lockstep run need the instrumented engine
+	if (le_trace || breakpoint || le_profile || ls_reference())
+		return le_run_debug(exec_mod, mod, pc);
 
-	// set_module_ptr
-	// Set code and data pointers to specified module index
-	//
-	void set_module_ptr(uint16_t mod)
+	switch (le_engine)
 	{
-		modn = mod;
-		modp = &(module_tab[mod]);
-		code_p = modp->code;
-		gs_G = modp->data_ofs;
+#ifdef LE_THREADED
+		case ENGINE_THREADED :
+			return le_run_threaded(exec_mod, mod, pc);
+
+		case ENGINE_TOS :
+			return le_run_tos(exec_mod, mod, pc);
+
+		case ENGINE_SUPER :
+		case ENGINE_JIT :
+			return le_run_super(exec_mod, mod, pc);
+
+		case ENGINE_REGIR :
+			return le_run_regir(exec_mod, mod, pc);
+#endif
+
+		default :
+			return le_run_switch(exec_mod, mod, pc);
 	}
-	
+}
+
+
+// le_run()
+// Runs the selected engine like le_run_engine(). With an instruction
+// budget or in a lockstep run, the runs form a chain, so that the
+// safepoints can charge the M-codes of the innermost run. The caller
+// adds the returned count to its own counter, where it is already
+// charged.
+//
+uint32_t le_run(uint8_t exec_mod, uint8_t mod, uint16_t pc)
+{
+	if ((le_max_mcodes == 0) && (mach_ctx.ls == NULL))
+		return le_run_engine(exec_mod, mod, pc);
+
+	le_run_t run = { 0, mach_ctx.run };
+	mach_ctx.run = &run;
+	mach_ctx.pending = 1;
+
+	uint32_t n = le_run_engine(exec_mod, mod, pc);
+
+	mach_ctx.run = run.up;
+	mach_ctx.mcodes += n - run.charged;
+	if (run.up != NULL)
+		run.up->charged += n;
+	return n;
+}
+
+
+// le_execute()
+// Main interpreter entry
+// Executes specified module and returns the number of M-codes executed
+//
+uint32_t le_execute(uint8_t exec_mod)
+{
+	uint32_t counter;
+
 	// Set stack to first location above data frames
 	// and clear first 3 bytes to allow RTN from main module (#1)
 	gs_PC = gs_L = gs_CS = 0;
@@ -84,1424 +1380,8 @@ uint32_t le_execute(uint8_t exec_mod)
 	gs_S = data_top;
 	stk_mark(CALL_EXT, 0);
 
-	// Setup registers and call procedure 0 of module
-	set_module_ptr(exec_mod);
-	gs_PC = modp->proc[0];
-
-	do {
-		// Check for code overrun
-		if (gs_PC >= modp->code_sz)
-			le_trap(modp, TRAP_CODE_OVF);
-
-		// Interrupt handling
-		if (gs_REQ)
-		{
-			_HALT
-			le_transfer(true, 2 * gs_ReqNo, 2 * gs_ReqNo + 1);
-		}
-
-		// Enter monitor
-		le_monitor(modp);
-
-		// Get next instruction
-		gs_IR = le_next();
-		counter ++;
-
-		// Execute M-Code in IR
-		switch (gs_IR)
-		{
-		case 000 ... 017:
-			// LI0 - LI15 load immediate
-			es_push(gs_IR & 0xf);
-			break;
-
-		case 020 :
-			// LIB  load immediate byte
-			es_push(le_next());
-			break;
-
-		case 022 :
-			// LIW  load immediate word
-			es_push(le_next2());
-			break;
-
-		case 023 :
-			// LID  load immediate double word
-			es_push(le_next2());
-			es_push(le_next2());
-			break;
-
-		case 024 :
-			// LLA  load local address
-			es_push(gs_L + le_next());
-			break;
-
-		case 025 :
-			// LGA  load global address
-			es_push(gs_G + le_next());
-			break;
-
-		case 026 :
-			// LSA  load stack address
-			es_push(es_pop() + le_next());
-			break;
-
-		case 027 : {
-			// LEA  load external address
-			uint16_t ext_mod = le_next();		// Module number
-			uint16_t ext_adr = le_next();		// Data word offset number
-			es_push(module_tab[ext_mod].data_ofs + ext_adr);
-			break;
-		}
-
-		case 030 :
-			// JPC  jump conditional
-			if (es_pop() == 0)
-			{
-				uint16_t i = le_next2();
-				gs_PC += i - 2;
-			}
-			else
-			{
-				gs_PC += 2;
-			}
-			break;
-
-		case 031 : {
-			// JP   jump
-			uint16_t i = le_next2();
-			gs_PC += i - 2;
-			break;
-		}
-
-		case 032 :
-			// JPFC  jump forward conditional
-			if (es_pop() == 0)
-			{
-				uint8_t i = le_next();
-				gs_PC += i - 1;
-			}
-			else
-			{
-				gs_PC ++;
-			}
-			break;
-
-		case 033 : {
-			// JPF  jump forward
-			uint16_t i = le_next();
-			gs_PC += i - 1;
-			break;
-		}
-
-		case 034 :
-			// JPBC  jump backward conditional
-			if (es_pop() == 0)
-			{
-				uint8_t i = le_next();
-				gs_PC -= i + 1;
-			}
-			else
-			{
-				gs_PC ++;
-			}
-			break;
-
-		case 035 : {
-			// JPB  jump backward
-			uint8_t i = le_next();
-			gs_PC -= i + 1;
-			break;
-		}
-
-		case 036 :
-			// ORJP  short circuit OR
-			if (es_pop() == 0)
-			{
-				gs_PC ++;
-			}
-			else
-			{
-				es_push(1);
-				uint8_t i = le_next();
-				gs_PC += i - 1;
-			}
-			break;
-
-		case 037 :
-			// ANDJP  short circuit AND
-			if (es_pop() == 0)
-			{
-				es_push(0);
-				uint8_t i = le_next();
-				gs_PC += i - 1;
-			}
-			else
-			{
-				gs_PC ++;
-			}
-			break;
-
-		case 040 :
-			// LLW  load local word
-			es_push(dsh_mem[gs_L + le_next()]);
-			break;
-
-		case 041 : {
-			// LLD  load local double word
-			uint16_t i = gs_L + le_next();
-			es_push(dsh_mem[i]);
-			es_push(dsh_mem[i + 1]);
-			break;
-		}
-
-		case 042 : {
-			// LEW  load external word
-			uint8_t ext_mod = le_next();		// Module number
-			uint8_t ext_adr = le_next();		// Data word offset
-			es_push(dsh_mem[module_tab[ext_mod].data_ofs + ext_adr]);
-			break;
-		}
-
-		case 043 : {
-			// LED
-			uint8_t ext_mod = le_next();		// Module number
-			uint8_t ext_adr = le_next();		// Data word offset
-			uint16_t ofs = module_tab[ext_mod].data_ofs + ext_adr;
-			es_push(dsh_mem[ofs]);
-			es_push(dsh_mem[ofs + 1]);
-			break;
-		}
-
-		case 044 ... 057 :
-			// LLW4-LLW15
-			es_push(dsh_mem[gs_L + (gs_IR & 0xf)]);
-			break;
-
-		case 060 :
-			// SLW  store local word
-			dsh_mem[gs_L + le_next()] = es_pop();
-			break;
-
-		case 061 : {
-			// SLD  store local double word
-			uint16_t i = gs_L + le_next();
-			dsh_mem[i + 1] = es_pop();
-			dsh_mem[i] = es_pop();
-			break;
-		}
-
-		case 062 : {
-			// SEW  store external word
-			uint8_t ext_mod = le_next();		// Module number
-			uint8_t ext_adr = le_next();		// Data word offset
-			dsh_mem[module_tab[ext_mod].data_ofs + ext_adr] = es_pop();
-			break;
-		}
-
-		case 063 : {
-			// SED  store external double word
-			_HALT
-			uint8_t ext_mod = le_next();		// Module number
-			uint8_t ext_adr = le_next();		// Data word offset
-			uint16_t ofs = module_tab[ext_mod].data_ofs + ext_adr;
-			dsh_mem[ofs + 1] = es_pop();
-			dsh_mem[ofs] = es_pop();
-			break;
-		}
-
-		case 064 ... 077 :
-			// SLW4-SLW15  store local word
-			dsh_mem[gs_L + (gs_IR & 0xf)] = es_pop();
-			break;
-
-		case 0100 :
-			// LGW  load global word
-			es_push(dsh_mem[gs_G + le_next()]);
-			break;
-
-		case 0101 : {
-			// LGD  load global double word
-			uint8_t i = gs_G + le_next();
-			es_push(dsh_mem[i]);
-			es_push(dsh_mem[i + 1]);
-			break;
-		}
-
-		case 0102 ... 0117 :
-			// LGW2 - LGW15  load global word
-			es_push(dsh_mem[gs_G + (gs_IR & 0xf)]);
-			break;
-
-		case 0120 :
-			// SGW  store global word
-			dsh_mem[gs_G + le_next()] = es_pop();
-			break;
-
-		case 0121 : {
-			// SGD  store global double word
-			uint16_t i = gs_G + le_next();
-			dsh_mem[i + 1] = es_pop();
-			dsh_mem[i] = es_pop();
-			break;
-		}
-
-		case 0122 ... 0137 :
-			// SGW2 - SGW15  store global word
-			dsh_mem[gs_G + (gs_IR & 0xf)] = es_pop();
-			break;
-
-		case 0140 ... 0157 :
-			// LSW0 - LSW15  load stack addressed word
-			es_push(dsh_mem[es_pop() + (gs_IR & 0xf)]);
-			break;
-
-		case 0160 ... 0177 : {
-			// SSW0 - SSW15  store stack-addressed word
-			uint16_t k = es_pop();
-			uint16_t i = es_pop() + (gs_IR & 0xf);
-			dsh_mem[i] = k;
-			break;
-		}
-
-		case 0200 : {
-			// LSW  load stack word
-			uint16_t i = es_pop() + le_next();
-			es_push(dsh_mem[i]);
-			break;
-		}
-
-		case 0201 : {
-			// LSD  load stack double word
-			uint16_t i = es_pop() + le_next();
-			es_push(dsh_mem[i]);
-			es_push(dsh_mem[i + 1]);
-			break;
-		}
-
-		case 0202 : {
-			// LSD0  load stack double word
-			uint16_t i = es_pop();
-			es_push(dsh_mem[i]);
-			es_push(dsh_mem[i + 1]);
-			break;
-		}
-
-		case 0203 : {
-			// LXFW  load indexed frame word
-			_HALT
-			uint16_t i = es_pop();
-			i += es_pop() << 2;
-			es_push(dsh_mem[i]);
-			break;
-		}
-
-		case 0204 :
-			// LSTA  load string address
-			es_push(dsh_mem[gs_G + 2] + le_next());
-			break;
-
-		case 0205 : {
-			// LXB  load indexed byte
-			uint16_t i = es_pop();
-			uint16_t j = es_pop();
-			uint16_t k = dsh_mem[j + (i >> 1)];
-			es_push((i & 1) ? (uint8_t) k : (k >> 8));
-			break;
-		}
-
-		case 0206 : {
-			// LXW  load indexed word
-			uint16_t i = es_pop();
-			es_push(dsh_mem[i + es_pop()]);
-			break;
-		}
-
-		case 0207 : {
-			// LXD  load indexed double word
-			uint16_t i = es_pop() << 1;
-			i += es_pop();
-			es_push(dsh_mem[i]);
-			es_push(dsh_mem[i + 1]);
-			break;
-		}
-
-		case 0210 : {
-			// DADD  double add
-			floatword_t y = es_dpop();
-			floatword_t x = es_dpop();
-			floatword_t z;
-			z.l = x.l + y.l;
-			es_dpush(z);
-			break;
-		}
-
-		case 0211 : {
-			// DSUB  double subtract
-			floatword_t y = es_dpop();
-			floatword_t x = es_dpop();
-			floatword_t z;
-			z.l = x.l - y.l;
-			es_dpush(z);
-			break;
-		}
-
-		case 0212 : {
-			// DMUL  double multiply
-			floatword_t y = es_dpop();
-			floatword_t x = es_dpop();
-			floatword_t z;
-			z.l = x.l * y.l;
-			es_dpush(z);
-			break;
-		}
-
-		case 0213 : {
-			// DDIV  double divide
-			floatword_t y = es_dpop();
-			floatword_t x = es_dpop();
-			floatword_t z;
-			z.l = x.l / y.l;
-			es_dpush(z);
-			break;
-		}
-
-		case 0216 : {
-			// DSHL  double shift left
-			floatword_t x = es_dpop();
-			floatword_t z;
-			z.l = x.l << 1;
-			es_dpush(z);
-			break;
-		}
-
-		case 0217 : {
-			// DSHR  double shift right
-			floatword_t x = es_dpop();
-			floatword_t z;
-			z.l = x.l >> 1;
-			es_dpush(z);
-			break;
-		}
-
-		case 0220 : {
-			// SSW  store stack word
-			_HALT
-			uint16_t k = es_pop();
-			uint16_t i = es_pop() + le_next();
-			dsh_mem[gs_S + i] = k;
-			break;
-		}
-
-		case 0221 : {
-			// SSD  store stack double word
-			uint16_t k = es_pop();
-			uint16_t j = es_pop();
-			uint16_t i = es_pop() + le_next();
-			dsh_mem[i] = j;
-			dsh_mem[i + 1] = k;
-			break;
-		}
-
-		case 0222 : {
-			// SSD0  store stack double word
-			uint16_t k = es_pop();
-			uint16_t j = es_pop();
-			uint16_t i = es_pop();
-			dsh_mem[i] = j;
-			dsh_mem[i + 1] = k;
-			break;
-		}
-
-		case 0223 : {
-			// SXFW  store indexed frame word
-			_HALT
-			uint16_t i = es_pop();
-			uint16_t k = es_pop();
-			k += es_pop() << 2;
-			dsh_mem[gs_S + k] = i;
-			break;
-		}
-
-		case 0224 : {
-			// TS  test and set
-			uint16_t adr = es_pop();
-			es_push(dsh_mem[adr]);
-			dsh_mem[adr] = 1;
-			break;
-		}
-
-		case 0225 : {
-			// SXB  store indexed byte
-			uint16_t k = es_pop();
-			uint16_t i = es_pop();
-			uint16_t j = es_pop() + (i >> 1);
-			dsh_mem[j] = (i & 1) ? 
-				((dsh_mem[j] & 0xff00) | k) : 
-				((dsh_mem[j] & 0x00ff) | (k << 8));
-			break;
-		}
-
-		case 0226 : {
-			// SXW  store indexed word
-			uint16_t k = es_pop();
-			uint16_t i = es_pop();
-			dsh_mem[i + es_pop()] = k;
-			break;
-		}
-
-		case 0227 : {
-			// SXD  store indexed double word
-			_HALT
-			uint16_t k = es_pop();
-			uint16_t j = es_pop();
-			uint16_t i = es_pop() << 2;
-			i += gs_S + es_pop();
-			dsh_mem[i] = j;
-			dsh_mem[i + 1] = k;
-			break;
-		}
-
-		case 0230 : {
-			// FADD  floating add
-			floatword_t y = es_dpop();
-			floatword_t x = es_dpop();
-			x.f += y.f;
-			es_dpush(x);
-			break;
-		}
-
-		case 0231 : {
-			// FSUB  floating subtract
-			floatword_t y = es_dpop();
-			floatword_t x = es_dpop();
-			x.f -= y.f;
-			es_dpush(x);
-			break;
-		}
-
-		case 0232 : {
-			// FMUL  floating multiply
-			floatword_t y = es_dpop();
-			floatword_t x = es_dpop();
-
-			// 4x * 4y = 16xy, so divide by 4 to fix result
-			x.f = (x.f * y.f) * 0.25;
-			es_dpush(x);
-			break;
-		}
-
-		case 0233 : {
-			// FDIV  floating divide
-			floatword_t y = es_dpop();
-			floatword_t x = es_dpop();
-
-			// 4x/4y=xy, so multiply by 4 to fix result
-			x.f = (4.0 * x.f) / y.f;
-			es_dpush(x);
-			break;
-		}
-
-		case 0234 : {
-			// FCMP  floating compare
-			float x = es_dpop().f;
-			float y = es_dpop().f;
-			if (x > y)
-			{
-				es_push(0);
-				es_push(1);		
-			}
-			else if (x < y)
-			{
-				es_push(1);
-				es_push(0);		
-			}
-			else{
-				es_push(0);
-				es_push(0);		
-			}
-			break;
-		}
-
-		case 0235 : {
-			// FABS  floating absolute value
-			floatword_t x = es_dpop();
-			if (x.f < 0.0) 
-				x.f = -x.f;
-			es_dpush(x);
-			break;
-		}
-
-		case 0236 : {
-			// FNEG  floating negative
-			floatword_t x = es_dpop();
-			x.f = -x.f;
-			es_dpush(x);
-			break;
-		}
-
-		case 0237 : {
-			// FFCT  floating functions
-			uint8_t i = le_next();
-			floatword_t z;
-			switch (i)
-			{
-				case 0 :
-					// Convert INTEGER to REAL
-					// Multiply result by 4 to fix to IEEE754 standard
-					z.f = ((float) es_pop()) * 4.0;
-					es_dpush(z);
-					break;
-
-				case 1 : {
-					// CONVERT long (32-bit) integer TO REAL
-					// Multiply result by 4 to fix to IEEE754 standard
-					floatword_t z1 = es_dpop();
-					z.f = ((float) z1.l) * 4.0;
-					es_dpush(z);
-					break;
-				}
-
-				case 2 :
-					// Convert REAL to INTEGER
-					// Divide value by 4 to fix to IEEE754 standard
-					z = es_dpop();
-					es_push((int16_t) (z.f * 0.25));
-					break;
-
-				case 3 : {
-					// Fix REAL with specified bias
-					uint16_t bias = es_pop() >> 7;	// bias (exponent)
-					z = es_dpop();					// REAL
-
-					uint8_t ex = z.bf.e;			// Exponent
-					uint32_t mask = 1 << 22;		// MSB of mantissa
-
-					// Increase exponent and rshift mantissa (= DIV 2)
-					while (ex < bias)
-					{
-						ex ++;
-						z.bf.m = (z.bf.m >> 1) | mask;
-						mask = 0;
-					}
-					z.bf.e = (z.bf.e < bias) ? 0 : 1;
-					es_dpush(z);
-					break;
-				}
-
-				default :
-					break;
-			}
-			break;
-		}
-
-		case 0240 : {
-			// READ
-			uint16_t i = es_pop();
-			uint16_t k = es_pop();
-			dsh_mem[i] = le_ioread(k);
-			break;
-		}
-
-		case 0241 : {
-			// WRITE
-			_HALT
-			uint16_t i = es_pop();
-			uint16_t k = es_pop();
-			le_iowrite(k, i);
-			break;
-		}
-
-		case 0242 :
-			// DSKR  disk read
-			error (1, 0, "DSKR not implemented");
-			break;
-
-		case 0243 :
-			// DSKW  disk write
-			error (1, 0, "DSKW not implemented");
-			break;
-
-		case 0244 :
-			// SETRK  set disk track
-			error (1, 0, "SETRK not implemented");
-			break;
-
-		case 0245 : {
-			// UCHK
-			_HALT
-			uint16_t k = es_pop();
-			uint16_t j = es_pop();
-			uint16_t i = es_pop();
-			es_push(i);
-			if ((i < j) || (i > k))
-				le_trap(modp, TRAP_INDEX);
-			break;
-		}
-
-		case 0246 : {
-			// SVC  system hook (emulator only)
-			uint8_t call = le_next();
-			if (call != 1)
-			{
-				// All calls except external module load
-				le_supervisor_call(exec_mod, call);
-			}
-			else
-			{
-				// Load external module
-				uint16_t ln = es_pop() + 2;	// HIGH of filename parameter
-				uint16_t sz = ln >> 1;		// # of stack words for filename
-
-				// Copy filename to own buffer
-				char *fn = malloc(ln);
-				fs_swapcpy(fn, (char *) &(dsh_mem[gs_S - sz]), ln - 1); 
-
-				// Save the stack, since it will be overwritten by loaded module
-				// We need to save datatop...gs_S
-				uint16_t saved_gs_L = gs_L;
-				uint16_t saved_gs_CS = gs_CS;
-				uint16_t saved_gs_PC = gs_PC;
-				uint16_t saved_gs_SP = gs_SP;
-				uint16_t saved_data_top = data_top;
-				data_top = gs_S;
-
-				// Try to load and execute the module
-				uint8_t top = le_load_initfile(fn, "SYS");
-				if (top > 0)
-					le_execute(top);
-
-				// Restore the stack
-				gs_S = data_top;
-				data_top = saved_data_top;
-				gs_SP = saved_gs_SP;
-				gs_PC = saved_gs_PC;
-				gs_CS = saved_gs_CS;
-				gs_L = saved_gs_L;
-				free(fn);
-
-				// Push return result
-				es_push((top > 0) ? 1 : 0);
-			}
-			break;
-		}
-
-		case 0247 :
-			// SYS  rarely used system functions
-			le_system_call(le_next());
-			break;
-
-		case 0250 :
-			// ENTP  entry priority
-			dsh_mem[gs_L + 3] = gs_M;
-			gs_M = 0xffff << (16 - le_next());
-			break;
-
-		case 0251 :
-			// EXP  exit priority
-			gs_M = dsh_mem[gs_L + 3];
-			break;
-
-		case 0252 : {
-			// ULSS
-			uint16_t j = es_pop();
-			uint16_t i = es_pop();
-			es_push((i < j) ? 1 : 0);
-			break;
-		}
-
-		case 0253 : {
-			// ULEQ
-			uint16_t j = es_pop();
-			uint16_t i = es_pop();
-			es_push((i <= j) ? 1 : 0);
-			break;
-		}
-
-		case 0254 : {
-			// UGTR
-			uint16_t j = es_pop();
-			uint16_t i = es_pop();
-			es_push((i > j) ? 1 : 0);
-			break;
-		}
-
-		case 0255 : {
-			// UGEQ
-			uint16_t j = es_pop();
-			uint16_t i = es_pop();
-			es_push((i >= j) ? 1 : 0);
-			break;
-		}
-
-		case 0256 : {
-			// TRA  coroutine transfer
-			_HALT
-			uint16_t i = es_pop();
-			uint16_t j = es_pop();
-			le_transfer((le_next() != 0), i, j);
-			break;
-		}
-
-		case 0257 : {
-			// RDS  read string
-			_HALT
-			uint16_t k = gs_S + es_pop();
-			int8_t i = le_next();
-			do {
-				dsh_mem[k++] = le_next2();
-			} while (i-- >= 0);
-			break;
-		}
-
-		case 0260 : {
-			// LODFW  reload stack after function return
-			uint16_t i = es_pop();
-			es_restore();
-			es_push(i);
-			break;
-		}
-
-		case 0261 : {
-			// LODFD  reload stack after function return
-			uint16_t i = es_pop();
-			uint16_t j = es_pop();
-			es_restore();
-			es_push(j);
-			es_push(i);
-			break;
-		}
-
-		case 0262 :
-			// STORE
-			es_save();
-			break;
-
-		case 0263 : {
-			// STOFV
-			_HALT
-			uint16_t i = es_pop();
-			es_save();
-			dsh_mem[gs_S ++] = i;
-			break;
-		}
-
-		case 0264 :
-			// STOT  copy from stack to procedure stack
-			dsh_mem[gs_S ++] = es_pop();
-			break;
-
-		case 0265 : {
-			// COPT  copy element on top of expression stack
-			uint16_t i = es_pop();
-			es_push(i);
-			es_push(i);
-			break;
-		}
-
-		case 0266 :
-			// DECS  decrement stackpointer
-			gs_S --;
-			break;
-
-		case 0267 : {
-			// PCOP  allocation and copy of value parameter
-			dsh_mem[gs_L + le_next()] = gs_S;
-			uint16_t sz = es_pop();
-			uint16_t adr = es_pop();
-
-			// Copy words from memory into stack
-			memcpy(&(dsh_mem[gs_S]), &(dsh_mem[adr]), sz << 1);
-			gs_S += sz;
-			break;
-		}
-
-		case 0270 : {
-			// UADD
-			uint16_t j = es_pop();
-			uint16_t i = es_pop();
-			es_push(i + j);
-			break;
-		}
-
-		case 0271 : {
-			// USUB
-			uint16_t j = es_pop();
-			uint16_t i = es_pop();
-			es_push(i - j);
-			break;
-		}
-
-		case 0272 : {
-			// UMUL
-			uint16_t j = es_pop();
-			uint16_t i = es_pop();
-			es_push(i * j);
-			break;
-		}
-
-		case 0273 : {
-			// UDIV
-			uint16_t j = es_pop();
-			uint16_t i = es_pop();
-			es_push(i / j);
-			break;
-		}
-
-		case 0274 : {
-			// UMOD
-			uint16_t j = es_pop();
-			uint16_t i = es_pop();
-			es_push(i % j);
-			break;
-		}
-
-		case 0275 : {
-			// ROR
-			uint16_t i = es_pop() & 0xf;
-			uint16_t j = es_pop();
-			uint32_t k = (j << 16) >> i;
-			es_push((k >> 16) | (k & 0xffff));
-			break;
-		}
-
-		case 0276 : {
-			// SHL
-			uint16_t i = es_pop() & 0xf;
-			uint16_t j = es_pop();
-			es_push(j << i);
-			break;
-		}
-
-		case 0277 : {
-			// SHR
-			uint16_t i = es_pop() & 0xf;
-			uint16_t j = es_pop();
-			es_push(j >> i);
-			break;
-		}
-
-		case 0300 : {
-			// FOR1  enter FOR statement
-			uint8_t sign = le_next();
-			int16_t hi = es_pop();
-			int16_t low = es_pop();
-			uint16_t adr = es_pop();
-			uint16_t jmp = gs_PC + 2;
-			jmp += (int16_t) le_next2() - 2;
-			if (((sign == 0) && (low <= hi))
-				|| ((sign != 0) && (low >= hi)))
-			{
-				dsh_mem[adr] = low;
-				dsh_mem[gs_S] = adr;
-				dsh_mem[gs_S + 1] = hi;
-				gs_S += 2;
-			}
-			else
-			{
-				gs_PC = jmp;
-			}
-			break;
-		}
-
-		case 0301 : {
-			// FOR2  exit FOR statement
-			int16_t hi = dsh_mem[gs_S - 1];
-			uint16_t adr = dsh_mem[gs_S - 2];
-			int8_t step = le_next();
-			uint16_t jmp = gs_PC;
-			jmp += (int16_t) le_next2();
-			int16_t i = dsh_mem[adr] + step;
-			if (((step >= 0) && (i > hi)) || ((step <= 0) && (i < hi)))
-			{
-				gs_S -= 2;
-			}
-			else
-			{
-				dsh_mem[adr] = i;
-				gs_PC = jmp;
-			}
-			break;
-		}
-
-		case 0302 : {
-			// ENTC  enter CASE statement
-			uint16_t i = le_next2();
-			gs_PC += i - 2;
-			uint16_t k = es_pop();
-			uint16_t low = le_next2();
-			uint16_t hi = le_next2();
-
-			dsh_mem[gs_S ++] = gs_PC + ((hi - low) << 1) + 4;
-			if ((k >= low) && (k <= hi))
-				gs_PC += (k - low + 1) << 1;
-			i = le_next2();
-			gs_PC += i - 2;
-			break;
-		}
-
-		case 0303 :
-			// EXC  exit CASE statement
-			gs_PC = dsh_mem[-- gs_S];
-			break;
-
-		case 0304 : {
-			// TRAP
-			le_trap(modp, es_pop());
-			break;
-		}
-
-		case 0305 : {
-			// CHK
-			int16_t hi = es_pop();
-			int16_t lo = es_pop();
-			int16_t i = es_pop();
-			es_push(i);
-			if ((i < lo) || (i > hi))
-				le_trap(modp, TRAP_INDEX);
-			break;
-		}
-
-		case 0306 : {
-			// CHKZ
-			int16_t hi = es_pop();
-			int16_t i = es_pop();
-			es_push(i);
-			if ((i < 0) || (i > hi))
-				le_trap(modp, TRAP_INDEX);
-			break;
-		}
-
-		case 0307 :
-			// CHKS  check sign bit
-			int16_t k = es_pop();
-			es_push(k);
-			if (k < 0)
-				le_trap(modp, TRAP_INDEX);
-			break;
-
-		case 0310 : {
-			// EQL
-			uint16_t j = es_pop();
-			uint16_t i = es_pop();
-			es_push((i == j) ? 1 : 0);
-			break;
-		}
-
-		case 0311 : {
-			// NEQ
-			uint16_t j = es_pop();
-			uint16_t i = es_pop();
-			es_push((i != j) ? 1 : 0);
-			break;
-		}
-
-		case 0312 : {
-			// LSS
-			int16_t j = es_pop();
-			int16_t i = es_pop();
-			es_push((i < j) ? 1 : 0);
-			break;
-		}
-
-		case 0313 : {
-			// LEQ
-			int16_t j = es_pop();
-			int16_t i = es_pop();
-			es_push((i <= j) ? 1 : 0);
-			break;
-		}
-
-		case 0314 : {
-			// GTR
-			int16_t j = es_pop();
-			int16_t i = es_pop();
-			es_push((i > j) ? 1 : 0);
-			break;
-		}
-
-		case 0315 : {
-			// GEQ
-			int16_t j = es_pop();
-			int16_t i = es_pop();
-			es_push((i >= j) ? 1 : 0);
-			break;
-		}
-
-		case 0316 : {
-			// ABS
-			int16_t i = es_pop();
-			es_push((i < 0) ? (-i) : i);
-			break;
-		}
-
-		case 0317 : {
-			// NEG
-			int16_t i = es_pop();
-			es_push(-i);
-			break;
-		}
-
-		case 0320 : {
-			// OR
-			uint16_t j = es_pop();
-			uint16_t i = es_pop();
-			es_push(i | j);
-			break;
-		}
-
-		case 0321 : {
-			// XOR
-			uint16_t j = es_pop();
-			uint16_t i = es_pop();
-			es_push(i ^ j);
-			break;
-		}
-
-		case 0322 : {
-			// AND
-			uint16_t j = es_pop();
-			uint16_t i = es_pop();
-			es_push(i & j);
-			break;
-		}
-
-		case 0323 :
-			// COM
-			es_push(~es_pop());
-			break;
-
-		case 0324 : {
-			// IN (bitset)
-			uint16_t j = es_pop();
-			uint16_t i = es_pop();
-			es_push((0x8000 >> i) & j);
-			break;
-		}
-
-		case 0325 :
-			// LIN  load immediate NIL
-			es_push(0xffff);
-			break;
-
-		case 0326 : {
-			// MSK
-			uint16_t i = es_pop() & 0xf;
-			es_push( 0xffff << (i - 16) );
-			break;
-		}
-
-		case 0327 :
-			// NOT
-			es_push((es_pop() & 1) ? 0 : 1);
-			break;
-
-		case 0330 : {
-			// IADD
-			int16_t j = es_pop();
-			int16_t i = es_pop();
-			es_push(i + j);
-			break;
-		}
-
-		case 0331 : {
-			// ISUB
-			int16_t j = es_pop();
-			int16_t i = es_pop();
-			es_push(i - j);
-			break;
-		}
-
-		case 0332 : {
-			// IMUL
-			int16_t j = es_pop();
-			int16_t i = es_pop();
-			es_push(i * j);
-			break;
-		}
-
-		case 0333 : {
-			// IDIV
-			int16_t j = es_pop();
-			int16_t i = es_pop();
-			es_push(i / j);
-			break;
-		}
-
-		case 0334 : {
-			// MOD
-			int16_t j = es_pop();
-			int16_t i = es_pop();
-			es_push(i % j);
-			break;
-		}
-
-		case 0335 : {
-			// BIT
-			_HALT
-			uint16_t j = es_pop() & 0xf;
-			es_push(0x8000 >> j);
-			break;
-		}
-
-		case 0336 :
-			// NOP
-			break;
-
-		case 0337 : {
-			// MOVF  move frame
-			_HALT
-			// uint16_t i = es_pop();
-			// uint16_t j = es_pop();
-			// j += es_pop() << 2;
-			// uint16_t k = es_pop();
-			// k += es_pop() << 2;
-			// while (i-- > 0)
-			// 	dsh_mem[k ++] = dsh_mem[j ++];
-			break;
-		}
-
-		case 0340 : {
-			// MOV  move block
-			uint16_t k = es_pop();
-			uint16_t j = es_pop();
-			uint16_t i = es_pop();
-			memcpy(&(dsh_mem[i]), &(dsh_mem[j]), k << 1);
-			break;
-		}
-
-		case 0341 : {
-			// CMP  compare blocks
-			_HALT
-			uint16_t k = es_pop();
-			uint16_t j = es_pop();
-			uint16_t i = es_pop();
-			if (k == 0)
-			{
-				es_push(0);
-				es_push(0);
-			}
-			else
-			{
-				while ((dsh_mem[i] != dsh_mem[j]) && (k > 0))
-				{
-					i ++; j++; k--;
-				}
-				es_push(dsh_mem[i]);
-				es_push(dsh_mem[j]);
-			}
-			break;
-		}
-
-		case 0342 : {
-			// DDT  display dot
-//          (* display point at <j,k> in mode i inside
-//             bitmap dbmd *) |
-			_HALT
-			// uint16_t k = es_pop();
-			// uint16_t j = es_pop();
-			// uint16_t dbmd = es_pop();
-			// uint16_t i = es_pop();
-			break;
-		}
-
-		case 0343 : {
-			// REPL  replicate pattern
-//          (* replicate pattern sb over block db inside
-//             bitmap dbmd in mode i *) |
-			_HALT
-			// uint16_t db = es_pop();
-			// uint16_t sb = es_pop();
-			// uint16_t dbmd = es_pop();
-			// uint16_t i = es_pop();
-			break;
-		}
-
-		case 0344 : {
-			// BBLT  bit block transfer
-//          (* transfer block sb in bitmap sbmd to block db
-//             inside bitmap dbmd in mode i *) |
-			_HALT
-			// uint16_t sbmd = es_pop();
-			// uint16_t db = es_pop();
-			// uint16_t sb = es_pop();
-			// uint16_t dbmd = es_pop();
-			// uint16_t i = es_pop();
-			break;
-		}
-
-		case 0345 : {
-			// DCH  display character
-//          (* copy bit pattern for character ch from font fo
-//             to block db inside bitmap dbmd *) |
-			uint16_t ch = es_pop();
-			// uint16_t db = es_pop();
-			// uint16_t fo = es_pop();
-			// uint16_t dbmd = es_pop();
-			le_putchar(ch);
-			break;
-		}
-
-		case 0346 : {
-			// UNPK  unpack
-			// Extract bits i..i+n-1 from x and shift right
-			uint16_t x = es_pop();
-			uint16_t n = es_pop();
-			uint16_t i = es_pop();
-
-			uint16_t sh = 16 - i - n;
-			uint16_t rmask = ((1 << n) - 1) << sh;
-
-			x = (x & rmask) >> sh;
-			es_push(x);
-			break;
-		}
-
-		case 0347 : {
-			// PACK  pack
-			// Pack the rightmost n bits of x into positions
-			// i..i+n-1 of word [adr]
-			uint16_t x = es_pop();
-			uint16_t n = es_pop();
-			uint16_t i = es_pop();
-			uint16_t adr = es_pop();
-
-			// Isolate rightmost n bits
-			uint16_t rmask = (1 << n) - 1;
-			x &= rmask;
-
-
-			// Determine shift amount
-			uint16_t sh = 16 - i - n;
-
-			// Shift both mask and value to target position
-			rmask <<= sh;
-			x <<= sh;
-
-			// Clear and overwrite target bits
-			dsh_mem[adr] = (dsh_mem[adr] & (~rmask)) | x;
-			break;
-		}
-
-		case 0350 : {
-			// GB  get base adr n levels down
-			uint16_t i = gs_L;
-			uint8_t j = le_next();
-			do {
-				i = dsh_mem[i + 1];
-			} while (--j != 0);
-			es_push(i);
-			break;
-		}
-
-		case 0351 :
-			// GB1  get base adr 1 level down
-			es_push(dsh_mem[gs_L + 1]);
-			break;
-
-		case 0352 : {
-			// ALLOC  allocate block
-			uint16_t i = es_pop();
-			if (gs_S < MACH_DSHMEM_SZ - i)
-			{
-				es_push(gs_S);
-				gs_S += i;
-			}
-			else
-			{
-				le_trap(modp, TRAP_STACK_OVF);
-			}
-			break;
-		}
-
-		case 0353 : {
-			// ENTR  enter procedure
-			uint8_t i = le_next();
-			if (gs_S < MACH_DSHMEM_SZ - i)
-				gs_S += i;
-			else
-				le_trap(modp, TRAP_STACK_OVF);
-			break;
-		}
-
-		case 0354 : {
-			// RTN  return from procedure
-			// Reset stack pointer to previous state
-			gs_S = gs_CS;
-
-			// Restore caller status from stack
-			gs_PC = dsh_mem[gs_S + 2];
-
-			uint16_t call_mod = dsh_mem[gs_S];
-			if (call_mod >= 0x100)
-			{
-				// Local call
-				gs_CS = call_mod - 0x100;
-				gs_L = gs_CS;
-			}
-			else
-			{
-				// External call (mem[S] contains module number)
-				gs_L = dsh_mem[gs_S + 1];
-				gs_CS = gs_L;
-				set_module_ptr((uint8_t) call_mod);
-			}
-			break;
-		}
-
-		case 0355 : {
-			// CLX  call external procedure
-			uint8_t call_mod = le_next();		// Module number
-			uint8_t call_proc = le_next();		// Procedure number
-			if ((call_mod != 0) || (call_proc != 0))
-			{
-				// Ignore calls to System.0
-				stk_mark(CALL_EXT, modn);
-				set_module_ptr(call_mod);
-				gs_PC = modp->proc[call_proc];
-			}
-			break;
-		}
-
-		case 0356 : {
-			// CLI  call procedure at intermediate level
-			uint8_t i = le_next();
-			uint16_t base = es_pop();
-			stk_mark(CALL_LEVEL, base);
-			gs_PC = modp->proc[i];
-			break;
-		}
-
-		case 0357 : {
-			// CLF  call formal procedure
-			uint16_t i = dsh_mem[gs_S - 1];
-			uint16_t call_mod = i >> 8;
-			uint16_t call_proc = i & 0xff;
-			stk_mark(CALL_FORMAL, modn);
-			set_module_ptr(call_mod);
-			gs_PC = modp->proc[call_proc];
-			break;
-		}
-
-		case 0360 : {
-			// CLL  call local procedure
-			uint8_t i = le_next();
-			stk_mark(CALL_LOCAL, 0);
-			gs_PC = modp->proc[i];
-			break;
-		}
-
-		case 0361 ... 0377 :
-			// CLL1 - CLL15  call local procedure
-			stk_mark(CALL_LOCAL, 0);
-			gs_PC = modp->proc[gs_IR & 0xf];
-			break;
-
-		default :
-			le_trap(modp, TRAP_INV_OPC);
-			break;
-		}
-	} while (gs_PC != 0);
+	// Run module body in the selected engine
+	counter = le_run(exec_mod, exec_mod, module_tab[exec_mod].proc[0]);
 
 	// Post-execution stage:
 	// Clean up loaded modules, heap and file descriptors
@@ -1513,10 +1393,10 @@ uint32_t le_execute(uint8_t exec_mod)
 
 		// Close all files opened by module
 		fs_close_all(cur_top);
-		
+
 		// Release heap memory allocated by module
-		hp_free_all(cur_top, UINT16_MAX);
+		hp_unload(cur_top);
 	}
 
 	return counter;
-}
\ No newline at end of file
+}
@@ -12,8 +12,97 @@
 #ifndef _LE_MCODE_H
 #define _LE_MCODE_H   1
 
+// Dispatch engines
+enum le_engine_t {
+	ENGINE_SWITCH,		// Portable switch-based dispatch
+	ENGINE_THREADED,	// Direct-threaded dispatch (GCC labels-as-values)
+	ENGINE_TOS,			// Threaded with top of stack cached in registers
+	ENGINE_SUPER,		// Pre-decoded with fused superinstructions
+	ENGINE_JIT,			// Pre-decoded with x86-64 JIT compiler
+	ENGINE_REGIR		// Threaded dispatch on register IR
+};
+
+extern enum le_engine_t le_engine;
+
+// Budgets of a run (0 = unlimited)
+extern uint64_t le_max_mcodes;
+extern uint32_t le_max_time;
+
+// Run of an engine, for charging M-codes to the budget
+typedef struct le_run_t {
+	uint32_t charged;		// M-codes of the run already charged
+	struct le_run_t *up;	// Enclosing run
+} le_run_t;
+
+// Instruction fetch and module switching
+// (shared by the users of le_mcode_ops.h, which keep modp, modn,
+// code_p and the frame pointers local_p and global_p as locals)
+//
+#define le_next()	(code_p[gs_PC ++])
+
+#define le_next2()	({ uint16_t _w = le_next() << 8; _w | le_next(); })
+
+// The frame pointers address the local frame at L and the global
+// frame at G in main memory, which is mapped twice in a row, so that
+// offsets past the top wrap around to the bottom. They are set
+// whenever L or G change: on calls (stk_mark()), returns and module
+// switches.
+//
+#define set_local_ptr()		(local_p = &(dsh_mem[gs_L]))
+#define set_global_ptr()	(global_p = &(dsh_mem[gs_G]))
+
+#define set_module_ptr(mod) do { \
+		modn = (mod); \
+		modp = &(module_tab[modn]); \
+		code_p = modp->code; \
+		gs_G = modp->data_ofs; \
+		set_global_ptr(); \
+		set_local_ptr(); \
+	} while (0)
+
+#define _HALT	{ gs_PC --; le_error(1, 0, "Halted in %s:%07o at opcode %03o", modp->id.name, gs_PC, gs_IR); }
+
+// OP_TABLE
+// Initializer for tables indexed by opcode. The user defines T(n)
+// and TR(n, m) for the entries of single opcodes and opcode ranges
+// and T_INVALID for invalid opcodes.
+//
+#define OP_TABLE \
+	[0 ... 0377] = T_INVALID, \
+	TR(000, 017), T(020), T(022), T(023), T(024), T(025), T(026), \
+	T(027), T(030), T(031), T(032), T(033), T(034), T(035), T(036), \
+	T(037), T(040), T(041), T(042), T(043), TR(044, 057), T(060), \
+	T(061), T(062), T(063), TR(064, 077), T(0100), T(0101), \
+	TR(0102, 0117), T(0120), T(0121), TR(0122, 0137), TR(0140, 0157), \
+	TR(0160, 0177), T(0200), T(0201), T(0202), T(0203), T(0204), \
+	T(0205), T(0206), T(0207), T(0210), T(0211), T(0212), T(0213), \
+	T(0214), T(0216), T(0217), T(0220), T(0221), T(0222), T(0223), \
+	T(0224), T(0225), T(0226), T(0227), T(0230), T(0231), T(0232), \
+	T(0233), T(0234), T(0235), T(0236), T(0237), T(0240), T(0241), \
+	T(0242), T(0243), T(0244), T(0245), T(0246), T(0247), T(0250), \
+	T(0251), T(0252), T(0253), T(0254), T(0255), T(0256), T(0257), \
+	T(0260), T(0261), T(0262), T(0263), T(0264), T(0265), T(0266), \
+	T(0267), T(0270), T(0271), T(0272), T(0273), T(0274), T(0275), \
+	T(0276), T(0277), T(0300), T(0301), T(0302), T(0303), T(0304), \
+	T(0305), T(0306), T(0307), T(0310), T(0311), T(0312), T(0313), \
+	T(0314), T(0315), T(0316), T(0317), T(0320), T(0321), T(0322), \
+	T(0323), T(0324), T(0325), T(0326), T(0327), T(0330), T(0331), \
+	T(0332), T(0333), T(0334), T(0335), T(0336), T(0337), T(0340), \
+	T(0341), T(0342), T(0343), T(0344), T(0345), T(0346), T(0347), \
+	T(0350), T(0351), T(0352), T(0353), T(0354), T(0355), T(0356), \
+	T(0357), T(0360), TR(0361, 0377)
+
+
 // Function declarations
 //
 uint32_t le_execute(uint8_t mod);
+void le_transfer(bool chg, uint16_t to, uint16_t from);
+bool le_set_engine(char *name);
+uint32_t le_run(uint8_t exec_mod, uint8_t mod, uint16_t pc);
+uint32_t le_run_super(uint8_t exec_mod, uint8_t mod, uint16_t pc);
+uint32_t le_run_regir(uint8_t exec_mod, uint8_t mod, uint16_t pc);
+void le_charge(uint32_t counter);
+bool le_safepoint(mod_entry_t *modp, uint32_t counter);
+void le_init_signals();
 
 #endif
\ No newline at end of file
@@ -0,0 +1,1445 @@
+//=====================================================
+// le_mcode_ops.h
+// M-Code instruction semantics
+//
+// Lilith M-Code Emulator
+//
+// Guido Hoss, 12.03.2022
+//
+// Published by Guido Hoss under GNU Public License V3.
+//=====================================================
+
+// This file is included by each dispatch engine in le_mcode.c and
+// by the opcode helpers in le_helper.c and must not be included
+// anywhere else. The including engine defines:
+//
+//   OP(n)        Entry of the handler for opcode n
+//   OPR(n, m)    Entry of the handler for opcodes n..m
+//   OP_DEFAULT   Entry of the handler for invalid opcodes
+//   NEXT         End of handler; continue with next instruction
+//   SAFEPOINT    Poll for pending work (backward jumps, calls, SVC)
+//   RESUME       Check a PC loaded from memory (RTN, EXC, AOT)
+//
+// as well as the variables modp, modn, exec_mod, counter, local_p
+// and global_p and the functions le_next(), le_next2(),
+// set_local_ptr() and set_module_ptr().
+
+OPR(000, 017)
+	// LI0 - LI15 load immediate
+	es_push(gs_IR & 0xf);
+	NEXT;
+
+OP(020)
+	// LIB  load immediate byte
+	es_push(le_next());
+	NEXT;
+
+OP(022)
+	// LIW  load immediate word
+	es_push(le_next2());
+	NEXT;
+
+OP(023)
+	// LID  load immediate double word
+	es_push(le_next2());
+	es_push(le_next2());
+	NEXT;
+
+OP(024)
+	// LLA  load local address
+	es_push(gs_L + le_next());
+	NEXT;
+
+OP(025)
+	// LGA  load global address
+	es_push(gs_G + le_next());
+	NEXT;
+
+OP(026)
+	// LSA  load stack address
+	es_push(es_pop() + le_next());
+	NEXT;
+
+OP(027) {
+	// LEA  load external address
+	uint16_t ext_mod = le_next();		// Module number
+	uint16_t ext_adr = le_next();		// Data word offset number
+	es_push(module_tab[ext_mod].data_ofs + ext_adr);
+	NEXT;
+}
+
+OP(030)
+	// JPC  jump conditional
+	if (es_pop() == 0)
+	{
+		uint16_t i = le_next2();
+		gs_PC += i - 2;
+		if ((int16_t) i < 0)
+			SAFEPOINT
+	}
+	else
+	{
+		gs_PC += 2;
+	}
+	NEXT;
+
+OP(031) {
+	// JP   jump
+	uint16_t i = le_next2();
+	gs_PC += i - 2;
+	if ((int16_t) i < 0)
+		SAFEPOINT
+	NEXT;
+}
+
+OP(032)
+	// JPFC  jump forward conditional
+	if (es_pop() == 0)
+	{
+		uint8_t i = le_next();
+		gs_PC += i - 1;
+	}
+	else
+	{
+		gs_PC ++;
+	}
+	NEXT;
+
+OP(033) {
+	// JPF  jump forward
+	uint16_t i = le_next();
+	gs_PC += i - 1;
+	NEXT;
+}
+
+OP(034)
+	// JPBC  jump backward conditional
+	if (es_pop() == 0)
+	{
+		uint8_t i = le_next();
+		gs_PC -= i + 1;
+		SAFEPOINT
+	}
+	else
+	{
+		gs_PC ++;
+	}
+	NEXT;
+
+OP(035) {
+	// JPB  jump backward
+	uint8_t i = le_next();
+	gs_PC -= i + 1;
+	SAFEPOINT
+	NEXT;
+}
+
+OP(036)
+	// ORJP  short circuit OR
+	if (es_pop() == 0)
+	{
+		gs_PC ++;
+	}
+	else
+	{
+		es_push(1);
+		uint8_t i = le_next();
+		gs_PC += i - 1;
+	}
+	NEXT;
+
+OP(037)
+	// ANDJP  short circuit AND
+	if (es_pop() == 0)
+	{
+		es_push(0);
+		uint8_t i = le_next();
+		gs_PC += i - 1;
+	}
+	else
+	{
+		gs_PC ++;
+	}
+	NEXT;
+
+OP(040)
+	// LLW  load local word
+	es_push(local_p[le_next()]);
+	NEXT;
+
+OP(041) {
+	// LLD  load local double word
+	es_dload(&local_p[le_next()]);
+	NEXT;
+}
+
+OP(042) {
+	// LEW  load external word
+	uint8_t ext_mod = le_next();		// Module number
+	uint8_t ext_adr = le_next();		// Data word offset
+	es_push(dsh_mem[module_tab[ext_mod].data_ofs + ext_adr]);
+	NEXT;
+}
+
+OP(043) {
+	// LED
+	uint8_t ext_mod = le_next();		// Module number
+	uint8_t ext_adr = le_next();		// Data word offset
+	uint16_t ofs = module_tab[ext_mod].data_ofs + ext_adr;
+	es_dload(&dsh_mem[ofs]);
+	NEXT;
+}
+
+OPR(044, 057)
+	// LLW4-LLW15
+	es_push(local_p[gs_IR & 0xf]);
+	NEXT;
+
+OP(060)
+	// SLW  store local word
+	local_p[le_next()] = es_pop();
+	NEXT;
+
+OP(061) {
+	// SLD  store local double word
+	es_dstore(&local_p[le_next()]);
+	NEXT;
+}
+
+OP(062) {
+	// SEW  store external word
+	uint8_t ext_mod = le_next();		// Module number
+	uint8_t ext_adr = le_next();		// Data word offset
+	dsh_mem[module_tab[ext_mod].data_ofs + ext_adr] = es_pop();
+	NEXT;
+}
+
+OP(063) {
+	// SED  store external double word
+	_HALT
+	uint8_t ext_mod = le_next();		// Module number
+	uint8_t ext_adr = le_next();		// Data word offset
+	uint16_t ofs = module_tab[ext_mod].data_ofs + ext_adr;
+	dsh_mem[ofs + 1] = es_pop();
+	dsh_mem[ofs] = es_pop();
+	NEXT;
+}
+
+OPR(064, 077)
+	// SLW4-SLW15  store local word
+	local_p[gs_IR & 0xf] = es_pop();
+	NEXT;
+
+OP(0100)
+	// LGW  load global word
+	es_push(global_p[le_next()]);
+	NEXT;
+
+OP(0101) {
+	// LGD  load global double word
+	es_dload(&global_p[le_next()]);
+	NEXT;
+}
+
+OPR(0102, 0117)
+	// LGW2 - LGW15  load global word
+	es_push(global_p[gs_IR & 0xf]);
+	NEXT;
+
+OP(0120)
+	// SGW  store global word
+	global_p[le_next()] = es_pop();
+	NEXT;
+
+OP(0121) {
+	// SGD  store global double word
+	es_dstore(&global_p[le_next()]);
+	NEXT;
+}
+
+OPR(0122, 0137)
+	// SGW2 - SGW15  store global word
+	global_p[gs_IR & 0xf] = es_pop();
+	NEXT;
+
+OPR(0140, 0157)
+	// LSW0 - LSW15  load stack addressed word
+	es_push(dsh_mem[es_pop() + (gs_IR & 0xf)]);
+	NEXT;
+
+OPR(0160, 0177) {
+	// SSW0 - SSW15  store stack-addressed word
+	uint16_t k = es_pop();
+	uint16_t i = es_pop() + (gs_IR & 0xf);
+	dsh_mem[i] = k;
+	NEXT;
+}
+
+OP(0200) {
+	// LSW  load stack word
+	uint16_t i = es_pop() + le_next();
+	es_push(dsh_mem[i]);
+	NEXT;
+}
+
+OP(0201) {
+	// LSD  load stack double word
+	uint16_t i = es_pop() + le_next();
+	es_dload(&dsh_mem[i]);
+	NEXT;
+}
+
+OP(0202) {
+	// LSD0  load stack double word
+	uint16_t i = es_pop();
+	es_dload(&dsh_mem[i]);
+	NEXT;
+}
+
+OP(0203) {
+	// LXFW  load indexed frame word
+	_HALT
+	uint16_t i = es_pop();
+	i += es_pop() << 2;
+	es_push(dsh_mem[i]);
+	NEXT;
+}
+
+OP(0204)
+	// LSTA  load string address
+	es_push(global_p[2] + le_next());
+	NEXT;
+
+OP(0205) {
+	// LXB  load indexed byte
+	uint16_t i = es_pop();
+	uint16_t j = es_pop();
+	uint16_t k = dsh_mem[j + (i >> 1)];
+	es_push((i & 1) ? (uint8_t) k : (k >> 8));
+	NEXT;
+}
+
+OP(0206) {
+	// LXW  load indexed word
+	uint16_t i = es_pop();
+	es_push(dsh_mem[i + es_pop()]);
+	NEXT;
+}
+
+OP(0207) {
+	// LXD  load indexed double word
+	uint16_t i = es_pop() << 1;
+	i += es_pop();
+	es_dload(&dsh_mem[i]);
+	NEXT;
+}
+
+OP(0210) {
+	// DADD  double add
+	floatword_t y = es_dpop();
+	floatword_t x = es_dpop();
+	floatword_t z;
+	z.l = x.l + y.l;
+	es_dpush(z);
+	NEXT;
+}
+
+OP(0211) {
+	// DSUB  double subtract
+	floatword_t y = es_dpop();
+	floatword_t x = es_dpop();
+	floatword_t z;
+	z.l = x.l - y.l;
+	es_dpush(z);
+	NEXT;
+}
+
+OP(0212) {
+	// DMUL  double multiply
+	floatword_t y = es_dpop();
+	floatword_t x = es_dpop();
+	floatword_t z;
+	z.l = x.l * y.l;
+	es_dpush(z);
+	NEXT;
+}
+
+OP(0213) {
+	// DDIV  double divide
+	floatword_t y = es_dpop();
+	floatword_t x = es_dpop();
+	floatword_t z;
+	z.l = x.l / y.l;
+	es_dpush(z);
+	NEXT;
+}
+
+OP(0214) {
+	// AOT  enter translated procedure (emulator only)
+	set_module_ptr(aot_enter(exec_mod, modp, gs_PC - 1, &counter));
+	RESUME
+	NEXT;
+}
+
+OP(0216) {
+	// DSHL  double shift left
+	floatword_t x = es_dpop();
+	floatword_t z;
+	z.l = x.l << 1;
+	es_dpush(z);
+	NEXT;
+}
+
+OP(0217) {
+	// DSHR  double shift right
+	floatword_t x = es_dpop();
+	floatword_t z;
+	z.l = x.l >> 1;
+	es_dpush(z);
+	NEXT;
+}
+
+OP(0220) {
+	// SSW  store stack word
+	_HALT
+	uint16_t k = es_pop();
+	uint16_t i = es_pop() + le_next();
+	dsh_mem[gs_S + i] = k;
+	NEXT;
+}
+
+OP(0221) {
+	// SSD  store stack double word
+	uint16_t k = es_pop();
+	uint16_t j = es_pop();
+	uint16_t i = es_pop() + le_next();
+	dsh_mem[i] = j;
+	dsh_mem[i + 1] = k;
+	NEXT;
+}
+
+OP(0222) {
+	// SSD0  store stack double word
+	uint16_t k = es_pop();
+	uint16_t j = es_pop();
+	uint16_t i = es_pop();
+	dsh_mem[i] = j;
+	dsh_mem[i + 1] = k;
+	NEXT;
+}
+
+OP(0223) {
+	// SXFW  store indexed frame word
+	_HALT
+	uint16_t i = es_pop();
+	uint16_t k = es_pop();
+	k += es_pop() << 2;
+	dsh_mem[gs_S + k] = i;
+	NEXT;
+}
+
+OP(0224) {
+	// TS  test and set
+	uint16_t adr = es_pop();
+	es_push(dsh_mem[adr]);
+	dsh_mem[adr] = 1;
+	NEXT;
+}
+
+OP(0225) {
+	// SXB  store indexed byte
+	uint16_t k = es_pop();
+	uint16_t i = es_pop();
+	uint16_t j = es_pop() + (i >> 1);
+	dsh_mem[j] = (i & 1) ? 
+		((dsh_mem[j] & 0xff00) | k) : 
+		((dsh_mem[j] & 0x00ff) | (k << 8));
+	NEXT;
+}
+
+OP(0226) {
+	// SXW  store indexed word
+	uint16_t k = es_pop();
+	uint16_t i = es_pop();
+	dsh_mem[i + es_pop()] = k;
+	NEXT;
+}
+
+OP(0227) {
+	// SXD  store indexed double word
+	_HALT
+	uint16_t k = es_pop();
+	uint16_t j = es_pop();
+	uint16_t i = es_pop() << 2;
+	i += gs_S + es_pop();
+	dsh_mem[i] = j;
+	dsh_mem[i + 1] = k;
+	NEXT;
+}
+
+OP(0230) {
+	// FADD  floating add
+	floatword_t y = es_dpop();
+	floatword_t x = es_dpop();
+	x.f += y.f;
+	es_dpush(x);
+	NEXT;
+}
+
+OP(0231) {
+	// FSUB  floating subtract
+	floatword_t y = es_dpop();
+	floatword_t x = es_dpop();
+	x.f -= y.f;
+	es_dpush(x);
+	NEXT;
+}
+
+OP(0232) {
+	// FMUL  floating multiply
+	floatword_t y = es_dpop();
+	floatword_t x = es_dpop();
+
+	// 4x * 4y = 16xy, so divide by 4 to fix result
+	x.f = (x.f * y.f) * 0.25;
+	es_dpush(x);
+	NEXT;
+}
+
+OP(0233) {
+	// FDIV  floating divide
+	floatword_t y = es_dpop();
+	floatword_t x = es_dpop();
+
+	// 4x/4y=xy, so multiply by 4 to fix result
+	x.f = (4.0 * x.f) / y.f;
+	es_dpush(x);
+	NEXT;
+}
+
+OP(0234) {
+	// FCMP  floating compare
+	float x = es_dpop().f;
+	float y = es_dpop().f;
+	if (x > y)
+	{
+		es_push(0);
+		es_push(1);		
+	}
+	else if (x < y)
+	{
+		es_push(1);
+		es_push(0);		
+	}
+	else{
+		es_push(0);
+		es_push(0);		
+	}
+	NEXT;
+}
+
+OP(0235) {
+	// FABS  floating absolute value
+	floatword_t x = es_dpop();
+	if (x.f < 0.0) 
+		x.f = -x.f;
+	es_dpush(x);
+	NEXT;
+}
+
+OP(0236) {
+	// FNEG  floating negative
+	floatword_t x = es_dpop();
+	x.f = -x.f;
+	es_dpush(x);
+	NEXT;
+}
+
+OP(0237) {
+	// FFCT  floating functions
+	uint8_t i = le_next();
+	floatword_t z;
+	switch (i)
+	{
+		case 0 :
+			// Convert INTEGER to REAL
+			// Multiply result by 4 to fix to IEEE754 standard
+			z.f = ((float) es_pop()) * 4.0;
+			es_dpush(z);
+			break;
+
+		case 1 : {
+			// CONVERT long (32-bit) integer TO REAL
+			// Multiply result by 4 to fix to IEEE754 standard
+			floatword_t z1 = es_dpop();
+			z.f = ((float) z1.l) * 4.0;
+			es_dpush(z);
+			break;
+		}
+
+		case 2 :
+			// Convert REAL to INTEGER
+			// Divide value by 4 to fix to IEEE754 standard
+			z = es_dpop();
+			es_push((int16_t) (z.f * 0.25));
+			break;
+
+		case 3 : {
+			// Fix REAL with specified bias
+			uint16_t bias = es_pop() >> 7;	// bias (exponent)
+			z = es_dpop();					// REAL
+
+			uint8_t ex = z.bf.e;			// Exponent
+			uint32_t mask = 1 << 22;		// MSB of mantissa
+
+			// Increase exponent and rshift mantissa (= DIV 2)
+			while (ex < bias)
+			{
+				ex ++;
+				z.bf.m = (z.bf.m >> 1) | mask;
+				mask = 0;
+			}
+			z.bf.e = (z.bf.e < bias) ? 0 : 1;
+			es_dpush(z);
+			break;
+		}
+
+		default :
+			break;
+	}
+	NEXT;
+}
+
+OP(0240) {
+	// READ
+	uint16_t i = es_pop();
+	uint16_t k = es_pop();
+	dsh_mem[i] = le_ioread(k);
+	NEXT;
+}
+
+OP(0241) {
+	// WRITE
+	_HALT
+	uint16_t i = es_pop();
+	uint16_t k = es_pop();
+	le_iowrite(k, i);
+	NEXT;
+}
+
+OP(0242)
+	// DSKR  disk read
+	error (1, 0, "DSKR not implemented");
+	NEXT;
+
+OP(0243)
+	// DSKW  disk write
+	error (1, 0, "DSKW not implemented");
+	NEXT;
+
+OP(0244)
+	// SETRK  set disk track
+	error (1, 0, "SETRK not implemented");
+	NEXT;
+
+OP(0245) {
+	// UCHK
+	_HALT
+	uint16_t k = es_pop();
+	uint16_t j = es_pop();
+	uint16_t i = es_pop();
+	es_push(i);
+	if ((i < j) || (i > k))
+		le_trap(modp, TRAP_INDEX);
+	NEXT;
+}
+
+OP(0246) {
+	// SVC  system hook (emulator only)
+	uint8_t call = le_next();
+	if (call != 1)
+	{
+		// All calls except external module load
+		le_supervisor_call(exec_mod, call);
+	}
+	else
+	{
+		// Load external module
+		uint16_t ln = es_pop() + 2;	// HIGH of filename parameter
+		uint16_t adr = es_pop();	// Address of filename parameter
+
+		// Copy filename to own buffer
+		char *fn = malloc(ln);
+		fs_swapcpy(fn, (char *) &(dsh_mem[adr]), ln - 1); 
+
+		// Save the stack, since it will be overwritten by loaded module
+		// We need to save datatop...gs_S. The loaded module starts
+		// with an empty expression stack; its words go below datatop.
+		uint16_t saved_gs_L = gs_L;
+		uint16_t saved_gs_CS = gs_CS;
+		uint16_t saved_gs_PC = gs_PC;
+		uint16_t saved_data_top = data_top;
+		uint32_t saved_jit_used = mach_ctx.jit_used;
+		es_save();
+		data_top = gs_S;
+
+		// Charge the M-codes run so far, so that the count of the
+		// machine stays exact in the nested run
+		if (mach_ctx.run != NULL)
+			le_charge(counter);
+
+		// Try to load and execute the module
+		uint8_t top = le_load_initfile(fn, "SYS");
+		if (top > 0)
+			counter += le_execute(top);
+
+		// Reuse the native code compiled while the module ran
+		jit_reset(saved_jit_used);
+
+		// Restore the stack
+		gs_S = data_top;
+		data_top = saved_data_top;
+		es_restore();
+		gs_PC = saved_gs_PC;
+		gs_CS = saved_gs_CS;
+		gs_L = saved_gs_L;
+		set_module_ptr(modn);
+		free(fn);
+
+		// Push return result
+		es_push((top > 0) ? 1 : 0);
+	}
+	SAFEPOINT
+	NEXT;
+}
+
+OP(0247)
+	// SYS  rarely used system functions
+	le_system_call(le_next());
+	NEXT;
+
+OP(0250)
+	// ENTP  entry priority
+	local_p[3] = gs_M;
+	gs_M = 0xffff << (16 - le_next());
+	NEXT;
+
+OP(0251)
+	// EXP  exit priority
+	gs_M = local_p[3];
+	NEXT;
+
+OP(0252) {
+	// ULSS
+	uint16_t j = es_pop();
+	uint16_t i = es_pop();
+	es_push((i < j) ? 1 : 0);
+	NEXT;
+}
+
+OP(0253) {
+	// ULEQ
+	uint16_t j = es_pop();
+	uint16_t i = es_pop();
+	es_push((i <= j) ? 1 : 0);
+	NEXT;
+}
+
+OP(0254) {
+	// UGTR
+	uint16_t j = es_pop();
+	uint16_t i = es_pop();
+	es_push((i > j) ? 1 : 0);
+	NEXT;
+}
+
+OP(0255) {
+	// UGEQ
+	uint16_t j = es_pop();
+	uint16_t i = es_pop();
+	es_push((i >= j) ? 1 : 0);
+	NEXT;
+}
+
+OP(0256) {
+	// TRA  coroutine transfer
+	_HALT
+	uint16_t i = es_pop();
+	uint16_t j = es_pop();
+	le_transfer((le_next() != 0), i, j);
+	NEXT;
+}
+
+OP(0257) {
+	// RDS  read string
+	_HALT
+	uint16_t k = gs_S + es_pop();
+	int8_t i = le_next();
+	do {
+		dsh_mem[k++] = le_next2();
+	} while (i-- >= 0);
+	NEXT;
+}
+
+OP(0260) {
+	// LODFW  reload stack after function return
+	// The verifier assumes that the stack holds only the result
+	if (gs_SP != 1)
+		le_trap(modp, TRAP_STACK_OVF);
+	uint16_t i = es_pop();
+	es_restore();
+	es_push(i);
+	NEXT;
+}
+
+OP(0261) {
+	// LODFD  reload stack after function return
+	if (gs_SP != 2)
+		le_trap(modp, TRAP_STACK_OVF);
+	uint16_t i = es_pop();
+	uint16_t j = es_pop();
+	es_restore();
+	es_push(j);
+	es_push(i);
+	NEXT;
+}
+
+OP(0262)
+	// STORE
+	es_save();
+	NEXT;
+
+OP(0263) {
+	// STOFV
+	_HALT
+	uint16_t i = es_pop();
+	es_save();
+	dsh_mem[gs_S ++] = i;
+	NEXT;
+}
+
+OP(0264)
+	// STOT  copy from stack to procedure stack
+	dsh_mem[gs_S ++] = es_pop();
+	NEXT;
+
+OP(0265) {
+	// COPT  copy element on top of expression stack
+	uint16_t i = es_pop();
+	es_push(i);
+	es_push(i);
+	NEXT;
+}
+
+OP(0266)
+	// DECS  decrement stackpointer
+	gs_S --;
+	NEXT;
+
+OP(0267) {
+	// PCOP  allocation and copy of value parameter
+	local_p[le_next()] = gs_S;
+	uint16_t sz = es_pop();
+	uint16_t adr = es_pop();
+
+	// Copy words from memory into stack
+	bk_move(gs_S, adr, sz);
+	gs_S += sz;
+	NEXT;
+}
+
+OP(0270) {
+	// UADD
+	uint16_t j = es_pop();
+	uint16_t i = es_pop();
+	es_push(i + j);
+	NEXT;
+}
+
+OP(0271) {
+	// USUB
+	uint16_t j = es_pop();
+	uint16_t i = es_pop();
+	es_push(i - j);
+	NEXT;
+}
+
+OP(0272) {
+	// UMUL
+	uint16_t j = es_pop();
+	uint16_t i = es_pop();
+	es_push(i * j);
+	NEXT;
+}
+
+OP(0273) {
+	// UDIV
+	uint16_t j = es_pop();
+	uint16_t i = es_pop();
+	es_push(i / j);
+	NEXT;
+}
+
+OP(0274) {
+	// UMOD
+	uint16_t j = es_pop();
+	uint16_t i = es_pop();
+	es_push(i % j);
+	NEXT;
+}
+
+OP(0275) {
+	// ROR
+	uint16_t i = es_pop() & 0xf;
+	uint16_t j = es_pop();
+	uint32_t k = (j << 16) >> i;
+	es_push((k >> 16) | (k & 0xffff));
+	NEXT;
+}
+
+OP(0276) {
+	// SHL
+	uint16_t i = es_pop() & 0xf;
+	uint16_t j = es_pop();
+	es_push(j << i);
+	NEXT;
+}
+
+OP(0277) {
+	// SHR
+	uint16_t i = es_pop() & 0xf;
+	uint16_t j = es_pop();
+	es_push(j >> i);
+	NEXT;
+}
+
+OP(0300) {
+	// FOR1  enter FOR statement
+	uint8_t sign = le_next();
+	int16_t hi = es_pop();
+	int16_t low = es_pop();
+	uint16_t adr = es_pop();
+	uint16_t jmp = gs_PC + 2;
+	jmp += (int16_t) le_next2() - 2;
+	if (((sign == 0) && (low <= hi))
+		|| ((sign != 0) && (low >= hi)))
+	{
+		dsh_mem[adr] = low;
+		dsh_mem[gs_S] = adr;
+		dsh_mem[gs_S + 1] = hi;
+		gs_S += 2;
+	}
+	else
+	{
+		gs_PC = jmp;
+	}
+	NEXT;
+}
+
+OP(0301) {
+	// FOR2  exit FOR statement
+	int16_t hi = dsh_mem[gs_S - 1];
+	uint16_t adr = dsh_mem[gs_S - 2];
+	int8_t step = le_next();
+	uint16_t jmp = gs_PC;
+	jmp += (int16_t) le_next2();
+	int16_t i = dsh_mem[adr] + step;
+	if (((step >= 0) && (i > hi)) || ((step <= 0) && (i < hi)))
+	{
+		gs_S -= 2;
+	}
+	else
+	{
+		dsh_mem[adr] = i;
+		gs_PC = jmp;
+		SAFEPOINT
+	}
+	NEXT;
+}
+
+OP(0302) {
+	// ENTC  enter CASE statement
+	// The verifier has resolved the case table of the instruction
+	const vf_case_t *t = vf_case(modp, gs_PC - 1);
+	uint16_t k = es_pop() - t->low;
+
+	dsh_mem[gs_S ++] = t->exit;
+	gs_PC = t->target[(k < t->n) ? k + 1 : 0];
+	NEXT;
+}
+
+OP(0303)
+	// EXC  exit CASE statement
+	gs_PC = dsh_mem[-- gs_S];
+	RESUME
+	NEXT;
+
+OP(0304) {
+	// TRAP
+	le_trap(modp, es_pop());
+	NEXT;
+}
+
+OP(0305) {
+	// CHK
+	int16_t hi = es_pop();
+	int16_t lo = es_pop();
+	int16_t i = es_pop();
+	es_push(i);
+	if ((i < lo) || (i > hi))
+		le_trap(modp, TRAP_INDEX);
+	NEXT;
+}
+
+OP(0306) {
+	// CHKZ
+	int16_t hi = es_pop();
+	int16_t i = es_pop();
+	es_push(i);
+	if ((i < 0) || (i > hi))
+		le_trap(modp, TRAP_INDEX);
+	NEXT;
+}
+
+OP(0307)
+	// CHKS  check sign bit
+	int16_t k = es_pop();
+	es_push(k);
+	if (k < 0)
+		le_trap(modp, TRAP_INDEX);
+	NEXT;
+
+OP(0310) {
+	// EQL
+	uint16_t j = es_pop();
+	uint16_t i = es_pop();
+	es_push((i == j) ? 1 : 0);
+	NEXT;
+}
+
+OP(0311) {
+	// NEQ
+	uint16_t j = es_pop();
+	uint16_t i = es_pop();
+	es_push((i != j) ? 1 : 0);
+	NEXT;
+}
+
+OP(0312) {
+	// LSS
+	int16_t j = es_pop();
+	int16_t i = es_pop();
+	es_push((i < j) ? 1 : 0);
+	NEXT;
+}
+
+OP(0313) {
+	// LEQ
+	int16_t j = es_pop();
+	int16_t i = es_pop();
+	es_push((i <= j) ? 1 : 0);
+	NEXT;
+}
+
+OP(0314) {
+	// GTR
+	int16_t j = es_pop();
+	int16_t i = es_pop();
+	es_push((i > j) ? 1 : 0);
+	NEXT;
+}
+
+OP(0315) {
+	// GEQ
+	int16_t j = es_pop();
+	int16_t i = es_pop();
+	es_push((i >= j) ? 1 : 0);
+	NEXT;
+}
+
+OP(0316) {
+	// ABS
+	int16_t i = es_pop();
+	es_push((i < 0) ? (-i) : i);
+	NEXT;
+}
+
+OP(0317) {
+	// NEG
+	int16_t i = es_pop();
+	es_push(-i);
+	NEXT;
+}
+
+OP(0320) {
+	// OR
+	uint16_t j = es_pop();
+	uint16_t i = es_pop();
+	es_push(i | j);
+	NEXT;
+}
+
+OP(0321) {
+	// XOR
+	uint16_t j = es_pop();
+	uint16_t i = es_pop();
+	es_push(i ^ j);
+	NEXT;
+}
+
+OP(0322) {
+	// AND
+	uint16_t j = es_pop();
+	uint16_t i = es_pop();
+	es_push(i & j);
+	NEXT;
+}
+
+OP(0323)
+	// COM
+	es_push(~es_pop());
+	NEXT;
+
+OP(0324) {
+	// IN (bitset)
+	uint16_t j = es_pop();
+	uint16_t i = es_pop();
+	es_push((0x8000 >> i) & j);
+	NEXT;
+}
+
+OP(0325)
+	// LIN  load immediate NIL
+	es_push(0xffff);
+	NEXT;
+
+OP(0326) {
+	// MSK
+	uint16_t i = es_pop() & 0xf;
+	es_push( 0xffff << (i - 16) );
+	NEXT;
+}
+
+OP(0327)
+	// NOT
+	es_push((es_pop() & 1) ? 0 : 1);
+	NEXT;
+
+OP(0330) {
+	// IADD
+	int16_t j = es_pop();
+	int16_t i = es_pop();
+	es_push(i + j);
+	NEXT;
+}
+
+OP(0331) {
+	// ISUB
+	int16_t j = es_pop();
+	int16_t i = es_pop();
+	es_push(i - j);
+	NEXT;
+}
+
+OP(0332) {
+	// IMUL
+	int16_t j = es_pop();
+	int16_t i = es_pop();
+	es_push(i * j);
+	NEXT;
+}
+
+OP(0333) {
+	// IDIV
+	int16_t j = es_pop();
+	int16_t i = es_pop();
+	es_push(i / j);
+	NEXT;
+}
+
+OP(0334) {
+	// MOD
+	int16_t j = es_pop();
+	int16_t i = es_pop();
+	es_push(i % j);
+	NEXT;
+}
+
+OP(0335) {
+	// BIT
+	_HALT
+	uint16_t j = es_pop() & 0xf;
+	es_push(0x8000 >> j);
+	NEXT;
+}
+
+OP(0336)
+	// NOP
+	NEXT;
+
+OP(0337) {
+	// MOVF  move frame
+	uint16_t i = es_pop();
+	uint16_t j = es_pop();
+	j += es_pop() << 2;
+	uint16_t k = es_pop();
+	k += es_pop() << 2;
+	bk_move(k, j, i);
+	NEXT;
+}
+
+OP(0340) {
+	// MOV  move block
+	uint16_t k = es_pop();
+	uint16_t j = es_pop();
+	uint16_t i = es_pop();
+	bk_move(i, j, k);
+	NEXT;
+}
+
+OP(0341) {
+	// CMP  compare blocks
+	// Pushes the first unequal words, or the last ones
+	uint16_t k = es_pop();
+	uint16_t j = es_pop();
+	uint16_t i = es_pop();
+	if (k == 0)
+	{
+		es_push(0);
+		es_push(0);
+	}
+	else
+	{
+		uint16_t n = bk_compare(i, j, k - 1);
+		es_push(dsh_mem[(uint16_t) (i + n)]);
+		es_push(dsh_mem[(uint16_t) (j + n)]);
+	}
+	NEXT;
+}
+
+OP(0342) {
+	// DDT  display dot
+//          (* display point at <j,k> in mode i inside
+//             bitmap dbmd *) |
+	_HALT
+	// uint16_t k = es_pop();
+	// uint16_t j = es_pop();
+	// uint16_t dbmd = es_pop();
+	// uint16_t i = es_pop();
+	NEXT;
+}
+
+OP(0343) {
+	// REPL  replicate pattern
+//          (* replicate pattern sb over block db inside
+//             bitmap dbmd in mode i *) |
+	_HALT
+	// uint16_t db = es_pop();
+	// uint16_t sb = es_pop();
+	// uint16_t dbmd = es_pop();
+	// uint16_t i = es_pop();
+	NEXT;
+}
+
+OP(0344) {
+	// BBLT  bit block transfer
+//          (* transfer block sb in bitmap sbmd to block db
+//             inside bitmap dbmd in mode i *) |
+	_HALT
+	// uint16_t sbmd = es_pop();
+	// uint16_t db = es_pop();
+	// uint16_t sb = es_pop();
+	// uint16_t dbmd = es_pop();
+	// uint16_t i = es_pop();
+	NEXT;
+}
+
+OP(0345) {
+	// DCH  display character
+//          (* copy bit pattern for character ch from font fo
+//             to block db inside bitmap dbmd *) |
+	uint16_t ch = es_pop();
+	// uint16_t db = es_pop();
+	// uint16_t fo = es_pop();
+	// uint16_t dbmd = es_pop();
+	le_putchar(ch);
+	NEXT;
+}
+
+OP(0346) {
+	// UNPK  unpack
+	// Extract bits i..i+n-1 from x and shift right
+	uint16_t x = es_pop();
+	uint16_t n = es_pop();
+	uint16_t i = es_pop();
+
+	uint16_t sh = 16 - i - n;
+	uint16_t rmask = ((1 << n) - 1) << sh;
+
+	x = (x & rmask) >> sh;
+	es_push(x);
+	NEXT;
+}
+
+OP(0347) {
+	// PACK  pack
+	// Pack the rightmost n bits of x into positions
+	// i..i+n-1 of word [adr]
+	uint16_t x = es_pop();
+	uint16_t n = es_pop();
+	uint16_t i = es_pop();
+	uint16_t adr = es_pop();
+
+	// Isolate rightmost n bits
+	uint16_t rmask = (1 << n) - 1;
+	x &= rmask;
+
+
+	// Determine shift amount
+	uint16_t sh = 16 - i - n;
+
+	// Shift both mask and value to target position
+	rmask <<= sh;
+	x <<= sh;
+
+	// Clear and overwrite target bits
+	dsh_mem[adr] = (dsh_mem[adr] & (~rmask)) | x;
+	NEXT;
+}
+
+OP(0350) {
+	// GB  get base adr n levels down
+	uint16_t i = local_p[1];
+	uint8_t j = le_next();
+	while (--j != 0)
+		i = dsh_mem[(uint16_t) (i + 1)];
+	es_push(i);
+	NEXT;
+}
+
+OP(0351)
+	// GB1  get base adr 1 level down
+	es_push(local_p[1]);
+	NEXT;
+
+OP(0352) {
+	// ALLOC  allocate block
+	uint16_t i = es_pop();
+	if (gs_S < MACH_DSHMEM_SZ - i)
+	{
+		es_push(gs_S);
+		gs_S += i;
+	}
+	else
+	{
+		le_trap(modp, TRAP_STACK_OVF);
+	}
+	NEXT;
+}
+
+OP(0353) {
+	// ENTR  enter procedure
+	uint8_t i = le_next();
+	if (gs_S < MACH_DSHMEM_SZ - i)
+		gs_S += i;
+	else
+		le_trap(modp, TRAP_STACK_OVF);
+	NEXT;
+}
+
+OP(0354) {
+	// RTN  return from procedure
+	// The verifier assumes that a call leaves at most a double word
+	if (gs_SP > VF_RESULT_MAX)
+		le_trap(modp, TRAP_STACK_OVF);
+
+	// Reset stack pointer to previous state
+	gs_S = gs_CS;
+
+	// Restore caller status from stack
+	gs_PC = dsh_mem[gs_S + 2];
+
+	uint16_t call_mod = dsh_mem[gs_S];
+	if (call_mod >= 0x100)
+	{
+		// Local call
+		gs_CS = call_mod - 0x100;
+		gs_L = gs_CS;
+		set_local_ptr();
+	}
+	else
+	{
+		// External call (mem[S] contains module number)
+		gs_L = dsh_mem[gs_S + 1];
+		gs_CS = gs_L;
+		set_module_ptr((uint8_t) call_mod);
+	}
+	RESUME
+	NEXT;
+}
+
+OP(0355) {
+	// CLX  call external procedure
+	uint8_t call_mod = le_next();		// Module number
+	uint8_t call_proc = le_next();		// Procedure number
+	if ((call_mod != 0) || (call_proc != 0))
+	{
+		// Ignore calls to System.0
+		stk_mark(CALL_EXT, modn);
+		set_module_ptr(call_mod);
+		gs_PC = modp->proc[call_proc];
+		SAFEPOINT
+	}
+	NEXT;
+}
+
+OP(0356) {
+	// CLI  call procedure at intermediate level
+	uint8_t i = le_next();
+	uint16_t base = es_pop();
+	stk_mark(CALL_LEVEL, base);
+	set_local_ptr();
+	gs_PC = modp->proc[i];
+	SAFEPOINT
+	NEXT;
+}
+
+OP(0357) {
+	// CLF  call formal procedure
+	uint16_t i = dsh_mem[gs_S - 1];
+	uint16_t call_mod = i >> 8;
+	uint16_t call_proc = i & 0xff;
+
+	// Procedure variables are data and escape the load-time checks
+	if ((call_mod >= module_num)
+		|| (call_proc >= module_tab[call_mod].proc_n)
+		|| (module_tab[call_mod].proc[call_proc] == 0))
+		le_trap(modp, TRAP_CODE_OVF);
+	stk_mark(CALL_FORMAL, modn);
+	set_module_ptr(call_mod);
+	gs_PC = modp->proc[call_proc];
+	SAFEPOINT
+	NEXT;
+}
+
+OP(0360) {
+	// CLL  call local procedure
+	uint8_t i = le_next();
+	stk_mark(CALL_LOCAL, 0);
+	set_local_ptr();
+	gs_PC = modp->proc[i];
+	SAFEPOINT
+	NEXT;
+}
+
+OPR(0361, 0377)
+	// CLL1 - CLL15  call local procedure
+	stk_mark(CALL_LOCAL, 0);
+	set_local_ptr();
+	gs_PC = modp->proc[gs_IR & 0xf];
+	SAFEPOINT
+	NEXT;
+
+OP_DEFAULT
+	le_trap(modp, TRAP_INV_OPC);
+	NEXT;
\ No newline at end of file
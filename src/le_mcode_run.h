@@ -0,0 +1,91 @@
+//=====================================================
+// le_mcode_run.h
+// Switch-based dispatch engine
+//
+// Lilith M-Code Emulator
+//
+// Guido Hoss, 12.03.2022
+//
+// Published by Guido Hoss under GNU Public License V3.
+//=====================================================
+
+// This file is included twice by le_mcode.c and must not be
+// included anywhere else. The including file defines:
+//
+//   RUN_FN       Name of the engine function
+//   RUN_DEBUG    1 for the instrumented variant, which calls the
+//                monitor and lockstep before and records the
+//                sequence profile after each fetch, and hands the
+//                run back to the lean engines when all of them are
+//                turned off;
+//                0 for the lean variant without these hooks
+
+
+// RUN_FN()
+// Switch-based dispatch engine: one central dispatch per instruction
+//
+uint32_t RUN_FN(uint8_t exec_mod, uint8_t mod, uint16_t pc)
+{
+	mod_entry_t *modp;		// Pointer to current module
+	uint8_t *code_p;		// Pointer to module code frame
+	uint16_t *local_p;		// Pointer to local frame at L
+	uint16_t *global_p;		// Pointer to global frame at G
+	uint32_t counter = 0;	// M-code counter
+	uint8_t modn;
+
+	// Setup registers and start at PC of module
+	set_module_ptr(mod);
+	gs_PC = pc;
+
+	for (;;)
+	{
+#if RUN_DEBUG
+		if (mach_ctx.ls != NULL)
+			ls_step(modp, counter);
+		if ((gs_PC != 0) && (gs_PC < modp->code_sz))
+		{
+			le_monitor(modp);
+			if (! (le_trace || breakpoint || le_profile || ls_reference()))
+			{
+				counter += le_run(exec_mod, modn, gs_PC);
+				goto done;
+			}
+		}
+#endif
+		FETCH
+#if RUN_DEBUG
+		if (le_profile)
+			pf_record(modp, gs_PC - 1, gs_IR);
+#endif
+
+		// Execute M-Code in IR
+		switch (gs_IR)
+		{
+#define OP(n)		case n :
+#define OPR(n, m)	case n ... m :
+#define OP_DEFAULT	default :
+#define NEXT		break
+
+#if RUN_DEBUG
+		// Already instrumented; safepoints only do the work
+#pragma push_macro("SAFEPOINT")
+#undef SAFEPOINT
+#define SAFEPOINT	{ if (mach_ctx.pending) le_safepoint(modp, counter); }
+#endif
+
+#include "le_mcode_ops.h"
+
+#if RUN_DEBUG
+#pragma pop_macro("SAFEPOINT")
+#endif
+
+#undef OP
+#undef OPR
+#undef OP_DEFAULT
+#undef NEXT
+		}
+	}
+
+done:
+	return counter;
+}
@@ -0,0 +1,527 @@
+//=====================================================
+// le_predec.c
+// Load-time pre-decoding of code frames
+//
+// Lilith M-Code Emulator
+//
+// Guido Hoss, 12.03.2022
+//
+// Published by Guido Hoss under GNU Public License V3.
+//=====================================================
+
+#include <config.h>
+#include "le_mach.h"
+#include "le_io.h"
+#include "le_trace.h"
+#include "le_mcode.h"
+#include "le_predec.h"
+#include "le_super.h"
+#include "le_jit.h"
+
+
+// Handler address tables, exported by le_run_super()
+const void *const *pd_handler = NULL;
+const void *const *pd_generic = NULL;
+const void *const *pd_super = NULL;
+
+// Superinstruction tables generated by tools/mksuper.py
+const uint8_t su_class[256] = { SU_CLASS_TAB };
+const bool su_specialized[SC_NUM] = { SU_SPECIALIZED_TAB };
+const struct {
+	uint8_t n;						// Pattern length
+	uint8_t cls[SU_LEN_MAX];		// Instruction classes
+} su_pattern[SU_NUM] = { SU_PATTERN_TAB };
+
+
+// pd_decode()
+// Decodes the instruction at offset pc of module mod into p.
+// Instructions which cannot be specialized safely (operands or
+// jump targets outside the code frame, calls to System.0, jumps to
+// PC 0) are left to the generic handler of their opcode.
+//
+void pd_decode(mod_entry_t *mod, uint16_t pc, pd_instr_t *p)
+{
+	uint8_t *c = mod->code;
+	uint8_t op = c[pc];
+	uint8_t len = le_opcode_len(op);
+	int h = -1;
+
+	p->pc = pc;
+	p->op = op;
+	p->len = len;
+	p->a = p->b = 0;
+	p->target = NULL;
+
+	// Operand bytes following the opcode
+	uint8_t b1 = (len > 1) ? c[pc + 1] : 0;
+	uint8_t b2 = (len > 2) ? c[pc + 2] : 0;
+	uint16_t w = (b1 << 8) | b2;
+	uint32_t tgt = 0;
+
+	// Instruction must be followed by another one in the code frame
+	if (pc + len >= mod->code_sz)
+		goto generic;
+
+	switch (op)
+	{
+		case 000 ... 017 :
+			// LI0 - LI15
+			h = PD_LIT;
+			p->a = op & 0xf;
+			break;
+
+		case 020 :
+			// LIB
+			h = PD_LIT;
+			p->a = b1;
+			break;
+
+		case 022 :
+			// LIW
+			h = PD_LIT;
+			p->a = w;
+			break;
+
+		case 023 :
+			// LID
+			h = PD_LIT2;
+			p->a = w;
+			p->b = (c[pc + 3] << 8) | c[pc + 4];
+			break;
+
+		case 024 :
+			// LLA
+			h = PD_LLA;
+			p->a = b1;
+			break;
+
+		case 025 :
+			// LGA
+			h = PD_LIT;
+			p->a = mod->data_ofs + b1;
+			break;
+
+		case 026 :
+			// LSA
+			h = PD_LSA;
+			p->a = b1;
+			break;
+
+		case 027 :
+			// LEA
+			h = PD_LIT;
+			p->a = module_tab[b1].data_ofs + b2;
+			break;
+
+		case 030 :
+			// JPC
+			h = PD_JPC;
+			tgt = (uint16_t) (pc + 1 + w);
+			break;
+
+		case 031 :
+			// JP
+			h = PD_JP;
+			tgt = (uint16_t) (pc + 1 + w);
+			break;
+
+		case 032 :
+			// JPFC
+			h = PD_JPC;
+			tgt = (uint16_t) (pc + 1 + b1);
+			break;
+
+		case 033 :
+			// JPF
+			h = PD_JP;
+			tgt = (uint16_t) (pc + 1 + b1);
+			break;
+
+		case 034 :
+			// JPBC
+			h = PD_JPC;
+			tgt = (uint16_t) (pc + 1 - b1);
+			break;
+
+		case 035 :
+			// JPB
+			h = PD_JP;
+			tgt = (uint16_t) (pc + 1 - b1);
+			break;
+
+		case 036 :
+			// ORJP
+			h = PD_ORJP;
+			tgt = (uint16_t) (pc + 1 + b1);
+			break;
+
+		case 037 :
+			// ANDJP
+			h = PD_ANDJP;
+			tgt = (uint16_t) (pc + 1 + b1);
+			break;
+
+		case 040 :
+			// LLW
+			h = PD_LLW;
+			p->a = b1;
+			break;
+
+		case 041 :
+			// LLD
+			h = PD_LLD;
+			p->a = b1;
+			break;
+
+		case 042 :
+			// LEW
+			h = PD_LDA;
+			p->a = module_tab[b1].data_ofs + b2;
+			break;
+
+		case 043 :
+			// LED
+			h = PD_LDA2;
+			p->a = module_tab[b1].data_ofs + b2;
+			break;
+
+		case 044 ... 057 :
+			// LLW4 - LLW15
+			h = PD_LLW;
+			p->a = op & 0xf;
+			break;
+
+		case 060 :
+			// SLW
+			h = PD_SLW;
+			p->a = b1;
+			break;
+
+		case 061 :
+			// SLD
+			h = PD_SLD;
+			p->a = b1;
+			break;
+
+		case 062 :
+			// SEW
+			h = PD_STA;
+			p->a = module_tab[b1].data_ofs + b2;
+			break;
+
+		case 064 ... 077 :
+			// SLW4 - SLW15
+			h = PD_SLW;
+			p->a = op & 0xf;
+			break;
+
+		case 0100 :
+			// LGW
+			h = PD_LDA;
+			p->a = mod->data_ofs + b1;
+			break;
+
+		case 0102 ... 0117 :
+			// LGW2 - LGW15
+			h = PD_LDA;
+			p->a = mod->data_ofs + (op & 0xf);
+			break;
+
+		case 0120 :
+			// SGW
+			h = PD_STA;
+			p->a = mod->data_ofs + b1;
+			break;
+
+		case 0121 :
+			// SGD
+			h = PD_STA2;
+			p->a = mod->data_ofs + b1;
+			break;
+
+		case 0122 ... 0137 :
+			// SGW2 - SGW15
+			h = PD_STA;
+			p->a = mod->data_ofs + (op & 0xf);
+			break;
+
+		case 0140 ... 0157 :
+			// LSW0 - LSW15
+			h = PD_LSW;
+			p->a = op & 0xf;
+			break;
+
+		case 0160 ... 0177 :
+			// SSW0 - SSW15
+			h = PD_SSW;
+			p->a = op & 0xf;
+			break;
+
+		case 0200 :
+			// LSW
+			h = PD_LSW;
+			p->a = b1;
+			break;
+
+		case 0201 :
+			// LSD
+			h = PD_LSD;
+			p->a = b1;
+			break;
+
+		case 0202 :
+			// LSD0
+			h = PD_LSD;
+			break;
+
+		case 0204 :
+			// LSTA
+			h = PD_LSTA;
+			p->a = mod->data_ofs + 2;
+			p->b = b1;
+			break;
+
+		case 0220 :
+			// SSW
+			h = PD_SSW;
+			p->a = b1;
+			break;
+
+		case 0300 :
+			// FOR1
+			h = PD_FOR1;
+			p->a = b1;
+			tgt = (uint16_t) (pc + 2 + (int16_t) ((c[pc + 2] << 8) | c[pc + 3]));
+			break;
+
+		case 0301 :
+			// FOR2
+			h = PD_FOR2;
+			p->a = (int8_t) b1;
+			tgt = (uint16_t) (pc + 2 + (int16_t) ((c[pc + 2] << 8) | c[pc + 3]));
+			break;
+
+		case 0325 :
+			// LIN
+			h = PD_LIT;
+			p->a = 0xffff;
+			break;
+
+		case 0353 :
+			// ENTR
+			h = PD_ENTR;
+			p->a = b1;
+			break;
+
+		case 0355 :
+			// CLX (calls to System.0 are ignored by the generic handler)
+			if ((b1 == 0) && (b2 == 0))
+				goto generic;
+			h = PD_CLX;
+			p->a = b1;
+			p->b = b2;
+			break;
+
+		case 0357 :
+			// CLF
+			h = PD_CLF;
+			p->b = PD_CLF_EMPTY;
+			break;
+
+		case 0360 :
+			// CLL
+			h = PD_CLL;
+			p->a = b1;
+			break;
+
+		case 0361 ... 0377 :
+			// CLL1 - CLL15
+			h = PD_CLL;
+			p->a = op & 0xf;
+			break;
+
+		default :
+			goto generic;
+	}
+
+	// Backward jumps are safepoints
+	if ((h == PD_JP) && (tgt <= pc))
+		h = PD_JPB;
+	if ((h == PD_JPC) && (tgt <= pc))
+		h = PD_JPBC;
+
+	// Resolve static jump targets
+	switch (h)
+	{
+		case PD_JP :
+		case PD_JPC :
+		case PD_JPB :
+		case PD_JPBC :
+		case PD_ORJP :
+		case PD_ANDJP :
+		case PD_FOR1 :
+		case PD_FOR2 :
+			if ((tgt == 0) || (tgt >= mod->code_sz))
+				goto generic;
+			p->target = mod->pcode + tgt;
+			break;
+
+		default :
+			break;
+	}
+
+	p->handler = pd_handler[h];
+	return;
+
+generic:
+	p->handler = pd_generic[op];
+}
+
+
+// pd_fuse()
+// Replaces the handler of the instruction at offset pc by the first
+// superinstruction whose pattern matches the instruction sequence
+// starting there. The entries of the following instructions are not
+// changed, so jumps into the sequence still work.
+//
+void pd_fuse(mod_entry_t *mod, uint16_t pc)
+{
+	uint8_t cls[SU_LEN_MAX];
+	uint8_t n = 0;
+	uint32_t i = pc;
+
+	// Collect classes of fusable instructions up to the first jump
+	while ((n < SU_LEN_MAX) && (i < mod->code_sz))
+	{
+		pd_instr_t *p = &(mod->pcode[i]);
+		uint8_t c = su_class[p->op];
+
+		if (c == 0)
+			break;
+		if (su_specialized[c]
+			? (p->handler == pd_generic[p->op])
+			: (i + p->len >= mod->code_sz))
+			break;
+
+		// Backward jumps are safepoints of their own
+		if ((p->handler == pd_handler[PD_JPB])
+			|| (p->handler == pd_handler[PD_JPBC]))
+			break;
+
+		cls[n ++] = c;
+		if ((c == SC_JPC) || (c == SC_JP))
+			break;
+		i += p->len;
+	}
+
+	for (uint8_t k = 0; k < SU_NUM; k ++)
+	{
+		if ((su_pattern[k].n <= n)
+			&& (memcmp(su_pattern[k].cls, cls, su_pattern[k].n) == 0))
+		{
+			mod->pcode[pc].handler = pd_super[k];
+			return;
+		}
+	}
+}
+
+
+// pd_decode_module()
+// Builds the pre-decoded code frame of module mod.
+// Every byte offset gets an entry, so that computed jumps (RTN,
+// ENTC, generic handlers) can continue at any PC value.
+//
+void pd_decode_module(mod_entry_t *mod)
+{
+#ifdef LE_THREADED
+	// Let the engine export its handler addresses
+	if (pd_handler == NULL)
+		le_run_super(0, 0, 0);
+#endif
+	if (pd_handler == NULL)
+		le_error(1, 0, "Super engine not available");
+
+	free(mod->pcode);
+	mod->pcode = calloc((mod->code_sz > 0) ? mod->code_sz : 1, sizeof(pd_instr_t));
+	if (mod->pcode == NULL)
+		le_error(1, errno, "Cannot allocate pre-decoded code frame for %s", mod->id.name);
+
+	for (uint32_t pc = 0; pc < mod->code_sz; pc ++)
+		pd_decode(mod, pc, &(mod->pcode[pc]));
+
+	// Superinstructions are not used in trace mode, where every
+	// instruction must pass through the monitor
+	if ((le_engine == ENGINE_SUPER) && (! le_trace))
+	{
+		for (uint32_t pc = 0; pc < mod->code_sz; pc ++)
+			pd_fuse(mod, pc);
+	}
+
+#ifdef LE_JIT
+	// Translated modules are native already
+	if ((le_engine == ENGINE_JIT) && (mod->aot == NULL))
+		jit_init_module(mod);
+#endif
+}
+
+
+// pd_link_module()
+// Links the static calls of module mod to the pre-decoded entry
+// points of their callees, which must all be decoded. Byte offsets
+// which only look like calls (operands, case tables) are left to
+// the generic handler; the verifier guarantees that all reachable
+// calls can be linked.
+//
+void pd_link_module(mod_entry_t *mod)
+{
+	for (uint32_t pc = 0; pc < mod->code_sz; pc ++)
+	{
+		pd_instr_t *p = &(mod->pcode[pc]);
+		uint8_t m, i;
+
+		if (p->handler == pd_handler[PD_CLX])
+		{
+			m = p->a;
+			i = p->b;
+		}
+		else if (p->handler == pd_handler[PD_CLL])
+		{
+			m = mod->id.idx;
+			i = p->a;
+		}
+		else
+			continue;
+
+		mod_entry_t *callee = &(module_tab[m]);
+		if ((m < module_num) && (callee->pcode != NULL)
+			&& (i < callee->proc_n) && (callee->proc[i] != 0))
+			p->target = callee->pcode + callee->proc[i];
+		else
+			p->handler = pd_generic[p->op];
+	}
+}
+
+
+// pd_unlink_module()
+// Empties the inline caches of CLF instructions which refer to
+// module mod before it is unloaded
+//
+void pd_unlink_module(mod_entry_t *mod)
+{
+	for (uint8_t k = 0; k < module_num; k ++)
+	{
+		mod_entry_t *m = &(module_tab[k]);
+		if (m->pcode == NULL)
+			continue;
+
+		for (uint32_t pc = 0; pc < m->code_sz; pc ++)
+		{
+			pd_instr_t *p = &(m->pcode[pc]);
+			if ((p->op == 0357) && ((p->b >> 8) == mod->id.idx))
+			{
+				p->b = PD_CLF_EMPTY;
+				p->target = NULL;
+			}
+		}
+	}
+}
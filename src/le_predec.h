@@ -0,0 +1,85 @@
+//=====================================================
+// le_predec.h
+// Load-time pre-decoding of code frames
+//
+// Lilith M-Code Emulator
+//
+// Guido Hoss, 12.03.2022
+//
+// Published by Guido Hoss under GNU Public License V3.
+//=====================================================
+
+#ifndef _LE_PREDEC_H
+#define _LE_PREDEC_H   1
+
+#include "le_mach.h"
+
+// Handlers of the pre-decoded engine which take decoded operands.
+// All other instructions run through the generic opcode handlers.
+//
+enum pd_handler_t {
+	PD_LIT,			// Push constant a (LI, LIB, LIW, LIN, LGA, LEA)
+	PD_LIT2,		// Push constants a, b (LID)
+	PD_LLA,			// Push local address L+a
+	PD_LSA,			// Add a to top of stack
+	PD_LSTA,		// Push string address mem[a]+b
+	PD_JP,			// Jump to target
+	PD_JPC,			// Jump to target if top of stack is zero
+	PD_JPB,			// Jump backward to target (safepoint)
+	PD_JPBC,		// Jump backward if top of stack is zero (safepoint)
+	PD_ORJP,		// Short circuit OR to target
+	PD_ANDJP,		// Short circuit AND to target
+	PD_LLW,			// Load local word
+	PD_LLD,			// Load local double word
+	PD_LDA,			// Load word at absolute address a (LGW, LEW)
+	PD_LDA2,		// Load double word at absolute address a (LED)
+	PD_SLW,			// Store local word
+	PD_SLD,			// Store local double word
+	PD_STA,			// Store word at absolute address a (SGW, SEW)
+	PD_STA2,		// Store double word at absolute address a (SGD)
+	PD_LSW,			// Load stack-addressed word
+	PD_LSD,			// Load stack-addressed double word
+	PD_SSW,			// Store stack-addressed word
+	PD_FOR1,		// Enter FOR statement
+	PD_FOR2,		// Exit FOR statement
+	PD_ENTR,		// Enter procedure
+	PD_CLX,			// Call external procedure
+	PD_CLL,			// Call local procedure
+	PD_CLF,			// Call formal procedure through inline cache
+	PD_JIT,			// Enter native code of compiled procedure
+	PD_JIT_COUNT,	// Count calls of procedure entry point
+	PD_JIT_LOOP,	// Count executions of backward jump
+	PD_NUM_HANDLERS
+};
+
+// Pre-decoded instruction
+// Each code frame byte offset has an entry, so PC values map
+// directly to entries and jump targets need no further checks.
+// Calls are linked to the entry of the callee; CLF keeps the last
+// procedure called in b and its entry in target.
+//
+typedef struct pd_instr_t {
+	const void *handler;		// Address of handler in engine
+	struct pd_instr_t *target;	// Resolved jump or call target
+	uint16_t pc;				// Byte offset in code frame
+	uint16_t a;					// First decoded operand
+	uint16_t b;					// Second decoded operand
+	uint8_t op;					// Opcode
+	uint8_t len;				// Instruction length in bytes
+} pd_instr_t;
+
+// Empty inline cache of CLF (module #0377 does not exist)
+#define PD_CLF_EMPTY	0xffff
+
+// Handler address tables, exported by the pre-decoded engine
+extern const void *const *pd_handler;
+extern const void *const *pd_generic;
+extern const void *const *pd_super;
+
+// Function declarations
+//
+void pd_decode_module(mod_entry_t *mod);
+void pd_link_module(mod_entry_t *mod);
+void pd_unlink_module(mod_entry_t *mod);
+
+#endif
@@ -0,0 +1,194 @@
+//=====================================================
+// le_profile.c
+// M-Code sequence profiling
+//
+// Records how often each opcode and each sequence of up to
+// PF_NGRAM_MAX consecutive opcodes is executed. Only sequences
+// running straight through the code frame are counted, i.e. a
+// taken jump, call or return starts a new sequence. The report is
+// written when the emulator exits and serves as input for the
+// superinstruction generator (tools/mksuper.py).
+//
+// Lilith M-Code Emulator
+//
+// Guido Hoss, 12.03.2022
+//
+// Published by Guido Hoss under GNU Public License V3.
+//=====================================================
+
+#include "le_mach.h"
+#include "le_io.h"
+#include "le_trace.h"
+#include "le_profile.h"
+
+
+// Sequence counter table entry
+// Key = sequence length in bits 32..39, opcodes in bits 0..31
+// with the last opcode in the lowest byte
+typedef struct {
+	uint64_t key;
+	uint64_t count;
+} pf_entry_t;
+
+bool le_profile = false;
+
+FILE *pf_file = NULL;			// Report file
+pf_entry_t *pf_tab = NULL;		// Open addressing hash table
+uint32_t pf_size = 0;			// Size of table (power of 2)
+uint32_t pf_used = 0;			// Used table entries
+uint64_t pf_total = 0;			// Total number of recorded opcodes
+
+// Window of preceding opcodes in current sequence
+uint8_t pf_win[PF_NGRAM_MAX - 1];
+uint8_t pf_win_n = 0;
+mod_entry_t *pf_win_mod = NULL;
+uint16_t pf_win_next;
+
+
+// pf_slot()
+// Returns the table slot for key
+//
+pf_entry_t *pf_slot(pf_entry_t *tab, uint32_t size, uint64_t key)
+{
+	uint32_t i = (uint32_t) ((key * 0x9e3779b97f4a7c15ULL) >> 32) & (size - 1);
+
+	while ((tab[i].key != 0) && (tab[i].key != key))
+		i = (i + 1) & (size - 1);
+	return &(tab[i]);
+}
+
+
+// pf_grow()
+// Doubles the size of the counter table
+//
+void pf_grow()
+{
+	uint32_t size = (pf_size == 0) ? 4096 : pf_size * 2;
+	pf_entry_t *tab = calloc(size, sizeof(pf_entry_t));
+
+	if (tab == NULL)
+		le_error(1, errno, "Can't allocate profile table");
+
+	for (uint32_t i = 0; i < pf_size; i ++)
+	{
+		if (pf_tab[i].key != 0)
+			*pf_slot(tab, size, pf_tab[i].key) = pf_tab[i];
+	}
+	free(pf_tab);
+	pf_tab = tab;
+	pf_size = size;
+}
+
+
+// pf_count()
+// Increments the counter of a sequence
+//
+void pf_count(uint8_t n, uint32_t ops)
+{
+	uint64_t key = ((uint64_t) n << 32) | ops;
+
+	if (pf_used * 4 >= pf_size * 3)
+		pf_grow();
+
+	pf_entry_t *e = pf_slot(pf_tab, pf_size, key);
+	if (e->key == 0)
+	{
+		e->key = key;
+		pf_used ++;
+	}
+	e->count ++;
+}
+
+
+// pf_record()
+// Records execution of opcode op at pc in module mod
+//
+void pf_record(mod_entry_t *mod, uint16_t pc, uint8_t op)
+{
+	uint32_t ops = op;
+
+	// Start new sequence if control did not fall through
+	if ((mod != pf_win_mod) || (pc != pf_win_next))
+		pf_win_n = 0;
+
+	pf_total ++;
+	pf_count(1, ops);
+	for (uint8_t i = 0; i < pf_win_n; i ++)
+	{
+		ops |= pf_win[i] << (8 * (i + 1));
+		pf_count(i + 2, ops);
+	}
+
+	// Shift opcode into window (most recent first)
+	memmove(pf_win + 1, pf_win, PF_NGRAM_MAX - 2);
+	pf_win[0] = op;
+	if (pf_win_n < PF_NGRAM_MAX - 1)
+		pf_win_n ++;
+	pf_win_mod = mod;
+	pf_win_next = pc + le_opcode_len(op);
+}
+
+
+// pf_write()
+// Writes the profile report, most frequent sequences first
+//
+void pf_write()
+{
+	int cmp(const void *a, const void *b)
+	{
+		const pf_entry_t *x = a, *y = b;
+		return (x->count < y->count) ? 1 : (x->count > y->count) ? -1 : 0;
+	}
+
+	pf_entry_t *tab = calloc(pf_used + 1, sizeof(pf_entry_t));
+	if ((pf_file == NULL) || (tab == NULL))
+		return;
+
+	fprintf(pf_file,
+		"# M-code sequence profile\n"
+		"# total %lu\n"
+		"# count  length  opcodes (octal)  ; mnemonics\n",
+		pf_total
+	);
+	for (uint8_t n = 1; n <= PF_NGRAM_MAX; n ++)
+	{
+		uint32_t m = 0;
+		for (uint32_t i = 0; i < pf_size; i ++)
+		{
+			if ((pf_tab[i].key >> 32) == n)
+				tab[m ++] = pf_tab[i];
+		}
+		qsort(tab, m, sizeof(pf_entry_t), cmp);
+
+		for (uint32_t i = 0; (i < m) && (i < PF_REPORT_MAX); i ++)
+		{
+			char mnem[LE_MNEM_LEN + 1];
+
+			fprintf(pf_file, "%lu %d", tab[i].count, n);
+			for (int8_t j = n - 1; j >= 0; j --)
+				fprintf(pf_file, " %03o", (uint8_t) (tab[i].key >> (8 * j)));
+			fprintf(pf_file, " ;");
+			for (int8_t j = n - 1; j >= 0; j --)
+				fprintf(pf_file, " %s", le_mnemonic(tab[i].key >> (8 * j), mnem));
+			fprintf(pf_file, "\n");
+		}
+	}
+	fclose(pf_file);
+	pf_file = NULL;
+	free(tab);
+}
+
+
+// pf_open()
+// Enables profiling and opens the report file, which is
+// written when the emulator exits
+//
+void pf_open(char *fname)
+{
+	if ((pf_file = fopen(fname, "w")) == NULL)
+		le_error(1, errno, "Can't create profile '%s'", fname);
+
+	le_profile = true;
+	pf_grow();
+	atexit(pf_write);
+}
@@ -0,0 +1,31 @@
+//=====================================================
+// le_profile.h
+// M-Code sequence profiling
+//
+// Lilith M-Code Emulator
+//
+// Guido Hoss, 12.03.2022
+//
+// Published by Guido Hoss under GNU Public License V3.
+//=====================================================
+
+#ifndef _LE_PROFILE_H
+#define _LE_PROFILE_H   1
+
+#include "le_mach.h"
+
+// Longest opcode sequence recorded by the profiler
+#define PF_NGRAM_MAX	4
+
+// Maximum number of sequences of each length in report
+#define PF_REPORT_MAX	1000
+
+// Profiling enabled if true
+extern bool le_profile;
+
+// Function declarations
+//
+void pf_open(char *fname);
+void pf_record(mod_entry_t *mod, uint16_t pc, uint8_t op);
+
+#endif
@@ -0,0 +1,683 @@
+//=====================================================
+// le_regir.c
+// Load-time translation of code frames into register IR
+//
+// The translator turns the stack code of each module into three-
+// address instructions. Within a block it follows the expression
+// stack symbolically: constants and words of the frames become the
+// operands of the instructions using them, and the results of
+// arithmetic, comparisons and indexed loads are kept in virtual
+// registers, one per expression stack slot. A comparison followed
+// by a conditional jump becomes a single compare-and-branch, and a
+// result which is stored right away is written to its destination
+// directly.
+//
+// The expression stack in memory is only written where it is needed:
+// before calls, supervisor calls, STORE and all other instructions
+// which run through their generic handlers, and at the labels where
+// blocks begin. Labels (entry points, jump targets and resume points)
+// therefore always have the expression stack in memory, which is
+// what the generic handlers, returns and the other engines expect.
+//
+// Lilith M-Code Emulator
+//
+// Guido Hoss, 12.03.2022
+//
+// Published by Guido Hoss under GNU Public License V3.
+//=====================================================
+
+#include <config.h>
+#include "le_mach.h"
+#include "le_io.h"
+#include "le_stack.h"
+#include "le_trace.h"
+#include "le_mcode.h"
+#include "le_verify.h"
+#include "le_regir.h"
+
+
+// Values of constants: ri_imm[x] = x
+uint16_t ri_imm[65536];
+
+// Handler address tables, exported by le_run_regir()
+const void *const *ri_handler = NULL;
+const void *const *ri_generic = NULL;
+
+// Operand on the symbolic expression stack
+typedef struct {
+	uint8_t m;					// Mode (ri_mode_t)
+	uint8_t n;					// Number of M-codes folded into operand
+	uint16_t x;					// Register, offset, address or constant
+} ri_opnd_t;
+
+// State of the translation of a module
+typedef struct {
+	mod_entry_t *mod;
+	ri_instr_t *ir;				// IR of the code frame
+	uint32_t n;					// Number of IR instructions
+	uint32_t max;				// Allocated IR instructions
+	uint16_t pc;				// M-code being translated
+	uint8_t k;					// Number of symbolic stack entries
+	ri_opnd_t s[MACH_EXSMEM_SZ];	// Symbolic stack above the stack in memory
+} ri_ctx_t;
+
+// Conditional jumps taken by JPC after the comparisons RI_EQL - RI_UGEQ
+const uint8_t ri_unless[] = {
+	RI_JNE, RI_JEQ, RI_JGE, RI_JGT, RI_JLE, RI_JLT,
+	RI_JUGE, RI_JUGT, RI_JULE, RI_JULT
+};
+
+// RI_SET()
+// Sets operand f (a, b or d) of IR instruction p to o
+//
+#define RI_SET(p, f, o) { \
+		ri_opnd_t _o = (o); \
+		(p)->f##m = _o.m; \
+		(p)->f = _o.x; \
+		(p)->n += _o.n; \
+	}
+
+
+// ri_init_imm()
+// Fills the table of constant values before the program starts
+//
+__attribute__((constructor))
+void ri_init_imm()
+{
+	for (uint32_t i = 0; i < 65536; i ++)
+		ri_imm[i] = i;
+}
+
+
+// ri_emit()
+// Appends an IR instruction with handler kind for the M-code being
+// translated and returns it. The pointer is valid until the next
+// instruction is appended.
+//
+ri_instr_t *ri_emit(ri_ctx_t *c, uint8_t kind)
+{
+	if (c->n == c->max)
+	{
+		c->max *= 2;
+		c->ir = realloc(c->ir, c->max * sizeof(ri_instr_t));
+		if (c->ir == NULL)
+			le_error(1, errno, "Cannot allocate register IR for %s", c->mod->id.name);
+	}
+
+	ri_instr_t *p = &(c->ir[c->n ++]);
+	memset(p, 0, sizeof(ri_instr_t));
+	p->kind = kind;
+	p->pc = c->pc;
+	p->op = c->mod->code[c->pc];
+	return p;
+}
+
+
+// ri_push()
+// Pushes an operand with mode m and value x, which folds n M-codes,
+// onto the symbolic stack
+//
+void ri_push(ri_ctx_t *c, uint8_t m, uint16_t x, uint8_t n)
+{
+	c->s[c->k ++] = (ri_opnd_t) { m, n, x };
+}
+
+
+// ri_flush()
+// Pushes the symbolic stack onto the expression stack in memory
+//
+void ri_flush(ri_ctx_t *c)
+{
+	for (uint8_t i = 0; i < c->k; i ++)
+	{
+		ri_instr_t *p = ri_emit(c, RI_PUSH);
+		RI_SET(p, a, c->s[i]);
+	}
+	c->k = 0;
+}
+
+
+// ri_need()
+// Makes sure that the top j entries of the stack are symbolic. The
+// missing entries are popped from the expression stack in memory
+// into the registers below the symbolic entries, which move up.
+//
+void ri_need(ri_ctx_t *c, uint8_t j)
+{
+	if (c->k >= j)
+		return;
+
+	uint8_t d = j - c->k;
+	for (int i = c->k - 1; i >= 0; i --)
+	{
+		ri_opnd_t *o = &(c->s[i]);
+		if (o->m == RI_REG)
+		{
+			ri_instr_t *p = ri_emit(c, RI_MOV);
+			p->a = o->x;
+			p->d = i + d;
+			o->x = i + d;
+		}
+		c->s[i + d] = *o;
+	}
+	for (int i = d - 1; i >= 0; i --)
+	{
+		ri_emit(c, RI_POP)->d = i;
+		c->s[i] = (ri_opnd_t) { RI_REG, 0, i };
+	}
+	c->k = j;
+}
+
+
+// ri_fix()
+// Loads the frame and memory words on the symbolic stack into their
+// registers before a store may change them. Returns the number of
+// instructions emitted.
+//
+uint8_t ri_fix(ri_ctx_t *c)
+{
+	uint8_t j = 0;
+
+	for (uint8_t i = 0; i < c->k; i ++)
+	{
+		ri_opnd_t *o = &(c->s[i]);
+		if ((o->m != RI_LOC) && (o->m != RI_MEM))
+			continue;
+
+		ri_instr_t *p = ri_emit(c, RI_MOV);
+		RI_SET(p, a, *o);
+		p->dm = RI_REG;
+		p->d = i;
+		*o = (ri_opnd_t) { RI_REG, 0, i };
+		j ++;
+	}
+	return j;
+}
+
+
+// ri_value()
+// Translates an M-code which replaces the nopnd operands on top of
+// the symbolic stack by the result of IR instruction kind
+//
+void ri_value(ri_ctx_t *c, uint8_t kind, uint8_t nopnd)
+{
+	ri_instr_t *p = ri_emit(c, kind);
+
+	p->n = 1;
+	if (nopnd > 1)
+		RI_SET(p, b, c->s[-- c->k]);
+	RI_SET(p, a, c->s[-- c->k]);
+	p->dm = RI_REG;
+	p->d = c->k;
+	ri_push(c, RI_REG, c->k, 0);
+}
+
+
+// ri_store()
+// Translates an M-code which stores the top of the symbolic stack at
+// the destination with mode dm and value d
+//
+void ri_store(ri_ctx_t *c, uint8_t dm, uint16_t d)
+{
+	ri_opnd_t v = c->s[-- c->k];
+
+	// The instruction computing the value writes the destination
+	// itself, unless words below the value must be loaded first
+	if ((ri_fix(c) == 0) && (v.m == RI_REG) && (v.x == c->k))
+	{
+		ri_instr_t *p = &(c->ir[c->n - 1]);
+		if ((p->kind >= RI_POP) && (p->kind <= RI_LDB)
+			&& (p->dm == RI_REG) && (p->d == v.x))
+		{
+			p->dm = dm;
+			p->d = d;
+			p->n ++;
+			return;
+		}
+	}
+
+	ri_instr_t *p = ri_emit(c, RI_MOV);
+	p->n = 1;
+	RI_SET(p, a, v);
+	p->dm = dm;
+	p->d = d;
+}
+
+
+// ri_store_x()
+// Translates an indexed store (SSW0 - SSW15, SXW, SXB) into IR
+// instruction kind. The index is an operand on the symbolic stack if
+// indexed is TRUE, otherwise the constant ofs.
+//
+void ri_store_x(ri_ctx_t *c, uint8_t kind, bool indexed, uint16_t ofs)
+{
+	ri_opnd_t v = c->s[-- c->k];
+	ri_opnd_t i = indexed ? c->s[-- c->k] : (ri_opnd_t) { RI_IMM, 0, ofs };
+	ri_opnd_t a = c->s[-- c->k];
+
+	ri_fix(c);
+	ri_instr_t *p = ri_emit(c, kind);
+	p->n = 1;
+	RI_SET(p, a, a);
+	RI_SET(p, b, i);
+	RI_SET(p, d, v);
+}
+
+
+// ri_jump()
+// Translates an unconditional jump to tgt
+//
+void ri_jump(ri_ctx_t *c, uint16_t tgt)
+{
+	ri_flush(c);
+	ri_instr_t *p = ri_emit(c, (tgt <= c->pc) ? RI_JPB : RI_JP);
+	p->n = 1;
+	p->d = tgt;
+}
+
+
+// ri_jump_c()
+// Translates a jump to tgt if the top of the symbolic stack is zero.
+// A forward jump on the result of the preceding comparison replaces
+// the comparison.
+//
+void ri_jump_c(ri_ctx_t *c, uint16_t tgt)
+{
+	ri_opnd_t v = c->s[-- c->k];
+	ri_instr_t *p = &(c->ir[c->n - 1]);
+
+	if ((tgt > c->pc) && (v.m == RI_REG) && (v.x == c->k)
+		&& (p->kind >= RI_EQL) && (p->kind <= RI_UGEQ)
+		&& (p->dm == RI_REG) && (p->d == v.x))
+	{
+		// Move the comparison behind the pushes of the rest of the
+		// stack, which only write the expression stack
+		ri_instr_t t = *p;
+		c->n --;
+		ri_flush(c);
+		p = ri_emit(c, ri_unless[t.kind - RI_EQL]);
+		p->n = t.n + 1;
+		p->am = t.am;
+		p->a = t.a;
+		p->bm = t.bm;
+		p->b = t.b;
+		p->d = tgt;
+		return;
+	}
+
+	ri_flush(c);
+	p = ri_emit(c, (tgt <= c->pc) ? RI_JZB : RI_JZ);
+	p->n = 1;
+	RI_SET(p, a, v);
+	p->d = tgt;
+}
+
+
+// ri_check()
+// Translates a bounds check of the entry below the nopnd bounds on
+// top of the symbolic stack; missing bounds are the constants low
+// and high. The checked entry stays on the stack.
+//
+void ri_check(ri_ctx_t *c, uint8_t nopnd, uint16_t low, uint16_t high)
+{
+	ri_opnd_t hi = (nopnd > 0) ? c->s[-- c->k] : (ri_opnd_t) { RI_IMM, 0, high };
+	ri_opnd_t lo = (nopnd > 1) ? c->s[-- c->k] : (ri_opnd_t) { RI_IMM, 0, low };
+	ri_opnd_t i = c->s[c->k - 1];
+
+	ri_instr_t *p = ri_emit(c, RI_CHK);
+	p->n = 1;
+	p->am = i.m;
+	p->a = i.x;
+	RI_SET(p, b, lo);
+	RI_SET(p, d, hi);
+}
+
+
+// ri_generic_op()
+// Translates an M-code which runs through its generic handler on the
+// expression stack in memory
+//
+void ri_generic_op(ri_ctx_t *c)
+{
+	ri_flush(c);
+	ri_emit(c, RI_OP)->n = 1;
+}
+
+
+// ri_translate()
+// Translates the M-code at the PC of the translation
+//
+void ri_translate(ri_ctx_t *c)
+{
+	mod_entry_t *mod = c->mod;
+	uint8_t *code = mod->code;
+	uint16_t pc = c->pc;
+	uint8_t op = code[pc];
+	uint8_t len = le_opcode_len(op);
+	uint8_t b1 = (len > 1) ? code[pc + 1] : 0;
+	uint8_t b2 = (len > 2) ? code[pc + 2] : 0;
+	uint16_t w = (b1 << 8) | b2;
+	uint16_t g = mod->data_ofs;
+
+	switch (op)
+	{
+		case 000 ... 017 :	ri_push(c, RI_IMM, op & 0xf, 1); return;	// LI0 - LI15
+		case 020 :	ri_push(c, RI_IMM, b1, 1); return;				// LIB
+		case 022 :	ri_push(c, RI_IMM, w, 1); return;				// LIW
+		case 0325 :	ri_push(c, RI_IMM, 0xffff, 1); return;			// LIN
+		case 025 :	ri_push(c, RI_IMM, g + b1, 1); return;			// LGA
+		case 027 :	ri_push(c, RI_IMM, module_tab[b1].data_ofs + b2, 1); return;	// LEA
+		case 040 :	ri_push(c, RI_LOC, b1, 1); return;				// LLW
+		case 044 ... 057 :	ri_push(c, RI_LOC, op & 0xf, 1); return;	// LLW4 - LLW15
+		case 042 :	ri_push(c, RI_MEM, module_tab[b1].data_ofs + b2, 1); return;	// LEW
+		case 0100 :	ri_push(c, RI_MEM, g + b1, 1); return;			// LGW
+		case 0102 ... 0117 :	ri_push(c, RI_MEM, g + (op & 0xf), 1); return;	// LGW2 - LGW15
+		case 0351 :	ri_push(c, RI_LOC, 1, 1); return;				// GB1
+
+		case 024 :
+			// LLA
+			ri_push(c, RI_IMM, b1, 0);
+			ri_value(c, RI_LLA, 1);
+			return;
+
+		case 0353 :
+		{
+			// ENTR (leaves the expression stack alone)
+			ri_instr_t *p = ri_emit(c, RI_ENTR);
+			p->n = 1;
+			p->am = RI_IMM;
+			p->a = b1;
+			return;
+		}
+
+		case 0204 :
+			// LSTA
+			ri_push(c, RI_MEM, g + 2, 0);
+			ri_push(c, RI_IMM, b1, 0);
+			ri_value(c, RI_ADD, 2);
+			return;
+
+		default :
+			break;
+	}
+
+	// Instructions taking operands from the stack
+	switch (op)
+	{
+		case 026 :	// LSA
+			ri_need(c, 1);
+			ri_push(c, RI_IMM, b1, 0);
+			ri_value(c, RI_ADD, 2);
+			return;
+
+		case 060 :	// SLW
+			ri_need(c, 1);
+			ri_store(c, RI_LOC, b1);
+			return;
+
+		case 064 ... 077 :	// SLW4 - SLW15
+			ri_need(c, 1);
+			ri_store(c, RI_LOC, op & 0xf);
+			return;
+
+		case 062 :	// SEW
+			ri_need(c, 1);
+			ri_store(c, RI_MEM, module_tab[b1].data_ofs + b2);
+			return;
+
+		case 0120 :	// SGW
+			ri_need(c, 1);
+			ri_store(c, RI_MEM, g + b1);
+			return;
+
+		case 0122 ... 0137 :	// SGW2 - SGW15
+			ri_need(c, 1);
+			ri_store(c, RI_MEM, g + (op & 0xf));
+			return;
+
+		case 0140 ... 0157 :	// LSW0 - LSW15
+			ri_need(c, 1);
+			ri_push(c, RI_IMM, op & 0xf, 0);
+			ri_value(c, RI_LDX, 2);
+			return;
+
+		case 0200 :	// LSW
+			ri_need(c, 1);
+			ri_push(c, RI_IMM, b1, 0);
+			ri_value(c, RI_LDX, 2);
+			return;
+
+		case 0160 ... 0177 :	// SSW0 - SSW15
+			ri_need(c, 2);
+			ri_store_x(c, RI_STX, false, op & 0xf);
+			return;
+
+		case 0205 :	// LXB
+			ri_need(c, 2);
+			ri_value(c, RI_LDB, 2);
+			return;
+
+		case 0206 :	// LXW
+			ri_need(c, 2);
+			ri_value(c, RI_LDX, 2);
+			return;
+
+		case 0225 :	// SXB
+			ri_need(c, 3);
+			ri_store_x(c, RI_STB, true, 0);
+			return;
+
+		case 0226 :	// SXW
+			ri_need(c, 3);
+			ri_store_x(c, RI_STX, true, 0);
+			return;
+
+		case 0252 ... 0255 :	// ULSS, ULEQ, UGTR, UGEQ
+			ri_need(c, 2);
+			ri_value(c, RI_ULSS + (op - 0252), 2);
+			return;
+
+		case 0265 :	// COPT
+			ri_need(c, 1);
+			ri_push(c, c->s[c->k - 1].m, c->s[c->k - 1].x, 1);
+			return;
+
+		case 0270 :	// UADD
+		case 0330 :	// IADD
+			ri_need(c, 2);
+			ri_value(c, RI_ADD, 2);
+			return;
+
+		case 0271 :	// USUB
+		case 0331 :	// ISUB
+			ri_need(c, 2);
+			ri_value(c, RI_SUB, 2);
+			return;
+
+		case 0272 :	// UMUL
+		case 0332 :	// IMUL
+			ri_need(c, 2);
+			ri_value(c, RI_MUL, 2);
+			return;
+
+		case 0273 :	// UDIV
+		case 0274 :	// UMOD
+			ri_need(c, 2);
+			ri_value(c, (op == 0273) ? RI_DIV : RI_MOD, 2);
+			return;
+
+		case 0276 :	// SHL
+		case 0277 :	// SHR
+			ri_need(c, 2);
+			ri_value(c, (op == 0276) ? RI_SHL : RI_SHR, 2);
+			return;
+
+		case 0305 :	// CHK
+			ri_need(c, 3);
+			ri_check(c, 2, 0, 0);
+			return;
+
+		case 0306 :	// CHKZ
+			ri_need(c, 2);
+			ri_check(c, 1, 0, 0);
+			return;
+
+		case 0307 :	// CHKS
+			ri_need(c, 1);
+			ri_check(c, 0, 0, 0x7fff);
+			return;
+
+		case 0310 ... 0315 :	// EQL, NEQ, LSS, LEQ, GTR, GEQ
+			ri_need(c, 2);
+			ri_value(c, RI_EQL + (op - 0310), 2);
+			return;
+
+		case 0316 :	// ABS
+			ri_need(c, 1);
+			ri_value(c, RI_ABS, 1);
+			return;
+
+		case 0317 :	// NEG
+			ri_need(c, 1);
+			ri_value(c, RI_NEG, 1);
+			return;
+
+		case 0320 :	// OR
+			ri_need(c, 2);
+			ri_value(c, RI_OR, 2);
+			return;
+
+		case 0321 :	// XOR
+			ri_need(c, 2);
+			ri_value(c, RI_XOR, 2);
+			return;
+
+		case 0322 :	// AND
+			ri_need(c, 2);
+			ri_value(c, RI_AND, 2);
+			return;
+
+		case 0323 :	// COM
+			ri_need(c, 1);
+			ri_value(c, RI_COM, 1);
+			return;
+
+		case 0324 :	// IN
+			ri_need(c, 2);
+			ri_value(c, RI_IN, 2);
+			return;
+
+		case 0327 :	// NOT
+			ri_need(c, 1);
+			ri_value(c, RI_NOT, 1);
+			return;
+
+		case 0333 :	// IDIV
+		case 0334 :	// MOD
+			ri_need(c, 2);
+			ri_value(c, (op == 0333) ? RI_IDIV : RI_IMOD, 2);
+			return;
+
+		case 030 :	// JPC
+			ri_need(c, 1);
+			ri_jump_c(c, pc + 1 + w);
+			return;
+
+		case 032 :	// JPFC
+			ri_need(c, 1);
+			ri_jump_c(c, pc + 1 + b1);
+			return;
+
+		case 034 :	// JPBC
+			ri_need(c, 1);
+			ri_jump_c(c, pc + 1 - b1);
+			return;
+
+		case 031 :	// JP
+			ri_jump(c, pc + 1 + w);
+			return;
+
+		case 033 :	// JPF
+			ri_jump(c, pc + 1 + b1);
+			return;
+
+		case 035 :	// JPB
+			ri_jump(c, pc + 1 - b1);
+			return;
+
+		default :
+			break;
+	}
+
+	// All other instructions
+	ri_generic_op(c);
+}
+
+
+// ri_translate_module()
+// Translates the verified code frame of module mod into register IR.
+// Every label and every instruction reached with an empty symbolic
+// stack gets an entry in the index of the code frame, so that
+// computed jumps (RTN, ENTC, generic handlers) can continue there.
+//
+void ri_translate_module(mod_entry_t *mod)
+{
+#ifdef LE_THREADED
+	// Let the engine export its handler addresses
+	if (ri_handler == NULL)
+		le_run_regir(0, 0, 0);
+#endif
+	if (ri_handler == NULL)
+		le_error(1, 0, "Register IR engine not available");
+
+	uint32_t sz = mod->code_sz;
+	ri_ctx_t c;
+
+	c.mod = mod;
+	c.k = 0;
+	c.n = 1;
+	c.max = sz + 16;
+	c.ir = malloc(c.max * sizeof(ri_instr_t));
+	free(mod->rcode);
+	free(mod->rcode_ix);
+	mod->rcode_ix = calloc((sz > 0) ? sz : 1, sizeof(uint32_t));
+	if ((c.ir == NULL) || (mod->rcode_ix == NULL))
+		le_error(1, errno, "Cannot allocate register IR for %s", mod->id.name);
+
+	// Index 0 means no entry; its instruction is never executed
+	memset(c.ir, 0, sizeof(ri_instr_t));
+	c.ir[0].op = 021;
+
+	for (uint32_t pc = 0; pc < sz; pc ++)
+	{
+		if (! (mod->flags[pc] & VF_INSTR))
+			continue;
+
+		c.pc = pc;
+		if (mod->flags[pc] & VF_LABEL)
+			ri_flush(&c);
+		if (c.k == 0)
+			mod->rcode_ix[pc] = c.n;
+		ri_translate(&c);
+	}
+	ri_flush(&c);
+
+	// Resolve jump targets, which are labels, and handlers
+	uint32_t m = 0;
+	for (uint32_t i = 0; i < c.n; i ++)
+	{
+		ri_instr_t *p = &(c.ir[i]);
+
+		if (p->kind >= RI_JP)
+			p->target = c.ir + mod->rcode_ix[p->d];
+		if (p->kind == RI_OP)
+			p->handler = ri_generic[p->op];
+		else
+			p->handler = ri_handler[p->kind];
+		m += p->n;
+	}
+	mod->rcode = c.ir;
+
+	le_verbose_msg("Translated %s (%u M-codes into %u IR instructions)\n",
+		mod->id.name, m, c.n - 1);
+}
@@ -0,0 +1,117 @@
+//=====================================================
+// le_regir.h
+// Load-time translation of code frames into register IR
+//
+// Lilith M-Code Emulator
+//
+// Guido Hoss, 12.03.2022
+//
+// Published by Guido Hoss under GNU Public License V3.
+//=====================================================
+
+#ifndef _LE_REGIR_H
+#define _LE_REGIR_H   1
+
+#include "le_mach.h"
+
+// Handlers of the register IR engine. Operands a and b are read and
+// destination d is written through their modes (ri_mode_t); stores
+// and RI_CHK read their third operand through d. Conditional jumps named after a
+// comparison are fused with it and jump if "a cond b" holds.
+//
+enum ri_handler_t {
+	RI_OP,			// Run the generic handler of the M-code at pc
+	RI_PUSH,		// Push a onto the expression stack
+	RI_POP,			// d := pop from the expression stack
+	RI_MOV,			// d := a
+	RI_LLA,			// d := L + a
+	RI_ADD,			// d := a + b
+	RI_SUB,			// d := a - b
+	RI_MUL,			// d := a * b
+	RI_DIV,			// d := a DIV b (unsigned)
+	RI_MOD,			// d := a MOD b (unsigned)
+	RI_IDIV,		// d := a DIV b (signed)
+	RI_IMOD,		// d := a MOD b (signed)
+	RI_AND,			// d := a & b
+	RI_OR,			// d := a | b
+	RI_XOR,			// d := a ^ b
+	RI_SHL,			// d := a << b
+	RI_SHR,			// d := a >> b
+	RI_IN,			// d := a IN b (bitset)
+	RI_EQL,			// d := a = b
+	RI_NEQ,			// d := a # b
+	RI_LSS,			// d := a < b
+	RI_LEQ,			// d := a <= b
+	RI_GTR,			// d := a > b
+	RI_GEQ,			// d := a >= b
+	RI_ULSS,		// d := a < b (unsigned)
+	RI_ULEQ,		// d := a <= b (unsigned)
+	RI_UGTR,		// d := a > b (unsigned)
+	RI_UGEQ,		// d := a >= b (unsigned)
+	RI_NEG,			// d := -a
+	RI_COM,			// d := ~a
+	RI_NOT,			// d := NOT a
+	RI_ABS,			// d := ABS(a)
+	RI_LDX,			// d := mem[a + b]
+	RI_LDB,			// d := byte b of string at a
+	RI_STX,			// mem[a + b] := d
+	RI_STB,			// byte b of string at a := d
+	RI_CHK,			// Trap unless b <= a <= d
+	RI_ENTR,		// Allocate a words on the stack
+	RI_JP,			// Jump to target
+	RI_JPB,			// Jump backward to target (safepoint)
+	RI_JZ,			// Jump to target if a = 0
+	RI_JZB,			// Jump backward to target if a = 0 (safepoint)
+	RI_JEQ,			// Jump to target if a = b
+	RI_JNE,			// Jump to target if a # b
+	RI_JLT,			// Jump to target if a < b
+	RI_JLE,			// Jump to target if a <= b
+	RI_JGT,			// Jump to target if a > b
+	RI_JGE,			// Jump to target if a >= b
+	RI_JULT,		// Jump to target if a < b (unsigned)
+	RI_JULE,		// Jump to target if a <= b (unsigned)
+	RI_JUGT,		// Jump to target if a > b (unsigned)
+	RI_JUGE,		// Jump to target if a >= b (unsigned)
+	RI_NUM_HANDLERS
+};
+
+// Operand modes, indexing the base pointers of the engine
+enum ri_mode_t {
+	RI_REG,			// Virtual register (expression stack slot)
+	RI_LOC,			// Word of the local frame at L
+	RI_MEM,			// Word at an absolute address
+	RI_IMM,			// Constant
+	RI_NUM_MODES
+};
+
+// Register IR instruction
+// Each instruction belongs to the M-code at pc, and n is the number
+// of M-codes it completes, including the loads folded into its
+// operands. Only PCs where the expression stack is held in memory
+// have an entry in the index of the code frame.
+//
+typedef struct ri_instr_t {
+	const void *handler;		// Address of handler in engine
+	struct ri_instr_t *target;	// Resolved jump target
+	uint16_t pc;				// Byte offset of M-code in code frame
+	uint16_t a;					// First operand
+	uint16_t b;					// Second operand
+	uint16_t d;					// Destination (target PC of jumps)
+	uint8_t am, bm, dm;			// Modes of a, b and d
+	uint8_t op;					// Opcode of M-code
+	uint8_t n;					// Number of M-codes completed
+	uint8_t kind;				// Handler (ri_handler_t)
+} ri_instr_t;
+
+// Values of constants, the base of operands with mode RI_IMM
+extern uint16_t ri_imm[65536];
+
+// Handler address tables, exported by the register IR engine
+extern const void *const *ri_handler;
+extern const void *const *ri_generic;
+
+// Function declarations
+//
+void ri_translate_module(mod_entry_t *mod);
+
+#endif
@@ -14,10 +14,18 @@
 #include "le_stack.h"
 
 
-// Memory structures defined in le_stack.h
-//
-uint16_t *exs_mem;
-uint8_t gs_SP;
+// The verifier bounds the expression stack to MACH_EXSMEM_SZ words
+// for code which follows the calling convention of the Lilith
+// compiler. Other code can move the 8-bit stack pointer to any
+// position, so exs_mem holds all 256 of them, plus the words below
+// and above which double words and the cached top of stack touch at
+// positions 0 and 255.
+#define ES_GUARD	3
+
+#ifdef LE_ES_STATS
+uint64_t es_stat_rd;		// Reads of exs_mem and gs_SP
+uint64_t es_stat_wr;		// Writes of exs_mem and gs_SP
+#endif
 
 
 // es_init()
@@ -26,8 +34,21 @@ uint8_t gs_SP;
 void es_init()
 {
     gs_SP = 0;
-    if ((exs_mem = calloc(MACH_EXSMEM_SZ, MACH_WORD_SZ)) == NULL)
+    if ((exs_mem = calloc(ES_GUARD + 256 + 1, MACH_WORD_SZ)) == NULL)
         le_error(1, errno, "Can't allocate expression stack");
+
+    // exs_mem[-1] receives the cached top of an empty stack (tos engine)
+    exs_mem += ES_GUARD;
+}
+
+
+// es_release()
+// Free expression stack
+//
+void es_release()
+{
+    free(exs_mem - ES_GUARD);
+    exs_mem = NULL;
 }
 
 
@@ -44,6 +65,7 @@ uint16_t es_stack(uint8_t i)
 //
 void es_push(uint16_t x)
 {
+    ES_STAT(1, 2);
     exs_mem[gs_SP++] = x;
 }
 
@@ -53,6 +75,7 @@ void es_push(uint16_t x)
 //
 uint16_t es_pop()
 {
+    ES_STAT(2, 1);
     return exs_mem[--gs_SP];
 }
 
@@ -62,8 +85,17 @@ uint16_t es_pop()
 //
 void es_dpush(floatword_t x)
 {
+#ifdef LE_ES_WORDS
     es_push(x.w[1]);
     es_push(x.w[0]);
+#else
+    // Swapping the halves puts the high word first on either host
+    uint32_t v = (x.l << 16) | (x.l >> 16);
+
+    ES_STAT(1, 2);
+    memcpy(&exs_mem[gs_SP], &v, 4);
+    gs_SP += 2;
+#endif
 }
 
 
@@ -74,12 +106,53 @@ floatword_t es_dpop()
 {
     floatword_t x;
 
+#ifdef LE_ES_WORDS
     x.w[0] = es_pop();
     x.w[1] = es_pop();
+#else
+    uint32_t v;
+
+    ES_STAT(2, 1);
+    gs_SP -= 2;
+    memcpy(&v, &exs_mem[gs_SP], 4);
+    x.l = (v << 16) | (v >> 16);
+#endif
     return x;
 }
 
 
+// es_dload()
+// Push the double word at p in memory
+//
+void es_dload(const uint16_t *p)
+{
+#ifdef LE_ES_WORDS
+    es_push(p[0]);
+    es_push(p[1]);
+#else
+    ES_STAT(1, 2);
+    memcpy(&exs_mem[gs_SP], p, 4);
+    gs_SP += 2;
+#endif
+}
+
+
+// es_dstore()
+// Pop a double word into memory at p
+//
+void es_dstore(uint16_t *p)
+{
+#ifdef LE_ES_WORDS
+    p[1] = es_pop();
+    p[0] = es_pop();
+#else
+    ES_STAT(2, 1);
+    gs_SP -= 2;
+    memcpy(p, &exs_mem[gs_SP], 4);
+#endif
+}
+
+
 // es_empty()
 // Return TRUE if stack is empty
 //
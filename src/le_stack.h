@@ -15,9 +15,24 @@
 // Expression stack
 #define MACH_EXSMEM_SZ	15		// Expression stack size in words
 
-// Memory for expression stack
-extern uint16_t *exs_mem;
-extern uint8_t gs_SP;		// Expression stack pointer
+#include "le_mach.h"
+
+// Memory for expression stack (machine context)
+#define exs_mem		(mach_ctx.exs_mem)
+#define gs_SP		(mach_ctx.gs_SP)		// Expression stack pointer
+
+// Counters of expression stack memory accesses (benchmark builds)
+#ifdef LE_ES_STATS
+extern uint64_t es_stat_rd, es_stat_wr;
+#define ES_STAT(r, w)	(es_stat_rd += (r), es_stat_wr += (w))
+#else
+#define ES_STAT(r, w)	((void) 0)
+#endif
+
+// Double words occupy two adjacent words of the expression stack,
+// high word first, in the same order as in memory. They are moved
+// as single 32-bit slots unless the benchmark reference build
+// defines LE_ES_WORDS, which moves them word by word.
 
 // Helper type to bytecast floats <-> (double) words
 //
@@ -46,11 +61,14 @@ enum es_calltype_t {
 // Function declarations
 //
 void es_init();
+void es_release();
 uint16_t es_stack(uint8_t i);
 void es_push(uint16_t x);
 uint16_t es_pop();
 void es_dpush(floatword_t d);
 floatword_t es_dpop();
+void es_dload(const uint16_t *p);
+void es_dstore(uint16_t *p);
 void es_save();
 void es_restore();
 void stk_mark(enum es_calltype_t ct, uint16_t arg);
@@ -0,0 +1,160 @@
+//=====================================================
+// le_super.h
+// Superinstruction patterns
+//
+// Generated by tools/mksuper.py from compile.prof comint.prof
+// (57162502 M-codes profiled). Do not edit.
+//
+// Lilith M-Code Emulator
+//
+// Guido Hoss, 12.03.2022
+//
+// Published by Guido Hoss under GNU Public License V3.
+//=====================================================
+
+#ifndef _LE_SUPER_H
+#define _LE_SUPER_H   1
+
+// Number of superinstructions and maximum pattern length
+#define SU_NUM		19
+#define SU_LEN_MAX	4
+
+// Instruction classes
+#define SC_LIT	1
+#define SC_LIT2	2
+#define SC_LLA	3
+#define SC_LSA	4
+#define SC_LSTA	5
+#define SC_LLW	6
+#define SC_LLD	7
+#define SC_LDA	8
+#define SC_LDA2	9
+#define SC_SLW	10
+#define SC_SLD	11
+#define SC_STA	12
+#define SC_STA2	13
+#define SC_LSW	14
+#define SC_LSD	15
+#define SC_SSW	16
+#define SC_LXB	17
+#define SC_LXW	18
+#define SC_SXB	19
+#define SC_SXW	20
+#define SC_CHK	21
+#define SC_CHKZ	22
+#define SC_CHKS	23
+#define SC_ENTR	24
+#define SC_IADD	25
+#define SC_ISUB	26
+#define SC_IMUL	27
+#define SC_UADD	28
+#define SC_USUB	29
+#define SC_OR	30
+#define SC_XOR	31
+#define SC_AND	32
+#define SC_EQL	33
+#define SC_NEQ	34
+#define SC_LSS	35
+#define SC_LEQ	36
+#define SC_GTR	37
+#define SC_GEQ	38
+#define SC_ULSS	39
+#define SC_ULEQ	40
+#define SC_UGTR	41
+#define SC_UGEQ	42
+#define SC_COM	43
+#define SC_NOT	44
+#define SC_NEG	45
+#define SC_COPT	46
+#define SC_JPC	47
+#define SC_JP	48
+#define SC_NUM	49
+
+// Class of each opcode (0 = not fusable)
+#define SU_CLASS_TAB \
+	[0000 ... 0020] = SC_LIT, [0022] = SC_LIT, [0025] = SC_LIT, [0027] = SC_LIT, [0325] = SC_LIT, \
+	[0023] = SC_LIT2, \
+	[0024] = SC_LLA, \
+	[0026] = SC_LSA, \
+	[0204] = SC_LSTA, \
+	[0040] = SC_LLW, [0044 ... 0057] = SC_LLW, \
+	[0041] = SC_LLD, \
+	[0042] = SC_LDA, [0100] = SC_LDA, [0102 ... 0117] = SC_LDA, \
+	[0043] = SC_LDA2, \
+	[0060] = SC_SLW, [0064 ... 0077] = SC_SLW, \
+	[0061] = SC_SLD, \
+	[0062] = SC_STA, [0120] = SC_STA, [0122 ... 0137] = SC_STA, \
+	[0121] = SC_STA2, \
+	[0140 ... 0157] = SC_LSW, [0200] = SC_LSW, \
+	[0201 ... 0202] = SC_LSD, \
+	[0160 ... 0177] = SC_SSW, [0220] = SC_SSW, \
+	[0205] = SC_LXB, \
+	[0206] = SC_LXW, \
+	[0225] = SC_SXB, \
+	[0226] = SC_SXW, \
+	[0305] = SC_CHK, \
+	[0306] = SC_CHKZ, \
+	[0307] = SC_CHKS, \
+	[0353] = SC_ENTR, \
+	[0330] = SC_IADD, \
+	[0331] = SC_ISUB, \
+	[0332] = SC_IMUL, \
+	[0270] = SC_UADD, \
+	[0271] = SC_USUB, \
+	[0320] = SC_OR, \
+	[0321] = SC_XOR, \
+	[0322] = SC_AND, \
+	[0310] = SC_EQL, \
+	[0311] = SC_NEQ, \
+	[0312] = SC_LSS, \
+	[0313] = SC_LEQ, \
+	[0314] = SC_GTR, \
+	[0315] = SC_GEQ, \
+	[0252] = SC_ULSS, \
+	[0253] = SC_ULEQ, \
+	[0254] = SC_UGTR, \
+	[0255] = SC_UGEQ, \
+	[0323] = SC_COM, \
+	[0327] = SC_NOT, \
+	[0317] = SC_NEG, \
+	[0265] = SC_COPT, \
+	[0030] = SC_JPC, [0032] = SC_JPC, [0034] = SC_JPC, \
+	[0031] = SC_JP, [0033] = SC_JP, [0035] = SC_JP
+
+// Classes taking operands from a pre-decoded handler
+#define SU_SPECIALIZED_TAB \
+	[SC_LIT] = true, [SC_LIT2] = true, [SC_LLA] = true, [SC_LSA] = true, \
+	[SC_LSTA] = true, [SC_LLW] = true, [SC_LLD] = true, [SC_LDA] = true, \
+	[SC_LDA2] = true, [SC_SLW] = true, [SC_SLD] = true, [SC_STA] = true, \
+	[SC_STA2] = true, [SC_LSW] = true, [SC_LSD] = true, [SC_SSW] = true, \
+	[SC_ENTR] = true, [SC_JPC] = true, [SC_JP] = true
+
+// Patterns, longest first (saved dispatches in profile)
+#define SU_PATTERN_TAB \
+	{ 4, { SC_LDA, SC_LLW, SC_LIT, SC_CHKZ } },	/* 0: 7942119 */ \
+	{ 4, { SC_LLW, SC_LIT, SC_EQL, SC_JPC } },	/* 1: 2659281 */ \
+	{ 4, { SC_ENTR, SC_SLW, SC_SLW, SC_LLW } },	/* 2: 1408452 */ \
+	{ 4, { SC_SSW, SC_LLW, SC_LLW, SC_LSW } },	/* 3: 873990 */ \
+	{ 4, { SC_LDA, SC_LIT, SC_ULEQ, SC_JPC } },	/* 4: 480039 */ \
+	{ 4, { SC_SXB, SC_LIT, SC_COPT, SC_LSW } },	/* 5: 350730 */ \
+	{ 4, { SC_LDA, SC_LIT, SC_UGTR, SC_JPC } },	/* 6: 341358 */ \
+	{ 4, { SC_UADD, SC_SLW, SC_LLW, SC_LLW } },	/* 7: 286905 */ \
+	{ 4, { SC_LDA, SC_LIT, SC_AND, SC_LIT } },	/* 8: 271542 */ \
+	{ 3, { SC_ENTR, SC_SLW, SC_SLW } },	/* 9: 1829174 */ \
+	{ 3, { SC_LDA, SC_LIT, SC_CHKZ } },	/* 10: 389736 */ \
+	{ 3, { SC_LDA, SC_LIT, SC_ULSS } },	/* 11: 348200 */ \
+	{ 2, { SC_LLW, SC_LIT } },	/* 12: 4721655 */ \
+	{ 2, { SC_LDA, SC_LLW } },	/* 13: 2734679 */ \
+	{ 2, { SC_LLW, SC_LLW } },	/* 14: 1635163 */ \
+	{ 2, { SC_LDA, SC_LIT } },	/* 15: 1600342 */ \
+	{ 2, { SC_LSW, SC_LIT } },	/* 16: 1589515 */ \
+	{ 2, { SC_EQL, SC_JPC } },	/* 17: 1413028 */ \
+	{ 2, { SC_ENTR, SC_SLW } },	/* 18: 1105393 */
+
+// Handler labels in le_run_super()
+#define SU_LABELS \
+	&&su_0, &&su_1, &&su_2, &&su_3, &&su_4, &&su_5, &&su_6, &&su_7, \
+	&&su_8, &&su_9, &&su_10, &&su_11, &&su_12, &&su_13, &&su_14, &&su_15, \
+	&&su_16, &&su_17, &&su_18
+
+#endif
@@ -0,0 +1,287 @@
+//=====================================================
+// le_super_ops.h
+// Superinstruction handlers
+//
+// Generated by tools/mksuper.py from compile.prof comint.prof
+// (57162502 M-codes profiled). Do not edit.
+//
+// Lilith M-Code Emulator
+//
+// Guido Hoss, 12.03.2022
+//
+// Published by Guido Hoss under GNU Public License V3.
+//=====================================================
+
+// Included by le_run_super() with macro SU(n) defining
+// the handler label. Each handler executes a pattern of
+// le_super.h, keeping intermediate values in temporaries
+// instead of the expression stack.
+
+SU(0) {
+	// LDA LLW LIT CHKZ
+	pd_instr_t *i1 = ip + ip->len;
+	pd_instr_t *i2 = i1 + i1->len;
+	pd_instr_t *i3 = i2 + i2->len;
+	uint16_t t0 = dsh_mem[ip->a];
+	uint16_t t1 = local_p[i1->a];
+	uint16_t t2 = i2->a;
+	uint16_t t3 = t1;
+	if (((int16_t) t1 < 0) || ((int16_t) t1 > (int16_t) t2)) SU_TRAP(i3, TRAP_INDEX)
+	es_push(t0);
+	es_push(t3);
+	counter += 3;
+	ip = i3 + i3->len;
+	PD_DISPATCH
+}
+
+SU(1) {
+	// LLW LIT EQL JPC
+	pd_instr_t *i1 = ip + ip->len;
+	pd_instr_t *i2 = i1 + i1->len;
+	pd_instr_t *i3 = i2 + i2->len;
+	uint16_t t0 = local_p[ip->a];
+	uint16_t t1 = i1->a;
+	uint16_t t2 = (t0 == t1) ? 1 : 0;
+	counter += 3;
+	ip = (t2 == 0) ? i3->target : i3 + i3->len;
+	PD_DISPATCH
+}
+
+SU(2) {
+	// ENTR SLW SLW LLW
+	pd_instr_t *i1 = ip + ip->len;
+	pd_instr_t *i2 = i1 + i1->len;
+	pd_instr_t *i3 = i2 + i2->len;
+	if (gs_S < MACH_DSHMEM_SZ - ip->a) gs_S += ip->a; else SU_TRAP(ip, TRAP_STACK_OVF)
+	uint16_t t0 = es_pop();
+	local_p[i1->a] = t0;
+	uint16_t t1 = es_pop();
+	local_p[i2->a] = t1;
+	uint16_t t2 = local_p[i3->a];
+	es_push(t2);
+	counter += 3;
+	ip = i3 + i3->len;
+	PD_DISPATCH
+}
+
+SU(3) {
+	// SSW LLW LLW LSW
+	pd_instr_t *i1 = ip + ip->len;
+	pd_instr_t *i2 = i1 + i1->len;
+	pd_instr_t *i3 = i2 + i2->len;
+	uint16_t t0 = es_pop();
+	uint16_t t1 = es_pop();
+	dsh_mem[(uint16_t) (t1 + ip->a)] = t0;
+	uint16_t t2 = local_p[i1->a];
+	uint16_t t3 = local_p[i2->a];
+	uint16_t t4 = dsh_mem[(uint16_t) (t3 + i3->a)];
+	es_push(t2);
+	es_push(t4);
+	counter += 3;
+	ip = i3 + i3->len;
+	PD_DISPATCH
+}
+
+SU(4) {
+	// LDA LIT ULEQ JPC
+	pd_instr_t *i1 = ip + ip->len;
+	pd_instr_t *i2 = i1 + i1->len;
+	pd_instr_t *i3 = i2 + i2->len;
+	uint16_t t0 = dsh_mem[ip->a];
+	uint16_t t1 = i1->a;
+	uint16_t t2 = (t0 <= t1) ? 1 : 0;
+	counter += 3;
+	ip = (t2 == 0) ? i3->target : i3 + i3->len;
+	PD_DISPATCH
+}
+
+SU(5) {
+	// SXB LIT COPT LSW
+	pd_instr_t *i1 = ip + ip->len;
+	pd_instr_t *i2 = i1 + i1->len;
+	pd_instr_t *i3 = i2 + i2->len;
+	uint16_t t0 = es_pop();
+	uint16_t t1 = es_pop();
+	uint16_t t2 = es_pop();
+	{ uint16_t j = t2 + (t1 >> 1); dsh_mem[j] = (t1 & 1) ? ((dsh_mem[j] & 0xff00) | t0) : ((dsh_mem[j] & 0x00ff) | (t0 << 8)); }
+	uint16_t t3 = i1->a;
+	uint16_t t4 = t3;
+	uint16_t t5 = t3;
+	uint16_t t6 = dsh_mem[(uint16_t) (t5 + i3->a)];
+	es_push(t4);
+	es_push(t6);
+	counter += 3;
+	ip = i3 + i3->len;
+	PD_DISPATCH
+}
+
+SU(6) {
+	// LDA LIT UGTR JPC
+	pd_instr_t *i1 = ip + ip->len;
+	pd_instr_t *i2 = i1 + i1->len;
+	pd_instr_t *i3 = i2 + i2->len;
+	uint16_t t0 = dsh_mem[ip->a];
+	uint16_t t1 = i1->a;
+	uint16_t t2 = (t0 > t1) ? 1 : 0;
+	counter += 3;
+	ip = (t2 == 0) ? i3->target : i3 + i3->len;
+	PD_DISPATCH
+}
+
+SU(7) {
+	// UADD SLW LLW LLW
+	pd_instr_t *i1 = ip + ip->len;
+	pd_instr_t *i2 = i1 + i1->len;
+	pd_instr_t *i3 = i2 + i2->len;
+	uint16_t t0 = es_pop();
+	uint16_t t1 = es_pop();
+	uint16_t t2 = t1 + t0;
+	local_p[i1->a] = t2;
+	uint16_t t3 = local_p[i2->a];
+	uint16_t t4 = local_p[i3->a];
+	es_push(t3);
+	es_push(t4);
+	counter += 3;
+	ip = i3 + i3->len;
+	PD_DISPATCH
+}
+
+SU(8) {
+	// LDA LIT AND LIT
+	pd_instr_t *i1 = ip + ip->len;
+	pd_instr_t *i2 = i1 + i1->len;
+	pd_instr_t *i3 = i2 + i2->len;
+	uint16_t t0 = dsh_mem[ip->a];
+	uint16_t t1 = i1->a;
+	uint16_t t2 = t0 & t1;
+	uint16_t t3 = i3->a;
+	es_push(t2);
+	es_push(t3);
+	counter += 3;
+	ip = i3 + i3->len;
+	PD_DISPATCH
+}
+
+SU(9) {
+	// ENTR SLW SLW
+	pd_instr_t *i1 = ip + ip->len;
+	pd_instr_t *i2 = i1 + i1->len;
+	if (gs_S < MACH_DSHMEM_SZ - ip->a) gs_S += ip->a; else SU_TRAP(ip, TRAP_STACK_OVF)
+	uint16_t t0 = es_pop();
+	local_p[i1->a] = t0;
+	uint16_t t1 = es_pop();
+	local_p[i2->a] = t1;
+	counter += 2;
+	ip = i2 + i2->len;
+	PD_DISPATCH
+}
+
+SU(10) {
+	// LDA LIT CHKZ
+	pd_instr_t *i1 = ip + ip->len;
+	pd_instr_t *i2 = i1 + i1->len;
+	uint16_t t0 = dsh_mem[ip->a];
+	uint16_t t1 = i1->a;
+	uint16_t t2 = t0;
+	if (((int16_t) t0 < 0) || ((int16_t) t0 > (int16_t) t1)) SU_TRAP(i2, TRAP_INDEX)
+	es_push(t2);
+	counter += 2;
+	ip = i2 + i2->len;
+	PD_DISPATCH
+}
+
+SU(11) {
+	// LDA LIT ULSS
+	pd_instr_t *i1 = ip + ip->len;
+	pd_instr_t *i2 = i1 + i1->len;
+	uint16_t t0 = dsh_mem[ip->a];
+	uint16_t t1 = i1->a;
+	uint16_t t2 = (t0 < t1) ? 1 : 0;
+	es_push(t2);
+	counter += 2;
+	ip = i2 + i2->len;
+	PD_DISPATCH
+}
+
+SU(12) {
+	// LLW LIT
+	pd_instr_t *i1 = ip + ip->len;
+	uint16_t t0 = local_p[ip->a];
+	uint16_t t1 = i1->a;
+	es_push(t0);
+	es_push(t1);
+	counter += 1;
+	ip = i1 + i1->len;
+	PD_DISPATCH
+}
+
+SU(13) {
+	// LDA LLW
+	pd_instr_t *i1 = ip + ip->len;
+	uint16_t t0 = dsh_mem[ip->a];
+	uint16_t t1 = local_p[i1->a];
+	es_push(t0);
+	es_push(t1);
+	counter += 1;
+	ip = i1 + i1->len;
+	PD_DISPATCH
+}
+
+SU(14) {
+	// LLW LLW
+	pd_instr_t *i1 = ip + ip->len;
+	uint16_t t0 = local_p[ip->a];
+	uint16_t t1 = local_p[i1->a];
+	es_push(t0);
+	es_push(t1);
+	counter += 1;
+	ip = i1 + i1->len;
+	PD_DISPATCH
+}
+
+SU(15) {
+	// LDA LIT
+	pd_instr_t *i1 = ip + ip->len;
+	uint16_t t0 = dsh_mem[ip->a];
+	uint16_t t1 = i1->a;
+	es_push(t0);
+	es_push(t1);
+	counter += 1;
+	ip = i1 + i1->len;
+	PD_DISPATCH
+}
+
+SU(16) {
+	// LSW LIT
+	pd_instr_t *i1 = ip + ip->len;
+	uint16_t t0 = es_pop();
+	uint16_t t1 = dsh_mem[(uint16_t) (t0 + ip->a)];
+	uint16_t t2 = i1->a;
+	es_push(t1);
+	es_push(t2);
+	counter += 1;
+	ip = i1 + i1->len;
+	PD_DISPATCH
+}
+
+SU(17) {
+	// EQL JPC
+	pd_instr_t *i1 = ip + ip->len;
+	uint16_t t0 = es_pop();
+	uint16_t t1 = es_pop();
+	uint16_t t2 = (t1 == t0) ? 1 : 0;
+	counter += 1;
+	ip = (t2 == 0) ? i1->target : i1 + i1->len;
+	PD_DISPATCH
+}
+
+SU(18) {
+	// ENTR SLW
+	pd_instr_t *i1 = ip + ip->len;
+	if (gs_S < MACH_DSHMEM_SZ - ip->a) gs_S += ip->a; else SU_TRAP(ip, TRAP_STACK_OVF)
+	uint16_t t0 = es_pop();
+	local_p[i1->a] = t0;
+	counter += 1;
+	ip = i1 + i1->len;
+	PD_DISPATCH
+}
@@ -18,6 +18,8 @@
 #include "le_filesys.h"
 #include "le_loader.h"
 #include "le_syscall.h"
+#include "le_block.h"
+#include "le_lockstep.h"
 
 
 // le_sys_call()
@@ -61,9 +63,14 @@ void svc_heap_func(uint8_t mod)
 	switch (mode)
 	{
 		case 0 :
-			// Allocation
-			dsh_mem[vadr] = hp_alloc(mod, sz);
+		{
+			// Allocation, counted for the caller of Storage.ALLOCATE
+			// found in the stack mark of the call
+			uint16_t m = dsh_mem[gs_L];
+			uint8_t caller = (m < module_num) ? m : mod;
+			dsh_mem[vadr] = hp_alloc(mod, sz, caller, dsh_mem[gs_L + 2]);
 			break;
+		}
 		
 		case 1 :
 			// Deallocation
@@ -83,14 +90,15 @@ void svc_heap_func(uint8_t mod)
 
 
 // svc_time_func()
-// Get system time and store it into a structure
-// comprised of 3 cardinals "day", "min" and "msec"
+// Get system time, or the fixed time of the machine if set, and
+// store it into a structure comprised of 3 cardinals "day", "min"
+// and "msec"
 //
 void svc_time_func()
 {
 	uint16_t vadr = es_pop();	// Address of target variable
 
-	time_t now = time(NULL);
+	time_t now = LS_IO((mach_ctx.fixed_time != 0) ? mach_ctx.fixed_time : time(NULL));
 	struct tm *t_now = localtime(&now);
 
 	dsh_mem[vadr] = bswap_16((t_now->tm_mday + 1)
@@ -105,7 +113,8 @@ void svc_time_func()
 
 
 // svc_file_func()
-// Filesystem functions
+// Filesystem functions. The results of the host calls go through
+// LS_IO(), so that lockstep runs do the calls only once.
 //
 void svc_file_func(uint8_t modn)
 {
@@ -134,13 +143,13 @@ void svc_file_func(uint8_t modn)
 			es_pop(); es_pop();		// Consume medium name
 
 			*fn = '\0';
-			res = fs_open(modn, fn, fn, true, m2_fd);
+			res = LS_IO(fs_open(modn, fn, fn, true, m2_fd));
 			break;
 		}
 
 		case 1 :
 			// Close(VAR f: File)
-			res = fs_close(m2_fd);
+			res = LS_IO(fs_close(m2_fd));
 			break;
 
 		case 2 : {
@@ -148,7 +157,7 @@ void svc_file_func(uint8_t modn)
 			char *fn;
 			char *p = get_filename(&fn);
 			bool create = dsh_mem[es_pop()];
-			res = fs_open(modn, fn, p, create, m2_fd);
+			res = LS_IO(fs_open(modn, fn, p, create, m2_fd));
 			break;
 		}
 
@@ -156,23 +165,23 @@ void svc_file_func(uint8_t modn)
 			// Rename(VAR f: File; filename: ARRAY OF CHAR)
 			char *fn;
 			char *p = get_filename(&fn);
-			res = fs_rename(m2_fd, fn, p);
+			res = LS_IO(fs_rename(m2_fd, fn, p));
 			break;
 		}
 
 		case 4 :
 			// SetRead(VAR f: File)
-			fs_reopen(m2_fd, FS_READ);
+			(void) LS_IO(fs_reopen(m2_fd, FS_READ));
 			break;
 
 		case 5 :
 			// SetWrite(VAR f: File)
-			fs_reopen(m2_fd, FS_WRITE);
+			(void) LS_IO(fs_reopen(m2_fd, FS_WRITE));
 			break; 
 
 		case 6 :
 			// SetModify(VAR f: File)
-			fs_reopen(m2_fd, FS_MODIFY);
+			(void) LS_IO(fs_reopen(m2_fd, FS_MODIFY));
 			break;
 
 		case 7 :
@@ -185,14 +194,15 @@ void svc_file_func(uint8_t modn)
 			// SetPos(VAR f: File; highpos, lowpos: CARDINAL)
 			uint32_t pos = dsh_mem[es_pop()];
 			pos |= dsh_mem[es_pop()] << 16;
-			res = fs_setpos(m2_fd, pos);
+			res = LS_IO(fs_setpos(m2_fd, pos));
 			break;
 		}
 
 		case 9 : {
 			// GetPos(VAR f: File; VAR highpos, lowpos: CARDINAL)
 			uint32_t pos = 0;			
-			res = fs_getpos(m2_fd, &pos);
+			res = LS_IO(fs_getpos(m2_fd, &pos));
+			pos = LS_IO(pos);
 			dsh_mem[es_pop()] = pos & 0xffff;
 			dsh_mem[es_pop()] = pos >> 16;
 			break;
@@ -201,7 +211,8 @@ void svc_file_func(uint8_t modn)
 		case 10 : {
 			// Length(VAR f: File; VAR highpos, lowpos: CARDINAL)
 			uint32_t pos = 0;
-			res = fs_length(m2_fd, &pos);
+			res = LS_IO(fs_length(m2_fd, &pos));
+			pos = LS_IO(pos);
 			dsh_mem[es_pop()] = pos & 0xffff;
 			dsh_mem[es_pop()] = pos >> 16;
 			break;
@@ -219,29 +230,33 @@ void svc_file_func(uint8_t modn)
 
 		case 13 : {
 			// ReadWord(VAR f: File; VAR w: WORD)
-			uint16_t w;
-			res = fs_read(m2_fd, &w, false);
+			uint16_t w = 0;
+			res = LS_IO(fs_read(m2_fd, &w, false));
+			w = LS_IO(w);
 			dsh_mem[es_pop()] = res ? bswap_16(w) : 0;
 			break;
 		}
 
 		case 14 : {
 			// WriteWord(VAR f: File; w: WORD)
-			res = fs_write(m2_fd, bswap_16(dsh_mem[es_pop()]), false);
+			uint16_t w = dsh_mem[es_pop()];
+			res = LS_IO(fs_write(m2_fd, bswap_16(w), false));
 			break;
 		}
 
 		case 15 : {
 			// ReadChar(VAR f: File; VAR ch: CHAR)
-			uint16_t ch;
-			res = fs_read(m2_fd, &ch, true);
+			uint16_t ch = 0;
+			res = LS_IO(fs_read(m2_fd, &ch, true));
+			ch = LS_IO(ch);
 			dsh_mem[es_pop()] = res ? (ch & 0xff) : 0;
 			break;
 		}
 
 		case 16 : {
 			// WriteChar(VAR f: File; ch: CHAR)
-			res = fs_write(m2_fd, dsh_mem[es_pop()], true);
+			uint16_t ch = dsh_mem[es_pop()];
+			res = LS_IO(fs_write(m2_fd, ch, true));
 			break;
 		}
 
@@ -255,6 +270,56 @@ void svc_file_func(uint8_t modn)
 }
 
 
+// svc_string_func()
+// String functions on character arrays; strings are addressed by
+// their word address and a character position
+//
+void svc_string_func()
+{
+	uint16_t cmd = es_pop();
+	uint16_t res = 0;
+
+	switch (cmd)
+	{
+		case 0 : {
+			// Length(s: ARRAY OF CHAR): CARDINAL
+			uint16_t high = es_pop();
+			uint16_t adr = es_pop();
+			res = bk_strlen(adr, high + 1);
+			break;
+		}
+
+		case 1 : {
+			// Compare(a: ADDRESS; ai: CARDINAL; b: ADDRESS; bi, n: CARDINAL): INTEGER
+			uint16_t n = es_pop();
+			uint16_t bi = es_pop();
+			uint16_t b = es_pop();
+			uint16_t ai = es_pop();
+			uint16_t a = es_pop();
+			res = bk_strcmp(a, ai, b, bi, n);
+			break;
+		}
+
+		case 2 : {
+			// Copy(src: ADDRESS; si: CARDINAL; dst: ADDRESS; di, n: CARDINAL): CARDINAL
+			uint16_t n = es_pop();
+			uint16_t di = es_pop();
+			uint16_t dst = es_pop();
+			uint16_t si = es_pop();
+			uint16_t src = es_pop();
+			bk_strcpy(dst, di, src, si, n);
+			res = n;
+			break;
+		}
+
+		default :
+			le_error(1, 0, "String command %d not implemented", cmd);
+			break;
+	}
+	es_push(res);
+}
+
+
 // le_supervisor_call()
 // Implements the (informal) SVC opcode
 // (NOT part of the original M-Code specification)
@@ -281,6 +346,11 @@ void le_supervisor_call(uint8_t modn, uint8_t n)
 			svc_file_func(modn);
 			break;
 
+		case 4 :
+			// String functions
+			svc_string_func();
+			break;
+
 		default :
 			le_error(1, 0, "Supervisor call %d not implemented", n);
 			break;
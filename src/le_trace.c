@@ -32,8 +32,6 @@ uint16_t bp_PC;				// Breakpoint PC
 
 // M-Code mnemonics table
 //
-#define LE_MNEM_LEN  5
-
 const char *mnem_tab = 
 	"LI0  LI1  LI2  LI3  LI4  LI5  LI6  LI7  LI8  LI9  LI10 LI11 LI12 LI13 LI14 LI15 "
 	"LIB +---- LIW *LID /LLA +LGA +LSA +LEA *JPC *JP  *JPFC+JPF +JPBC+JPB +ORJP+AJP +"
@@ -43,7 +41,7 @@ const char *mnem_tab =
 	"SGW +SGD +SGW2 SGW3 SGW4 SGW5 SGW6 SGW7 SGW8 SGW9 SGW10SGW11SGW12SGW13SGW14SGW15"
 	"LSW0 LSW1 LSW2 LSW3 LSW4 LSW5 LSW6 LSW7 LSW8 LSW9 LSW10LSW11LSW12LSW13LSW14LSW15"
 	"SSW0 SSW1 SSW2 SSW3 SSW4 SSW5 SSW6 SSW7 SSW8 SSW9 SSW10SSW11SSW12SSW13SSW14SSW15"
-	"LSW +LSD +LSD0 LXFW LSTA+LXB  LXW  LXD  DADD DSUB DMUL DDIV ---- ---- DSHL DSHR "
+	"LSW +LSD +LSD0 LXFW LSTA+LXB  LXW  LXD  DADD DSUB DMUL DDIV AOT  ---- DSHL DSHR "
 	"SSW +SSD +SSD0 SXFW TS   SXB  SXW  SXD  FADD FSUB FMUL FDIV FCMP FABS FNEG FFCT+"
 	"READ WRT  DSKR DSKW TRK  UCHK SVC +SYS +ENTP+EXP  ULSS ULEQ UGTR UGEQ TRA +RDS +"
 	"LODFWLODFDSTOR STOFVSTOT COPT DECS PCOP+UADD USUB UMUL UDIV UMOD ROR  SHL  SHR  "
@@ -126,6 +124,23 @@ uint8_t le_opcode_len(uint8_t mcode)
 }
 
 
+// le_mnemonic()
+// Copies the mnemonic of an opcode without its operand type
+// character to s, which must hold LE_MNEM_LEN + 1 characters
+//
+char *le_mnemonic(uint8_t mcode, char *s)
+{
+	const char *m = mnem_tab + mcode * LE_MNEM_LEN;
+	uint8_t n = (le_opcode_len(mcode) > 1) ? LE_MNEM_LEN - 1 : LE_MNEM_LEN;
+
+	while ((n > 0) && (m[n - 1] == ' '))
+		n --;
+	memcpy(s, m, n);
+	s[n] = '\0';
+	return s;
+}
+
+
 // le_decode()
 // Print an opcode and its arguments at PC counter "pc"
 //
@@ -404,6 +419,12 @@ void le_monitor(mod_entry_t *mod)
 				le_monitor_usage();
 				break;
 
+			case 'x' :
+				// Leave the monitor and continue without tracing
+				le_trace = breakpoint = false;
+				quit = true;
+				break;
+
 			case 't' :
 				// Do nothing (step one instruction)
 				breakpoint = false;
@@ -439,4 +460,20 @@ void le_trap(mod_entry_t *modp, uint16_t n)
 		"TRAP #%d: %s\r\n%d:%07o (%s)", 
 		n, trap_descr[n], modp->id.idx, gs_PC - 1, modp->id.name
 	);
-}
\ No newline at end of file
+}
+
+// le_abort()
+// Stops execution for a reason other than a trap, e.g. an exceeded
+// budget
+//
+void le_abort(mod_entry_t *modp, char *reason)
+{
+	le_show_callchain(modp);
+	if (le_verbose)
+		le_show_registers(modp);
+
+	le_error(1, 0,
+		"%s at %d:%07o (%s)",
+		reason, modp->id.idx, gs_PC, modp->id.name
+	);
+}
@@ -24,10 +24,18 @@
 #define TRAP_INV_OPC	13		// Invalid opcode
 #define TRAP_SYSTEM		14		// System-triggered trap
 
+extern bool breakpoint;
+
+// Length of mnemonics in mnemonics table
+#define LE_MNEM_LEN  5
+
 // Function declarations
 //
 void le_decode(mod_entry_t *mod, uint16_t pc);
+uint8_t le_opcode_len(uint8_t mcode);
+char *le_mnemonic(uint8_t mcode, char *s);
 void le_monitor(mod_entry_t *mod);
 void le_trap(mod_entry_t *modp, uint16_t n);
+void le_abort(mod_entry_t *modp, char *reason);
 
 #endif
\ No newline at end of file
@@ -32,12 +32,24 @@ void le_prog_version()
 void le_prog_usage()
 {
     printf(
-        "USAGE: " PKG " [-htvV] {-i path} [object_file]\n\n"
+        "USAGE: " PKG " [-hNtvV] [-e engine] [-j calls] [-l mcodes] [-T seconds]\n"
+		"       [-D mcodes] [-P file] [-H file] {-i path} [object_file]\n\n"
 		"-i\tSearch specified path(s) for objects and libraries\n"
+		"-e\tSelect execution engine (switch, threaded, tos, super, regir, jit)\n"
+		"-j\tCompile procedures after this number of calls (jit engine)\n"
+		"-l\tStop after this number of M-codes (instruction budget)\n"
+		"-T\tStop after this number of seconds (time budget)\n"
+		"-D\tRun in lockstep with the switch engine, comparing the machines\n"
+		"\tat the first safepoint after this number of M-codes\n"
+		"-N\tDon't use native module libraries translated by mule2c\n"
+		"-P\tWrite M-code sequence profile to file (uses switch engine)\n"
+		"-H\tShow heap report at exit and write it to file\n"
  		"-t\tEnable trace mode (runtime debugging)\n"
 		"-h\tShow this help information\n"
-        "-V\tShow version information\n\n"
+        "-V\tShow version information\n"
         "-v\tVerbose mode\n\n"
+		"SIGINT (Ctrl-C) enters the monitor of a running program,\n"
+		"SIGUSR1 shows its heap report.\n\n"
         "object_file is the filename of a Lilith M-Code (OBJ) file.\n\n"
 		"Additional include paths may be specified in the\n"
 		"environment variable MULE_PATH (delimited by colons).\n\n"
@@ -52,12 +64,13 @@ void le_monitor_usage()
 {
     wprintw(app_win,
         "\nt\tExecute one instruction\n"
-		"s\tExecute one instruction, but skip through proc calls"
+		"s\tExecute one instruction, but skip through proc calls\n"
 		"g\tExecute until next breakpoint or end of program\n"
 		"r\tSwitch register/stack display on/off\n"
 		"d num\tShow contents of data word 'num'\n"
 		"c\tShow current procedure call chain\n"
 		"b m:pc\tSet breakpoint to program counter pc in module number m\n"
+		"x\tLeave monitor and continue at full speed\n"
 		"q\tExit interpreter\n"
         "h, ?\tShow this help summary\n\n"
     );
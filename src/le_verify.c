@@ -0,0 +1,708 @@
+//=====================================================
+// le_verify.c
+// Load-time verification of code frames
+//
+// The verifier follows the control flow of each procedure from its
+// entry point and rejects the module unless
+//
+//   - every reachable instruction lies inside the code frame and
+//     has a valid opcode,
+//   - the targets of jumps, FOR1/FOR2 and ENTC case tables start
+//     reachable instructions, and no instructions overlap,
+//   - static calls (CLX, CLI, CLL) go to procedures which exist,
+//   - the expression stack neither overflows nor underflows.
+//
+// The engines therefore fetch instructions without checking the PC.
+// Only PCs loaded from memory (RTN, EXC) are checked against the
+// resume points collected by the verifier. The case table of each
+// ENTC is resolved into absolute targets, so a CASE statement needs
+// a single bounds check and jump at run time. The flags of the code
+// frame bytes are kept for the translators, which need to know the
+// reachable instructions and the labels where blocks begin.
+//
+// The depth of the expression stack is bounded under the calling
+// convention of the Lilith compiler: the prologue of a procedure
+// stores its parameters, a call takes all words on the expression
+// stack as parameters and leaves the result of the callee, and
+// STORE ... LODFW/LODFD spill the stack around a call within an
+// expression. As the verifier does not know what a callee returns,
+// RTN checks the result size at run time. The expression stack
+// memory covers every position of the 8-bit stack pointer, so code
+// which breaks the convention otherwise cannot access memory
+// outside of it.
+//
+// Lilith M-Code Emulator
+//
+// Guido Hoss, 12.03.2022
+//
+// Published by Guido Hoss under GNU Public License V3.
+//=====================================================
+
+#include <config.h>
+#include "le_mach.h"
+#include "le_io.h"
+#include "le_stack.h"
+#include "le_trace.h"
+#include "le_verify.h"
+
+
+// Expression stack effect (words popped, words pushed) of opcodes
+// with a fixed effect. Control flow instructions, calls, SVC, FFCT
+// and the spill instructions are handled by vf_step().
+//
+typedef struct {
+	uint8_t pop;
+	uint8_t push;
+} vf_effect_t;
+
+const vf_effect_t vf_effect[256] = {
+	[000 ... 017] = {0, 1},		// LI0 - LI15
+	[020] = {0, 1},				// LIB
+	[022] = {0, 1},				// LIW
+	[023] = {0, 2},				// LID
+	[024 ... 025] = {0, 1},		// LLA, LGA
+	[026] = {1, 1},				// LSA
+	[027] = {0, 1},				// LEA
+	[030] = {1, 0},				// JPC
+	[032] = {1, 0},				// JPFC
+	[034] = {1, 0},				// JPBC
+	[036 ... 037] = {1, 0},		// ORJP, ANDJP (not taken)
+	[040] = {0, 1},				// LLW
+	[041] = {0, 2},				// LLD
+	[042] = {0, 1},				// LEW
+	[043] = {0, 2},				// LED
+	[044 ... 057] = {0, 1},		// LLW4 - LLW15
+	[060] = {1, 0},				// SLW
+	[061] = {2, 0},				// SLD
+	[062] = {1, 0},				// SEW
+	[063] = {2, 0},				// SED
+	[064 ... 077] = {1, 0},		// SLW4 - SLW15
+	[0100] = {0, 1},			// LGW
+	[0101] = {0, 2},			// LGD
+	[0102 ... 0117] = {0, 1},	// LGW2 - LGW15
+	[0120] = {1, 0},			// SGW
+	[0121] = {2, 0},			// SGD
+	[0122 ... 0137] = {1, 0},	// SGW2 - SGW15
+	[0140 ... 0157] = {1, 1},	// LSW0 - LSW15
+	[0160 ... 0177] = {2, 0},	// SSW0 - SSW15
+	[0200] = {1, 1},			// LSW
+	[0201 ... 0202] = {1, 2},	// LSD, LSD0
+	[0203] = {2, 1},			// LXFW
+	[0204] = {0, 1},			// LSTA
+	[0205 ... 0206] = {2, 1},	// LXB, LXW
+	[0207] = {2, 2},			// LXD
+	[0210 ... 0213] = {4, 2},	// DADD - DDIV
+	[0216 ... 0217] = {2, 2},	// DSHL, DSHR
+	[0220] = {2, 0},			// SSW
+	[0221 ... 0223] = {3, 0},	// SSD, SSD0, SXFW
+	[0224] = {1, 1},			// TS
+	[0225 ... 0226] = {3, 0},	// SXB, SXW
+	[0227] = {4, 0},			// SXD
+	[0230 ... 0234] = {4, 2},	// FADD - FDIV, FCMP
+	[0235 ... 0236] = {2, 2},	// FABS, FNEG
+	[0240 ... 0241] = {2, 0},	// READ, WRITE
+	[0245] = {3, 1},			// UCHK
+	[0252 ... 0255] = {2, 1},	// ULSS - UGEQ
+	[0256] = {2, 0},			// TRA
+	[0264] = {1, 0},			// STOT
+	[0265] = {1, 2},			// COPT
+	[0267] = {2, 0},			// PCOP
+	[0270 ... 0277] = {2, 1},	// UADD - SHR
+	[0300] = {3, 0},			// FOR1
+	[0302] = {1, 0},			// ENTC
+	[0304] = {1, 0},			// TRAP
+	[0305] = {3, 1},			// CHK
+	[0306] = {2, 1},			// CHKZ
+	[0307] = {1, 1},			// CHKS
+	[0310 ... 0315] = {2, 1},	// EQL - GEQ
+	[0316 ... 0317] = {1, 1},	// ABS, NEG
+	[0320 ... 0322] = {2, 1},	// OR, XOR, AND
+	[0323] = {1, 1},			// COM
+	[0324] = {2, 1},			// IN
+	[0325] = {0, 1},			// LIN
+	[0326 ... 0327] = {1, 1},	// MSK, NOT
+	[0330 ... 0334] = {2, 1},	// IADD - MOD
+	[0335] = {1, 1},			// BIT
+	[0337] = {5, 0},			// MOVF
+	[0340] = {3, 0},			// MOV
+	[0341] = {3, 2},			// CMP
+	[0342 ... 0343] = {4, 0},	// DDT, REPL
+	[0344] = {5, 0},			// BBLT
+	[0345] = {1, 0},			// DCH (character only)
+	[0346] = {3, 1},			// UNPK
+	[0347] = {4, 0},			// PACK
+	[0350 ... 0351] = {0, 1},	// GB, GB1
+	[0352] = {1, 1},			// ALLOC
+	[0356] = {1, 0}				// CLI (static link)
+};
+
+// Expression stack at an instruction
+typedef struct {
+	int8_t d;					// Upper bound of depth, -1 if not reached
+	uint8_t n;					// Number of stacks spilled by STORE
+	int8_t s[VF_STORE_MAX];		// Depths spilled by STORE
+	bool queued;				// On worklist
+} vf_state_t;
+
+// State of the verification of a module
+typedef struct {
+	mod_entry_t *mod;
+	uint8_t *flags;				// VF_ flags of code frame bytes
+	vf_state_t *st;				// Expression stack per code frame byte
+	uint16_t *work;				// Worklist of instructions
+	uint32_t work_n;
+	uint32_t case_n;			// Words used in resolved case tables
+	uint8_t depth;				// Maximum expression stack depth
+} vf_ctx_t;
+
+
+// vf_reject()
+// Stops with an error in the instruction at pc
+//
+void vf_reject(vf_ctx_t *c, uint32_t pc, char *msg)
+{
+	le_error(1, 0, "Module %s: %s at %07o", c->mod->id.name, msg, pc);
+}
+
+
+// vf_word()
+// Returns the word at offset pc of the code frame
+//
+uint16_t vf_word(vf_ctx_t *c, uint32_t pc)
+{
+	return (c->mod->code[pc] << 8) | c->mod->code[pc + 1];
+}
+
+
+// vf_mark()
+// Marks the len bytes of the instruction at pc, which must not
+// overlap any other reachable instruction or case table
+//
+void vf_mark(vf_ctx_t *c, uint32_t pc, uint8_t len)
+{
+	uint8_t *f = c->flags;
+
+	if (f[pc] & VF_INSTR)
+		return;
+	for (uint8_t i = 0; i < len; i ++)
+	{
+		if (f[pc + i] & (VF_INSTR | VF_OPND))
+			vf_reject(c, pc, "Overlapping instructions");
+	}
+	f[pc] |= VF_INSTR;
+	memset(f + pc + 1, VF_OPND, len - 1);
+}
+
+
+// vf_merge()
+// Merges expression stack s into the state of the instruction at pc,
+// which is a jump target if from != pc, and queues the instruction
+// if its state changed
+//
+void vf_merge(vf_ctx_t *c, uint32_t from, uint32_t pc, vf_state_t *s)
+{
+	if ((pc == 0) || (pc >= c->mod->code_sz))
+		vf_reject(c, from, "Jump outside code frame");
+
+	vf_state_t *t = &(c->st[pc]);
+	bool changed = false;
+
+	if (t->d < 0)
+	{
+		*t = *s;
+		changed = true;
+	}
+	else
+	{
+		if (t->n != s->n)
+			vf_reject(c, pc, "Inconsistent expression stack");
+		if (s->d > t->d)
+		{
+			t->d = s->d;
+			changed = true;
+		}
+		for (uint8_t i = 0; i < s->n; i ++)
+		{
+			if (s->s[i] > t->s[i])
+			{
+				t->s[i] = s->s[i];
+				changed = true;
+			}
+		}
+	}
+
+	if (changed && ! t->queued)
+	{
+		t->queued = true;
+		c->work[c->work_n ++] = pc;
+	}
+}
+
+
+// vf_jump()
+// Merges expression stack s into the state of the jump target pc and
+// marks it as a label
+//
+void vf_jump(vf_ctx_t *c, uint32_t from, uint32_t pc, vf_state_t *s)
+{
+	vf_merge(c, from, pc, s);
+	c->flags[pc] |= VF_LABEL;
+}
+
+
+// vf_apply()
+// Applies the stack effect of pop and push words to s
+//
+void vf_apply(vf_ctx_t *c, uint32_t pc, vf_state_t *s, uint8_t pop, uint8_t push)
+{
+	if (s->d < pop)
+		vf_reject(c, pc, "Expression stack underflow");
+	s->d += push - pop;
+	if (s->d > MACH_EXSMEM_SZ)
+		vf_reject(c, pc, "Expression stack overflow");
+	if (s->d > c->depth)
+		c->depth = s->d;
+}
+
+
+// vf_callee()
+// Checks that procedure p of module m exists
+//
+void vf_callee(vf_ctx_t *c, uint32_t pc, uint8_t m, uint8_t p)
+{
+	if ((m == 0) || (m >= module_num) || (! module_tab[m].id.loaded))
+		vf_reject(c, pc, "Call of unknown module");
+	if ((p >= module_tab[m].proc_n) || (module_tab[m].proc[p] == 0))
+		vf_reject(c, pc, "Call of missing procedure");
+}
+
+
+// vf_call()
+// Continues after a call at pc, which the callee returns to
+//
+void vf_call(vf_ctx_t *c, uint32_t pc, vf_state_t *s)
+{
+	s->d = VF_RESULT_MAX;
+	if (s->d > c->depth)
+		c->depth = s->d;
+	c->mod->resume[pc >> 3] |= 1 << (pc & 7);
+	if (pc < c->mod->code_sz)
+		c->flags[pc] |= VF_LABEL;
+}
+
+
+// vf_resolve()
+// Appends the resolved table of the ENTC instruction at pc with the
+// case table at tab and the exit at ex to the case tables of the
+// module, unless it has one already
+//
+void vf_resolve(vf_ctx_t *c, uint32_t pc, uint32_t tab, uint32_t ex)
+{
+	mod_entry_t *mod = c->mod;
+
+	if (mod->case_ix == NULL)
+	{
+		// Word 0 is not used, so index 0 means no table
+		mod->case_ix = calloc(mod->code_sz, sizeof(uint16_t));
+		mod->case_tab = malloc(sizeof(uint16_t));
+		c->case_n = 1;
+		if ((mod->case_ix == NULL) || (mod->case_tab == NULL))
+			le_error(1, errno, "Cannot allocate case tables for %s", mod->id.name);
+	}
+	if (mod->case_ix[pc] != 0)
+		return;
+
+	// ELSE part and one target per label
+	uint32_t n = (ex - tab - 4) / 2;
+	uint32_t i = c->case_n;
+	if (i + 3 + n > UINT16_MAX)
+		vf_reject(c, pc, "Case tables too large");
+	mod->case_tab = realloc(mod->case_tab, (i + 3 + n) * sizeof(uint16_t));
+	if (mod->case_tab == NULL)
+		le_error(1, errno, "Cannot allocate case tables for %s", mod->id.name);
+
+	vf_case_t *t = (vf_case_t *) &(mod->case_tab[i]);
+	t->low = vf_word(c, tab);
+	t->n = n - 1;
+	t->exit = ex;
+	for (uint32_t k = 0; k < n; k ++)
+	{
+		uint32_t e = tab + 4 + 2 * k;
+		t->target[k] = e + vf_word(c, e);
+	}
+	mod->case_ix[pc] = i;
+	c->case_n = i + 3 + n;
+}
+
+
+// vf_entc()
+// Follows the case table of the ENTC instruction at pc: all cases
+// and the exit, where EXC continues, are targets
+//
+void vf_entc(vf_ctx_t *c, uint32_t pc, vf_state_t *s)
+{
+	uint32_t sz = c->mod->code_sz;
+	uint32_t tab = (uint16_t) (pc + 1 + vf_word(c, pc + 1));
+
+	if (tab + 4 > sz)
+		vf_reject(c, pc, "Case table outside code frame");
+	uint16_t low = vf_word(c, tab);
+	uint16_t hi = vf_word(c, tab + 2);
+	uint32_t ex = tab + 8 + 2 * (uint32_t) (hi - low);
+	if ((hi < low) || (ex > sz))
+		vf_reject(c, pc, "Invalid case table");
+
+	for (uint32_t i = tab; i < ex; i ++)
+	{
+		if (c->flags[i] & VF_INSTR)
+			vf_reject(c, pc, "Overlapping instructions");
+		c->flags[i] = VF_OPND;
+	}
+	for (uint32_t e = tab + 4; e < ex; e += 2)
+		vf_jump(c, pc, (uint16_t) (e + vf_word(c, e)), s);
+
+	vf_jump(c, pc, ex, s);
+	c->mod->resume[ex >> 3] |= 1 << (ex & 7);
+	vf_resolve(c, pc, tab, ex);
+}
+
+
+// vf_halts()
+// Returns true if the instruction with opcode op is not implemented
+// by the emulator and halts the machine
+//
+bool vf_halts(uint8_t op)
+{
+	switch (op)
+	{
+		case 063 :				// SED
+		case 0203 :				// LXFW
+		case 0220 :				// SSW
+		case 0223 :				// SXFW
+		case 0227 :				// SXD
+		case 0241 :				// WRITE
+		case 0245 :				// UCHK
+		case 0256 ... 0257 :	// TRA, RDS
+		case 0263 :				// STOFV
+		case 0335 :				// BIT
+		case 0342 ... 0344 :	// DDT, REPL, BBLT
+			return true;
+
+		default :
+			return false;
+	}
+}
+
+
+// vf_step()
+// Verifies the instruction at pc and merges the resulting expression
+// stack into its successors
+//
+void vf_step(vf_ctx_t *c, uint32_t pc)
+{
+	mod_entry_t *mod = c->mod;
+	uint8_t *code = mod->code;
+	uint8_t op = code[pc];
+
+	// RDS halts; its length depends on its operand
+	uint8_t len = (op == 0257) ? 1 : le_opcode_len(op);
+	if (pc + len > mod->code_sz)
+		vf_reject(c, pc, "Instruction exceeds code frame");
+	vf_mark(c, pc, len);
+
+	uint8_t b1 = (len > 1) ? code[pc + 1] : 0;
+	uint8_t b2 = (len > 2) ? code[pc + 2] : 0;
+	uint32_t next = pc + len;
+	vf_state_t s = c->st[pc];
+	s.queued = false;
+
+	// Unimplemented instructions halt the machine
+	if (vf_halts(op))
+		return;
+
+	vf_apply(c, pc, &s, vf_effect[op].pop, vf_effect[op].push);
+	switch (op)
+	{
+		case 021 :
+		case 0214 :
+		case 0215 :
+			vf_reject(c, pc, "Invalid opcode");
+			break;
+
+		case 027 :	// LEA
+		case 042 :	// LEW
+		case 043 :	// LED
+		case 062 :	// SEW
+		case 063 :	// SED
+			if ((b1 == 0) || (b1 >= module_num))
+				vf_reject(c, pc, "Access of unknown module");
+			break;
+
+		case 030 :	// JPC
+			vf_jump(c, pc, (uint16_t) (pc + 1 + vf_word(c, pc + 1)), &s);
+			break;
+
+		case 031 :	// JP
+			vf_jump(c, pc, (uint16_t) (pc + 1 + vf_word(c, pc + 1)), &s);
+			return;
+
+		case 032 :	// JPFC
+			vf_jump(c, pc, pc + 1 + b1, &s);
+			break;
+
+		case 033 :	// JPF
+			vf_jump(c, pc, pc + 1 + b1, &s);
+			return;
+
+		case 034 :	// JPBC
+			vf_jump(c, pc, (uint16_t) (pc + 1 - b1), &s);
+			break;
+
+		case 035 :	// JPB
+			vf_jump(c, pc, (uint16_t) (pc + 1 - b1), &s);
+			return;
+
+		case 036 :	// ORJP
+		case 037 :	// ANDJP
+		{
+			// The jump leaves the result of the condition
+			vf_state_t t = s;
+			vf_apply(c, pc, &t, 0, 1);
+			vf_jump(c, pc, pc + 1 + b1, &t);
+			break;
+		}
+
+		case 0237 :	// FFCT
+			switch (b1)
+			{
+				case 0 : vf_apply(c, pc, &s, 1, 2); break;
+				case 1 : vf_apply(c, pc, &s, 2, 2); break;
+				case 2 : vf_apply(c, pc, &s, 2, 1); break;
+				case 3 : vf_apply(c, pc, &s, 3, 2); break;
+				default : break;
+			}
+			break;
+
+		case 0246 :	// SVC
+			switch (b1)
+			{
+				case 0 : vf_apply(c, pc, &s, 3, 0); break;	// Heap
+				case 1 : vf_apply(c, pc, &s, 1, 1); break;	// Program call
+				case 2 : vf_apply(c, pc, &s, 1, 0); break;	// Time
+				case 3 : vf_apply(c, pc, &s, 2, 1); break;	// Files (pops more)
+				case 4 : vf_apply(c, pc, &s, 3, 1); break;	// Strings (pops more)
+				default : break;
+			}
+			break;
+
+		case 0303 :	// EXC
+		case 0304 :	// TRAP
+		case 0354 :	// RTN
+			return;
+
+		case 0260 :	// LODFW
+		case 0261 :	// LODFD
+		{
+			// Reload the spilled stack below the function result,
+			// which is all the stack holds (checked at run time)
+			uint8_t r = op - 0257;
+			if (s.n == 0)
+				vf_reject(c, pc, "Reload without STORE");
+			s.n --;
+			s.d = r;
+			vf_apply(c, pc, &s, r, s.s[s.n] + r);
+			break;
+		}
+
+		case 0263 :	// STOFV
+			vf_apply(c, pc, &s, 1, 0);
+			// Fall through
+
+		case 0262 :	// STORE
+			if (s.n == VF_STORE_MAX)
+				vf_reject(c, pc, "STORE nested too deeply");
+			s.s[s.n ++] = s.d;
+			s.d = 0;
+			break;
+
+		case 0300 :	// FOR1
+			vf_jump(c, pc, (uint16_t) (pc + 2 + (int16_t) vf_word(c, pc + 2)), &s);
+			break;
+
+		case 0301 :	// FOR2
+			vf_jump(c, pc, (uint16_t) (pc + 2 + (int16_t) vf_word(c, pc + 2)), &s);
+			break;
+
+		case 0302 :	// ENTC
+			vf_entc(c, pc, &s);
+			return;
+
+		case 0355 :	// CLX (calls to System.0 are ignored)
+			if ((b1 != 0) || (b2 != 0))
+			{
+				vf_callee(c, pc, b1, b2);
+				vf_call(c, next, &s);
+			}
+			break;
+
+		case 0356 :	// CLI
+		case 0360 :	// CLL
+			vf_callee(c, pc, mod->id.idx, b1);
+			vf_call(c, next, &s);
+			break;
+
+		case 0357 :	// CLF (checked at run time)
+			vf_call(c, next, &s);
+			break;
+
+		case 0361 ... 0377 :	// CLL1 - CLL15
+			vf_callee(c, pc, mod->id.idx, op & 0xf);
+			vf_call(c, next, &s);
+			break;
+
+		default :
+			break;
+	}
+
+	// Continue with the following instruction
+	if (next >= mod->code_sz)
+		vf_reject(c, pc, "Code runs off end of code frame");
+	vf_merge(c, pc, next, &s);
+}
+
+
+// vf_special()
+// Returns true if the instruction with opcode op has no fixed
+// effect on the expression stack or changes the control flow
+//
+bool vf_special(uint8_t op)
+{
+	switch (op)
+	{
+		case 021 :
+		case 030 ... 037 :
+		case 0214 ... 0215 :
+		case 0237 :
+		case 0246 :
+		case 0257 ... 0263 :
+		case 0300 ... 0304 :
+		case 0354 ... 0377 :
+			return true;
+
+		default :
+			return false;
+	}
+}
+
+
+// vf_params()
+// Returns the number of parameter words of the procedure at entry,
+// which its prologue pops from the expression stack before the
+// first jump or call
+//
+uint8_t vf_params(vf_ctx_t *c, uint32_t entry)
+{
+	uint8_t *code = c->mod->code;
+	uint32_t pc = entry;
+	int d = 0;
+	int min = 0;
+
+	while ((pc < c->mod->code_sz) && ! vf_special(code[pc]))
+	{
+		const vf_effect_t *e = &(vf_effect[code[pc]]);
+
+		d -= e->pop;
+		if (d < min)
+			min = d;
+		d += e->push;
+		pc += le_opcode_len(code[pc]);
+	}
+	return (min < -MACH_EXSMEM_SZ) ? MACH_EXSMEM_SZ : -min;
+}
+
+
+// vf_proc()
+// Verifies the procedure with entry point entry
+//
+void vf_proc(vf_ctx_t *c, uint32_t entry)
+{
+	uint32_t sz = c->mod->code_sz;
+	vf_state_t s;
+
+	for (uint32_t pc = 0; pc < sz; pc ++)
+	{
+		c->st[pc].d = -1;
+		c->st[pc].queued = false;
+	}
+
+	memset(&s, 0, sizeof(s));
+	s.d = vf_params(c, entry);
+	if (s.d > c->depth)
+		c->depth = s.d;
+	vf_merge(c, entry, entry, &s);
+	c->flags[entry] |= VF_LABEL;
+
+	while (c->work_n > 0)
+	{
+		uint16_t pc = c->work[-- c->work_n];
+		c->st[pc].queued = false;
+		vf_step(c, pc);
+	}
+}
+
+
+// vf_verify_module()
+// Verifies the code frame of module mod after its fixups and builds
+// its bitmap of resume points and the flags of its code frame bytes.
+// The modules it calls must be fixed up.
+// Stops with an error if the module is rejected.
+//
+void vf_verify_module(mod_entry_t *mod)
+{
+	uint32_t sz = mod->code_sz;
+	uint32_t n = (sz > 0) ? sz : 1;
+	vf_ctx_t c;
+
+	// PC values are 16 bits wide
+	if (sz > 65536)
+		le_error(1, 0, "Module %s: Code frame too large", mod->id.name);
+
+	c.mod = mod;
+	c.depth = 0;
+	c.work_n = 0;
+	c.case_n = 0;
+	c.flags = calloc(n, 1);
+	c.st = malloc(n * sizeof(vf_state_t));
+	c.work = malloc(n * sizeof(uint16_t));
+	free(mod->resume);
+	mod->resume = calloc(VF_RESUME_SZ, 1);
+	free(mod->case_ix);
+	free(mod->case_tab);
+	mod->case_ix = NULL;
+	mod->case_tab = NULL;
+	if ((c.flags == NULL) || (c.st == NULL) || (c.work == NULL)
+		|| (mod->resume == NULL))
+		le_error(1, errno, "Cannot allocate verifier state for %s", mod->id.name);
+
+	// Missing procedures (entry point 0) are not called statically
+	uint16_t procs = 0;
+	for (uint16_t i = 0; i < mod->proc_n; i ++)
+	{
+		uint16_t e = mod->proc[i];
+		if (e == 0)
+			continue;
+		if (e >= sz)
+			vf_reject(&c, e, "Procedure entry outside code frame");
+		vf_proc(&c, e);
+		procs ++;
+	}
+	mod->es_depth = c.depth;
+
+	le_verbose_msg("Verified %s (%d procs, expression stack depth %d)\n",
+		mod->id.name, procs, c.depth);
+
+	free(mod->flags);
+	mod->flags = c.flags;
+	free(c.st);
+	free(c.work);
+}
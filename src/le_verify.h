@@ -0,0 +1,57 @@
+//=====================================================
+// le_verify.h
+// Load-time verification of code frames
+//
+// Lilith M-Code Emulator
+//
+// Guido Hoss, 12.03.2022
+//
+// Published by Guido Hoss under GNU Public License V3.
+//=====================================================
+
+#ifndef _LE_VERIFY_H
+#define _LE_VERIFY_H   1
+
+#include "le_mach.h"
+
+// Bound of the expression stack after a call: the callee takes all
+// words on the stack as its parameters and leaves its result, which
+// is a word or a double word
+#define VF_RESULT_MAX	2
+
+// Nesting depth of STORE ... LODFW/LODFD sequences
+#define VF_STORE_MAX	4
+
+// Flags of code frame bytes
+#define VF_INSTR	1		// First byte of a reachable instruction
+#define VF_OPND		2		// Operand byte or case table
+#define VF_LABEL	4		// Entry point, jump target or resume point
+
+// Size of the bitmap of resume points (one bit per PC value)
+#define VF_RESUME_SZ	(65536 / 8)
+
+// vf_resume()
+// Returns non-zero if pc is a resume point of the verified module m:
+// the return address of a call or the exit of a CASE statement
+//
+#define vf_resume(m, pc)	((m)->resume[(pc) >> 3] & (1 << ((pc) & 7)))
+
+// Case table of an ENTC instruction, resolved by the verifier
+typedef struct {
+	uint16_t low;				// Lowest case label
+	uint16_t n;					// Number of case labels
+	uint16_t exit;				// Exit address, where EXC continues
+	uint16_t target[];			// ELSE part, then one target per label
+} vf_case_t;
+
+// vf_case()
+// Returns the resolved case table of the ENTC instruction at pc of
+// the verified module m
+//
+#define vf_case(m, pc)	((const vf_case_t *) &((m)->case_tab[(m)->case_ix[pc]]))
+
+// Function declarations
+//
+void vf_verify_module(mod_entry_t *mod);
+
+#endif
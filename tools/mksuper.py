@@ -0,0 +1,357 @@
+#!/usr/bin/env python3
+#=====================================================
+# mksuper.py
+# Superinstruction generator
+#
+# Reads an M-code sequence profile written by "mule -P file"
+# and generates the superinstructions of the pre-decoded engine:
+#
+#   src/le_super.h      pattern tables for the loader (le_predec.c)
+#   src/le_super_ops.h  fused handlers for le_run_super()
+#
+# Usage: mksuper.py [-n count] [-p classes]... [-o srcdir] profile...
+#
+# Without -p, the n class sequences saving the most dispatches in
+# the profile are generated. The profile counts overlapping windows,
+# but a fused handler skips the entries of the instructions it
+# covers, so many of these patterns never run. -p names a pattern
+# to generate instead (classes separated by commas, e.g. LDA,LIT),
+# for a set chosen by measuring the super engine.
+#
+# Lilith M-Code Emulator
+#
+# Guido Hoss, 12.03.2022
+#
+# Published by Guido Hoss under GNU Public License V3.
+#=====================================================
+
+import argparse
+import collections
+import os
+import sys
+
+LEN_MAX = 4
+
+# Fusable instruction classes
+# name: (opcodes, specialized, pops, result expressions, side effect)
+#   opcodes      opcodes of the class
+#   specialized  operands come from a pre-decoded handler (pd_handler_t)
+#   pops         number of words popped
+#   results      expressions for the words pushed, in push order
+#   effect       statement executed after the results are computed
+# In expressions, {a}/{b} are the decoded operands of the instruction,
+# {x0} is the deepest popped word and {x<pops-1>} the top of stack,
+# {p} is the pointer to the instruction (for SU_TRAP).
+#
+CLASSES = collections.OrderedDict([
+	('LIT', (list(range(0o000, 0o020)) + [0o020, 0o022, 0o025, 0o027, 0o325],
+		True, 0, ['{a}'], None)),
+	('LIT2', ([0o023], True, 0, ['{a}', '{b}'], None)),
+	('LLA', ([0o024], True, 0, ['gs_L + {a}'], None)),
+	('LSA', ([0o026], True, 1, ['{x0} + {a}'], None)),
+	('LSTA', ([0o204], True, 0, ['dsh_mem[{a}] + {b}'], None)),
+	('LLW', ([0o040] + list(range(0o044, 0o060)), True, 0,
+		['local_p[{a}]'], None)),
+	('LLD', ([0o041], True, 0,
+		['local_p[{a}]',
+		 'local_p[{a} + 1]'], None)),
+	('LDA', ([0o042, 0o100] + list(range(0o102, 0o120)), True, 0,
+		['dsh_mem[{a}]'], None)),
+	('LDA2', ([0o043], True, 0,
+		['dsh_mem[{a}]', 'dsh_mem[(uint16_t) ({a} + 1)]'], None)),
+	('SLW', ([0o060] + list(range(0o064, 0o100)), True, 1, [],
+		'local_p[{a}] = {x0};')),
+	('SLD', ([0o061], True, 2, [],
+		'local_p[{a} + 1] = {x1}; '
+		'local_p[{a}] = {x0};')),
+	('STA', ([0o062, 0o120] + list(range(0o122, 0o140)), True, 1, [],
+		'dsh_mem[{a}] = {x0};')),
+	('STA2', ([0o121], True, 2, [],
+		'dsh_mem[(uint16_t) ({a} + 1)] = {x1}; dsh_mem[{a}] = {x0};')),
+	('LSW', (list(range(0o140, 0o160)) + [0o200], True, 1,
+		['dsh_mem[(uint16_t) ({x0} + {a})]'], None)),
+	('LSD', ([0o201, 0o202], True, 1,
+		['dsh_mem[(uint16_t) ({x0} + {a})]',
+		 'dsh_mem[(uint16_t) ({x0} + {a} + 1)]'], None)),
+	('SSW', (list(range(0o160, 0o200)) + [0o220], True, 2, [],
+		'dsh_mem[(uint16_t) ({x0} + {a})] = {x1};')),
+	('LXB', ([0o205], False, 2,
+		['({x1} & 1) ? (uint8_t) dsh_mem[(uint16_t) ({x0} + ({x1} >> 1))] '
+		 ': (dsh_mem[(uint16_t) ({x0} + ({x1} >> 1))] >> 8)'], None)),
+	('LXW', ([0o206], False, 2, ['dsh_mem[(uint16_t) ({x0} + {x1})]'], None)),
+	('SXB', ([0o225], False, 3, [],
+		'{{ uint16_t j = {x0} + ({x1} >> 1); dsh_mem[j] = ({x1} & 1) ? '
+		'((dsh_mem[j] & 0xff00) | {x2}) : ((dsh_mem[j] & 0x00ff) | ({x2} << 8)); }}')),
+	('SXW', ([0o226], False, 3, [], 'dsh_mem[(uint16_t) ({x0} + {x1})] = {x2};')),
+	('CHK', ([0o305], False, 3, ['{x0}'],
+		'if (((int16_t) {x0} < (int16_t) {x1}) || ((int16_t) {x0} > (int16_t) {x2})) '
+		'SU_TRAP({p}, TRAP_INDEX)')),
+	('CHKZ', ([0o306], False, 2, ['{x0}'],
+		'if (((int16_t) {x0} < 0) || ((int16_t) {x0} > (int16_t) {x1})) '
+		'SU_TRAP({p}, TRAP_INDEX)')),
+	('CHKS', ([0o307], False, 1, ['{x0}'],
+		'if ((int16_t) {x0} < 0) SU_TRAP({p}, TRAP_INDEX)')),
+	('ENTR', ([0o353], True, 0, [],
+		'if (gs_S < MACH_DSHMEM_SZ - {a}) gs_S += {a}; '
+		'else SU_TRAP({p}, TRAP_STACK_OVF)')),
+	('IADD', ([0o330], False, 2, ['{x0} + {x1}'], None)),
+	('ISUB', ([0o331], False, 2, ['{x0} - {x1}'], None)),
+	('IMUL', ([0o332], False, 2, ['(int16_t) {x0} * (int16_t) {x1}'], None)),
+	('UADD', ([0o270], False, 2, ['{x0} + {x1}'], None)),
+	('USUB', ([0o271], False, 2, ['{x0} - {x1}'], None)),
+	('OR', ([0o320], False, 2, ['{x0} | {x1}'], None)),
+	('XOR', ([0o321], False, 2, ['{x0} ^ {x1}'], None)),
+	('AND', ([0o322], False, 2, ['{x0} & {x1}'], None)),
+	('EQL', ([0o310], False, 2, ['({x0} == {x1}) ? 1 : 0'], None)),
+	('NEQ', ([0o311], False, 2, ['({x0} != {x1}) ? 1 : 0'], None)),
+	('LSS', ([0o312], False, 2,
+		['((int16_t) {x0} < (int16_t) {x1}) ? 1 : 0'], None)),
+	('LEQ', ([0o313], False, 2,
+		['((int16_t) {x0} <= (int16_t) {x1}) ? 1 : 0'], None)),
+	('GTR', ([0o314], False, 2,
+		['((int16_t) {x0} > (int16_t) {x1}) ? 1 : 0'], None)),
+	('GEQ', ([0o315], False, 2,
+		['((int16_t) {x0} >= (int16_t) {x1}) ? 1 : 0'], None)),
+	('ULSS', ([0o252], False, 2, ['({x0} < {x1}) ? 1 : 0'], None)),
+	('ULEQ', ([0o253], False, 2, ['({x0} <= {x1}) ? 1 : 0'], None)),
+	('UGTR', ([0o254], False, 2, ['({x0} > {x1}) ? 1 : 0'], None)),
+	('UGEQ', ([0o255], False, 2, ['({x0} >= {x1}) ? 1 : 0'], None)),
+	('COM', ([0o323], False, 1, ['~{x0}'], None)),
+	('NOT', ([0o327], False, 1, ['({x0} & 1) ? 0 : 1'], None)),
+	('NEG', ([0o317], False, 1, ['-{x0}'], None)),
+	('COPT', ([0o265], False, 1, ['{x0}', '{x0}'], None)),
+	# Jumps end a superinstruction
+	('JPC', ([0o030, 0o032, 0o034], True, 1, [], None)),
+	('JP', ([0o031, 0o033, 0o035], True, 0, [], None)),
+])
+
+TERMINAL = ('JPC', 'JP')
+
+HEADER = '''\
+//=====================================================
+// {name}
+// {descr}
+//
+// Generated by tools/mksuper.py from {profiles}
+// ({total} M-codes profiled). Do not edit.
+//
+// Lilith M-Code Emulator
+//
+// Guido Hoss, 12.03.2022
+//
+// Published by Guido Hoss under GNU Public License V3.
+//=====================================================
+'''
+
+
+# read_profiles()
+# Returns total count and a counter of opcode sequences (length >= 2)
+#
+def read_profiles(files):
+	total = 0
+	seqs = collections.Counter()
+	for fn in files:
+		with open(fn) as f:
+			for line in f:
+				line = line.split(';')[0].split()
+				if not line:
+					continue
+				if line[0] == '#':
+					if line[1:2] == ['total']:
+						total += int(line[2])
+					continue
+				n = int(line[1])
+				if n >= 2:
+					seqs[tuple(int(x, 8) for x in line[2:2 + n])] += int(line[0])
+	return total, seqs
+
+
+# select()
+# Maps opcode sequences to class sequences and returns the n class
+# sequences saving the most dispatches, longest first
+#
+def select(seqs, n):
+	op_class = {}
+	for name, (ops, _, _, _, _) in CLASSES.items():
+		for op in ops:
+			op_class[op] = name
+
+	weight = collections.Counter()
+	for seq, count in seqs.items():
+		cls = tuple(op_class.get(op) for op in seq)
+		if None in cls:
+			continue
+		if any(c in TERMINAL for c in cls[:-1]):
+			continue
+		weight[cls] += count * (len(cls) - 1)
+
+	best = [c for c, _ in weight.most_common(n)]
+	best.sort(key = lambda c: (-len(c), -weight[c]))
+	return best, weight
+
+
+# ranges()
+# Returns the designators for a list of opcodes, merging contiguous
+# ranges
+#
+def ranges(ops):
+	out = []
+	ops = sorted(ops)
+	while ops:
+		i = 1
+		while i < len(ops) and ops[i] == ops[0] + i:
+			i += 1
+		if i > 1:
+			out.append('[0{:03o} ... 0{:03o}]'.format(ops[0], ops[i - 1]))
+		else:
+			out.append('[0{:03o}]'.format(ops[0]))
+		ops = ops[i:]
+	return out
+
+
+# wrap()
+# Returns a comma-separated list for a macro definition with
+# n items per line
+#
+def wrap(items, n):
+	lines = [', '.join(items[i:i + n]) for i in range(0, len(items), n)]
+	return '\t' + ', \\\n\t'.join(lines)
+
+
+# gen_handler()
+# Returns the C code of the fused handler for class sequence pat
+#
+def gen_handler(k, pat):
+	out = ['SU({}) {{'.format(k), '\t// ' + ' '.join(pat)]
+	ins = ['ip'] + ['i{}'.format(i) for i in range(1, len(pat))]
+	for i in range(1, len(pat)):
+		out.append('\tpd_instr_t *{} = {} + {}->len;'.format(
+			ins[i], ins[i - 1], ins[i - 1]))
+
+	# Virtual expression stack of temporaries
+	stack = []
+	temps = 0
+
+	def temp(expr):
+		nonlocal temps
+		t = 't{}'.format(temps)
+		temps += 1
+		out.append('\tuint16_t {} = {};'.format(t, expr))
+		return t
+
+	def pop():
+		return stack.pop() if stack else temp('es_pop()')
+
+	cont = None
+	for i, name in enumerate(pat):
+		_, _, pops, results, effect = CLASSES[name]
+		x = [pop() for _ in range(pops)][::-1]
+		args = { 'a' : ins[i] + '->a', 'b' : ins[i] + '->b', 'p' : ins[i] }
+		args.update(('x{}'.format(j), v) for j, v in enumerate(x))
+		res = [temp(r.format(**args)) for r in results]
+		if effect is not None:
+			out.append('\t' + effect.format(**args))
+		stack += res
+
+		if name == 'JPC':
+			cont = '({} == 0) ? {}->target : {} + {}->len'.format(
+				x[0], ins[i], ins[i], ins[i])
+		elif name == 'JP':
+			cont = ins[i] + '->target'
+
+	for t in stack:
+		out.append('\tes_push({});'.format(t))
+	if cont is None:
+		cont = '{} + {}->len'.format(ins[-1], ins[-1])
+	out.append('\tcounter += {};'.format(len(pat) - 1))
+	out.append('\tip = {};'.format(cont))
+	out.append('\tPD_DISPATCH')
+	out.append('}')
+	return '\n'.join(out)
+
+
+def main():
+	ap = argparse.ArgumentParser(description = 'Generate superinstructions')
+	ap.add_argument('-n', type = int, default = 32,
+		help = 'number of superinstructions')
+	ap.add_argument('-o', default = os.path.join(
+		os.path.dirname(os.path.abspath(__file__)), '..', 'src'),
+		help = 'output directory')
+	ap.add_argument('-p', action = 'append', metavar = 'classes',
+		help = 'generate this pattern instead of selecting (repeatable)')
+	ap.add_argument('profile', nargs = '+')
+	args = ap.parse_args()
+
+	total, seqs = read_profiles(args.profile)
+	pats, weight = select(seqs, args.n)
+	if args.p:
+		pats = [tuple(p.split(',')) for p in args.p]
+		for pat in pats:
+			if (len(pat) > LEN_MAX) or any(c not in CLASSES for c in pat) \
+				or any(c in TERMINAL for c in pat[:-1]):
+				sys.exit('mksuper.py: invalid pattern ' + ','.join(pat))
+		pats.sort(key = lambda c: (-len(c), -weight[c]))
+	if not pats:
+		sys.exit('mksuper.py: no fusable sequences in profile')
+
+	names = ' '.join(os.path.basename(p) for p in args.profile)
+	cls_id = { name : i + 1 for i, name in enumerate(CLASSES) }
+
+	# Pattern tables
+	h = [HEADER.format(name = 'le_super.h',
+		descr = 'Superinstruction patterns', profiles = names, total = total)]
+	h.append('#ifndef _LE_SUPER_H\n#define _LE_SUPER_H   1\n')
+	h.append('// Number of superinstructions and maximum pattern length')
+	h.append('#define SU_NUM\t\t{}'.format(len(pats)))
+	h.append('#define SU_LEN_MAX\t{}\n'.format(LEN_MAX))
+	h.append('// Instruction classes')
+	for name in CLASSES:
+		h.append('#define SC_{}\t{}'.format(name, cls_id[name]))
+	h.append('#define SC_NUM\t{}\n'.format(len(CLASSES) + 1))
+
+	h.append('// Class of each opcode (0 = not fusable)')
+	h.append('#define SU_CLASS_TAB \\')
+	for name, (ops, _, _, _, _) in CLASSES.items():
+		h.append('\t{}, \\'.format(', '.join(
+			'{} = SC_{}'.format(r, name) for r in ranges(ops))))
+	h[-1] = h[-1][:-3]
+	h.append('')
+
+	h.append('// Classes taking operands from a pre-decoded handler')
+	h.append('#define SU_SPECIALIZED_TAB \\')
+	h.append(wrap(['[SC_{}] = true'.format(n)
+		for n, c in CLASSES.items() if c[1]], 4))
+	h.append('')
+
+	h.append('// Patterns, longest first (saved dispatches in profile)')
+	h.append('#define SU_PATTERN_TAB \\')
+	for k, pat in enumerate(pats):
+		h.append('\t{{ {}, {{ {} }} }},\t/* {}: {} */ \\'.format(
+			len(pat), ', '.join('SC_' + c for c in pat), k, weight[pat]))
+	h[-1] = h[-1][:-2]
+	h.append('')
+
+	h.append('// Handler labels in le_run_super()')
+	h.append('#define SU_LABELS \\')
+	h.append(wrap(['&&su_{}'.format(k) for k in range(len(pats))], 8))
+	h.append('\n#endif')
+
+	# Fused handlers
+	o = [HEADER.format(name = 'le_super_ops.h',
+		descr = 'Superinstruction handlers', profiles = names, total = total)]
+	o.append('// Included by le_run_super() with macro SU(n) defining')
+	o.append('// the handler label. Each handler executes a pattern of')
+	o.append('// le_super.h, keeping intermediate values in temporaries')
+	o.append('// instead of the expression stack.\n')
+	for k, pat in enumerate(pats):
+		o.append(gen_handler(k, pat))
+		o.append('')
+
+	with open(os.path.join(args.o, 'le_super.h'), 'w') as f:
+		f.write('\n'.join(h) + '\n')
+	with open(os.path.join(args.o, 'le_super_ops.h'), 'w') as f:
+		f.write('\n'.join(o))
+
+
+if __name__ == '__main__':
+	main()